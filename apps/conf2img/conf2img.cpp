@@ -48,6 +48,10 @@ static RNAngle xfov = 0;
 static RNRgb background(0,0,0);
 static int glut = 1;
 static int mesa = 0;
+static int software = 0;
+static int stream_window_size = 0;
+static const char *file_cache_directory = NULL;
+static double file_cache_size = 0; // in megabytes (0 for unlimited)
 
 
 // Printing program variables
@@ -64,6 +68,7 @@ static int print_debug = 0;
 // State variables
 
 static RGBDConfiguration configuration;
+static RGBDConfigurationStream stream;
 static RNArray<R3Camera *> cameras;
 static R3Mesh mesh;
 static int current_image_index = -1;
@@ -85,10 +90,29 @@ ReadConfiguration(const char *filename)
     fflush(stdout);
   }
 
-  // Read file
-  if (!configuration.ReadFile(filename)) {
-    fprintf(stderr, "Unable to read configuration from %s\n", filename);
-    return 0;
+  // Read decoded channels from file cache, if requested
+  if (file_cache_directory) {
+    RGBDImage::SetFileCacheDirectory(file_cache_directory, (unsigned long long) (file_cache_size * 1024 * 1024));
+  }
+
+  // Read file into stream (images are processed a few at a time)
+  if (stream_window_size > 0) {
+    if (!stream.ReadFile(filename)) {
+      fprintf(stderr, "Unable to read configuration from %s\n", filename);
+      return 0;
+    }
+
+    // Only depth channels are needed to write images
+    stream.SetWindow(stream_window_size, stream_window_size - 1, TRUE, FALSE);
+  }
+
+  // Read file into configuration (all images are needed for rendering)
+  if ((stream_window_size == 0) || capture_color_images || capture_depth_images ||
+      capture_object_images || capture_category_images) {
+    if (!configuration.ReadFile(filename)) {
+      fprintf(stderr, "Unable to read configuration from %s\n", filename);
+      return 0;
+    }
   }
 
 #if 0
@@ -102,7 +126,7 @@ ReadConfiguration(const char *filename)
   // Print statistics
   if (print_verbose) {
     printf("  Time = %.2f seconds\n", start_time.Elapsed());
-    printf("  # Images = %d\n", configuration.NImages());
+    printf("  # Images = %d\n", (stream_window_size > 0) ? stream.NFrames() : configuration.NImages());
     printf("  # Surfaces = %d\n", configuration.NSurfaces());
     fflush(stdout);
   }
@@ -218,8 +242,10 @@ WriteImages(const char *output_directory)
   system(cmd);
 
   // Write images
-  for (int i = 0; i < configuration.NImages(); i++) {
-    RGBDImage *image = configuration.Image(i);
+  int nimages = (stream_window_size > 0) ? stream.NFrames() : configuration.NImages();
+  for (int i = 0; i < nimages; i++) {
+    RGBDImage *image = (stream_window_size > 0) ? stream.Frame(i) : configuration.Image(i);
+    if (!image) return 0;
 
     // Get image name
     char image_name_buffer[4096];
@@ -299,7 +325,7 @@ WriteImages(const char *output_directory)
   if (print_verbose) {
     printf("Wrote images to %s\n", output_directory);
     printf("  Time = %.2f seconds\n", start_time.Elapsed());
-    printf("  # Images = %d\n", configuration.NImages());
+    printf("  # Images = %d\n", nimages);
     fflush(stdout);
   }
 
@@ -736,6 +762,129 @@ RenderImagesWithMesa(const char *output_image_directory)
 
 
 
+static int
+RenderImagesWithRasterizer(const char *output_image_directory)
+{
+  // Print message
+  if (print_verbose) {
+    printf("Rendering images with software rasterizer to %s\n", output_image_directory);
+    fflush(stdout);
+  }
+
+  // Check mesh
+  if (mesh.NFaces() == 0) {
+    fprintf(stderr, "Software rendering requires a mesh (-mesh)\n");
+    return 0;
+  }
+
+  // Start statistics
+  RNTime start_time;
+  start_time.Read();
+
+  // Create rasterizer
+  R3Rasterizer rasterizer(width, height);
+
+  // Render images
+  int nimages = (cameras.NEntries() > 0) ? cameras.NEntries() : configuration.NImages();
+  for (int i = 0; i < nimages; i++) {
+    // Set camera
+    if (cameras.NEntries() > 0) {
+      // Set camera from input file
+      rasterizer.SetCamera(*(cameras.Kth(i)));
+    }
+    else {
+      // Set camera for image from configuration (intrinsics scaled to output resolution)
+      RGBDImage *image = configuration.Image(i);
+      if (image->NPixels(RN_X) == 0) {
+        image->ReadDepthChannel();  // Temporary, just to read width/height :(
+        image->ReleaseDepthChannel();
+      }
+      R3Matrix intrinsics = image->Intrinsics();
+      RNScalar xscale = (RNScalar) width / (RNScalar) image->NPixels(RN_X);
+      RNScalar yscale = (RNScalar) height / (RNScalar) image->NPixels(RN_Y);
+      intrinsics[0][0] *= xscale;
+      intrinsics[0][2] *= xscale;
+      intrinsics[1][1] *= yscale;
+      intrinsics[1][2] *= yscale;
+      rasterizer.SetCamera(intrinsics, image->CameraToWorld().Matrix());
+    }
+
+    // Get image name
+    char image_name_buffer[4096];
+    char *name = image_name_buffer;
+    if (i < configuration.NImages()) {
+      RGBDImage *image = configuration.Image(i);
+      strncpy(image_name_buffer, image->DepthFilename(), 4096);
+      if (strrchr(image_name_buffer, '/')) name = strrchr(image_name_buffer, '/')+1;
+      char *endp = strrchr(name, '.');
+      if (endp) *endp = '\0';
+    }
+    else {
+      sprintf(image_name_buffer, "%06d", i);
+    }
+
+    // Print debug statement
+    if (print_debug) {
+      printf("  Rendering %s ...\n", name);
+      fflush(stdout);
+    }
+
+    // Rasterize mesh
+    if (!rasterizer.RasterizeMesh(mesh)) return 0;
+
+    // Write depth image
+    if (capture_depth_images) {
+      R2Grid depth_image;
+      rasterizer.CreateDepthImage(depth_image);
+      depth_image.Substitute(R2_GRID_UNKNOWN_VALUE, 0);
+      depth_image.Multiply(4000);
+      depth_image.Threshold(65535, R2_GRID_KEEP_VALUE, 0);
+      char output_image_filename[4096];
+      sprintf(output_image_filename, "%s/%s_depth.png", output_image_directory, name);
+      depth_image.WriteFile(output_image_filename);
+    }
+
+    // Write color image (vertex colors)
+    if (capture_color_images) {
+      R2Image color_image(width, height, 3);
+      rasterizer.CreateColorImage(color_image, background);
+      char output_image_filename[4096];
+      sprintf(output_image_filename, "%s/%s_color.jpg", output_image_directory, name);
+      color_image.Write(output_image_filename);
+    }
+
+    // Write object image
+    if (capture_object_images) {
+      R2Grid object_image;
+      rasterizer.CreateSegmentImage(object_image);
+      char output_image_filename[4096];
+      sprintf(output_image_filename, "%s/%s_object.png", output_image_directory, name);
+      object_image.WriteFile(output_image_filename);
+    }
+
+    // Write category image
+    if (capture_category_images) {
+      R2Grid category_image;
+      rasterizer.CreateMaterialImage(category_image);
+      char output_image_filename[4096];
+      sprintf(output_image_filename, "%s/%s_category.png", output_image_directory, name);
+      category_image.WriteFile(output_image_filename);
+    }
+  }
+
+  // Print statistics
+  if (print_verbose) {
+    printf("  Time = %.2f seconds\n", start_time.Elapsed());
+    printf("  # Images = %d\n", nimages);
+    fflush(stdout);
+  }
+
+  // Return success
+  return 1;
+}
+
+
+
 static int
 RenderImages(const char *output_image_directory)
 {
@@ -745,7 +894,8 @@ RenderImages(const char *output_image_directory)
   system(cmd);
 
   // Render images
-  if (glut) { if (!RenderImagesWithGlut(output_image_directory)) return 0; }
+  if (software) { if (!RenderImagesWithRasterizer(output_image_directory)) return 0; }
+  else if (glut) { if (!RenderImagesWithGlut(output_image_directory)) return 0; }
   else if (mesa) { if (!RenderImagesWithMesa(output_image_directory)) return 0; }
   else { RNAbort("Not implemented"); }
 
@@ -771,8 +921,9 @@ ParseArgs(int argc, char **argv)
     if ((*argv)[0] == '-') {
       if (!strcmp(*argv, "-v")) print_verbose = 1;
       else if (!strcmp(*argv, "-debug")) print_debug = 1;
-      else if (!strcmp(*argv, "-glut")) { mesa = 0; glut = 1; }
-      else if (!strcmp(*argv, "-mesa")) { mesa = 1; glut = 0; }
+      else if (!strcmp(*argv, "-glut")) { mesa = 0; glut = 1; software = 0; }
+      else if (!strcmp(*argv, "-mesa")) { mesa = 1; glut = 0; software = 0; }
+      else if (!strcmp(*argv, "-software")) { mesa = 0; glut = 0; software = 1; }
       else if (!strcmp(*argv, "-cameras")) { argc--; argv++; input_camera_filename = *argv; }
       else if (!strcmp(*argv, "-mesh")) { argc--; argv++; input_mesh_filename = *argv; }
       else if (!strcmp(*argv, "-create_position_images")) { output = create_position_images = 1; }
@@ -785,6 +936,9 @@ ParseArgs(int argc, char **argv)
       else if (!strcmp(*argv, "-width")) { argc--; argv++; width = atoi(*argv); }
       else if (!strcmp(*argv, "-height")) { argc--; argv++; height = atoi(*argv); }
       else if (!strcmp(*argv, "-xfov")) { argc--; argv++; xfov = atof(*argv); }
+      else if (!strcmp(*argv, "-stream")) { argc--; argv++; stream_window_size = atoi(*argv); }
+      else if (!strcmp(*argv, "-file_cache_directory")) { argc--; argv++; file_cache_directory = *argv; }
+      else if (!strcmp(*argv, "-file_cache_size")) { argc--; argv++; file_cache_size = atof(*argv); }
       else if (!strcmp(*argv, "-background")) {
         argc--; argv++; background[0] = atof(*argv);
         argc--; argv++; background[1] = atof(*argv);
@@ -33,6 +33,9 @@ static int max_reprojection_distance = 32; // in pixels
 static double max_depth_inconsistency = 0.1; // as fraction of depth
 static double max_depth = 0;
 static double grid_spacing = 0.05;
+static double channel_cache_size = 2048; // in megabytes
+static const char *file_cache_directory = NULL;
+static double file_cache_size = 0; // in megabytes (0 for unlimited)
 static double vertex_spacing = 0;
 static int pixel_spacing = 1;
 static int print_verbose = 0;
@@ -62,12 +65,20 @@ ReadConfigurationFile(const char *filename)
     return NULL;
   }
 
+  // Read decoded channels from file cache, if requested
+  if (file_cache_directory) {
+    RGBDImage::SetFileCacheDirectory(file_cache_directory, (unsigned long long) (file_cache_size * 1024 * 1024));
+  }
+
   // Read file
   if (!configuration->ReadFile(filename, load_every_kth_image)) {
     fprintf(stderr, "Unable to read configuration from %s\n", filename);
     return NULL;
   }
 
+  // Keep decoded depth images in memory, so that each is read only once
+  configuration->SetChannelCacheSize((unsigned long long) (channel_cache_size * 1024 * 1024));
+
   // Print statistics
   if (print_verbose) {
     printf("  Time = %.2f seconds\n", start_time.Elapsed());
@@ -144,84 +155,307 @@ CountVertexOverlaps(R3Mesh *mesh, const RNArray<R3MeshVertex *>& a0, const RNArr
 
 
 
+////////////////////////////////////////////////////////////////////////
+// Pixel overlap data
+////////////////////////////////////////////////////////////////////////
+
+// Number of dst images whose points are kept in memory at a time
+static const int pixel_overlap_dst_block_size = 32;
+
+// Number of src images whose depths are kept in memory at a time
+static const int pixel_overlap_src_block_size = 256;
+
+struct PixelOverlapImage {
+  // Camera parameters
+  int width, height;
+  float fx, fy, cx, cy;
+  float camera_to_world[3][4];
+  float world_to_camera[3][4];
+
+  // Depths (NULL when not loaded)
+  float *depths;
+
+  // World positions of sampled pixels with known depth (NULL when not computed)
+  int npoints;
+  int *point_pixels;
+  float *point_x;
+  float *point_y;
+  float *point_z;
+
+  // Culling information
+  RNBoolean valid;
+  R3Box world_bbox;
+  R3Frustum world_frustum;
+};
+
+
+
+static void
+InitializePixelOverlapImage(PixelOverlapImage& data, RGBDImage *image)
+{
+  // Initialize camera parameters
+  const R3Matrix& intrinsics = image->Intrinsics();
+  R4Matrix camera_to_world = image->CameraToWorld().Matrix();
+  R4Matrix world_to_camera = camera_to_world.Inverse();
+  data.width = data.height = 0;
+  data.fx = intrinsics[0][0];
+  data.fy = intrinsics[1][1];
+  data.cx = intrinsics[0][2];
+  data.cy = intrinsics[1][2];
+  for (int i = 0; i < 3; i++) {
+    for (int j = 0; j < 4; j++) {
+      data.camera_to_world[i][j] = camera_to_world[i][j];
+      data.world_to_camera[i][j] = world_to_camera[i][j];
+    }
+  }
+
+  // Initialize depths and points
+  data.depths = NULL;
+  data.npoints = 0;
+  data.point_pixels = NULL;
+  data.point_x = data.point_y = data.point_z = NULL;
+
+  // Initialize culling information
+  data.valid = FALSE;
+  data.world_bbox = R3null_box;
+}
+
+
+
 static int
-CountPixelOverlaps(RGBDImage *dst_image, RGBDImage *src_image)
+LoadPixelOverlapDepths(PixelOverlapImage& data, RGBDImage *image)
 {
-  // Convenient variables
-  RNScalar max_reprojection_distance_squared = max_reprojection_distance * max_reprojection_distance;
-  
-  // Initialize count
-  int count = 0;
+  // Check if already loaded
+  if (data.depths) return 1;
 
-  // Get depth channels
-  R2Grid *src_depth_channel = src_image->DepthChannel();
-  if (!src_depth_channel) return 0; 
-  R2Grid *dst_depth_channel = dst_image->DepthChannel();
-  if (!dst_depth_channel) return 0; 
-
-  // Check all pixels via reverse mapping
-  for (int dst_iy = 0; dst_iy < dst_depth_channel->YResolution(); dst_iy += pixel_spacing) {
-    for (int dst_ix = 0; dst_ix < dst_depth_channel->XResolution(); dst_ix += pixel_spacing) {
-      // Get the dst image depth
-      RNScalar dst_depth = dst_depth_channel->GridValue(dst_ix, dst_iy);
-      if (dst_depth == R2_GRID_UNKNOWN_VALUE) continue;
-
-      // Map point from dst_image coordinates into dst world coordinates
-      R3Point dst_world_position;
-      R2Point dst_image_position(dst_ix+0.5, dst_iy+0.5);
-      if (!RGBDTransformImageToWorld(dst_image_position, dst_world_position, dst_image)) continue;
-      
-      // Map from dst world coordinates into src image coordinates      
-      R2Point src_image_position;
-      if (!RGBDTransformWorldToImage(dst_world_position, src_image_position, src_image)) continue;
-
-      // Check src image coordinates
-      int src_ix = src_image_position.X() + 0.5;
-      int src_iy = src_image_position.Y() + 0.5;
-      if ((src_ix < 0) || (src_ix >= src_depth_channel->XResolution())) continue;
-      if ((src_iy < 0) || (src_iy >= src_depth_channel->YResolution())) continue;
-      
-      // Check for depth consistency in src image
-      if (max_depth_inconsistency > 0) {
-        RNScalar src_depth = src_depth_channel->GridValue(src_ix, src_iy);
-        if (src_depth == R2_GRID_UNKNOWN_VALUE) continue;
-        if (RNIsPositive(src_depth)) {
-          RNScalar reprojected_src_depth = (dst_world_position - src_image->WorldViewpoint()).Dot(src_image->WorldTowards());
-          if (reprojected_src_depth <= 0) continue;
-          RNScalar depth_difference = fabs(src_depth - reprojected_src_depth);
-          RNScalar depth_inconsistency = depth_difference / src_depth;
-          if (depth_inconsistency > max_depth_inconsistency) continue;
-        }
-      }
+  // Read depth channel
+  if (!image->ReadDepthChannel()) return 0;
+  R2Grid *depth_channel = image->DepthChannel();
+  if (!depth_channel || (depth_channel->NEntries() == 0)) {
+    image->ReleaseDepthChannel();
+    return 0;
+  }
 
-      // Map from src image coordinates to src world coordinates
-      R3Point src_world_position;
-      if (!RGBDTransformImageToWorld(src_image_position, src_world_position, src_image)) continue;
+  // Copy depths
+  data.width = depth_channel->XResolution();
+  data.height = depth_channel->YResolution();
+  data.depths = new float [ data.width * data.height ];
+  const RNScalar *depths = depth_channel->GridValues();
+  for (int i = 0; i < data.width * data.height; i++) data.depths[i] = depths[i];
 
-      // Compute reprojected depth in dst image
-      RNScalar reprojected_dst_depth = (src_world_position - dst_image->WorldViewpoint()).Dot(dst_image->WorldTowards());
-      if (reprojected_dst_depth <= 0) continue;
+  // Release depth channel
+  image->ReleaseDepthChannel();
 
-      // Check for depth consistency in dst image
-      if (max_depth_inconsistency > 0) {
-        RNScalar dst_depth = dst_depth_channel->GridValue(dst_ix, dst_iy);
-        if (RNIsPositive(dst_depth)) {
-          RNScalar depth_difference = fabs(dst_depth - reprojected_dst_depth);
-          RNScalar depth_inconsistency = depth_difference / dst_depth;
-          if (depth_inconsistency > max_depth_inconsistency) continue;
-        }
-      }
+  // Return success
+  return 1;
+}
+
+
+
+static void
+ReleasePixelOverlapData(PixelOverlapImage& data)
+{
+  // Delete depths and points
+  if (data.depths) { delete [] data.depths; data.depths = NULL; }
+  if (data.point_pixels) { delete [] data.point_pixels; data.point_pixels = NULL; }
+  if (data.point_x) { delete [] data.point_x; data.point_x = NULL; }
+  if (data.point_y) { delete [] data.point_y; data.point_y = NULL; }
+  if (data.point_z) { delete [] data.point_z; data.point_z = NULL; }
+  data.npoints = 0;
+}
+
+
+
+static void
+ComputePixelOverlapCullingInformation(PixelOverlapImage& data, RGBDImage *image)
+{
+  // Check depths and intrinsics
+  if (!data.depths) return;
+  if (RNIsZero(data.fx) || RNIsZero(data.fy)) return;
+
+  // Compute bounding box of world positions and range of depths
+  const float (*m)[4] = data.camera_to_world;
+  RNScalar min_depth = FLT_MAX;
+  RNScalar max_depth = -FLT_MAX;
+  R3Box bbox = R3null_box;
+  for (int iy = 0; iy < data.height; iy++) {
+    for (int ix = 0; ix < data.width; ix++) {
+      float depth = data.depths[iy*data.width + ix];
+      if (depth == R2_GRID_UNKNOWN_VALUE) continue;
+      if (depth < min_depth) min_depth = depth;
+      if (depth > max_depth) max_depth = depth;
+      if (RNIsZero(depth)) continue;
+      float x = (ix + 0.5F - data.cx) * depth / data.fx;
+      float y = (iy + 0.5F - data.cy) * depth / data.fy;
+      float z = -depth;
+      bbox.Union(R3Point(m[0][0]*x + m[0][1]*y + m[0][2]*z + m[0][3],
+                         m[1][0]*x + m[1][1]*y + m[1][2]*z + m[1][3],
+                         m[2][0]*x + m[2][1]*y + m[2][2]*z + m[2][3]));
+    }
+  }
+
+  // Check depths
+  if (min_depth > max_depth) return;
+  if (bbox.IsEmpty()) bbox.Union(image->WorldViewpoint());
 
-      // Check for reprojection consistency
-      if (max_reprojection_distance > 0) {
-        R2Point reprojected_dst_image_position;
-        if (!RGBDTransformWorldToImage(src_world_position, reprojected_dst_image_position, dst_image)) continue;
-        if (R2SquaredDistance(reprojected_dst_image_position, dst_image_position) > max_reprojection_distance_squared) continue;
+  // Set culling information
+  data.world_bbox = bbox;
+  data.world_frustum = R3Frustum(image->WorldViewpoint(), image->WorldTowards(), image->WorldUp(),
+    atan(0.5 * data.width / data.fx), atan(0.5 * data.height / data.fy), min_depth, max_depth);
+  data.valid = TRUE;
+}
+
+
+
+static void
+ComputePixelOverlapPoints(PixelOverlapImage& data)
+{
+  // Check depths and intrinsics
+  if (data.point_pixels) return;
+  if (!data.depths) return;
+  if (RNIsZero(data.fx) || RNIsZero(data.fy)) return;
+
+  // Count sampled pixels with known depth
+  int npoints = 0;
+  for (int iy = 0; iy < data.height; iy += pixel_spacing) {
+    for (int ix = 0; ix < data.width; ix += pixel_spacing) {
+      float depth = data.depths[iy*data.width + ix];
+      if ((depth == R2_GRID_UNKNOWN_VALUE) || RNIsZero(depth)) continue;
+      npoints++;
+    }
+  }
+
+  // Allocate points
+  data.npoints = npoints;
+  data.point_pixels = new int [ npoints ];
+  data.point_x = new float [ npoints ];
+  data.point_y = new float [ npoints ];
+  data.point_z = new float [ npoints ];
+
+  // Back-project sampled pixels into world coordinates
+  const float (*m)[4] = data.camera_to_world;
+  int k = 0;
+  for (int iy = 0; iy < data.height; iy += pixel_spacing) {
+    for (int ix = 0; ix < data.width; ix += pixel_spacing) {
+      float depth = data.depths[iy*data.width + ix];
+      if ((depth == R2_GRID_UNKNOWN_VALUE) || RNIsZero(depth)) continue;
+      float x = (ix + 0.5F - data.cx) * depth / data.fx;
+      float y = (iy + 0.5F - data.cy) * depth / data.fy;
+      float z = -depth;
+      data.point_pixels[k] = iy*data.width + ix;
+      data.point_x[k] = m[0][0]*x + m[0][1]*y + m[0][2]*z + m[0][3];
+      data.point_y[k] = m[1][0]*x + m[1][1]*y + m[1][2]*z + m[1][3];
+      data.point_z[k] = m[2][0]*x + m[2][1]*y + m[2][2]*z + m[2][3];
+      k++;
+    }
+  }
+}
+
+
+
+static int
+CountPixelOverlaps(const PixelOverlapImage& dst, const PixelOverlapImage& src, float *buffer)
+{
+  // Checks are the same as mapping each dst pixel into the src image and
+  // back with RGBDTransformImageToWorld and RGBDTransformWorldToImage
+
+  // Convenient variables
+  const int npoints = dst.npoints;
+  const float epsilon = RN_EPSILON;
+  const float max_inconsistency = max_depth_inconsistency;
+  const float max_distance_squared = max_reprojection_distance * max_reprojection_distance;
+  const float unknown_value = R2_GRID_UNKNOWN_VALUE;
+  float *src_u = &buffer[0];
+  float *src_v = &buffer[npoints];
+  float *src_d = &buffer[2*npoints];
+
+  // Check src intrinsics
+  if (!src.depths || RNIsZero(src.fx) || RNIsZero(src.fy)) return 0;
+
+  // Project all dst points into src image (this loop vectorizes)
+  const float (*w)[4] = src.world_to_camera;
+  const float *px = dst.point_x;
+  const float *py = dst.point_y;
+  const float *pz = dst.point_z;
+  for (int k = 0; k < npoints; k++) {
+    float x = w[0][0]*px[k] + w[0][1]*py[k] + w[0][2]*pz[k] + w[0][3];
+    float y = w[1][0]*px[k] + w[1][1]*py[k] + w[1][2]*pz[k] + w[1][3];
+    float d = -(w[2][0]*px[k] + w[2][1]*py[k] + w[2][2]*pz[k] + w[2][3]);
+    src_u[k] = src.cx + x * src.fx / d;
+    src_v[k] = src.cy + y * src.fy / d;
+    src_d[k] = d;
+  }
+
+  // Compute transformation from src camera coordinates to dst camera coordinates
+  float m[3][4];
+  for (int i = 0; i < 3; i++) {
+    for (int j = 0; j < 4; j++) {
+      m[i][j] = (j == 3) ? dst.world_to_camera[i][3] : 0;
+      for (int k = 0; k < 3; k++) m[i][j] += dst.world_to_camera[i][k] * src.camera_to_world[k][j];
+    }
+  }
+
+  // Check all projected points
+  int count = 0;
+  for (int k = 0; k < npoints; k++) {
+    // Check projection into src image
+    float depth = src_d[k];
+    if (depth <= epsilon) continue;
+    float u = src_u[k], v = src_v[k];
+    if ((u < 0) || (u >= src.width)) continue;
+    if ((v < 0) || (v >= src.height)) continue;
+    int src_ix = (int) (u + 0.5F);
+    int src_iy = (int) (v + 0.5F);
+    if ((src_ix >= src.width) || (src_iy >= src.height)) continue;
+    float src_depth = src.depths[src_iy*src.width + src_ix];
+    if ((src_depth == unknown_value) || (src_depth == 0)) continue;
+    if ((src_depth < 0.9F * depth) || (src_depth > 1.1F * depth)) continue;
+
+    // Check for depth consistency in src image
+    if ((max_inconsistency > 0) && (src_depth > epsilon)) {
+      if (fabs(src_depth - depth) / src_depth > max_inconsistency) continue;
+    }
+
+    // Map from src image coordinates to dst camera coordinates
+    float src_depth2 = src.depths[((int) v)*src.width + (int) u];
+    if ((src_depth2 == unknown_value) || RNIsZero(src_depth2)) continue;
+    float x = (u - src.cx) * src_depth2 / src.fx;
+    float y = (v - src.cy) * src_depth2 / src.fy;
+    float z = -src_depth2;
+    float dst_x = m[0][0]*x + m[0][1]*y + m[0][2]*z + m[0][3];
+    float dst_y = m[1][0]*x + m[1][1]*y + m[1][2]*z + m[1][3];
+    float reprojected_dst_depth = -(m[2][0]*x + m[2][1]*y + m[2][2]*z + m[2][3]);
+    if (reprojected_dst_depth <= 0) continue;
+
+    // Check for depth consistency in dst image
+    int dst_pixel = dst.point_pixels[k];
+    if (max_inconsistency > 0) {
+      float dst_depth = dst.depths[dst_pixel];
+      if (dst_depth > epsilon) {
+        if (fabs(dst_depth - reprojected_dst_depth) / dst_depth > max_inconsistency) continue;
       }
-    
-      // Update counter
-      count++;
     }
+
+    // Check for reprojection consistency
+    if (max_reprojection_distance > 0) {
+      if (reprojected_dst_depth <= epsilon) continue;
+      float dst_u = dst.cx + dst_x * dst.fx / reprojected_dst_depth;
+      float dst_v = dst.cy + dst_y * dst.fy / reprojected_dst_depth;
+      if ((dst_u < 0) || (dst_u >= dst.width)) continue;
+      if ((dst_v < 0) || (dst_v >= dst.height)) continue;
+      int dst_ix = (int) (dst_u + 0.5F);
+      int dst_iy = (int) (dst_v + 0.5F);
+      if ((dst_ix >= dst.width) || (dst_iy >= dst.height)) continue;
+      float dst_depth = dst.depths[dst_iy*dst.width + dst_ix];
+      if ((dst_depth == unknown_value) || (dst_depth == 0)) continue;
+      if ((dst_depth < 0.9F * reprojected_dst_depth) || (dst_depth > 1.1F * reprojected_dst_depth)) continue;
+      float du = dst_u - (dst_pixel % dst.width + 0.5F);
+      float dv = dst_v - (dst_pixel / dst.width + 0.5F);
+      if (du*du + dv*dv > max_distance_squared) continue;
+    }
+
+    // Update counter
+    count++;
   }
 
   // Return number of pixels in overlap
@@ -242,56 +476,120 @@ ComputePixelOverlaps(RGBDConfiguration *configuration, R2Grid& pixel_overlap_mat
   }
 
   // Initialize matrix
-  pixel_overlap_matrix = R2Grid(configuration->NImages(), configuration->NImages());
+  int nimages = configuration->NImages();
+  pixel_overlap_matrix = R2Grid(nimages, nimages);
 
-  // Consider every image
-  for (int i0 = 0; i0 < configuration->NImages(); i0++) {
-    RGBDImage *dst_image = configuration->Image(i0);
+  // Initialize image data
+  PixelOverlapImage *data = new PixelOverlapImage [ nimages ];
+  for (int i = 0; i < nimages; i++) {
+    InitializePixelOverlapImage(data[i], configuration->Image(i));
+  }
 
-    // Read dst image depth channel
-    dst_image->ReadDepthChannel();
-    R2Grid *dst_depth_channel = dst_image->DepthChannel();
+  // Compute culling information, one block of images at a time
+  for (int i0 = 0; i0 < nimages; i0 += pixel_overlap_src_block_size) {
+    int n = (i0 + pixel_overlap_src_block_size <= nimages) ? pixel_overlap_src_block_size : nimages - i0;
+    configuration->PrefetchDepthChannels(i0, n);
+    for (int i = i0; i < i0 + n; i++) LoadPixelOverlapDepths(data[i], configuration->Image(i));
+#pragma omp parallel for schedule(dynamic)
+    for (int i = i0; i < i0 + n; i++) ComputePixelOverlapCullingInformation(data[i], configuration->Image(i));
+    for (int i = i0; i < i0 + n; i++) ReleasePixelOverlapData(data[i]);
+  }
 
-    // Compute dst image info
-    RNInterval dst_depth_range = dst_depth_channel->Range();
-    const R3Box& dst_bbox = dst_image->WorldBBox();
-    R3Frustum dst_frustum(dst_image->WorldViewpoint(), dst_image->WorldTowards(), dst_image->WorldUp(),
-      dst_image->XFov(), dst_image->YFov(), dst_depth_range.Min(), dst_depth_range.Max());
+  // Find pairs of images whose bounding boxes and view frusta intersect
+  unsigned char *candidates = new unsigned char [ (size_t) nimages * nimages ];
+#pragma omp parallel for schedule(dynamic)
+  for (int i0 = 0; i0 < nimages; i0++) {
+    const PixelOverlapImage& dst = data[i0];
+    for (int i1 = 0; i1 < nimages; i1++) {
+      const PixelOverlapImage& src = data[i1];
+      unsigned char& candidate = candidates[(size_t) i0 * nimages + i1];
+      candidate = 0;
+      if (!dst.valid || !src.valid) continue;
+      if (!dst.world_bbox.Intersects(src.world_bbox)) continue;
+      if (!dst.world_frustum.Intersects(src.world_bbox)) continue;
+      if (!src.world_frustum.Intersects(dst.world_bbox)) continue;
+      candidate = 1;
+    }
+  }
 
-    // Consider every other image
-    for (int i1 = 0; i1 < configuration->NImages(); i1++) {
-      RGBDImage *src_image = configuration->Image(i1);
+  // Count overlaps, one block of dst images and one block of src images at a time
+  int *pairs = new int [ 2 * pixel_overlap_dst_block_size * pixel_overlap_src_block_size ];
+  int *counts = new int [ pixel_overlap_dst_block_size * pixel_overlap_src_block_size ];
+  for (int i0 = 0; i0 < nimages; i0 += pixel_overlap_dst_block_size) {
+    int n0 = (i0 + pixel_overlap_dst_block_size <= nimages) ? pixel_overlap_dst_block_size : nimages - i0;
+
+    // Load dst images and back-project their pixels
+    configuration->PrefetchDepthChannels(i0, n0);
+    for (int i = i0; i < i0 + n0; i++) LoadPixelOverlapDepths(data[i], configuration->Image(i));
+#pragma omp parallel for schedule(dynamic)
+    for (int i = i0; i < i0 + n0; i++) ComputePixelOverlapPoints(data[i]);
+    int max_npoints = 0;
+    for (int i = i0; i < i0 + n0; i++) {
+      if (data[i].npoints > max_npoints) max_npoints = data[i].npoints;
+    }
 
-      // Check src bounding box intersection
-      const R3Box& src_bbox = src_image->WorldBBox();
-      if (!dst_bbox.Intersects(src_bbox)) continue;
-      if (!dst_frustum.Intersects(src_bbox)) continue;
+    // Consider blocks of src images
+    for (int i1 = 0; i1 < nimages; i1 += pixel_overlap_src_block_size) {
+      int n1 = (i1 + pixel_overlap_src_block_size <= nimages) ? pixel_overlap_src_block_size : nimages - i1;
+
+      // Gather candidate pairs
+      int npairs = 0;
+      int min_src_index = nimages, max_src_index = -1;
+      for (int dst_index = i0; dst_index < i0 + n0; dst_index++) {
+        for (int src_index = i1; src_index < i1 + n1; src_index++) {
+          if (!candidates[(size_t) dst_index * nimages + src_index]) continue;
+          if (src_index < min_src_index) min_src_index = src_index;
+          if (src_index > max_src_index) max_src_index = src_index;
+          pairs[2*npairs+0] = dst_index;
+          pairs[2*npairs+1] = src_index;
+          npairs++;
+        }
+      }
 
-      // Read src image depth channel
-      src_image->ReadDepthChannel();
-      R2Grid *src_depth_channel = src_image->DepthChannel();
+      // Check if there are any pairs
+      if (npairs == 0) continue;
 
-      // Check src view frustum intersection
-      RNInterval src_depth_range = src_depth_channel->Range();
-      R3Frustum src_frustum(src_image->WorldViewpoint(), src_image->WorldTowards(), src_image->WorldUp(),
-        src_image->XFov(), src_image->YFov(), src_depth_range.Min(), src_depth_range.Max());
-      if (!src_frustum.Intersects(dst_bbox)) continue;
+      // Load src images
+      configuration->PrefetchDepthChannels(min_src_index, max_src_index - min_src_index + 1);
+      for (int k = 0; k < npairs; k++) {
+        int src_index = pairs[2*k+1];
+        LoadPixelOverlapDepths(data[src_index], configuration->Image(src_index));
+      }
 
-      // Compute overlap
-      int overlaps = CountPixelOverlaps(dst_image, src_image);
-      pixel_overlap_matrix.SetGridValue(i0, i1, overlaps);
+      // Count overlaps for pairs in parallel
+#pragma omp parallel
+      {
+        float *buffer = new float [ 3 * max_npoints + 1 ];
+#pragma omp for schedule(dynamic)
+        for (int k = 0; k < npairs; k++) {
+          counts[k] = CountPixelOverlaps(data[pairs[2*k+0]], data[pairs[2*k+1]], buffer);
+        }
+        delete [] buffer;
+      }
 
-      // Print debug statement
-      if (print_debug) printf("%d %d  %d\n", i0, i1, overlaps);
+      // Update matrix
+      for (int k = 0; k < npairs; k++) {
+        pixel_overlap_matrix.SetGridValue(pairs[2*k+0], pairs[2*k+1], counts[k]);
+        if (print_debug) printf("%d %d  %d\n", pairs[2*k+0], pairs[2*k+1], counts[k]);
+      }
 
-      // Release src image depth channel
-      src_image->ReleaseDepthChannel();
+      // Release src images (except the ones in the dst block)
+      for (int src_index = min_src_index; src_index <= max_src_index; src_index++) {
+        if ((src_index >= i0) && (src_index < i0 + n0)) continue;
+        ReleasePixelOverlapData(data[src_index]);
+      }
     }
 
-    // Release dst image depth channel
-    dst_image->ReleaseDepthChannel();
+    // Release dst images
+    for (int i = i0; i < i0 + n0; i++) ReleasePixelOverlapData(data[i]);
   }
-  
+
+  // Delete temporary data
+  delete [] pairs;
+  delete [] counts;
+  delete [] candidates;
+  delete [] data;
+
   // Print statistics
   if (print_verbose) {
     printf("  Time = %.2f seconds\n", start_time.Elapsed());
@@ -320,6 +618,9 @@ ComputeGridOverlaps(RGBDConfiguration *configuration, R2Grid& image_image_grid_o
   // Initialize matrix
   image_image_grid_overlap_matrix = R2Grid(configuration->NImages(), configuration->NImages());
 
+  // Decode depth images in parallel
+  configuration->PrefetchDepthChannels();
+
   // Consider every image
   for (int i0 = 0; i0 < configuration->NImages(); i0++) {
     RGBDImage *image0 = configuration->Image(i0);
@@ -782,6 +1083,9 @@ ParseArgs(int argc, char **argv)
       else if (!strcmp(*argv, "-pixel_spacing")) { argc--; argv++; pixel_spacing = atoi(*argv); }
       else if (!strcmp(*argv, "-vertex_spacing")) { argc--; argv++; vertex_spacing = atof(*argv); }
       else if (!strcmp(*argv, "-grid_spacing")) { argc--; argv++; grid_spacing = atof(*argv); }
+      else if (!strcmp(*argv, "-channel_cache_size")) { argc--; argv++; channel_cache_size = atof(*argv); }
+      else if (!strcmp(*argv, "-file_cache_directory")) { argc--; argv++; file_cache_directory = *argv; }
+      else if (!strcmp(*argv, "-file_cache_size")) { argc--; argv++; file_cache_size = atof(*argv); }
       else { fprintf(stderr, "Invalid program argument: %s", *argv); exit(1); }
       argv++; argc--;
     }
@@ -337,12 +337,15 @@ SelectAtoms(PDBFile *file, RNArray<PDBAtom *>& atoms)
       }
     }
 
+    // Find atoms touching sphere
+    RNArray<PDBAtom *> sphere_atoms;
+    model->AtomIndex()->FindAtoms(sphere_centers[i], radius, sphere_atoms);
+
     // Mark atoms touching sphere
-    for (int j = 0; j < model->NAtoms(); j++) {
-      PDBAtom *atom = model->Atom(j);
+    for (int j = 0; j < sphere_atoms.NEntries(); j++) {
+      PDBAtom *atom = sphere_atoms.Kth(j);
       if (atom->IsHetAtom()) continue;
       if (atom->accessible_surface_area == 0) continue;
-      if (R3Distance(sphere_centers[i], atom->Position()) > radius + atom->Radius()) continue;
       if (sphere_granularities[i] == PDB_ATOM) atom->SetMark();
       else if (sphere_granularities[i] == PDB_RESIDUE) atom->Residue()->SetMark();
       else if (sphere_granularities[i] == PDB_CHAIN) atom->Chain()->SetMark();
@@ -372,14 +375,15 @@ SelectAtoms(PDBFile *file, RNArray<PDBAtom *>& atoms)
     }
 
     // Mark atoms within offset of any center atom
-    for (int j = 0; j < model->NAtoms(); j++) {
-      PDBAtom *atom = model->Atom(j);
-      if (atom->IsHetAtom()) continue;
-      if (atom->accessible_surface_area == 0) continue;
-      for (int k = 0; k < offset_atoms.NEntries(); k++) {
-        PDBAtom *center = offset_atoms.Kth(k);
-        RNLength distance = R3Distance(atom->Position(), center->Position());
-        if (distance > offset_radius[i] + atom->Radius() + center->Radius()) continue;
+    const PDBAtomIndex *index = model->AtomIndex();
+    for (int k = 0; k < offset_atoms.NEntries(); k++) {
+      PDBAtom *center = offset_atoms.Kth(k);
+      RNArray<PDBAtom *> nearby_atoms;
+      index->FindAtoms(center->Position(), offset_radius[i] + center->Radius(), nearby_atoms);
+      for (int j = 0; j < nearby_atoms.NEntries(); j++) {
+        PDBAtom *atom = nearby_atoms.Kth(j);
+        if (atom->IsHetAtom()) continue;
+        if (atom->accessible_surface_area == 0) continue;
         if (offset_granularities[i] == PDB_ATOM) atom->SetMark();
         else if (offset_granularities[i] == PDB_RESIDUE) atom->Residue()->SetMark();
         else if (offset_granularities[i] == PDB_CHAIN) atom->Chain()->SetMark();
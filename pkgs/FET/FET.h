@@ -12,11 +12,14 @@
 ////////////////////////////////////////////////////////////////////////
 
 struct FETDescriptor;
+struct FETDescriptorMatrix;
 struct FETFeature;
 struct FETCorrespondence;
 struct FETShape;
 struct FETMatch;
 struct FETReconstruction;
+struct FETPoseGraph;
+struct FETColumnarFile;
 
 
 
@@ -25,10 +28,13 @@ struct FETReconstruction;
 ////////////////////////////////////////////////////////////////////////
 
 #include "FETDescriptor.h"
+#include "FETDescriptorMatrix.h"
 #include "FETFeature.h"
 #include "FETCorrespondence.h"
 #include "FETShape.h"
 #include "FETMatch.h"
+#include "FETPoseGraph.h"
+#include "FETColumnarFile.h"
 #include "FETReconstruction.h"
 
 
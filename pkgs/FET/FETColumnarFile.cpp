@@ -0,0 +1,810 @@
+////////////////////////////////////////////////////////////////////////
+// Source file for columnar reconstruction file class
+////////////////////////////////////////////////////////////////////////
+
+
+
+////////////////////////////////////////////////////////////////////////
+// Include files
+////////////////////////////////////////////////////////////////////////
+
+#include "FET.h"
+#if (RN_OS != RN_WINDOWS)
+#  include <fcntl.h>
+#  include <unistd.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#endif
+
+
+
+////////////////////////////////////////////////////////////////////////
+// File format definitions
+////////////////////////////////////////////////////////////////////////
+
+static const char FET_COLUMNAR_MAGIC[8] = { 'F', 'E', 'T', 'C', 'O', 'L', 'S', '\0' };
+static const int FET_COLUMNAR_MAJOR_VERSION = 1;
+static const int FET_COLUMNAR_MINOR_VERSION = 0;
+static const long long FET_COLUMNAR_ALIGNMENT = 64;
+
+enum {
+  FET_COLUMNAR_SHAPES,
+  FET_COLUMNAR_SHAPE_PARENTS,
+  FET_COLUMNAR_MATCHES,
+  FET_COLUMNAR_FEATURE_RECONSTRUCTION_INDICES,
+  FET_COLUMNAR_FEATURE_SHAPE_INDICES,
+  FET_COLUMNAR_FEATURE_SHAPE_TYPES,
+  FET_COLUMNAR_FEATURE_GENERATOR_TYPES,
+  FET_COLUMNAR_FEATURE_PRIMITIVE_MARKERS,
+  FET_COLUMNAR_FEATURE_FLAGS,
+  FET_COLUMNAR_FEATURE_POSITIONS,
+  FET_COLUMNAR_FEATURE_DIRECTIONS,
+  FET_COLUMNAR_FEATURE_NORMALS,
+  FET_COLUMNAR_FEATURE_COLORS,
+  FET_COLUMNAR_FEATURE_RADII,
+  FET_COLUMNAR_FEATURE_SALIENCES,
+  FET_COLUMNAR_FEATURE_DISTINCTIONS,
+  FET_COLUMNAR_DESCRIPTOR_OFFSETS,
+  FET_COLUMNAR_DESCRIPTOR_VALUES,
+  FET_COLUMNAR_CORRESPONDENCES,
+  FET_COLUMNAR_NUM_SECTIONS
+};
+
+struct FETColumnarHeader {
+  char magic[8];
+  int major_version;
+  int minor_version;
+  int nshapes;
+  int nmatches;
+  int nfeatures;
+  int ncorrespondences;
+  int nsections;
+  int dummy;
+  double avg_feature_radius;
+  long long ndescriptor_values;
+  long long nparents;
+};
+
+struct FETColumnarSection {
+  int id;
+  int element_size;
+  long long count;
+  long long offset;
+};
+
+
+
+static long long
+FETColumnarAlign(long long offset)
+{
+  // Return offset rounded up to alignment
+  return ((offset + FET_COLUMNAR_ALIGNMENT - 1) / FET_COLUMNAR_ALIGNMENT) * FET_COLUMNAR_ALIGNMENT;
+}
+
+
+
+////////////////////////////////////////////////////////////////////////
+// Constructors
+////////////////////////////////////////////////////////////////////////
+
+FETColumnarFile::
+FETColumnarFile(void)
+  : header(NULL),
+    sections(NULL),
+    data(NULL),
+    size(0),
+    mapped(FALSE),
+    shapes(NULL),
+    shape_parents(NULL),
+    matches(NULL),
+    feature_reconstruction_indices(NULL),
+    feature_shape_indices(NULL),
+    feature_shape_types(NULL),
+    feature_generator_types(NULL),
+    feature_primitive_markers(NULL),
+    feature_flags(NULL),
+    feature_positions(NULL),
+    feature_directions(NULL),
+    feature_normals(NULL),
+    feature_colors(NULL),
+    feature_radii(NULL),
+    feature_saliences(NULL),
+    feature_distinctions(NULL),
+    descriptor_offsets(NULL),
+    descriptor_values(NULL),
+    correspondences(NULL),
+    nshapes(0),
+    nmatches(0),
+    nfeatures(0),
+    ncorrespondences(0)
+{
+}
+
+
+
+FETColumnarFile::
+~FETColumnarFile(void)
+{
+  // Unmap file
+  Close();
+}
+
+
+
+////////////////////////////////////////////////////////////////////////
+// Properties
+////////////////////////////////////////////////////////////////////////
+
+int FETColumnarFile::
+MajorVersion(void) const
+{
+  // Return major version of file format
+  if (!header) return 0;
+  return header->major_version;
+}
+
+
+
+int FETColumnarFile::
+MinorVersion(void) const
+{
+  // Return minor version of file format
+  if (!header) return 0;
+  return header->minor_version;
+}
+
+
+
+RNLength FETColumnarFile::
+AverageFeatureRadius(void) const
+{
+  // Return average feature radius stored in file
+  if (!header) return 0;
+  return header->avg_feature_radius;
+}
+
+
+
+////////////////////////////////////////////////////////////////////////
+// Opening and closing
+////////////////////////////////////////////////////////////////////////
+
+int FETColumnarFile::
+Open(const char *filename)
+{
+  // Close previous file
+  Close();
+
+#if (RN_OS != RN_WINDOWS)
+  // Map file into memory
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0) {
+    fprintf(stderr, "Unable to open reconstruction file %s\n", filename);
+    return 0;
+  }
+  struct stat st;
+  if ((fstat(fd, &st) < 0) || (st.st_size < (off_t) sizeof(FETColumnarHeader))) {
+    fprintf(stderr, "Invalid reconstruction file %s\n", filename);
+    close(fd);
+    return 0;
+  }
+  void *address = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (address == MAP_FAILED) {
+    fprintf(stderr, "Unable to map reconstruction file %s\n", filename);
+    return 0;
+  }
+  madvise(address, st.st_size, MADV_WILLNEED);
+  data = (const char *) address;
+  size = st.st_size;
+  mapped = TRUE;
+#else
+  // Read file into memory
+  FILE *fp = fopen(filename, "rb");
+  if (!fp) {
+    fprintf(stderr, "Unable to open reconstruction file %s\n", filename);
+    return 0;
+  }
+  RNFileSeek(fp, 0, RN_FILE_SEEK_END);
+  size = RNFileTell(fp);
+  RNFileSeek(fp, 0, RN_FILE_SEEK_SET);
+  if (size < (long long) sizeof(FETColumnarHeader)) {
+    fprintf(stderr, "Invalid reconstruction file %s\n", filename);
+    fclose(fp);
+    return 0;
+  }
+  char *buffer = new char [ size ];
+  if (fread(buffer, 1, size, fp) != (size_t) size) {
+    fprintf(stderr, "Unable to read reconstruction file %s\n", filename);
+    delete [] buffer;
+    fclose(fp);
+    return 0;
+  }
+  fclose(fp);
+  data = buffer;
+  mapped = FALSE;
+#endif
+
+  // Check header
+  header = (const FETColumnarHeader *) data;
+  if (memcmp(header->magic, FET_COLUMNAR_MAGIC, 8)) {
+    fprintf(stderr, "Unrecognized reconstruction file %s\n", filename);
+    Close();
+    return 0;
+  }
+  if (header->major_version != FET_COLUMNAR_MAJOR_VERSION) {
+    fprintf(stderr, "Unrecognized version %d %d\n", header->major_version, header->minor_version);
+    Close();
+    return 0;
+  }
+  if ((header->nshapes < 0) || (header->nmatches < 0) || (header->nfeatures < 0) ||
+      (header->ncorrespondences < 0) || (header->ndescriptor_values < 0) || (header->nparents < 0) ||
+      (header->nsections < 0) || (sizeof(FETColumnarHeader) + header->nsections * sizeof(FETColumnarSection) > (size_t) size)) {
+    fprintf(stderr, "Invalid header in reconstruction file %s\n", filename);
+    Close();
+    return 0;
+  }
+
+  // Assign counts
+  nshapes = header->nshapes;
+  nmatches = header->nmatches;
+  nfeatures = header->nfeatures;
+  ncorrespondences = header->ncorrespondences;
+
+  // Find sections (later minor versions may append sections with unknown ids)
+  sections = (const FETColumnarSection *) (data + sizeof(FETColumnarHeader));
+  shapes = (const FETColumnarShape *) Section(FET_COLUMNAR_SHAPES, sizeof(FETColumnarShape), nshapes);
+  shape_parents = (const int *) Section(FET_COLUMNAR_SHAPE_PARENTS, sizeof(int), header->nparents);
+  matches = (const FETColumnarMatch *) Section(FET_COLUMNAR_MATCHES, sizeof(FETColumnarMatch), nmatches);
+  feature_reconstruction_indices = (const int *) Section(FET_COLUMNAR_FEATURE_RECONSTRUCTION_INDICES, sizeof(int), nfeatures);
+  feature_shape_indices = (const int *) Section(FET_COLUMNAR_FEATURE_SHAPE_INDICES, sizeof(int), nfeatures);
+  feature_shape_types = (const int *) Section(FET_COLUMNAR_FEATURE_SHAPE_TYPES, sizeof(int), nfeatures);
+  feature_generator_types = (const int *) Section(FET_COLUMNAR_FEATURE_GENERATOR_TYPES, sizeof(int), nfeatures);
+  feature_primitive_markers = (const int *) Section(FET_COLUMNAR_FEATURE_PRIMITIVE_MARKERS, sizeof(int), nfeatures);
+  feature_flags = (const unsigned long long *) Section(FET_COLUMNAR_FEATURE_FLAGS, sizeof(unsigned long long), nfeatures);
+  feature_positions = (const double *) Section(FET_COLUMNAR_FEATURE_POSITIONS, 3 * sizeof(double), nfeatures);
+  feature_directions = (const double *) Section(FET_COLUMNAR_FEATURE_DIRECTIONS, 3 * sizeof(double), nfeatures);
+  feature_normals = (const double *) Section(FET_COLUMNAR_FEATURE_NORMALS, 3 * sizeof(double), nfeatures);
+  feature_colors = (const double *) Section(FET_COLUMNAR_FEATURE_COLORS, 3 * sizeof(double), nfeatures);
+  feature_radii = (const double *) Section(FET_COLUMNAR_FEATURE_RADII, sizeof(double), nfeatures);
+  feature_saliences = (const double *) Section(FET_COLUMNAR_FEATURE_SALIENCES, sizeof(double), nfeatures);
+  feature_distinctions = (const double *) Section(FET_COLUMNAR_FEATURE_DISTINCTIONS, sizeof(double), nfeatures);
+  descriptor_offsets = (const long long *) Section(FET_COLUMNAR_DESCRIPTOR_OFFSETS, sizeof(long long), nfeatures + 1);
+  descriptor_values = (const float *) Section(FET_COLUMNAR_DESCRIPTOR_VALUES, sizeof(float), header->ndescriptor_values);
+  correspondences = (const FETColumnarCorrespondence *) Section(FET_COLUMNAR_CORRESPONDENCES, sizeof(FETColumnarCorrespondence), ncorrespondences);
+  if (!shapes || !shape_parents || !matches || !feature_reconstruction_indices || !feature_shape_indices ||
+      !feature_shape_types || !feature_generator_types || !feature_primitive_markers || !feature_flags ||
+      !feature_positions || !feature_directions || !feature_normals || !feature_colors ||
+      !feature_radii || !feature_saliences || !feature_distinctions ||
+      !descriptor_offsets || !descriptor_values || !correspondences) {
+    fprintf(stderr, "Missing or invalid section in reconstruction file %s\n", filename);
+    Close();
+    return 0;
+  }
+
+  // Check offsets into other sections, so that accessors do not have to
+  for (int i = 0; i < nshapes; i++) {
+    const FETColumnarShape& shape = shapes[i];
+    if ((shape.nparents < 0) || (shape.first_parent < 0) || (shape.first_parent + (long long) shape.nparents > header->nparents) ||
+        (shape.nfeatures < 0) || (shape.first_feature < 0) || (shape.first_feature + (long long) shape.nfeatures > nfeatures)) {
+      fprintf(stderr, "Invalid shape %d in reconstruction file %s\n", i, filename);
+      Close();
+      return 0;
+    }
+  }
+  if ((descriptor_offsets[0] != 0) || (descriptor_offsets[nfeatures] != header->ndescriptor_values)) {
+    fprintf(stderr, "Invalid descriptor offsets in reconstruction file %s\n", filename);
+    Close();
+    return 0;
+  }
+  for (int i = 0; i < nfeatures; i++) {
+    if (descriptor_offsets[i] > descriptor_offsets[i+1]) {
+      fprintf(stderr, "Invalid descriptor offsets in reconstruction file %s\n", filename);
+      Close();
+      return 0;
+    }
+  }
+
+  // Return success
+  return 1;
+}
+
+
+
+void FETColumnarFile::
+Close(void)
+{
+  // Release file contents
+  if (data) {
+#if (RN_OS != RN_WINDOWS)
+    if (mapped) munmap((void *) data, size);
+    else delete [] data;
+#else
+    delete [] data;
+#endif
+  }
+
+  // Reset everything
+  header = NULL;
+  sections = NULL;
+  data = NULL;
+  size = 0;
+  mapped = FALSE;
+  shapes = NULL;
+  shape_parents = NULL;
+  matches = NULL;
+  feature_reconstruction_indices = NULL;
+  feature_shape_indices = NULL;
+  feature_shape_types = NULL;
+  feature_generator_types = NULL;
+  feature_primitive_markers = NULL;
+  feature_flags = NULL;
+  feature_positions = NULL;
+  feature_directions = NULL;
+  feature_normals = NULL;
+  feature_colors = NULL;
+  feature_radii = NULL;
+  feature_saliences = NULL;
+  feature_distinctions = NULL;
+  descriptor_offsets = NULL;
+  descriptor_values = NULL;
+  correspondences = NULL;
+  nshapes = nmatches = nfeatures = ncorrespondences = 0;
+}
+
+
+
+const void *FETColumnarFile::
+Section(int id, int element_size, long long count) const
+{
+  // Find section with id and check that it fits in file
+  for (int i = 0; i < header->nsections; i++) {
+    const FETColumnarSection& section = sections[i];
+    if (section.id != id) continue;
+    if (section.element_size != element_size) return NULL;
+    if (section.count != count) return NULL;
+    if (section.offset % FET_COLUMNAR_ALIGNMENT) return NULL;
+    if ((section.offset < 0) || (section.offset + count * element_size > size)) return NULL;
+    return data + section.offset;
+  }
+
+  // Section not found
+  return NULL;
+}
+
+
+
+////////////////////////////////////////////////////////////////////////
+// Conversion to reconstruction
+////////////////////////////////////////////////////////////////////////
+
+int FETColumnarFile::
+ReadReconstruction(FETReconstruction *reconstruction) const
+{
+  // Check file
+  if (!IsOpen()) return 0;
+
+  // Get offsets of indices (objects are appended to reconstruction)
+  int shape_offset = reconstruction->NShapes();
+  int match_offset = reconstruction->NMatches();
+  int feature_offset = reconstruction->NFeatures();
+
+  // Create shapes
+  for (int i = 0; i < nshapes; i++) {
+    const FETColumnarShape& record = shapes[i];
+    FETShape *shape = new FETShape(reconstruction);
+    char name_buffer[256];
+    strncpy(name_buffer, record.name, 255);
+    name_buffer[255] = '\0';
+    if (name_buffer[0] != '\0') shape->name = strdup(name_buffer);
+    shape->current_transformation.Reset(R4Matrix(record.current_matrix), 0);
+    shape->initial_transformation.Reset(R4Matrix(record.current_matrix), 0);
+    shape->ground_truth_transformation.Reset(R4Matrix(record.ground_truth_matrix), 0);
+    for (int j = 0; j < FETShape::max_variables; j++) shape->variable_inertias[j] = record.variable_inertias[j];
+    shape->viewpoint.Reset(record.viewpoint[0], record.viewpoint[1], record.viewpoint[2]);
+    shape->towards.Reset(record.towards[0], record.towards[1], record.towards[2]);
+    shape->up.Reset(record.up[0], record.up[1], record.up[2]);
+    shape->origin.Reset(record.origin[0], record.origin[1], record.origin[2]);
+  }
+
+  // Insert shapes into parents
+  for (int i = 0; i < nshapes; i++) {
+    FETShape *shape = reconstruction->Shape(shape_offset + i);
+    const int *parents = ShapeParents(i);
+    for (int j = 0; j < shapes[i].nparents; j++) {
+      if ((parents[j] < 0) || (parents[j] >= nshapes)) continue;
+      FETShape *parent = reconstruction->Shape(shape_offset + parents[j]);
+      parent->InsertChild(shape);
+    }
+  }
+
+  // Create matches
+  for (int i = 0; i < nmatches; i++) {
+    const FETColumnarMatch& record = matches[i];
+    FETMatch *match = new FETMatch(reconstruction);
+    for (int j = 0; j < 2; j++) {
+      if ((record.shapes[j] < 0) || (record.shapes[j] >= nshapes)) continue;
+      FETShape *shape = reconstruction->Shape(shape_offset + record.shapes[j]);
+      shape->InsertMatch(match, j);
+    }
+    match->current_transformation.Reset(R4Matrix(record.current_matrix), 0);
+    match->initial_transformation.Reset(R4Matrix(record.current_matrix), 0);
+    match->ground_truth_transformation.Reset(R4Matrix(record.ground_truth_matrix), 0);
+    match->affinity = record.affinity;
+  }
+
+  // Sort rows by reconstruction index
+  FETFeature **row_features = new FETFeature * [ nfeatures ];
+  int *row_order = new int [ nfeatures ];
+  for (int i = 0; i < nfeatures; i++) row_order[i] = -1;
+  for (int row = 0; row < nfeatures; row++) {
+    int r = feature_reconstruction_indices[row];
+    if ((r < 0) || (r >= nfeatures) || (row_order[r] >= 0)) {
+      fprintf(stderr, "Invalid feature index %d in reconstruction file\n", r);
+      delete [] row_features;
+      delete [] row_order;
+      return 0;
+    }
+    row_order[r] = row;
+  }
+
+  // Create features (objects are independent until inserted)
+#pragma omp parallel for schedule(static)
+  for (int row = 0; row < nfeatures; row++) {
+    FETFeature *feature = new FETFeature();
+    const double *p = &feature_positions[3*row];
+    const double *d = &feature_directions[3*row];
+    const double *n = &feature_normals[3*row];
+    const double *c = &feature_colors[3*row];
+    feature->shape_type = feature_shape_types[row];
+    feature->generator_type = feature_generator_types[row];
+    feature->primitive_marker = feature_primitive_markers[row];
+    feature->flags = (unsigned long) feature_flags[row];
+    feature->position.Reset(p[0], p[1], p[2]);
+    feature->direction.Reset(d[0], d[1], d[2]);
+    feature->normal.Reset(n[0], n[1], n[2]);
+    feature->color.Reset(c[0], c[1], c[2]);
+    feature->radius = feature_radii[row];
+    feature->salience = feature_saliences[row];
+    feature->distinction = feature_distinctions[row];
+    int nvalues = 0;
+    const float *values = FeatureDescriptorValues(row, &nvalues);
+    feature->descriptor.Reset(nvalues, (float *) values);
+    row_features[row] = feature;
+  }
+
+  // Insert features into reconstruction
+  for (int i = 0; i < nfeatures; i++) {
+    reconstruction->InsertFeature(row_features[row_order[i]]);
+  }
+
+  // Insert features into shapes
+  for (int i = 0; i < nshapes; i++) {
+    FETShape *shape = reconstruction->Shape(shape_offset + i);
+    int first_feature = shapes[i].first_feature;
+    for (int j = 0; j < shapes[i].nfeatures; j++) {
+      shape->InsertFeature(row_features[first_feature + j]);
+    }
+  }
+
+  // Create correspondences
+  for (int i = 0; i < ncorrespondences; i++) {
+    const FETColumnarCorrespondence& record = correspondences[i];
+    FETFeature *features[2] = { NULL, NULL };
+    for (int j = 0; j < 2; j++) {
+      if ((record.features[j] < 0) || (record.features[j] >= nfeatures)) continue;
+      features[j] = reconstruction->Feature(feature_offset + record.features[j]);
+    }
+    FETCorrespondence *correspondence = new FETCorrespondence(reconstruction,
+      features[0], features[1], record.affinity, record.relationship_type);
+    if ((record.match >= 0) && (record.match < nmatches)) {
+      FETMatch *match = reconstruction->Match(match_offset + record.match);
+      match->InsertCorrespondence(correspondence);
+    }
+  }
+
+  // Delete temporary memory
+  delete [] row_features;
+  delete [] row_order;
+
+  // Return success
+  return 1;
+}
+
+
+
+////////////////////////////////////////////////////////////////////////
+// Conversion from reconstruction
+////////////////////////////////////////////////////////////////////////
+
+static void
+FETColumnarFillSection(int id, char *buffer, const FETReconstruction *reconstruction,
+  FETFeature **row_features, const long long *descriptor_offsets)
+{
+  // Fill buffer with contents of section
+  int nfeatures = reconstruction->NFeatures();
+  switch (id) {
+  case FET_COLUMNAR_SHAPES: {
+    FETColumnarShape *records = (FETColumnarShape *) buffer;
+    int first_parent = 0, first_feature = 0;
+    for (int i = 0; i < reconstruction->NShapes(); i++) {
+      FETShape *shape = reconstruction->Shape(i);
+      FETColumnarShape& record = records[i];
+      memset(&record, 0, sizeof(FETColumnarShape));
+      if (shape->name) strncpy(record.name, shape->name, 255);
+      for (int j = 0; j < 3; j++) record.origin[j] = shape->origin[j];
+      R4Matrix current_matrix = shape->current_transformation.Matrix();
+      R4Matrix ground_truth_matrix = shape->ground_truth_transformation.Matrix();
+      for (int j = 0; j < 16; j++) record.current_matrix[j] = current_matrix[j/4][j%4];
+      for (int j = 0; j < 16; j++) record.ground_truth_matrix[j] = ground_truth_matrix[j/4][j%4];
+      for (int j = 0; j < FETShape::max_variables; j++) record.variable_inertias[j] = shape->variable_inertias[j];
+      for (int j = 0; j < 3; j++) record.viewpoint[j] = (float) shape->viewpoint[j];
+      for (int j = 0; j < 3; j++) record.towards[j] = (float) shape->towards[j];
+      for (int j = 0; j < 3; j++) record.up[j] = (float) shape->up[j];
+      record.reconstruction_index = i;
+      record.nparents = shape->NParents();
+      record.first_parent = first_parent;
+      record.nfeatures = shape->NFeatures();
+      record.first_feature = first_feature;
+      first_parent += record.nparents;
+      first_feature += record.nfeatures;
+    }
+    break; }
+
+  case FET_COLUMNAR_SHAPE_PARENTS: {
+    int *parents = (int *) buffer;
+    for (int i = 0; i < reconstruction->NShapes(); i++) {
+      FETShape *shape = reconstruction->Shape(i);
+      for (int j = 0; j < shape->NParents(); j++) {
+        *(parents++) = shape->Parent(j)->reconstruction_index;
+      }
+    }
+    break; }
+
+  case FET_COLUMNAR_MATCHES: {
+    FETColumnarMatch *records = (FETColumnarMatch *) buffer;
+    for (int i = 0; i < reconstruction->NMatches(); i++) {
+      FETMatch *match = reconstruction->Match(i);
+      FETColumnarMatch& record = records[i];
+      memset(&record, 0, sizeof(FETColumnarMatch));
+      record.reconstruction_index = i;
+      for (int j = 0; j < 2; j++) {
+        FETShape *shape = match->Shape(j);
+        record.shapes[j] = (shape) ? shape->reconstruction_index : -1;
+      }
+      record.ncorrespondences = match->NCorrespondences();
+      R4Matrix current_matrix = match->current_transformation.Matrix();
+      R4Matrix ground_truth_matrix = match->ground_truth_transformation.Matrix();
+      for (int j = 0; j < 16; j++) record.current_matrix[j] = current_matrix[j/4][j%4];
+      for (int j = 0; j < 16; j++) record.ground_truth_matrix[j] = ground_truth_matrix[j/4][j%4];
+      record.affinity = match->affinity;
+    }
+    break; }
+
+  case FET_COLUMNAR_FEATURE_RECONSTRUCTION_INDICES:
+  case FET_COLUMNAR_FEATURE_SHAPE_INDICES:
+  case FET_COLUMNAR_FEATURE_SHAPE_TYPES:
+  case FET_COLUMNAR_FEATURE_GENERATOR_TYPES:
+  case FET_COLUMNAR_FEATURE_PRIMITIVE_MARKERS: {
+    int *values = (int *) buffer;
+#pragma omp parallel for schedule(static)
+    for (int row = 0; row < nfeatures; row++) {
+      FETFeature *feature = row_features[row];
+      if (id == FET_COLUMNAR_FEATURE_RECONSTRUCTION_INDICES) values[row] = feature->reconstruction_index;
+      else if (id == FET_COLUMNAR_FEATURE_SHAPE_INDICES) values[row] = (feature->shape) ? feature->shape->reconstruction_index : -1;
+      else if (id == FET_COLUMNAR_FEATURE_SHAPE_TYPES) values[row] = feature->shape_type;
+      else if (id == FET_COLUMNAR_FEATURE_GENERATOR_TYPES) values[row] = feature->generator_type;
+      else values[row] = feature->primitive_marker;
+    }
+    break; }
+
+  case FET_COLUMNAR_FEATURE_FLAGS: {
+    unsigned long long *values = (unsigned long long *) buffer;
+#pragma omp parallel for schedule(static)
+    for (int row = 0; row < nfeatures; row++) {
+      values[row] = (unsigned long) row_features[row]->flags;
+    }
+    break; }
+
+  case FET_COLUMNAR_FEATURE_POSITIONS:
+  case FET_COLUMNAR_FEATURE_DIRECTIONS:
+  case FET_COLUMNAR_FEATURE_NORMALS:
+  case FET_COLUMNAR_FEATURE_COLORS: {
+    double *values = (double *) buffer;
+#pragma omp parallel for schedule(static)
+    for (int row = 0; row < nfeatures; row++) {
+      FETFeature *feature = row_features[row];
+      const RNScalar *coords = feature->color.Coords();
+      if (id == FET_COLUMNAR_FEATURE_POSITIONS) coords = feature->position.Coords();
+      else if (id == FET_COLUMNAR_FEATURE_DIRECTIONS) coords = feature->direction.Coords();
+      else if (id == FET_COLUMNAR_FEATURE_NORMALS) coords = feature->normal.Coords();
+      for (int j = 0; j < 3; j++) values[3*row+j] = coords[j];
+    }
+    break; }
+
+  case FET_COLUMNAR_FEATURE_RADII:
+  case FET_COLUMNAR_FEATURE_SALIENCES:
+  case FET_COLUMNAR_FEATURE_DISTINCTIONS: {
+    double *values = (double *) buffer;
+#pragma omp parallel for schedule(static)
+    for (int row = 0; row < nfeatures; row++) {
+      FETFeature *feature = row_features[row];
+      if (id == FET_COLUMNAR_FEATURE_RADII) values[row] = feature->radius;
+      else if (id == FET_COLUMNAR_FEATURE_SALIENCES) values[row] = feature->salience;
+      else values[row] = feature->distinction;
+    }
+    break; }
+
+  case FET_COLUMNAR_DESCRIPTOR_OFFSETS:
+    memcpy(buffer, descriptor_offsets, (nfeatures + 1) * sizeof(long long));
+    break;
+
+  case FET_COLUMNAR_DESCRIPTOR_VALUES: {
+    float *values = (float *) buffer;
+#pragma omp parallel for schedule(dynamic, 1024)
+    for (int row = 0; row < nfeatures; row++) {
+      const FETDescriptor& descriptor = row_features[row]->descriptor;
+      if (descriptor.nvalues == 0) continue;
+      memcpy(&values[descriptor_offsets[row]], descriptor.values, descriptor.nvalues * sizeof(float));
+    }
+    break; }
+
+  case FET_COLUMNAR_CORRESPONDENCES: {
+    FETColumnarCorrespondence *records = (FETColumnarCorrespondence *) buffer;
+#pragma omp parallel for schedule(static)
+    for (int i = 0; i < reconstruction->NCorrespondences(); i++) {
+      FETCorrespondence *correspondence = reconstruction->Correspondence(i);
+      FETColumnarCorrespondence& record = records[i];
+      memset(&record, 0, sizeof(FETColumnarCorrespondence));
+      record.match = (correspondence->Match()) ? correspondence->Match()->reconstruction_index : -1;
+      for (int j = 0; j < 2; j++) {
+        FETFeature *feature = correspondence->Feature(j);
+        record.features[j] = (feature) ? feature->reconstruction_index : -1;
+      }
+      record.relationship_type = correspondence->relationship_type;
+      record.affinity = correspondence->affinity;
+    }
+    break; }
+  }
+}
+
+
+
+int FETColumnarFile::
+WriteReconstruction(const FETReconstruction *reconstruction, const char *filename)
+{
+  // Get counts
+  int nshapes = reconstruction->NShapes();
+  int nmatches = reconstruction->NMatches();
+  int nfeatures = reconstruction->NFeatures();
+  int ncorrespondences = reconstruction->NCorrespondences();
+
+  // Order feature rows by shape (features of each shape in shape order, then features without shape)
+  FETFeature **row_features = new FETFeature * [ nfeatures ];
+  long long nparents = 0;
+  int nrows = 0;
+  for (int i = 0; i < nshapes; i++) {
+    FETShape *shape = reconstruction->Shape(i);
+    nparents += shape->NParents();
+    for (int j = 0; j < shape->NFeatures(); j++) {
+      FETFeature *feature = shape->Feature(j);
+      assert(feature->reconstruction == reconstruction);
+      if (nrows < nfeatures) row_features[nrows] = feature;
+      nrows++;
+    }
+  }
+  for (int i = 0; i < nfeatures; i++) {
+    FETFeature *feature = reconstruction->Feature(i);
+    if (feature->shape && (feature->shape->reconstruction == reconstruction)) continue;
+    if (nrows < nfeatures) row_features[nrows] = feature;
+    nrows++;
+  }
+  if (nrows != nfeatures) {
+    fprintf(stderr, "Features of shapes do not match features of reconstruction\n");
+    delete [] row_features;
+    return 0;
+  }
+
+  // Compute descriptor offsets
+  long long *descriptor_offsets = new long long [ nfeatures + 1 ];
+  descriptor_offsets[0] = 0;
+  for (int row = 0; row < nfeatures; row++) {
+    descriptor_offsets[row+1] = descriptor_offsets[row] + row_features[row]->descriptor.nvalues;
+  }
+
+  // Fill header
+  FETColumnarHeader header;
+  memset(&header, 0, sizeof(FETColumnarHeader));
+  memcpy(header.magic, FET_COLUMNAR_MAGIC, 8);
+  header.major_version = FET_COLUMNAR_MAJOR_VERSION;
+  header.minor_version = FET_COLUMNAR_MINOR_VERSION;
+  header.nshapes = nshapes;
+  header.nmatches = nmatches;
+  header.nfeatures = nfeatures;
+  header.ncorrespondences = ncorrespondences;
+  header.nsections = FET_COLUMNAR_NUM_SECTIONS;
+  header.avg_feature_radius = reconstruction->avg_feature_radius;
+  header.ndescriptor_values = descriptor_offsets[nfeatures];
+  header.nparents = nparents;
+
+  // Fill section table
+  FETColumnarSection sections[FET_COLUMNAR_NUM_SECTIONS];
+  for (int id = 0; id < FET_COLUMNAR_NUM_SECTIONS; id++) {
+    FETColumnarSection& section = sections[id];
+    section.id = id;
+    section.count = nfeatures;
+    if (id == FET_COLUMNAR_SHAPES) { section.element_size = sizeof(FETColumnarShape); section.count = nshapes; }
+    else if (id == FET_COLUMNAR_SHAPE_PARENTS) { section.element_size = sizeof(int); section.count = nparents; }
+    else if (id == FET_COLUMNAR_MATCHES) { section.element_size = sizeof(FETColumnarMatch); section.count = nmatches; }
+    else if (id == FET_COLUMNAR_FEATURE_FLAGS) section.element_size = sizeof(unsigned long long);
+    else if (id == FET_COLUMNAR_FEATURE_POSITIONS) section.element_size = 3 * sizeof(double);
+    else if (id == FET_COLUMNAR_FEATURE_DIRECTIONS) section.element_size = 3 * sizeof(double);
+    else if (id == FET_COLUMNAR_FEATURE_NORMALS) section.element_size = 3 * sizeof(double);
+    else if (id == FET_COLUMNAR_FEATURE_COLORS) section.element_size = 3 * sizeof(double);
+    else if (id == FET_COLUMNAR_FEATURE_RADII) section.element_size = sizeof(double);
+    else if (id == FET_COLUMNAR_FEATURE_SALIENCES) section.element_size = sizeof(double);
+    else if (id == FET_COLUMNAR_FEATURE_DISTINCTIONS) section.element_size = sizeof(double);
+    else if (id == FET_COLUMNAR_DESCRIPTOR_OFFSETS) { section.element_size = sizeof(long long); section.count = nfeatures + 1; }
+    else if (id == FET_COLUMNAR_DESCRIPTOR_VALUES) { section.element_size = sizeof(float); section.count = header.ndescriptor_values; }
+    else if (id == FET_COLUMNAR_CORRESPONDENCES) { section.element_size = sizeof(FETColumnarCorrespondence); section.count = ncorrespondences; }
+    else section.element_size = sizeof(int);
+  }
+
+  // Compute section offsets
+  long long offset = FETColumnarAlign(sizeof(FETColumnarHeader) + sizeof(sections));
+  long long max_section_size = 0;
+  for (int id = 0; id < FET_COLUMNAR_NUM_SECTIONS; id++) {
+    long long section_size = sections[id].count * sections[id].element_size;
+    if (section_size > max_section_size) max_section_size = section_size;
+    sections[id].offset = offset;
+    offset = FETColumnarAlign(offset + section_size);
+  }
+
+  // Open file
+  FILE *fp = fopen(filename, "wb");
+  if (!fp) {
+    fprintf(stderr, "Unable to open %s\n", filename);
+    delete [] row_features;
+    delete [] descriptor_offsets;
+    return 0;
+  }
+
+  // Write header and section table
+  static const char padding[FET_COLUMNAR_ALIGNMENT] = { 0 };
+  long long position = sizeof(FETColumnarHeader) + sizeof(sections);
+  int status = 1;
+  if (fwrite(&header, sizeof(FETColumnarHeader), 1, fp) != 1) status = 0;
+  if (fwrite(sections, sizeof(sections), 1, fp) != 1) status = 0;
+
+  // Write sections (each is filled into one buffer and written with one call)
+  char *buffer = new char [ max_section_size + 1 ];
+  for (int id = 0; status && (id < FET_COLUMNAR_NUM_SECTIONS); id++) {
+    const FETColumnarSection& section = sections[id];
+    long long section_size = section.count * section.element_size;
+    if (section.offset > position) {
+      if (fwrite(padding, 1, section.offset - position, fp) != (size_t) (section.offset - position)) status = 0;
+      position = section.offset;
+    }
+    if (section_size == 0) continue;
+    FETColumnarFillSection(id, buffer, reconstruction, row_features, descriptor_offsets);
+    if (fwrite(buffer, 1, section_size, fp) != (size_t) section_size) status = 0;
+    position += section_size;
+  }
+
+  // Check for errors
+  if (!status) fprintf(stderr, "Unable to write %s\n", filename);
+
+  // Close file
+  fclose(fp);
+
+  // Delete temporary memory
+  delete [] buffer;
+  delete [] row_features;
+  delete [] descriptor_offsets;
+
+  // Return status
+  return status;
+}
+
+
+
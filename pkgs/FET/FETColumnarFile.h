@@ -0,0 +1,365 @@
+////////////////////////////////////////////////////////////////////////
+// Columnar reconstruction file class definition
+////////////////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////////////////
+// NOTE:
+// A columnar file (.fcm) stores a reconstruction as a header, a table
+// of section offsets, and a set of 64-byte aligned sections, each of
+// which is a contiguous array of fixed-size elements.  Shapes and
+// matches are stored as records, while features are stored as one
+// array per field (positions, normals, flags, etc.), with rows sorted
+// by shape so that the features of every shape are contiguous.
+// Descriptor values are concatenated into one array indexed by an
+// array of offsets.  The file is mapped into memory when opened, so
+// the accessors below are read-only views of the file contents that
+// can be used without creating any FETShape or FETFeature objects.
+////////////////////////////////////////////////////////////////////////
+
+
+
+////////////////////////////////////////////////////////////////////////
+// Record definitions
+////////////////////////////////////////////////////////////////////////
+
+struct FETColumnarShape {
+  char name[256];
+  double origin[3];
+  double current_matrix[16];
+  double ground_truth_matrix[16];
+  double variable_inertias[9];
+  float viewpoint[3];
+  float towards[3];
+  float up[3];
+  int reconstruction_index;
+  int nparents;
+  int first_parent;
+  int nfeatures;
+  int first_feature;
+};
+
+struct FETColumnarMatch {
+  int reconstruction_index;
+  int shapes[2];
+  int ncorrespondences;
+  double current_matrix[16];
+  double ground_truth_matrix[16];
+  double affinity;
+};
+
+struct FETColumnarCorrespondence {
+  int match;
+  int features[2];
+  int relationship_type;
+  double affinity;
+};
+
+
+
+////////////////////////////////////////////////////////////////////////
+// Class definition
+////////////////////////////////////////////////////////////////////////
+
+struct FETColumnarFile {
+public:
+  // Constructors
+  FETColumnarFile(void);
+  ~FETColumnarFile(void);
+
+  // Opening and closing
+  int Open(const char *filename);
+  void Close(void);
+
+  // Properties
+  RNBoolean IsOpen(void) const;
+  int MajorVersion(void) const;
+  int MinorVersion(void) const;
+  RNLength AverageFeatureRadius(void) const;
+
+  // Shape access (features of a shape are rows first_feature ... first_feature + nfeatures - 1)
+  int NShapes(void) const;
+  const FETColumnarShape& Shape(int k) const;
+  const int *ShapeParents(int k) const;
+
+  // Match access
+  int NMatches(void) const;
+  const FETColumnarMatch& Match(int k) const;
+
+  // Feature access (one entry per row, rows are sorted by shape)
+  int NFeatures(void) const;
+  const int *FeatureReconstructionIndices(void) const;
+  const int *FeatureShapeIndices(void) const;
+  const int *FeatureShapeTypes(void) const;
+  const int *FeatureGeneratorTypes(void) const;
+  const int *FeaturePrimitiveMarkers(void) const;
+  const unsigned long long *FeatureFlags(void) const;
+  const double *FeaturePositions(void) const;
+  const double *FeatureDirections(void) const;
+  const double *FeatureNormals(void) const;
+  const double *FeatureColors(void) const;
+  const double *FeatureRadii(void) const;
+  const double *FeatureSaliences(void) const;
+  const double *FeatureDistinctions(void) const;
+  const float *FeatureDescriptorValues(int row, int *nvalues) const;
+
+  // Correspondence access
+  int NCorrespondences(void) const;
+  const FETColumnarCorrespondence& Correspondence(int k) const;
+
+  // Conversion to and from reconstructions
+  int ReadReconstruction(FETReconstruction *reconstruction) const;
+  static int WriteReconstruction(const FETReconstruction *reconstruction, const char *filename);
+
+private:
+  const void *Section(int id, int element_size, long long count) const;
+
+private:
+  // File contents
+  const struct FETColumnarHeader *header;
+  const struct FETColumnarSection *sections;
+  const char *data;
+  long long size;
+  RNBoolean mapped;
+
+  // Sections
+  const FETColumnarShape *shapes;
+  const int *shape_parents;
+  const FETColumnarMatch *matches;
+  const int *feature_reconstruction_indices;
+  const int *feature_shape_indices;
+  const int *feature_shape_types;
+  const int *feature_generator_types;
+  const int *feature_primitive_markers;
+  const unsigned long long *feature_flags;
+  const double *feature_positions;
+  const double *feature_directions;
+  const double *feature_normals;
+  const double *feature_colors;
+  const double *feature_radii;
+  const double *feature_saliences;
+  const double *feature_distinctions;
+  const long long *descriptor_offsets;
+  const float *descriptor_values;
+  const FETColumnarCorrespondence *correspondences;
+  int nshapes, nmatches, nfeatures, ncorrespondences;
+};
+
+
+
+////////////////////////////////////////////////////////////////////////
+// Inline functions
+////////////////////////////////////////////////////////////////////////
+
+inline RNBoolean FETColumnarFile::
+IsOpen(void) const
+{
+  // Return whether file is open
+  return (data) ? TRUE : FALSE;
+}
+
+
+
+inline int FETColumnarFile::
+NShapes(void) const
+{
+  // Return number of shapes
+  return nshapes;
+}
+
+
+
+inline const FETColumnarShape& FETColumnarFile::
+Shape(int k) const
+{
+  // Return kth shape record
+  assert((k >= 0) && (k < nshapes));
+  return shapes[k];
+}
+
+
+
+inline const int *FETColumnarFile::
+ShapeParents(int k) const
+{
+  // Return indices of parents of kth shape
+  assert((k >= 0) && (k < nshapes));
+  return &shape_parents[shapes[k].first_parent];
+}
+
+
+
+inline int FETColumnarFile::
+NMatches(void) const
+{
+  // Return number of matches
+  return nmatches;
+}
+
+
+
+inline const FETColumnarMatch& FETColumnarFile::
+Match(int k) const
+{
+  // Return kth match record
+  assert((k >= 0) && (k < nmatches));
+  return matches[k];
+}
+
+
+
+inline int FETColumnarFile::
+NFeatures(void) const
+{
+  // Return number of features
+  return nfeatures;
+}
+
+
+
+inline const int *FETColumnarFile::
+FeatureReconstructionIndices(void) const
+{
+  // Return reconstruction index of feature in every row
+  return feature_reconstruction_indices;
+}
+
+
+
+inline const int *FETColumnarFile::
+FeatureShapeIndices(void) const
+{
+  // Return shape index of feature in every row (-1 if none)
+  return feature_shape_indices;
+}
+
+
+
+inline const int *FETColumnarFile::
+FeatureShapeTypes(void) const
+{
+  // Return shape type of feature in every row
+  return feature_shape_types;
+}
+
+
+
+inline const int *FETColumnarFile::
+FeatureGeneratorTypes(void) const
+{
+  // Return generator type of feature in every row
+  return feature_generator_types;
+}
+
+
+
+inline const int *FETColumnarFile::
+FeaturePrimitiveMarkers(void) const
+{
+  // Return primitive marker of feature in every row
+  return feature_primitive_markers;
+}
+
+
+
+inline const unsigned long long *FETColumnarFile::
+FeatureFlags(void) const
+{
+  // Return flags of feature in every row
+  return feature_flags;
+}
+
+
+
+inline const double *FETColumnarFile::
+FeaturePositions(void) const
+{
+  // Return positions (3 coordinates per row)
+  return feature_positions;
+}
+
+
+
+inline const double *FETColumnarFile::
+FeatureDirections(void) const
+{
+  // Return directions (3 coordinates per row)
+  return feature_directions;
+}
+
+
+
+inline const double *FETColumnarFile::
+FeatureNormals(void) const
+{
+  // Return normals (3 coordinates per row)
+  return feature_normals;
+}
+
+
+
+inline const double *FETColumnarFile::
+FeatureColors(void) const
+{
+  // Return colors (3 components per row)
+  return feature_colors;
+}
+
+
+
+inline const double *FETColumnarFile::
+FeatureRadii(void) const
+{
+  // Return radius of feature in every row
+  return feature_radii;
+}
+
+
+
+inline const double *FETColumnarFile::
+FeatureSaliences(void) const
+{
+  // Return salience of feature in every row
+  return feature_saliences;
+}
+
+
+
+inline const double *FETColumnarFile::
+FeatureDistinctions(void) const
+{
+  // Return distinction of feature in every row
+  return feature_distinctions;
+}
+
+
+
+inline const float *FETColumnarFile::
+FeatureDescriptorValues(int row, int *nvalues) const
+{
+  // Return descriptor values of feature in row
+  assert((row >= 0) && (row < nfeatures));
+  if (nvalues) *nvalues = (int) (descriptor_offsets[row+1] - descriptor_offsets[row]);
+  return &descriptor_values[descriptor_offsets[row]];
+}
+
+
+
+inline int FETColumnarFile::
+NCorrespondences(void) const
+{
+  // Return number of correspondences
+  return ncorrespondences;
+}
+
+
+
+inline const FETColumnarCorrespondence& FETColumnarFile::
+Correspondence(int k) const
+{
+  // Return kth correspondence record
+  assert((k >= 0) && (k < ncorrespondences));
+  return correspondences[k];
+}
+
+
+
@@ -3,6 +3,10 @@
 ////////////////////////////////////////////////////////////////////////
 
 #include "FET.h"
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#  define FET_USE_AVX2
+#  include <immintrin.h>
+#endif
 
 
 
@@ -214,16 +218,8 @@ float FETDescriptor::
 SquaredDistance(const FETDescriptor& descriptor, float unknown_penalty) const
 {
   // Return squared distance in descriptor space
-  float sum = 0.0;
   assert(nvalues == descriptor.nvalues);
-  for (int i = 0; i < nvalues; i++) {
-    float delta;
-    if (values[i] == RN_UNKNOWN) delta = unknown_penalty;
-    else if (descriptor.values[i] == RN_UNKNOWN) delta = unknown_penalty;
-    else delta = values[i] - descriptor.values[i];
-    sum += delta * delta;
-  }
-  return sum;
+  return FETSquaredDescriptorDistance(values, descriptor.values, nvalues, unknown_penalty);
 }
 
 
@@ -237,3 +233,84 @@ Distance(const FETDescriptor& descriptor, float unknown_penalty) const
 
 
 
+////////////////////////////////////////////////////////////////////////
+// Distance kernels
+////////////////////////////////////////////////////////////////////////
+
+static float
+ScalarSquaredDescriptorDistance(const float *values1, const float *values2, int nvalues, float unknown_penalty)
+{
+  // Sum squared differences without branches (so that compiler can vectorize)
+  float sum = 0.0;
+  for (int i = 0; i < nvalues; i++) {
+    float value1 = values1[i];
+    float value2 = values2[i];
+    float delta = ((value1 == RN_UNKNOWN) || (value2 == RN_UNKNOWN)) ? unknown_penalty : value1 - value2;
+    sum += delta * delta;
+  }
+  return sum;
+}
+
+
+
+#ifdef FET_USE_AVX2
+
+__attribute__((target("avx2")))
+static float
+AVX2SquaredDescriptorDistance(const float *values1, const float *values2, int nvalues, float unknown_penalty)
+{
+  // Sum squared differences eight values at a time, substituting penalty where either value is unknown
+  const __m256 unknown = _mm256_set1_ps(RN_UNKNOWN);
+  const __m256 penalty = _mm256_set1_ps(unknown_penalty);
+  __m256 sum8 = _mm256_setzero_ps();
+  int i = 0;
+  for ( ; i + 8 <= nvalues; i += 8) {
+    __m256 value1 = _mm256_loadu_ps(&values1[i]);
+    __m256 value2 = _mm256_loadu_ps(&values2[i]);
+    __m256 mask = _mm256_or_ps(_mm256_cmp_ps(value1, unknown, _CMP_EQ_OQ), _mm256_cmp_ps(value2, unknown, _CMP_EQ_OQ));
+    __m256 delta = _mm256_blendv_ps(_mm256_sub_ps(value1, value2), penalty, mask);
+    sum8 = _mm256_add_ps(sum8, _mm256_mul_ps(delta, delta));
+  }
+
+  // Add up lanes
+  __m128 sum4 = _mm_add_ps(_mm256_castps256_ps128(sum8), _mm256_extractf128_ps(sum8, 1));
+  sum4 = _mm_add_ps(sum4, _mm_movehl_ps(sum4, sum4));
+  sum4 = _mm_add_ss(sum4, _mm_shuffle_ps(sum4, sum4, 1));
+  float sum = _mm_cvtss_f32(sum4);
+
+  // Add remaining values
+  if (i < nvalues) sum += ScalarSquaredDescriptorDistance(&values1[i], &values2[i], nvalues - i, unknown_penalty);
+  return sum;
+}
+
+
+
+static int
+HasAVX2(void)
+{
+  // Check processor once (races only write the same value)
+  static int has_avx2 = -1;
+  if (has_avx2 < 0) {
+    __builtin_cpu_init();
+    has_avx2 = (__builtin_cpu_supports("avx2")) ? 1 : 0;
+  }
+  return has_avx2;
+}
+
+#endif
+
+
+
+float 
+FETSquaredDescriptorDistance(const float *values1, const float *values2, int nvalues, float unknown_penalty)
+{
+#ifdef FET_USE_AVX2
+  // Use AVX2 kernel if processor supports it
+  if ((nvalues >= 8) && HasAVX2()) {
+    return AVX2SquaredDescriptorDistance(values1, values2, nvalues, unknown_penalty);
+  }
+#endif
+
+  // Use scalar kernel
+  return ScalarSquaredDescriptorDistance(values1, values2, nvalues, unknown_penalty);
+}
@@ -34,3 +34,12 @@ public:
   float *values;
   int nvalues;
 };
+
+
+
+////////////////////////////////////////////////////////////////////////
+// Distance kernels
+////////////////////////////////////////////////////////////////////////
+
+// Squared distance between value vectors (unknown values contribute unknown_penalty squared)
+float FETSquaredDescriptorDistance(const float *values1, const float *values2, int nvalues, float unknown_penalty = 10);
@@ -0,0 +1,173 @@
+////////////////////////////////////////////////////////////////////////
+// Include files
+////////////////////////////////////////////////////////////////////////
+
+#include "FET.h"
+
+
+
+////////////////////////////////////////////////////////////////////////
+// Descriptor matrix member functions
+////////////////////////////////////////////////////////////////////////
+
+FETDescriptorMatrix::
+FETDescriptorMatrix(void)
+  : buffer(NULL),
+    values(NULL),
+    labels(NULL),
+    nrows(0),
+    ncolumns(0),
+    stride(0)
+{
+}
+
+
+
+FETDescriptorMatrix::
+FETDescriptorMatrix(const RNArray<FETFeature *>& features)
+  : buffer(NULL),
+    values(NULL),
+    labels(NULL),
+    nrows(0),
+    ncolumns(0),
+    stride(0)
+{
+  // Fill matrix
+  Reset(features);
+}
+
+
+
+FETDescriptorMatrix::
+~FETDescriptorMatrix(void)
+{
+  // Delete data
+  if (buffer) delete [] buffer;
+  if (labels) delete [] labels;
+}
+
+
+
+void FETDescriptorMatrix::
+Reset(const RNArray<FETFeature *>& features)
+{
+  // Delete previous data
+  if (buffer) delete [] buffer;
+  if (labels) delete [] labels;
+  buffer = NULL;
+  values = NULL;
+  labels = NULL;
+  nrows = 0;
+  ncolumns = 0;
+  stride = 0;
+
+  // Check features
+  if (features.IsEmpty()) return;
+
+  // Determine dimensions (rows are padded to 32 byte boundaries)
+  nrows = features.NEntries();
+  for (int i = 0; i < nrows; i++) {
+    FETFeature *feature = features.Kth(i);
+    if (feature->descriptor.nvalues > ncolumns) ncolumns = feature->descriptor.nvalues;
+  }
+  stride = 8 * ((ncolumns + 7) / 8);
+
+  // Allocate aligned values
+  buffer = new float [ nrows * stride + 8 ];
+  values = (float *) (((size_t) buffer + 31) & ~((size_t) 31));
+  labels = new int [ nrows ];
+
+  // Copy descriptors
+  for (int i = 0; i < nrows; i++) {
+    FETFeature *feature = features.Kth(i);
+    const FETDescriptor& descriptor = feature->descriptor;
+    float *row = &values[i * stride];
+    if ((ncolumns > 0) && (descriptor.nvalues == ncolumns)) {
+      for (int j = 0; j < ncolumns; j++) row[j] = descriptor.values[j];
+      for (int j = ncolumns; j < stride; j++) row[j] = 0.0F;
+      labels[i] = feature->generator_type;
+    }
+    else {
+      for (int j = 0; j < stride; j++) row[j] = 0.0F;
+      labels[i] = -1;
+    }
+  }
+}
+
+
+
+int FETDescriptorMatrix::
+FindBestMatches(const FETDescriptorMatrix& matrix, int max_matches,
+  int *matches, float *squared_distances, float max_squared_distance,
+  RNBoolean match_labels, float unknown_penalty) const
+{
+  // Finds up to max_matches rows of matrix closest to each row of this matrix,
+  // sorted by distance.  Results for row i are stored at matches[i*max_matches],
+  // with -1 filling entries where fewer matches were found.
+
+  // Initialize results
+  for (int i = 0; i < nrows * max_matches; i++) matches[i] = -1;
+  if (max_matches <= 0) return 0;
+  if (ncolumns != matrix.ncolumns) return 0;
+
+  // Allocate distances, if not provided
+  float *distances = squared_distances;
+  if (!distances) distances = new float [ nrows * max_matches ];
+  for (int i = 0; i < nrows * max_matches; i++) distances[i] = FLT_MAX;
+
+  // Compare blocks of rows, so that the block of matrix rows stays in cache
+  const int block_size = 256;
+  int nblocks = (nrows + block_size - 1) / block_size;
+  int count = 0;
+#pragma omp parallel for schedule(dynamic, 1) reduction(+:count)
+  for (int b = 0; b < nblocks; b++) {
+    int i0 = b * block_size;
+    int i1 = (i0 + block_size < nrows) ? i0 + block_size : nrows;
+    for (int j0 = 0; j0 < matrix.nrows; j0 += block_size) {
+      int j1 = (j0 + block_size < matrix.nrows) ? j0 + block_size : matrix.nrows;
+      for (int i = i0; i < i1; i++) {
+        // Check row label
+        int label = labels[i];
+        if (label < 0) continue;
+        const float *row = &values[i * stride];
+        int *row_matches = &matches[i * max_matches];
+        float *row_distances = &distances[i * max_matches];
+        for (int j = j0; j < j1; j++) {
+          // Check matrix row label
+          int matrix_label = matrix.labels[j];
+          if (matrix_label < 0) continue;
+          if (match_labels && (matrix_label != label)) continue;
+
+          // Check distance
+          float dd = FETSquaredDescriptorDistance(row, &matrix.values[j * stride], stride, unknown_penalty);
+          if (dd > max_squared_distance) continue;
+          if (dd >= row_distances[max_matches-1]) continue;
+
+          // Insert into sorted list of best matches
+          int k = max_matches - 1;
+          while ((k > 0) && (row_distances[k-1] > dd)) {
+            row_distances[k] = row_distances[k-1];
+            row_matches[k] = row_matches[k-1];
+            k--;
+          }
+          row_distances[k] = dd;
+          row_matches[k] = j;
+        }
+      }
+    }
+
+    // Count matches
+    for (int i = i0 * max_matches; i < i1 * max_matches; i++) {
+      if (matches[i] >= 0) count++;
+    }
+  }
+
+  // Delete distances
+  if (distances != squared_distances) delete [] distances;
+
+  // Return number of matches
+  return count;
+}
+
+
+
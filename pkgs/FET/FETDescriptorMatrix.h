@@ -0,0 +1,121 @@
+////////////////////////////////////////////////////////////////////////
+// Descriptor matrix class definition
+////////////////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////////////////
+// NOTE:
+// A descriptor matrix packs the descriptors of a set of features into
+// one aligned row-major array (one row per feature, padded with zeros
+// to a multiple of eight floats), so that distances can be computed
+// with vector instructions over contiguous memory rather than through
+// each feature's separately allocated values.  Each row also has a
+// label (the feature's generator type), or -1 if the feature has no
+// descriptor of the common length.
+////////////////////////////////////////////////////////////////////////
+
+struct FETDescriptorMatrix {
+public:
+  // Constructors
+  FETDescriptorMatrix(void);
+  FETDescriptorMatrix(const RNArray<FETFeature *>& features);
+  ~FETDescriptorMatrix(void);
+
+  // Properties
+  int NRows(void) const;
+  int NColumns(void) const;
+  int RowStride(void) const;
+  const float *Row(int k) const;
+  int RowLabel(int k) const;
+
+  // Manipulation
+  void Reset(const RNArray<FETFeature *>& features);
+
+  // Relationships
+  float SquaredDistance(int row, const float *values, float unknown_penalty = 10) const;
+  float SquaredDistance(int row, const FETDescriptorMatrix& matrix, int matrix_row, float unknown_penalty = 10) const;
+  int FindBestMatches(const FETDescriptorMatrix& matrix, int max_matches,
+    int *matches, float *squared_distances = NULL, float max_squared_distance = FLT_MAX,
+    RNBoolean match_labels = TRUE, float unknown_penalty = 10) const;
+
+public:
+  // Internal data
+  float *buffer;
+  float *values;
+  int *labels;
+  int nrows;
+  int ncolumns;
+  int stride;
+};
+
+
+
+////////////////////////////////////////////////////////////////////////
+// Inline functions
+////////////////////////////////////////////////////////////////////////
+
+inline int FETDescriptorMatrix::
+NRows(void) const
+{
+  // Return number of rows (features)
+  return nrows;
+}
+
+
+
+inline int FETDescriptorMatrix::
+NColumns(void) const
+{
+  // Return number of columns (descriptor values)
+  return ncolumns;
+}
+
+
+
+inline int FETDescriptorMatrix::
+RowStride(void) const
+{
+  // Return number of floats between rows
+  return stride;
+}
+
+
+
+inline const float *FETDescriptorMatrix::
+Row(int k) const
+{
+  // Return kth row
+  assert((k >= 0) && (k < nrows));
+  return &values[k * stride];
+}
+
+
+
+inline int FETDescriptorMatrix::
+RowLabel(int k) const
+{
+  // Return label of kth row (-1 if row has no descriptor)
+  assert((k >= 0) && (k < nrows));
+  return labels[k];
+}
+
+
+
+inline float FETDescriptorMatrix::
+SquaredDistance(int row, const float *values, float unknown_penalty) const
+{
+  // Return squared distance between row and values (which must have NColumns entries)
+  return FETSquaredDescriptorDistance(Row(row), values, ncolumns, unknown_penalty);
+}
+
+
+
+inline float FETDescriptorMatrix::
+SquaredDistance(int row, const FETDescriptorMatrix& matrix, int matrix_row, float unknown_penalty) const
+{
+  // Return squared distance between row and row of other matrix (padding is zero in both)
+  assert(stride == matrix.stride);
+  return FETSquaredDescriptorDistance(Row(row), matrix.Row(matrix_row), stride, unknown_penalty);
+}
+
+
+
@@ -181,6 +181,30 @@ SetRadius(RNLength radius, RNBoolean transformed)
 
 
 
+void FETFeature::
+SetDescriptor(const FETDescriptor& descriptor)
+{
+  // Set descriptor
+  this->descriptor = descriptor;
+
+  // Invalidate shape's descriptor matrix
+  if (shape) shape->InvalidateDescriptorMatrix();
+}
+
+
+
+void FETFeature::
+SetGeneratorType(int generator_type)
+{
+  // Set generator type
+  this->generator_type = generator_type;
+
+  // Invalidate shape's descriptor matrix (rows are labeled by generator type)
+  if (shape) shape->InvalidateDescriptorMatrix();
+}
+
+
+
 void FETFeature::
 Transform(const R3Affine& transformation)
 {
@@ -599,7 +623,15 @@ AreFeaturesCompatible(FETFeature *feature1, FETFeature *feature2, void *data)
   int t = feature1->GeneratorType();
   if (t == feature2->GeneratorType()) {
     if (compatibility->max_descriptor_distance_squared[t] != RN_UNKNOWN) {
-      RNScalar dd = feature1->descriptor.SquaredDistance(feature2->descriptor);
+      RNScalar dd;
+      const FETDescriptorMatrix *matrix2 = (feature2->shape) ? feature2->shape->descriptor_matrix : NULL;
+      if (matrix2 && (matrix2->RowLabel(feature2->shape_index) >= 0) && (feature1->descriptor.nvalues == matrix2->NColumns())) {
+        // Use packed row of feature2's shape's descriptor matrix, if it has been built
+        dd = matrix2->SquaredDistance(feature2->shape_index, feature1->descriptor.values);
+      }
+      else {
+        dd = feature1->descriptor.SquaredDistance(feature2->descriptor);
+      }
       if ((dd == RN_UNKNOWN) || (dd > compatibility->max_descriptor_distance_squared[t])) return 0;
     }
   }
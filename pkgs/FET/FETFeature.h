@@ -373,15 +373,6 @@ SetDistinction(RNScalar distinction)
 
 
 
-inline void FETFeature::
-SetDescriptor(const FETDescriptor& descriptor)
-{
-  // Set descriptor
-  this->descriptor = descriptor;
-}
-
-
-
 inline void FETFeature::
 SetColor(const RNRgb& color)
 {
@@ -391,15 +382,6 @@ SetColor(const RNRgb& color)
 
 
 
-inline void FETFeature::
-SetGeneratorType(int generator_type)
-{
-  // Set generator type
-  this->generator_type = generator_type;
-}
-
-
-
 inline void FETFeature::
 SetFlags(const RNFlags& flags)
 {
@@ -0,0 +1,1096 @@
+////////////////////////////////////////////////////////////////////////
+// Include files
+////////////////////////////////////////////////////////////////////////
+
+#include "FET.h"
+
+
+
+////////////////////////////////////////////////////////////////////////
+// Residual definitions
+////////////////////////////////////////////////////////////////////////
+
+enum {
+  FET_POINT_POINT_RESIDUAL,
+  FET_POINT_PLANE_RESIDUAL,
+  FET_PARALLEL_VECTOR_RESIDUAL,
+  FET_PERPENDICULAR_VECTOR_RESIDUAL,
+  FET_INERTIA_RESIDUAL
+};
+
+struct FETPoseGraphResidual {
+  int type;
+  int shapes[2];
+  int variable;
+  double a[3];
+  double b[3];
+  double c[3];
+  double w;
+};
+
+struct FETPoseGraphSortEntry {
+  int shapes[2];
+  int residual_index;
+};
+
+static const int nv = FET_NUM_VARIABLES;
+static const int nvnv = FET_NUM_VARIABLES * FET_NUM_VARIABLES;
+
+static const RNScalar max_fill_factor = 16;
+static const int max_conjugate_gradient_iterations = 1000;
+static const RNScalar conjugate_gradient_tolerance = 1E-10;
+
+
+
+////////////////////////////////////////////////////////////////////////
+// Dense block functions (blocks are 9x9, row-major)
+////////////////////////////////////////////////////////////////////////
+
+static int
+FactorBlock(double *A)
+{
+  // Replace A with lower triangular L such that A = L * LT
+  for (int j = 0; j < nv; j++) {
+    double d = A[j*nv+j];
+    for (int k = 0; k < j; k++) d -= A[j*nv+k] * A[j*nv+k];
+    if (d <= 0) return 0;
+    d = sqrt(d);
+    A[j*nv+j] = d;
+    for (int i = j+1; i < nv; i++) {
+      double s = A[i*nv+j];
+      for (int k = 0; k < j; k++) s -= A[i*nv+k] * A[j*nv+k];
+      A[i*nv+j] = s / d;
+    }
+    for (int i = 0; i < j; i++) A[i*nv+j] = 0;
+  }
+
+  // Return success
+  return 1;
+}
+
+
+
+static void
+SolveLowerBlock(const double *L, double *b)
+{
+  // Replace b with solution of L * x = b
+  for (int i = 0; i < nv; i++) {
+    double s = b[i];
+    for (int k = 0; k < i; k++) s -= L[i*nv+k] * b[k];
+    b[i] = s / L[i*nv+i];
+  }
+}
+
+
+
+static void
+SolveUpperBlock(const double *L, double *b)
+{
+  // Replace b with solution of LT * x = b
+  for (int i = nv-1; i >= 0; i--) {
+    double s = b[i];
+    for (int k = i+1; k < nv; k++) s -= L[k*nv+i] * b[k];
+    b[i] = s / L[i*nv+i];
+  }
+}
+
+
+
+static void
+SubtractProductTransposeBlock(double *C, const double *A, const double *B)
+{
+  // C -= A * BT
+  for (int i = 0; i < nv; i++) {
+    for (int j = 0; j < nv; j++) {
+      double s = 0;
+      for (int k = 0; k < nv; k++) s += A[i*nv+k] * B[j*nv+k];
+      C[i*nv+j] -= s;
+    }
+  }
+}
+
+
+
+static void
+MultiplyAddBlock(double *y, const double *A, const double *x)
+{
+  // y += A * x
+  for (int i = 0; i < nv; i++) {
+    double s = 0;
+    for (int k = 0; k < nv; k++) s += A[i*nv+k] * x[k];
+    y[i] += s;
+  }
+}
+
+
+
+static void
+MultiplyTransposeAddBlock(double *y, const double *A, const double *x)
+{
+  // y += AT * x
+  for (int k = 0; k < nv; k++) {
+    double xk = x[k];
+    if (xk == 0) continue;
+    for (int i = 0; i < nv; i++) y[i] += A[k*nv+i] * xk;
+  }
+}
+
+
+
+static void
+MultiplySubtractBlock(double *y, const double *A, const double *x)
+{
+  // y -= A * x
+  for (int i = 0; i < nv; i++) {
+    double s = 0;
+    for (int k = 0; k < nv; k++) s += A[i*nv+k] * x[k];
+    y[i] -= s;
+  }
+}
+
+
+
+static void
+MultiplyTransposeSubtractBlock(double *y, const double *A, const double *x)
+{
+  // y -= AT * x
+  for (int k = 0; k < nv; k++) {
+    double xk = x[k];
+    if (xk == 0) continue;
+    for (int i = 0; i < nv; i++) y[i] -= A[k*nv+i] * xk;
+  }
+}
+
+
+
+static void
+AddOuterProduct(double *C, const double *a, const double *b)
+{
+  // C += a * bT
+  for (int i = 0; i < nv; i++) {
+    double ai = a[i];
+    if (ai == 0) continue;
+    for (int j = 0; j < nv; j++) C[i*nv+j] += ai * b[j];
+  }
+}
+
+
+
+static void
+AddScaledVector(double *y, const double *a, double s)
+{
+  // y += a * s
+  if (s == 0) return;
+  for (int i = 0; i < nv; i++) y[i] += a[i] * s;
+}
+
+
+
+////////////////////////////////////////////////////////////////////////
+// Residual linearization
+////////////////////////////////////////////////////////////////////////
+
+static void
+ComputePointJacobian(const double *p, const double *c, double (*J)[FET_NUM_VARIABLES])
+{
+  // Derivatives of c + S * R * (p - c) + t at identity
+  double dx = p[0] - c[0], dy = p[1] - c[1], dz = p[2] - c[2];
+  for (int i = 0; i < 3; i++) for (int j = 0; j < nv; j++) J[i][j] = 0;
+  J[0][FET_TX] = 1;  J[0][FET_RY] = dz;  J[0][FET_RZ] = -dy; J[0][FET_SX] = dx;
+  J[1][FET_TY] = 1;  J[1][FET_RX] = -dz; J[1][FET_RZ] = dx;  J[1][FET_SY] = dy;
+  J[2][FET_TZ] = 1;  J[2][FET_RX] = dy;  J[2][FET_RY] = -dx; J[2][FET_SZ] = dz;
+}
+
+
+
+static void
+ComputeVectorJacobian(const double *v, double (*J)[FET_NUM_VARIABLES])
+{
+  // Derivatives of R * v at identity
+  for (int i = 0; i < 3; i++) for (int j = 0; j < nv; j++) J[i][j] = 0;
+  J[0][FET_RY] = v[2];  J[0][FET_RZ] = -v[1];
+  J[1][FET_RX] = -v[2]; J[1][FET_RZ] = v[0];
+  J[2][FET_RX] = v[1];  J[2][FET_RY] = -v[0];
+}
+
+
+
+static void
+ProjectJacobian(const double *v, double (*J)[FET_NUM_VARIABLES], double *result, double scale)
+{
+  // result += scale * vT * J
+  for (int j = 0; j < nv; j++) {
+    result[j] += scale * (v[0]*J[0][j] + v[1]*J[1][j] + v[2]*J[2][j]);
+  }
+}
+
+
+
+static int
+LinearizeResidual(const FETPoseGraphResidual *residual, const double *centers,
+  double *r, double (*J1)[FET_NUM_VARIABLES], double (*J2)[FET_NUM_VARIABLES])
+{
+  // Get convenient variables
+  const double *c1 = &centers[3*residual->shapes[0]];
+  const double *c2 = &centers[3*residual->shapes[1]];
+  const double w = residual->w;
+  double JA[3][FET_NUM_VARIABLES], JB[3][FET_NUM_VARIABLES];
+
+  // Compute residuals and jacobians with respect to variables of both shapes
+  switch (residual->type) {
+  case FET_POINT_POINT_RESIDUAL: {
+    // w * (p2 - p1)
+    ComputePointJacobian(residual->a, c1, J1);
+    ComputePointJacobian(residual->b, c2, J2);
+    for (int i = 0; i < 3; i++) {
+      r[i] = w * (residual->b[i] - residual->a[i]);
+      for (int j = 0; j < nv; j++) { J1[i][j] *= -w; J2[i][j] *= w; }
+    }
+    return 3; }
+
+  case FET_POINT_PLANE_RESIDUAL: {
+    // w * (p1 - p2) . n2
+    const double *n2 = residual->c;
+    double d[3] = { residual->a[0] - residual->b[0], residual->a[1] - residual->b[1], residual->a[2] - residual->b[2] };
+    r[0] = w * (d[0]*n2[0] + d[1]*n2[1] + d[2]*n2[2]);
+    for (int j = 0; j < nv; j++) { J1[0][j] = 0; J2[0][j] = 0; }
+    ComputePointJacobian(residual->a, c1, JA);
+    ProjectJacobian(n2, JA, J1[0], w);
+    ComputePointJacobian(residual->b, c2, JA);
+    ProjectJacobian(n2, JA, J2[0], -w);
+    ComputeVectorJacobian(n2, JB);
+    ProjectJacobian(d, JB, J2[0], w);
+    return 1; }
+
+  case FET_PARALLEL_VECTOR_RESIDUAL: {
+    // w * (v2 - v1)
+    ComputeVectorJacobian(residual->a, J1);
+    ComputeVectorJacobian(residual->b, J2);
+    for (int i = 0; i < 3; i++) {
+      r[i] = w * (residual->b[i] - residual->a[i]);
+      for (int j = 0; j < nv; j++) { J1[i][j] *= -w; J2[i][j] *= w; }
+    }
+    return 3; }
+
+  case FET_PERPENDICULAR_VECTOR_RESIDUAL: {
+    // w * (v1 . v2)
+    const double *v1 = residual->a, *v2 = residual->b;
+    r[0] = w * (v1[0]*v2[0] + v1[1]*v2[1] + v1[2]*v2[2]);
+    for (int j = 0; j < nv; j++) { J1[0][j] = 0; J2[0][j] = 0; }
+    ComputeVectorJacobian(v1, JA);
+    ProjectJacobian(v2, JA, J1[0], w);
+    ComputeVectorJacobian(v2, JB);
+    ProjectJacobian(v1, JB, J2[0], w);
+    return 1; }
+
+  case FET_INERTIA_RESIDUAL: {
+    // w * x[variable]
+    r[0] = 0;
+    for (int j = 0; j < nv; j++) { J1[0][j] = 0; J2[0][j] = 0; }
+    J1[0][residual->variable] = w;
+    return 1; }
+  }
+
+  // Should not get here
+  return 0;
+}
+
+
+
+////////////////////////////////////////////////////////////////////////
+// Constructors
+////////////////////////////////////////////////////////////////////////
+
+FETPoseGraph::
+FETPoseGraph(void)
+  : nshapes(0),
+    centers(NULL),
+    free_variables(NULL),
+    residuals(NULL),
+    nresiduals(0),
+    nallocated_residuals(0),
+    group_residuals(NULL),
+    group_starts(NULL),
+    group_shapes(NULL),
+    ngroups(0),
+    row_starts(NULL),
+    row_columns(NULL),
+    lower_starts(NULL),
+    lower_rows(NULL),
+    lower_blocks(NULL),
+    nblocks(0),
+    diagonal_blocks(NULL),
+    offdiagonal_blocks(NULL),
+    gradient(NULL),
+    factor_row_starts(NULL),
+    factor_row_columns(NULL),
+    factor_column_starts(NULL),
+    factor_column_rows(NULL),
+    factor_column_blocks(NULL),
+    factor_blocks(NULL),
+    factor_diagonal_blocks(NULL),
+    nfactor_blocks(0),
+    symbolic_factorization_is_valid(FALSE)
+{
+}
+
+
+
+FETPoseGraph::
+~FETPoseGraph(void)
+{
+  // Delete shapes and residuals
+  if (centers) delete [] centers;
+  if (free_variables) delete [] free_variables;
+  if (residuals) delete [] residuals;
+  if (group_residuals) delete [] group_residuals;
+  if (group_starts) delete [] group_starts;
+  if (group_shapes) delete [] group_shapes;
+
+  // Delete pattern and normal equations
+  if (row_starts) delete [] row_starts;
+  if (row_columns) delete [] row_columns;
+  if (lower_starts) delete [] lower_starts;
+  if (lower_rows) delete [] lower_rows;
+  if (lower_blocks) delete [] lower_blocks;
+  if (diagonal_blocks) delete [] diagonal_blocks;
+  if (offdiagonal_blocks) delete [] offdiagonal_blocks;
+  if (gradient) delete [] gradient;
+
+  // Delete factorization
+  if (factor_row_starts) delete [] factor_row_starts;
+  if (factor_row_columns) delete [] factor_row_columns;
+  if (factor_column_starts) delete [] factor_column_starts;
+  if (factor_column_rows) delete [] factor_column_rows;
+  if (factor_column_blocks) delete [] factor_column_blocks;
+  if (factor_blocks) delete [] factor_blocks;
+  if (factor_diagonal_blocks) delete [] factor_diagonal_blocks;
+}
+
+
+
+////////////////////////////////////////////////////////////////////////
+// Shape and residual manipulation
+////////////////////////////////////////////////////////////////////////
+
+void FETPoseGraph::
+Reset(int nshapes)
+{
+  // Empty residuals (keep pattern and symbolic factorization for reuse)
+  nresiduals = 0;
+
+  // Check number of shapes
+  if (nshapes == this->nshapes) return;
+
+  // Reallocate shapes
+  if (centers) delete [] centers;
+  if (free_variables) delete [] free_variables;
+  this->nshapes = nshapes;
+  centers = new double [ 3 * nshapes ];
+  free_variables = new RNBoolean [ nv * nshapes ];
+  for (int i = 0; i < 3 * nshapes; i++) centers[i] = 0;
+  for (int i = 0; i < nv * nshapes; i++) free_variables[i] = TRUE;
+
+  // Invalidate pattern
+  if (row_starts) delete [] row_starts;
+  row_starts = NULL;
+  symbolic_factorization_is_valid = FALSE;
+}
+
+
+
+void FETPoseGraph::
+SetShape(int shape_index, const R3Point& center, const RNBoolean *variable_is_free)
+{
+  // Set center of rotation and scale
+  assert((shape_index >= 0) && (shape_index < nshapes));
+  centers[3*shape_index+0] = center.X();
+  centers[3*shape_index+1] = center.Y();
+  centers[3*shape_index+2] = center.Z();
+
+  // Set which variables are free
+  for (int i = 0; i < nv; i++) {
+    free_variables[nv*shape_index+i] = (variable_is_free) ? variable_is_free[i] : TRUE;
+  }
+}
+
+
+
+FETPoseGraphResidual *FETPoseGraph::
+InsertResidual(void)
+{
+  // Grow array of residuals
+  if (nresiduals == nallocated_residuals) {
+    int n = (nallocated_residuals > 0) ? 2 * nallocated_residuals : 1024;
+    FETPoseGraphResidual *r = new FETPoseGraphResidual [ n ];
+    if (residuals) {
+      memcpy(r, residuals, nresiduals * sizeof(FETPoseGraphResidual));
+      delete [] residuals;
+    }
+    residuals = r;
+    nallocated_residuals = n;
+  }
+
+  // Return next residual
+  return &residuals[nresiduals++];
+}
+
+
+
+void FETPoseGraph::
+InsertPointPointResidual(int shape_index1, int shape_index2,
+  const R3Point& position1, const R3Point& position2, RNScalar w)
+{
+  // Insert residual w * (position2 - position1)
+  if (w <= 0) return;
+  FETPoseGraphResidual *residual = InsertResidual();
+  residual->type = FET_POINT_POINT_RESIDUAL;
+  residual->shapes[0] = shape_index1;
+  residual->shapes[1] = shape_index2;
+  residual->variable = -1;
+  for (int i = 0; i < 3; i++) {
+    residual->a[i] = position1[i];
+    residual->b[i] = position2[i];
+    residual->c[i] = 0;
+  }
+  residual->w = w;
+}
+
+
+
+void FETPoseGraph::
+InsertPointPlaneResidual(int shape_index1, int shape_index2,
+  const R3Point& position1, const R3Point& position2, const R3Vector& normal2, RNScalar w)
+{
+  // Insert residual w * (position1 - position2) . normal2
+  if (w <= 0) return;
+  FETPoseGraphResidual *residual = InsertResidual();
+  residual->type = FET_POINT_PLANE_RESIDUAL;
+  residual->shapes[0] = shape_index1;
+  residual->shapes[1] = shape_index2;
+  residual->variable = -1;
+  for (int i = 0; i < 3; i++) {
+    residual->a[i] = position1[i];
+    residual->b[i] = position2[i];
+    residual->c[i] = normal2[i];
+  }
+  residual->w = w;
+}
+
+
+
+void FETPoseGraph::
+InsertParallelVectorResidual(int shape_index1, int shape_index2,
+  const R3Vector& vector1, const R3Vector& vector2, RNScalar w)
+{
+  // Insert residual w * (vector2 - vector1)
+  if (w <= 0) return;
+  FETPoseGraphResidual *residual = InsertResidual();
+  residual->type = FET_PARALLEL_VECTOR_RESIDUAL;
+  residual->shapes[0] = shape_index1;
+  residual->shapes[1] = shape_index2;
+  residual->variable = -1;
+  for (int i = 0; i < 3; i++) {
+    residual->a[i] = vector1[i];
+    residual->b[i] = vector2[i];
+    residual->c[i] = 0;
+  }
+  residual->w = w;
+}
+
+
+
+void FETPoseGraph::
+InsertPerpendicularVectorResidual(int shape_index1, int shape_index2,
+  const R3Vector& vector1, const R3Vector& vector2, RNScalar w)
+{
+  // Insert residual w * (vector1 . vector2)
+  if (w <= 0) return;
+  FETPoseGraphResidual *residual = InsertResidual();
+  residual->type = FET_PERPENDICULAR_VECTOR_RESIDUAL;
+  residual->shapes[0] = shape_index1;
+  residual->shapes[1] = shape_index2;
+  residual->variable = -1;
+  for (int i = 0; i < 3; i++) {
+    residual->a[i] = vector1[i];
+    residual->b[i] = vector2[i];
+    residual->c[i] = 0;
+  }
+  residual->w = w;
+}
+
+
+
+void FETPoseGraph::
+InsertInertiaResidual(int shape_index, int variable, RNScalar w)
+{
+  // Insert residual w * x[variable]
+  if (w <= 0) return;
+  assert((variable >= 0) && (variable < nv));
+  FETPoseGraphResidual *residual = InsertResidual();
+  residual->type = FET_INERTIA_RESIDUAL;
+  residual->shapes[0] = shape_index;
+  residual->shapes[1] = shape_index;
+  residual->variable = variable;
+  for (int i = 0; i < 3; i++) {
+    residual->a[i] = 0;
+    residual->b[i] = 0;
+    residual->c[i] = 0;
+  }
+  residual->w = w;
+}
+
+
+
+////////////////////////////////////////////////////////////////////////
+// Pattern and assembly functions
+////////////////////////////////////////////////////////////////////////
+
+static int
+CompareSortEntries(const void *data1, const void *data2)
+{
+  // Sort by shape pair, then by residual index
+  const FETPoseGraphSortEntry *entry1 = (const FETPoseGraphSortEntry *) data1;
+  const FETPoseGraphSortEntry *entry2 = (const FETPoseGraphSortEntry *) data2;
+  if (entry1->shapes[0] != entry2->shapes[0]) return (entry1->shapes[0] < entry2->shapes[0]) ? -1 : 1;
+  if (entry1->shapes[1] != entry2->shapes[1]) return (entry1->shapes[1] < entry2->shapes[1]) ? -1 : 1;
+  if (entry1->residual_index != entry2->residual_index) return (entry1->residual_index < entry2->residual_index) ? -1 : 1;
+  return 0;
+}
+
+
+
+int FETPoseGraph::
+UpdatePattern(void)
+{
+  // Sort residuals by shape pair (smaller shape index first)
+  FETPoseGraphSortEntry *entries = new FETPoseGraphSortEntry [ nresiduals ];
+  for (int i = 0; i < nresiduals; i++) {
+    const FETPoseGraphResidual *residual = &residuals[i];
+    int shape_index1 = residual->shapes[0];
+    int shape_index2 = residual->shapes[1];
+    if ((shape_index1 < 0) || (shape_index1 >= nshapes) || (shape_index2 < 0) || (shape_index2 >= nshapes)) {
+      fprintf(stderr, "Invalid shape index in pose graph residual\n");
+      delete [] entries;
+      return 0;
+    }
+    entries[i].shapes[0] = (shape_index1 < shape_index2) ? shape_index1 : shape_index2;
+    entries[i].shapes[1] = (shape_index1 < shape_index2) ? shape_index2 : shape_index1;
+    entries[i].residual_index = i;
+  }
+  qsort(entries, nresiduals, sizeof(FETPoseGraphSortEntry), CompareSortEntries);
+
+  // Group residuals by shape pair
+  if (group_residuals) delete [] group_residuals;
+  if (group_starts) delete [] group_starts;
+  if (group_shapes) delete [] group_shapes;
+  group_residuals = new int [ nresiduals + 1 ];
+  group_starts = new int [ nresiduals + 1 ];
+  group_shapes = new int [ 2 * nresiduals + 2 ];
+  ngroups = 0;
+  for (int i = 0; i < nresiduals; i++) {
+    group_residuals[i] = entries[i].residual_index;
+    if ((i == 0) || (entries[i].shapes[0] != entries[i-1].shapes[0]) || (entries[i].shapes[1] != entries[i-1].shapes[1])) {
+      group_starts[ngroups] = i;
+      group_shapes[2*ngroups+0] = entries[i].shapes[0];
+      group_shapes[2*ngroups+1] = entries[i].shapes[1];
+      ngroups++;
+    }
+  }
+  group_starts[ngroups] = nresiduals;
+  delete [] entries;
+
+  // Compute block pattern of upper triangle
+  int *new_row_starts = new int [ nshapes + 1 ];
+  int *new_row_columns = new int [ ngroups + 1 ];
+  int new_nblocks = 0;
+  int g = 0;
+  for (int i = 0; i < nshapes; i++) {
+    new_row_starts[i] = new_nblocks;
+    while ((g < ngroups) && (group_shapes[2*g+0] == i)) {
+      if (group_shapes[2*g+1] != i) new_row_columns[new_nblocks++] = group_shapes[2*g+1];
+      g++;
+    }
+  }
+  new_row_starts[nshapes] = new_nblocks;
+
+  // Check if pattern is the same as before
+  RNBoolean same_pattern = (row_starts && (new_nblocks == nblocks));
+  for (int i = 0; same_pattern && (i <= nshapes); i++) {
+    if (new_row_starts[i] != row_starts[i]) same_pattern = FALSE;
+  }
+  for (int i = 0; same_pattern && (i < nblocks); i++) {
+    if (new_row_columns[i] != row_columns[i]) same_pattern = FALSE;
+  }
+
+  // Keep previous pattern if same
+  if (same_pattern) {
+    delete [] new_row_starts;
+    delete [] new_row_columns;
+    return 1;
+  }
+
+  // Replace pattern
+  if (row_starts) delete [] row_starts;
+  if (row_columns) delete [] row_columns;
+  row_starts = new_row_starts;
+  row_columns = new_row_columns;
+  nblocks = new_nblocks;
+
+  // Compute transposed pattern (lower triangle, by row)
+  if (lower_starts) delete [] lower_starts;
+  if (lower_rows) delete [] lower_rows;
+  if (lower_blocks) delete [] lower_blocks;
+  lower_starts = new int [ nshapes + 1 ];
+  lower_rows = new int [ nblocks + 1 ];
+  lower_blocks = new int [ nblocks + 1 ];
+  for (int i = 0; i <= nshapes; i++) lower_starts[i] = 0;
+  for (int b = 0; b < nblocks; b++) lower_starts[row_columns[b]+1]++;
+  for (int i = 0; i < nshapes; i++) lower_starts[i+1] += lower_starts[i];
+  int *counts = new int [ nshapes ];
+  for (int i = 0; i < nshapes; i++) counts[i] = lower_starts[i];
+  for (int i = 0; i < nshapes; i++) {
+    for (int b = row_starts[i]; b < row_starts[i+1]; b++) {
+      int k = counts[row_columns[b]]++;
+      lower_rows[k] = i;
+      lower_blocks[k] = b;
+    }
+  }
+  delete [] counts;
+
+  // Reallocate normal equations
+  if (diagonal_blocks) delete [] diagonal_blocks;
+  if (offdiagonal_blocks) delete [] offdiagonal_blocks;
+  if (gradient) delete [] gradient;
+  diagonal_blocks = new double [ nvnv * nshapes ];
+  offdiagonal_blocks = new double [ nvnv * nblocks + 1 ];
+  gradient = new double [ nv * nshapes ];
+
+  // Invalidate symbolic factorization
+  symbolic_factorization_is_valid = FALSE;
+
+  // Return success
+  return 1;
+}
+
+
+
+void FETPoseGraph::
+AssembleNormalEquations(void)
+{
+  // Initialize normal equations
+  for (int i = 0; i < nvnv * nshapes; i++) diagonal_blocks[i] = 0;
+  for (int i = 0; i < nvnv * nblocks; i++) offdiagonal_blocks[i] = 0;
+  for (int i = 0; i < nv * nshapes; i++) gradient[i] = 0;
+
+  // Find first group of every row, and offdiagonal block of every group
+  int *row_groups = new int [ nshapes + 1 ];
+  int *group_blocks = new int [ ngroups + 1 ];
+  int g = 0, b = 0;
+  for (int i = 0; i < nshapes; i++) {
+    row_groups[i] = g;
+    while ((g < ngroups) && (group_shapes[2*g+0] == i)) {
+      group_blocks[g] = (group_shapes[2*g+1] != i) ? b++ : -1;
+      g++;
+    }
+  }
+  row_groups[nshapes] = ngroups;
+
+  // Allocate contributions of groups to diagonal blocks of their second shapes
+  double *side_blocks = new double [ (nvnv + nv) * ngroups + 1 ];
+
+  // Accumulate contributions of residuals (every row is handled by one thread)
+#pragma omp parallel for schedule(dynamic, 16)
+  for (int i = 0; i < nshapes; i++) {
+    double *Hii = &diagonal_blocks[nvnv*i];
+    double *gi = &gradient[nv*i];
+    for (int g = row_groups[i]; g < row_groups[i+1]; g++) {
+      int j = group_shapes[2*g+1];
+      double *Hij = (group_blocks[g] >= 0) ? &offdiagonal_blocks[nvnv*group_blocks[g]] : NULL;
+      double *Hjj = &side_blocks[(nvnv + nv)*g];
+      double *gj = Hjj + nvnv;
+      for (int k = 0; k < nvnv + nv; k++) Hjj[k] = 0;
+      const RNBoolean *free_i = &free_variables[nv*i];
+      const RNBoolean *free_j = &free_variables[nv*j];
+      for (int k = group_starts[g]; k < group_starts[g+1]; k++) {
+        const FETPoseGraphResidual *residual = &residuals[group_residuals[k]];
+
+        // Linearize residual
+        double r[3], J1[3][FET_NUM_VARIABLES], J2[3][FET_NUM_VARIABLES];
+        int nrows = LinearizeResidual(residual, centers, r, J1, J2);
+
+        // Accumulate rows
+        for (int m = 0; m < nrows; m++) {
+          // Get jacobians with respect to variables of shapes i and j
+          double Ji[FET_NUM_VARIABLES], Jj[FET_NUM_VARIABLES];
+          const double *Ja = (residual->shapes[0] == i) ? J1[m] : J2[m];
+          const double *Jb = (residual->shapes[0] == i) ? J2[m] : J1[m];
+          if (j == i) { for (int v = 0; v < nv; v++) { Ji[v] = (free_i[v]) ? Ja[v] + Jb[v] : 0; Jj[v] = 0; } }
+          else { for (int v = 0; v < nv; v++) { Ji[v] = (free_i[v]) ? Ja[v] : 0; Jj[v] = (free_j[v]) ? Jb[v] : 0; } }
+
+          // Add to normal equations
+          AddOuterProduct(Hii, Ji, Ji);
+          AddScaledVector(gi, Ji, r[m]);
+          if (j != i) {
+            AddOuterProduct(Hij, Ji, Jj);
+            AddOuterProduct(Hjj, Jj, Jj);
+            AddScaledVector(gj, Jj, r[m]);
+          }
+        }
+      }
+    }
+  }
+
+  // Add contributions of groups to diagonal blocks of their second shapes
+  for (int g = 0; g < ngroups; g++) {
+    int j = group_shapes[2*g+1];
+    if (j == group_shapes[2*g+0]) continue;
+    const double *Hjj = &side_blocks[(nvnv + nv)*g];
+    const double *gj = Hjj + nvnv;
+    for (int k = 0; k < nvnv; k++) diagonal_blocks[nvnv*j+k] += Hjj[k];
+    for (int k = 0; k < nv; k++) gradient[nv*j+k] += gj[k];
+  }
+
+  // Fix variables that are not free, and regularize others slightly
+  double max_diagonal = 0;
+  for (int i = 0; i < nv * nshapes; i++) {
+    double d = diagonal_blocks[nvnv*(i/nv) + (i%nv)*(nv+1)];
+    if (d > max_diagonal) max_diagonal = d;
+  }
+  double ridge = 1E-12 * max_diagonal + 1E-300;
+  for (int i = 0; i < nshapes; i++) {
+    double *Hii = &diagonal_blocks[nvnv*i];
+    for (int v = 0; v < nv; v++) {
+      if (free_variables[nv*i+v]) Hii[v*nv+v] += ridge;
+      else { Hii[v*nv+v] = 1; gradient[nv*i+v] = 0; }
+    }
+  }
+
+  // Delete temporary data
+  delete [] side_blocks;
+  delete [] row_groups;
+  delete [] group_blocks;
+}
+
+
+
+////////////////////////////////////////////////////////////////////////
+// Cholesky factorization
+////////////////////////////////////////////////////////////////////////
+
+int FETPoseGraph::
+UpdateSymbolicFactorization(void)
+{
+  // Check if already uptodate
+  if (symbolic_factorization_is_valid) return 1;
+
+  // Delete previous factorization
+  if (factor_row_starts) delete [] factor_row_starts;
+  if (factor_row_columns) delete [] factor_row_columns;
+  if (factor_column_starts) delete [] factor_column_starts;
+  if (factor_column_rows) delete [] factor_column_rows;
+  if (factor_column_blocks) delete [] factor_column_blocks;
+  if (factor_blocks) delete [] factor_blocks;
+  if (factor_diagonal_blocks) delete [] factor_diagonal_blocks;
+  factor_row_starts = NULL;
+  factor_row_columns = NULL;
+  factor_column_starts = NULL;
+  factor_column_rows = NULL;
+  factor_column_blocks = NULL;
+  factor_blocks = NULL;
+  factor_diagonal_blocks = NULL;
+  nfactor_blocks = 0;
+
+  // Compute elimination tree (rows of lower triangle are columns of upper triangle)
+  int *parent = new int [ nshapes ];
+  int *ancestor = new int [ nshapes ];
+  for (int j = 0; j < nshapes; j++) {
+    parent[j] = -1;
+    ancestor[j] = -1;
+    for (int k = lower_starts[j]; k < lower_starts[j+1]; k++) {
+      int r = lower_rows[k];
+      while ((r != -1) && (r != j)) {
+        int next = ancestor[r];
+        ancestor[r] = j;
+        if (next == -1) { parent[r] = j; break; }
+        r = next;
+      }
+    }
+  }
+
+  // Count blocks in every row of factor
+  int *marks = ancestor;
+  for (int j = 0; j < nshapes; j++) marks[j] = -1;
+  factor_row_starts = new int [ nshapes + 1 ];
+  factor_row_starts[0] = 0;
+  RNScalar max_factor_blocks = max_fill_factor * (nblocks + nshapes);
+  RNBoolean too_much_fill = FALSE;
+  for (int j = 0; j < nshapes; j++) {
+    int count = 0;
+    marks[j] = j;
+    for (int k = lower_starts[j]; k < lower_starts[j+1]; k++) {
+      for (int r = lower_rows[k]; marks[r] != j; r = parent[r]) { marks[r] = j; count++; }
+    }
+    factor_row_starts[j+1] = factor_row_starts[j] + count;
+    if (factor_row_starts[j+1] > max_factor_blocks) { too_much_fill = TRUE; break; }
+  }
+
+  // Check fill (use conjugate gradients if factor would be much bigger than matrix)
+  if (too_much_fill) {
+    delete [] factor_row_starts;
+    factor_row_starts = NULL;
+    delete [] parent;
+    delete [] ancestor;
+    nfactor_blocks = -1;
+    symbolic_factorization_is_valid = TRUE;
+    return 1;
+  }
+
+  // Fill sorted rows of factor
+  nfactor_blocks = factor_row_starts[nshapes];
+  factor_row_columns = new int [ nfactor_blocks + 1 ];
+  for (int j = 0; j < nshapes; j++) marks[j] = -1;
+  for (int j = 0; j < nshapes; j++) {
+    int *columns = &factor_row_columns[factor_row_starts[j]];
+    int count = 0;
+    marks[j] = j;
+    for (int k = lower_starts[j]; k < lower_starts[j+1]; k++) {
+      for (int r = lower_rows[k]; marks[r] != j; r = parent[r]) { marks[r] = j; columns[count++] = r; }
+    }
+    qsort(columns, count, sizeof(int), RNCompareInts);
+  }
+
+  // Compute columns of factor
+  factor_column_starts = new int [ nshapes + 1 ];
+  factor_column_rows = new int [ nfactor_blocks + 1 ];
+  factor_column_blocks = new int [ nfactor_blocks + 1 ];
+  for (int j = 0; j <= nshapes; j++) factor_column_starts[j] = 0;
+  for (int b = 0; b < nfactor_blocks; b++) factor_column_starts[factor_row_columns[b]+1]++;
+  for (int j = 0; j < nshapes; j++) factor_column_starts[j+1] += factor_column_starts[j];
+  int *counts = parent;
+  for (int j = 0; j < nshapes; j++) counts[j] = factor_column_starts[j];
+  for (int i = 0; i < nshapes; i++) {
+    for (int b = factor_row_starts[i]; b < factor_row_starts[i+1]; b++) {
+      int k = counts[factor_row_columns[b]]++;
+      factor_column_rows[k] = i;
+      factor_column_blocks[k] = b;
+    }
+  }
+
+  // Allocate numeric factor
+  factor_blocks = new double [ nvnv * nfactor_blocks + 1 ];
+  factor_diagonal_blocks = new double [ nvnv * nshapes ];
+
+  // Delete temporary data
+  delete [] parent;
+  delete [] ancestor;
+
+  // Return success
+  symbolic_factorization_is_valid = TRUE;
+  return 1;
+}
+
+
+
+int FETPoseGraph::
+SolveWithCholesky(RNScalar *x)
+{
+  // Factor columns from left to right
+  int status = 1;
+  for (int j = 0; j < nshapes; j++) {
+    // Compute diagonal block
+    double *Ljj = &factor_diagonal_blocks[nvnv*j];
+    for (int k = 0; k < nvnv; k++) Ljj[k] = diagonal_blocks[nvnv*j+k];
+    for (int b = factor_row_starts[j]; b < factor_row_starts[j+1]; b++) {
+      const double *Ljk = &factor_blocks[nvnv*b];
+      SubtractProductTransposeBlock(Ljj, Ljk, Ljk);
+    }
+    if (!FactorBlock(Ljj)) { status = 0; break; }
+
+    // Compute blocks below diagonal (rows are independent)
+    int column_start = factor_column_starts[j];
+    int column_end = factor_column_starts[j+1];
+#pragma omp parallel for schedule(dynamic, 4)
+    for (int c = column_start; c < column_end; c++) {
+      int i = factor_column_rows[c];
+      double *Lij = &factor_blocks[nvnv*factor_column_blocks[c]];
+
+      // Initialize with block of matrix (transpose of upper block in row j)
+      for (int k = 0; k < nvnv; k++) Lij[k] = 0;
+      int *columns = &row_columns[row_starts[j]];
+      int ncolumns = row_starts[j+1] - row_starts[j];
+      int *found = (int *) bsearch(&i, columns, ncolumns, sizeof(int), RNCompareInts);
+      if (found) {
+        const double *Hji = &offdiagonal_blocks[nvnv*(row_starts[j] + (found - columns))];
+        for (int r = 0; r < nv; r++) for (int s = 0; s < nv; s++) Lij[r*nv+s] = Hji[s*nv+r];
+      }
+
+      // Subtract products of blocks in columns to the left (merge sorted rows i and j)
+      int bi = factor_row_starts[i], ei = factor_row_starts[i+1];
+      int bj = factor_row_starts[j], ej = factor_row_starts[j+1];
+      while ((bi < ei) && (bj < ej)) {
+        int ki = factor_row_columns[bi];
+        int kj = factor_row_columns[bj];
+        if (ki >= j) break;
+        if (ki < kj) bi++;
+        else if (kj < ki) bj++;
+        else { SubtractProductTransposeBlock(Lij, &factor_blocks[nvnv*bi], &factor_blocks[nvnv*bj]); bi++; bj++; }
+      }
+
+      // Multiply by inverse transpose of diagonal block
+      for (int r = 0; r < nv; r++) SolveLowerBlock(Ljj, &Lij[r*nv]);
+    }
+  }
+
+  // Check status
+  if (!status) {
+    fprintf(stderr, "Pose graph matrix is not positive definite\n");
+    return 0;
+  }
+
+  // Solve L * y = -g
+  for (int i = 0; i < nshapes; i++) {
+    double *yi = &x[nv*i];
+    for (int v = 0; v < nv; v++) yi[v] = -gradient[nv*i+v];
+    for (int b = factor_row_starts[i]; b < factor_row_starts[i+1]; b++) {
+      MultiplySubtractBlock(yi, &factor_blocks[nvnv*b], &x[nv*factor_row_columns[b]]);
+    }
+    SolveLowerBlock(&factor_diagonal_blocks[nvnv*i], yi);
+  }
+
+  // Solve LT * x = y
+  for (int i = nshapes-1; i >= 0; i--) {
+    double *xi = &x[nv*i];
+    for (int c = factor_column_starts[i]; c < factor_column_starts[i+1]; c++) {
+      MultiplyTransposeSubtractBlock(xi, &factor_blocks[nvnv*factor_column_blocks[c]], &x[nv*factor_column_rows[c]]);
+    }
+    SolveUpperBlock(&factor_diagonal_blocks[nvnv*i], xi);
+  }
+
+  // Return success
+  return 1;
+}
+
+
+
+////////////////////////////////////////////////////////////////////////
+// Conjugate gradients
+////////////////////////////////////////////////////////////////////////
+
+int FETPoseGraph::
+SolveWithConjugateGradients(RNScalar *x)
+{
+  // Allocate vectors
+  int n = nv * nshapes;
+  double *r = new double [ n ];
+  double *z = new double [ n ];
+  double *p = new double [ n ];
+  double *q = new double [ n ];
+
+  // Factor diagonal blocks for block Jacobi preconditioner
+  double *preconditioner = new double [ nvnv * nshapes ];
+  int status = 1;
+  for (int i = 0; i < nshapes; i++) {
+    for (int k = 0; k < nvnv; k++) preconditioner[nvnv*i+k] = diagonal_blocks[nvnv*i+k];
+    if (!FactorBlock(&preconditioner[nvnv*i])) status = 0;
+  }
+  if (!status) {
+    fprintf(stderr, "Pose graph matrix is not positive definite\n");
+    delete [] preconditioner;
+    delete [] r; delete [] z; delete [] p; delete [] q;
+    return 0;
+  }
+
+  // Initialize x = 0, r = -g, z = M^-1 r, p = z
+  double rz = 0, bb = 0;
+  for (int i = 0; i < n; i++) { x[i] = 0; r[i] = -gradient[i]; z[i] = r[i]; bb += r[i] * r[i]; }
+  for (int i = 0; i < nshapes; i++) {
+    SolveLowerBlock(&preconditioner[nvnv*i], &z[nv*i]);
+    SolveUpperBlock(&preconditioner[nvnv*i], &z[nv*i]);
+  }
+  for (int i = 0; i < n; i++) { p[i] = z[i]; rz += r[i] * z[i]; }
+
+  // Iterate
+  double tolerance = conjugate_gradient_tolerance * conjugate_gradient_tolerance * bb;
+  for (int iteration = 0; iteration < max_conjugate_gradient_iterations; iteration++) {
+    // Check residual
+    double rr = 0;
+    for (int i = 0; i < n; i++) rr += r[i] * r[i];
+    if (rr <= tolerance) break;
+
+    // Compute q = H * p
+#pragma omp parallel for schedule(static)
+    for (int i = 0; i < nshapes; i++) {
+      double *qi = &q[nv*i];
+      for (int v = 0; v < nv; v++) qi[v] = 0;
+      MultiplyAddBlock(qi, &diagonal_blocks[nvnv*i], &p[nv*i]);
+      for (int b = row_starts[i]; b < row_starts[i+1]; b++) {
+        MultiplyAddBlock(qi, &offdiagonal_blocks[nvnv*b], &p[nv*row_columns[b]]);
+      }
+      for (int k = lower_starts[i]; k < lower_starts[i+1]; k++) {
+        MultiplyTransposeAddBlock(qi, &offdiagonal_blocks[nvnv*lower_blocks[k]], &p[nv*lower_rows[k]]);
+      }
+    }
+
+    // Update x and r
+    double pq = 0;
+    for (int i = 0; i < n; i++) pq += p[i] * q[i];
+    if (pq <= 0) break;
+    double alpha = rz / pq;
+    for (int i = 0; i < n; i++) { x[i] += alpha * p[i]; r[i] -= alpha * q[i]; }
+
+    // Update z and p
+    for (int i = 0; i < n; i++) z[i] = r[i];
+    for (int i = 0; i < nshapes; i++) {
+      SolveLowerBlock(&preconditioner[nvnv*i], &z[nv*i]);
+      SolveUpperBlock(&preconditioner[nvnv*i], &z[nv*i]);
+    }
+    double rz_next = 0;
+    for (int i = 0; i < n; i++) rz_next += r[i] * z[i];
+    double beta = rz_next / rz;
+    rz = rz_next;
+    for (int i = 0; i < n; i++) p[i] = z[i] + beta * p[i];
+  }
+
+  // Delete vectors
+  delete [] preconditioner;
+  delete [] r;
+  delete [] z;
+  delete [] p;
+  delete [] q;
+
+  // Return success
+  return 1;
+}
+
+
+
+////////////////////////////////////////////////////////////////////////
+// Solve function
+////////////////////////////////////////////////////////////////////////
+
+int FETPoseGraph::
+Solve(RNScalar *x)
+{
+  // Initialize result
+  for (int i = 0; i < nv * nshapes; i++) x[i] = 0;
+  if (nshapes == 0) return 1;
+
+  // Update block pattern (keeps symbolic factorization if unchanged)
+  if (!UpdatePattern()) return 0;
+
+  // Assemble normal equations
+  AssembleNormalEquations();
+
+  // Update symbolic factorization
+  if (!UpdateSymbolicFactorization()) return 0;
+
+  // Solve normal equations
+  double *solution = new double [ nv * nshapes ];
+  int status = (nfactor_blocks >= 0) ? SolveWithCholesky(solution) : SolveWithConjugateGradients(solution);
+  if (status) { for (int i = 0; i < nv * nshapes; i++) x[i] = solution[i]; }
+  delete [] solution;
+
+  // Return status
+  return status;
+}
@@ -0,0 +1,122 @@
+////////////////////////////////////////////////////////////////////////
+// Pose graph class definition
+////////////////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////////////////
+// NOTE:
+// A pose graph solves the same linearized least squares problem as the
+// system of equations built by FETReconstruction (one block of
+// FET_NUM_VARIABLES translation, rotation, and scale variables per
+// shape, linearized around the current transformations), without
+// building an RNAlgebraic tree per residual.  Residuals are stored as
+// fixed-size records in a flat array, their Jacobians are computed
+// analytically, and the normal equations are assembled into 9x9 blocks
+// in parallel.  The system is solved with a sparse block Cholesky
+// factorization, whose symbolic analysis is reused by later solves
+// with the same pattern of shape pairs (e.g., successive ICP
+// iterations), or with block-Jacobi preconditioned conjugate gradients
+// if the factorization would fill in too much.
+////////////////////////////////////////////////////////////////////////
+
+struct FETPoseGraph {
+public:
+  // Constructors
+  FETPoseGraph(void);
+  ~FETPoseGraph(void);
+
+  // Properties
+  int NShapes(void) const;
+  int NResiduals(void) const;
+
+  // Shape manipulation (center is the transformed origin of rotation and scale)
+  void Reset(int nshapes);
+  void SetShape(int shape_index, const R3Point& center, const RNBoolean *variable_is_free);
+
+  // Residual manipulation (all positions and vectors are in world coordinates)
+  void InsertPointPointResidual(int shape_index1, int shape_index2,
+    const R3Point& position1, const R3Point& position2, RNScalar w);
+  void InsertPointPlaneResidual(int shape_index1, int shape_index2,
+    const R3Point& position1, const R3Point& position2, const R3Vector& normal2, RNScalar w);
+  void InsertParallelVectorResidual(int shape_index1, int shape_index2,
+    const R3Vector& vector1, const R3Vector& vector2, RNScalar w);
+  void InsertPerpendicularVectorResidual(int shape_index1, int shape_index2,
+    const R3Vector& vector1, const R3Vector& vector2, RNScalar w);
+  void InsertInertiaResidual(int shape_index, int variable, RNScalar w);
+
+  // Solve for variables (x has FET_NUM_VARIABLES entries per shape)
+  int Solve(RNScalar *x);
+
+private:
+  struct FETPoseGraphResidual *InsertResidual(void);
+  int UpdatePattern(void);
+  int UpdateSymbolicFactorization(void);
+  void AssembleNormalEquations(void);
+  int SolveWithCholesky(RNScalar *x);
+  int SolveWithConjugateGradients(RNScalar *x);
+
+private:
+  // Shapes
+  int nshapes;
+  double *centers;
+  RNBoolean *free_variables;
+
+  // Residuals
+  struct FETPoseGraphResidual *residuals;
+  int nresiduals;
+  int nallocated_residuals;
+
+  // Residuals sorted into groups by shape pair
+  int *group_residuals;
+  int *group_starts;
+  int *group_shapes;
+  int ngroups;
+
+  // Block pattern of normal equations (upper triangle, by row)
+  int *row_starts;
+  int *row_columns;
+  int *lower_starts;
+  int *lower_rows;
+  int *lower_blocks;
+  int nblocks;
+
+  // Normal equations
+  double *diagonal_blocks;
+  double *offdiagonal_blocks;
+  double *gradient;
+
+  // Cholesky factorization (strictly lower blocks by row, plus diagonal blocks)
+  int *factor_row_starts;
+  int *factor_row_columns;
+  int *factor_column_starts;
+  int *factor_column_rows;
+  int *factor_column_blocks;
+  double *factor_blocks;
+  double *factor_diagonal_blocks;
+  int nfactor_blocks;
+  RNBoolean symbolic_factorization_is_valid;
+};
+
+
+
+////////////////////////////////////////////////////////////////////////
+// Inline functions
+////////////////////////////////////////////////////////////////////////
+
+inline int FETPoseGraph::
+NShapes(void) const
+{
+  // Return number of shapes
+  return nshapes;
+}
+
+
+
+inline int FETPoseGraph::
+NResiduals(void) const
+{
+  // Return number of residual blocks
+  return nresiduals;
+}
+
+
+
@@ -28,11 +28,13 @@ FETReconstruction(void)
     discard_boundaries(TRUE),
     discard_not_mutually_closest(FALSE),
     discard_outliers(TRUE),
+    random_seed(0),
     total_match_weight(0),
     total_trajectory_weight(0),
     total_inertia_weight(0),
-    solver(RN_CSPARSE_SOLVER),
-    bbox(FLT_MAX, FLT_MAX, FLT_MAX, -FLT_MAX, -FLT_MAX, -FLT_MAX)
+    solver(FET_POSE_GRAPH_SOLVER),
+    bbox(FLT_MAX, FLT_MAX, FLT_MAX, -FLT_MAX, -FLT_MAX, -FLT_MAX),
+    pose_graph(NULL)
 {
   // Initialize parameters
   InitializeFeatureParameters();
@@ -64,11 +66,13 @@ FETReconstruction(const FETReconstruction& reconstruction)
     discard_boundaries(reconstruction.discard_boundaries),
     discard_not_mutually_closest(reconstruction.discard_not_mutually_closest),
     discard_outliers(reconstruction.discard_outliers),
+    random_seed(reconstruction.random_seed),
     total_match_weight(reconstruction.total_match_weight),
     total_trajectory_weight(reconstruction.total_trajectory_weight),
     total_inertia_weight(reconstruction.total_inertia_weight),
     solver(reconstruction.solver),
-    bbox(reconstruction.bbox)
+    bbox(reconstruction.bbox),
+    pose_graph(NULL)
 {
   // Copy other stuff
   for (int i = 0; i < NUM_FEATURE_TYPES; i++) {
@@ -105,6 +109,9 @@ FETReconstruction::
     FETShape *shape = Shape(NShapes()-1);
     delete shape;
   }
+
+  // Delete optimization data
+  if (pose_graph) delete pose_graph;
 }
 
 
@@ -1218,6 +1225,9 @@ ReadFile(const char *filename)
   if (!strncmp(extension, ".fcb", 4)) {
     if (!ReadBinaryFile(filename)) return 0;
   }
+  else if (!strncmp(extension, ".fcm", 4)) {
+    if (!ReadColumnarFile(filename)) return 0;
+  }
   else {
     if (!ReadAsciiFile(filename)) return 0;
   }
@@ -1242,6 +1252,9 @@ WriteFile(const char *filename) const
   if (!strncmp(extension, ".fcb", 4)) {
     if (!WriteBinaryFile(filename)) return 0;
   }
+  else if (!strncmp(extension, ".fcm", 4)) {
+    if (!WriteColumnarFile(filename)) return 0;
+  }
   else {
     if (!WriteAsciiFile(filename)) return 0;
   }
@@ -1483,6 +1496,50 @@ WriteBinaryFile(const char *filename) const
 
 
 
+int FETReconstruction::
+ReadColumnarFile(const char *filename)
+{
+  // Check filename
+  if (!filename) return 0;
+
+  // Map file
+  FETColumnarFile file;
+  if (!file.Open(filename)) return 0;
+
+  // Read file contents
+  avg_feature_radius = file.AverageFeatureRadius();
+  if (!file.ReadReconstruction(this)) return 0;
+
+  // Update parameters
+  if (avg_feature_radius <= 0) InitializeFeatureParameters();
+  InitializeCorrespondenceParameters();
+  InitializeOptimizationParameters();
+
+  // Return success
+  return 1;
+}
+
+  
+
+int FETReconstruction::
+WriteColumnarFile(const char *filename) const
+{
+  // Check filename
+  if (!filename) return 0;
+
+  // Update parameters
+  FETReconstruction *tmp = (FETReconstruction *) this;
+  if (avg_feature_radius <= 0) tmp->InitializeFeatureParameters();
+
+  // Write file contents
+  if (!FETColumnarFile::WriteReconstruction(this, filename)) return 0;
+
+  // Return success
+  return 1;
+}
+
+
+
 int FETReconstruction::
 ReadBinary(FILE *fp)
 {
@@ -1637,48 +1694,154 @@ UpdateBBox(void)
 // Correspondence creation
 ////////////////////////////////////////////////////////////////////////
 
-void FETReconstruction::
-CreateCorrespondences(FETShape *shape1, FETShape *shape2, RNScalar num_correspondences)
+struct FETCorrespondencePair {
+  FETShape *shape1;
+  FETShape *shape2;
+  RNArray<FETFeature *> query_features2;
+  FETFeature **features1;
+  RNScalar *affinities;
+};
+
+
+
+static void
+InitializeQueryFeature(FETFeature& query, const FETFeature *feature,
+  const R3Affine& query_transformation, const R3Affine& inverse_transformation)
+{
+  // Copy properties used by compatibility tests
+  query.shape = feature->shape;
+  query.shape_type = feature->shape_type;
+  query.radius = feature->radius;
+  query.salience = feature->salience;
+  query.distinction = feature->distinction;
+  query.flags = feature->flags;
+  query.generator_type = feature->generator_type;
+
+  // Transform geometry into coordinate system of shape being searched
+  query.position = feature->position;
+  query.direction = feature->direction;
+  query.normal = feature->normal;
+  query.position.Transform(query_transformation);
+  query.direction.Transform(query_transformation);
+  query.normal.Transform(query_transformation);
+  query.position.InverseTransform(inverse_transformation);
+  query.direction.InverseTransform(inverse_transformation);
+  query.normal.InverseTransform(inverse_transformation);
+
+  // Share descriptor values (released in ReleaseQueryFeature)
+  query.descriptor.values = feature->descriptor.values;
+  query.descriptor.nvalues = feature->descriptor.nvalues;
+}
+
+
+
+static void
+ReleaseQueryFeature(FETFeature& query)
+{
+  // Detach query from shape and descriptor values, so that destructor leaves them alone
+  query.shape = NULL;
+  query.descriptor.values = NULL;
+  query.descriptor.nvalues = 0;
+}
+
+
+
+static void
+InsertPairCorrespondences(FETReconstruction *reconstruction, FETShape *shape1, FETShape *shape2,
+  const RNArray<FETFeature *>& query_features2, FETFeature **features1, RNScalar *affinities)
+{
+  // Create correspondences in order of query features
+  for (int i = 0; i < query_features2.NEntries(); i++) {
+    FETFeature *feature2 = query_features2.Kth(i);
+    FETFeature *feature1 = features1[i];
+    if (!feature1) continue;
+
+    // Create correspondence with sorted shapes
+    if (shape1->reconstruction_index < shape2->reconstruction_index) {
+      FETCorrespondence *correspondence = new FETCorrespondence(reconstruction, feature1, feature2, affinities[i]);
+      if (!correspondence) RNAbort("Unable to create correspondence");
+    }
+    else {
+      FETCorrespondence *correspondence = new FETCorrespondence(reconstruction, feature2, feature1, affinities[i]);
+      if (!correspondence) RNAbort("Unable to create correspondence");
+    }
+  }
+}
+
+
+
+int FETReconstruction::
+SelectQueryFeatures(FETShape *shape1, FETShape *shape2, RNScalar num_correspondences, RNArray<FETFeature *>& query_features2)
 {
   // Check number of correspondences
-  if (num_correspondences == 0) return;
+  if (num_correspondences == 0) return 0;
 
   // Check bounding box distance
   if (max_euclidean_distance > 0) {
     R3Box bbox1 = shape1->BBox();
     R3Box bbox2 = shape2->BBox();
-    if (R3Distance(bbox1, bbox2) > max_euclidean_distance) return;
+    if (R3Distance(bbox1, bbox2) > max_euclidean_distance) return 0;
   }
 
-  // Find query features
+  // Find candidate features
   RNScalar total_salience = 0;
-  RNArray<FETFeature *> query_features2;
+  RNArray<FETFeature *> candidate_features2;
   for (int i = 0; i < shape2->NFeatures(); i++) {
     FETFeature *feature2 = shape2->Feature(i);
     if ((min_salience > 0) && (feature2->Salience() < min_salience)) continue;
     if ((min_distinction > 0) && (feature2->Distinction() < min_distinction)) continue;
     if ((feature2->generator_type >= 0) && (total_correspondence_weights[feature2->generator_type] <= 0)) continue;
     if (feature2->IsOnBoundary() && (!feature2->IsOnSilhouetteBoundary())) continue;
-    query_features2.Insert(feature2);
+    candidate_features2.Insert(feature2);
     total_salience += feature2->Salience();
   }
   
-  // Compute correspondences for shape2 -> shape1
-  for (int i = 0; i < query_features2.NEntries(); i++) {
-    FETFeature *feature2 = query_features2.Kth(i);
-
-    // Subsample features randomly
+  // Subsample candidate features randomly
+  for (int i = 0; i < candidate_features2.NEntries(); i++) {
+    FETFeature *feature2 = candidate_features2.Kth(i);
     if ((num_correspondences != RN_UNKNOWN) && (total_salience > 0)) {
       const RNScalar expected_inlier_probability = 0.1;
       RNScalar p = num_correspondences * feature2->Salience() / total_salience;
       p /= expected_inlier_probability;
       if ((p < 1.0) && (RNRandomScalar() > p)) continue;
     }
+    query_features2.Insert(feature2);
+  }
+
+  // Return number of query features
+  return query_features2.NEntries();
+}
+
+
+
+int FETReconstruction::
+FindCorrespondences(FETShape *shape1, FETShape *shape2, const RNArray<FETFeature *>& query_features2,
+  FETFeature **features1, RNScalar *affinities) const
+{
+  // Neither shapes nor features are modified here, so pairs can be searched concurrently
+
+  // Load compatibility parameters
+  FETCompatibilityParameters compatibility(max_euclidean_distance,
+    (RNLength *) max_descriptor_distances, max_normal_angle,
+    min_distinction, min_salience, discard_boundaries);
+
+  // Transform query features into coordinate system of shape1
+  int nqueries = query_features2.NEntries();
+  FETFeature *queries2 = new FETFeature [ nqueries ];
+  for (int i = 0; i < nqueries; i++) {
+    InitializeQueryFeature(queries2[i], query_features2.Kth(i),
+      shape2->Transformation(), shape1->current_transformation);
+  }
+
+  // Compute correspondences for shape2 -> shape1
+  int count = 0;
+  for (int i = 0; i < nqueries; i++) {
+    FETFeature *feature2 = query_features2.Kth(i);
+    features1[i] = NULL;
+    affinities[i] = 0;
 
     // Find closest feature on shape1
-    FETFeature *feature1 = shape1->FindClosestFeature(feature2, shape2->Transformation(), 
-      0.0, max_euclidean_distance, max_descriptor_distances, max_normal_angle,
-      min_distinction, min_salience, discard_boundaries);
+    FETFeature *feature1 = shape1->FindClosestFeature(&queries2[i], compatibility, 0.0, max_euclidean_distance);
     if (!feature1) continue;
 
     // Check if should discard because on boundary
@@ -1694,22 +1857,47 @@ CreateCorrespondences(FETShape *shape1, FETShape *shape2, RNScalar num_correspon
 
     // Check if mutually closest
     if (discard_not_mutually_closest) {
-      FETFeature *feature2a = shape2->FindClosestFeature(feature1, shape1->Transformation(), 
-        0.0, max_euclidean_distance, max_descriptor_distances, max_normal_angle,
-        min_distinction, min_salience, discard_boundaries);
+      FETFeature query1;
+      InitializeQueryFeature(query1, feature1, shape1->Transformation(), shape2->current_transformation);
+      FETFeature *feature2a = shape2->FindClosestFeature(&query1, compatibility, 0.0, max_euclidean_distance);
+      ReleaseQueryFeature(query1);
       if (feature2a != feature2) continue;
     }
 
-    // Create correspondence with sorted shapes
-    if (shape1->reconstruction_index < shape2->reconstruction_index) {
-      FETCorrespondence *correspondence = new FETCorrespondence(this, feature1, feature2, affinity);
-      if (!correspondence) RNAbort("Unable to create correspondence");
-    }
-    else {
-      FETCorrespondence *correspondence = new FETCorrespondence(this, feature2, feature1, affinity);
-      if (!correspondence) RNAbort("Unable to create correspondence");
-    }
+    // Remember correspondence
+    features1[i] = feature1;
+    affinities[i] = affinity;
+    count++;
   }
+
+  // Delete query features
+  for (int i = 0; i < nqueries; i++) ReleaseQueryFeature(queries2[i]);
+  delete [] queries2;
+
+  // Return number of correspondences found
+  return count;
+}
+
+
+
+void FETReconstruction::
+CreateCorrespondences(FETShape *shape1, FETShape *shape2, RNScalar num_correspondences)
+{
+  // Find query features
+  RNArray<FETFeature *> query_features2;
+  if (!SelectQueryFeatures(shape1, shape2, num_correspondences, query_features2)) return;
+
+  // Compute correspondences for shape2 -> shape1
+  FETFeature **features1 = new FETFeature * [ query_features2.NEntries() ];
+  RNScalar *affinities = new RNScalar [ query_features2.NEntries() ];
+  FindCorrespondences(shape1, shape2, query_features2, features1, affinities);
+
+  // Create correspondences
+  InsertPairCorrespondences(this, shape1, shape2, query_features2, features1, affinities);
+
+  // Delete temporary data
+  delete [] features1;
+  delete [] affinities;
 }
 
 
@@ -1748,7 +1936,8 @@ CreateCorrespondences(void)
     }
   }
 
-  // Create correspondences 
+  // Select query features for shape/shape pairs (serially, so random subsampling is deterministic)
+  RNArray<FETCorrespondencePair *> pairs;
   for (int i = 0; i < NShapes(); i++) {
     FETShape *shape1 = Shape(i);
     R3Box bbox1 = shape1->BBox();
@@ -1760,11 +1949,46 @@ CreateCorrespondences(void)
       if (R3Intersects(bbox1, bbox2, &intersection)) {
         RNScalar allocation = shape_saliences[i] * shape_saliences[j] * intersection.Volume();
         RNScalar num_correspondences = (total_allocation > 0) ? max_correspondences * allocation / total_allocation : RN_UNKNOWN;
-        CreateCorrespondences(shape1, shape2, num_correspondences);
+        FETCorrespondencePair *pair = new FETCorrespondencePair();
+        pair->shape1 = shape1;
+        pair->shape2 = shape2;
+        pair->features1 = NULL;
+        pair->affinities = NULL;
+        if (SelectQueryFeatures(shape1, shape2, num_correspondences, pair->query_features2)) pairs.Insert(pair);
+        else delete pair;
       }
     }
   }
 
+  // Build kdtrees and descriptor matrices before searching them concurrently
+  for (int i = 0; i < NShapes(); i++) {
+    FETShape *shape = Shape(i);
+    shape->UpdateKdtree();
+    shape->UpdateDescriptorMatrix();
+  }
+
+  // Compute correspondences for shape/shape pairs
+#pragma omp parallel for schedule(dynamic, 1)
+  for (int i = 0; i < pairs.NEntries(); i++) {
+    FETCorrespondencePair *pair = pairs.Kth(i);
+    pair->features1 = new FETFeature * [ pair->query_features2.NEntries() ];
+    pair->affinities = new RNScalar [ pair->query_features2.NEntries() ];
+    FindCorrespondences(pair->shape1, pair->shape2, pair->query_features2, pair->features1, pair->affinities);
+  }
+
+  // Create correspondences in order of shape/shape pairs
+  for (int i = 0; i < pairs.NEntries(); i++) {
+    FETCorrespondencePair *pair = pairs.Kth(i);
+    InsertPairCorrespondences(this, pair->shape1, pair->shape2,
+      pair->query_features2, pair->features1, pair->affinities);
+    delete [] pair->features1;
+    delete [] pair->affinities;
+    delete pair;
+  }
+
+  // Delete shape saliences
+  delete [] shape_saliences;
+
   // Discard outliers
   if (discard_outliers) DiscardOutlierCorrespondences();
 
@@ -2380,117 +2604,456 @@ AddTrajectoryEquations(RNSystemOfEquations *system, RNScalar total_weight, RNSca
 
 
 
-void FETReconstruction::
-OptimizeTransformationsWithClosedFormEquations(void)
-{
-  // Check the correspondences
-  if (NShapes() != 2) return;
-  if (correspondences.NEntries() == 0) return;
-
-  // Compute the aligning transformation
-  R3Affine transformation21 = AligningTransformation(correspondences);
-
-  // Update transformation for second shape
-  FETShape *shape1 = Shape(0);
-  FETShape *shape2 = Shape(1);
-  shape2->current_transformation = R3identity_affine;
-  shape2->current_transformation.Transform(shape1->current_transformation);
-  shape2->current_transformation.Transform(transformation21);
-}
-
 
+////////////////////////////////////////////////////////////////////////
+// Pose graph functions
+////////////////////////////////////////////////////////////////////////
 
 void FETReconstruction::
-OptimizeTransformationsWithGlobalRelaxation(void)
+AddPairwiseTransformationResiduals(FETPoseGraph *graph,
+  FETShape *shape1, FETShape *shape2, 
+  const R3Affine& transformation21, RNScalar w)
 {
-#if 1
-  // ELENA: COMMENT THIS OUT 
-  if (NShapes() < 2) return;
-  FETShape *shape0 = Shape(0);
-  shape0->SetTransformation(R3identity_affine);
-  for (int i = 0; i < 8; i++) {
-    for (int j = 0; j < NMatches(); j++) {
-      FETMatch *match = Match(j);
-      FETShape *shape1 = match->Shape(0);
-      FETShape *shape2 = match->Shape(1);
-      R3Affine transformation21 = match->Transformation();
-      if (shape1->reconstruction_index < shape2->reconstruction_index) {
-        R3Affine transformation2 = R3identity_affine;
-        transformation2.InverseTransform(shape1->Transformation());
-        transformation2.Transform(transformation21);
-        shape2->SetTransformation(transformation2);
-      }
-      else {
-        R3Affine transformation1 = R3identity_affine;
-        transformation1.Transform(shape2->Transformation());
-        transformation1.InverseTransform(transformation21);
-        shape1->SetTransformation(transformation1);
+  // Get/check weight
+  if (w <= 0) return;
+
+  // Get radius of bounding box
+  RNBoolean tmp = shape2->BBox().IsEmpty();
+  RNLength r = (tmp) ? 1.0 : shape2->BBox().DiagonalRadius();
+
+  // Add residuals to align shapes transformed by transformation21
+  for (int i1 = -1; i1 <= 1; i1 += 2) {
+    for (int i2 = -1; i2 <= 1; i2 += 2) {
+      for (int i3 = -1; i3 <= 1; i3 += 2) {
+        R3Point position2 = shape2->Centroid();
+        position2[0] += i1*r; position2[1] += i2*r; position2[2] += i3*r;
+        R3Point position1 = position2; position1.Transform(transformation21);  
+        position1.Transform(shape1->Transformation());
+        position2.Transform(shape2->Transformation());
+        graph->InsertPointPointResidual(shape1->reconstruction_index, shape2->reconstruction_index, position1, position2, w / 8.0);
       }
     }
   }
-#else
-#endif
 }
 
 
 
-////////////////////////////////////////////////////////////////////////
-// ICP alignment
-////////////////////////////////////////////////////////////////////////
-
-static R3Affine
-ComputeTransformationWithICP(FETReconstruction *reconstruction1, FETShape *shape1A, FETShape *shape1B, int max_iterations)
+void FETReconstruction::
+AddInertiaResiduals(FETPoseGraph *graph, RNScalar total_weight)
 {
-  // Create a new reconstruction
-  FETReconstruction *reconstruction2 = new FETReconstruction(*reconstruction1);
-  reconstruction2->InitializeOptimizationParameters();
-
-  // Copy shape1A
-  FETShape *shape2A = new FETShape(*shape1A);
-  reconstruction2->InsertShape(shape2A);
-  for (int i = 0; i < shape1A->NFeatures(); i++) {
-    FETFeature *feature1A = shape1A->Feature(i);
-    FETFeature *feature2A = new FETFeature(*feature1A);
-    reconstruction2->InsertFeature(feature2A);
-    shape2A->InsertFeature(feature2A);
-  }
+  // Check total weight
+  if (total_weight <= 0) return;
+  if (NShapes() == 0) return;
 
-  // Copy shape1B
-  FETShape *shape2B = new FETShape(*shape1B);
-  reconstruction2->InsertShape(shape2B);
-  for (int i = 0; i < shape1B->NFeatures(); i++) {
-    FETFeature *feature1B = shape1B->Feature(i);
-    FETFeature *feature2B = new FETFeature(*feature1B);
-    reconstruction2->InsertFeature(feature2B);
-    shape2B->InsertFeature(feature2B);
+  // Compute total inertia
+  RNScalar total_inertia = 0;
+  for (int i = 0; i < NShapes(); i++) {
+    FETShape *shape = Shape(i);
+    for (int j = 0; j < shape->NVariables(); j++) {
+      if (shape->variable_index[j] < 0) continue;
+      if (shape->variable_inertias[j] >= RN_INFINITY) continue;
+      total_inertia += shape->variable_inertias[j];
+    }
   }
 
-  // Optimize transformations with ICP
-  reconstruction2->OptimizeTransformationsWithICP(max_iterations);
+  // Determine factor to compute weight per shape
+  if (total_inertia <= 0) return;
+  RNScalar w = total_weight / total_inertia; 
 
-  // Compute transformation from shape2B to shape2A
-  R3Affine transformation = R3null_affine;
-  if (reconstruction2->NCorrespondences() > 0) {
-    transformation = R3identity_affine;
-    transformation.InverseTransform(shape2A->Transformation());
-    transformation.Transform(shape2B->Transformation());
+  // Add inertia residuals for each shape
+  for (int i = 0; i < NShapes(); i++) {
+    FETShape *shape = Shape(i);
+    for (int j = 0; j < shape->NVariables(); j++) {
+      if (shape->variable_index[j] < 0) continue;
+      if (shape->variable_inertias[j] >= RN_INFINITY) continue;
+      graph->InsertInertiaResidual(i, j, w * shape->variable_inertias[j]);
+    }
   }
- 
-  // Delete reconstruction
-  delete reconstruction2;
-
-  // Return transformation
-  return transformation;
 }
 
 
-static FETMatch *
-CreateMatchWithICP(FETReconstruction *reconstruction,
-  FETShape *shape1, FETShape *shape2,
-  int max_iterations = 1)
+
+void FETReconstruction::
+AddCorrespondenceResiduals(FETPoseGraph *graph, FETCorrespondence *correspondence, RNScalar weight)
 {
-  // Compute transformation with ICP
-  R3Affine transformation21 = ComputeTransformationWithICP(reconstruction, shape1, shape2, max_iterations);
+  // Check total weight
+  if (weight <= 0) return;
+
+  // Get useful variables
+  FETFeature *feature1 = correspondence->Feature(0);
+  FETFeature *feature2 = correspondence->Feature(1);
+  if (!feature1 || !feature2) return;
+  FETShape *shape1 = feature1->shape;
+  FETShape *shape2 = feature2->shape;
+  if (!shape1 || !shape2) return;
+  int index1 = shape1->reconstruction_index;
+  int index2 = shape2->reconstruction_index;
+
+  // Get feature positions and vectors after current transformations
+  const R3Affine& transformation1 = shape1->Transformation();
+  const R3Affine& transformation2 = shape2->Transformation();
+  R3Point position1 = feature1->Position(); position1.Transform(transformation1);
+  R3Point position2 = feature2->Position(); position2.Transform(transformation2);
+  R3Vector vector1 = (feature1->shape_type == LINE_FEATURE_SHAPE) ? feature1->Direction() : feature1->Normal();
+  R3Vector vector2 = (feature2->shape_type == LINE_FEATURE_SHAPE) ? feature2->Direction() : feature2->Normal();
+  vector1.Transform(transformation1);
+  vector2.Transform(transformation2);
+
+  // Add residuals for correspondence
+  if (correspondence->relationship_type == COINCIDENT_RELATIONSHIP) {
+    if ((feature1->shape_type == POINT_FEATURE_SHAPE) && (feature2->shape_type == POINT_FEATURE_SHAPE)) {
+      graph->InsertPointPointResidual(index1, index2, position1, position2, weight);
+    }
+    else {
+      if (feature1->shape_type == LINE_FEATURE_SHAPE) {        
+        int dim = vector1.MinDimension();
+        R3Vector n1A = vector1 % R3xyz_triad[dim]; n1A.Normalize();
+        R3Vector n1B = vector1 % n1A; n1B.Normalize();
+        graph->InsertPointPlaneResidual(index2, index1, position2, position1, n1A, 0.5 * weight);
+        graph->InsertPointPlaneResidual(index2, index1, position2, position1, n1B, 0.5 * weight);
+      }
+      else if (feature1->shape_type == PLANE_FEATURE_SHAPE) {        
+        graph->InsertPointPlaneResidual(index2, index1, position2, position1, vector1, weight);
+      }
+
+      if (feature2->shape_type == LINE_FEATURE_SHAPE) {        
+        int dim = vector2.MinDimension();
+        R3Vector n2A = vector2 % R3xyz_triad[dim]; n2A.Normalize();
+        R3Vector n2B = vector2 % n2A; n2B.Normalize();
+        graph->InsertPointPlaneResidual(index1, index2, position1, position2, n2A, 0.5 * weight);
+        graph->InsertPointPlaneResidual(index1, index2, position1, position2, n2B, 0.5 * weight);
+      }
+      else if (feature2->shape_type == PLANE_FEATURE_SHAPE) {        
+        graph->InsertPointPlaneResidual(index1, index2, position1, position2, vector2, weight);
+      }
+    }
+  }
+
+  // Check if vectors are defined
+  if ((feature1->shape_type != LINE_FEATURE_SHAPE) && (feature1->shape_type != PLANE_FEATURE_SHAPE)) return;
+  if ((feature2->shape_type != LINE_FEATURE_SHAPE) && (feature2->shape_type != PLANE_FEATURE_SHAPE)) return;
+  RNBoolean same_shape_types = (feature1->shape_type == feature2->shape_type);
+
+  // Add residuals for vectors (a line direction is perpendicular to a plane normal, and vice versa)
+  if (correspondence->relationship_type == PARALLEL_RELATIONSHIP) {
+    if (same_shape_types) graph->InsertParallelVectorResidual(index1, index2, vector1, vector2, weight);
+    else graph->InsertPerpendicularVectorResidual(index1, index2, vector1, vector2, weight);
+  }
+  else if (correspondence->relationship_type == ANTIPARALLEL_RELATIONSHIP) {
+    if (same_shape_types) graph->InsertParallelVectorResidual(index1, index2, vector1, -vector2, weight);
+    else graph->InsertPerpendicularVectorResidual(index1, index2, vector1, vector2, weight);
+  }
+  else if (correspondence->relationship_type == PERPENDICULAR_RELATIONSHIP) {
+    if (same_shape_types) graph->InsertPerpendicularVectorResidual(index1, index2, vector1, vector2, weight);
+    else graph->InsertParallelVectorResidual(index1, index2, vector1, vector2, weight);
+  }
+}
+
+
+
+void FETReconstruction::
+AddCorrespondenceResiduals(FETPoseGraph *graph, RNScalar *total_weights)
+{
+  // Check total weight
+  if (correspondences.NEntries() == 0) return;
+
+  // Compute total affinities
+  RNScalar total_affinities[NUM_FEATURE_TYPES] = { 0.0 };
+  for (int i = 0; i < correspondences.NEntries(); i++) {
+    FETCorrespondence *correspondence = correspondences.Kth(i);
+    FETFeature *feature1 = correspondence->Feature(0);
+    FETFeature *feature2 = correspondence->Feature(1);
+    if (!feature1 || !feature2) continue;
+    RNScalar affinity = correspondence->affinity;
+    if (affinity == 0) continue;
+    int generator_type = feature1->GeneratorType();
+    total_affinities[generator_type] += affinity;
+  }
+
+  // Determine factor to compute weight per correspondence
+  RNScalar factors[NUM_FEATURE_TYPES] = { 0.0 };
+  for (int i = 0; i < NUM_FEATURE_TYPES; i++) {
+    if (total_weights[i] == 0) continue;
+    if (total_affinities[i] <= 0) continue;
+    factors[i] = total_weights[i] / total_affinities[i];
+  }
+
+  // Add residuals for each correspondence
+  for (int i = 0; i < correspondences.NEntries(); i++) {
+    FETCorrespondence *correspondence = correspondences.Kth(i);
+    FETFeature *feature1 = correspondence->Feature(0);
+    FETFeature *feature2 = correspondence->Feature(1);
+    if (!feature1 || !feature2) continue;
+    RNScalar affinity = correspondence->affinity;
+    if (affinity == 0) continue;
+    int generator_type = feature1->GeneratorType();
+    RNScalar weight = factors[generator_type] * affinity;
+    AddCorrespondenceResiduals(graph, correspondence, weight);
+  }
+}
+
+
+
+void FETReconstruction::
+AddMatchResiduals(FETPoseGraph *graph, RNScalar total_weight)
+{
+  // Check total weight
+  if (total_weight <= 0) return;
+  if (NMatches() == 0) return;
+
+  // Determine weight per match (all matches have score 1, as for AddMatchEquations)
+  RNScalar w = total_weight / NMatches(); 
+
+  // Add residuals for each match
+  for (int i = 0; i < NMatches(); i++) {
+    FETMatch *match = Match(i);
+    FETShape *shape1 = match->Shape(0);
+    FETShape *shape2 = match->Shape(1);
+    R3Affine transformation21 = match->Transformation();
+    AddPairwiseTransformationResiduals(graph, shape1, shape2, transformation21, w);
+  }
+}
+
+
+
+void FETReconstruction::
+AddTrajectoryResiduals(FETPoseGraph *graph, RNScalar total_weight, RNScalar sigma)
+{
+  // Check total weight
+  if (total_weight <= 0) return;
+  if (NShapes() == 0) return;
+  if (sigma <= 0) return;
+
+  // Get convenient variables
+  RNScalar min_affinity = 1E-3;
+  RNScalar f = -1.0 / (2.0 * sigma * sigma);
+  
+  // Compute trajectory parameterization
+  RNLength *parameterization = new RNLength [ NShapes() ];
+  parameterization[0] = 0; 
+  for (int i = 1; i < NShapes(); i++) {
+    FETShape *shape0 = Shape(i-1);
+    FETShape *shape1 = Shape(i);
+    RNLength d = R3Distance(shape0->Origin(), shape1->Origin());
+    parameterization[i] = parameterization[i-1] + d;
+  }
+
+  // Determine total affinity
+  RNScalar total_affinity = 0;
+  for (int i = 0; i < NShapes(); i++) {
+    for (int j = 1; j <= 16; j *= 2) {
+      if (i-j >= 0) {
+        RNScalar d = parameterization[i] - parameterization[i-j];
+        RNScalar affinity = exp(f*d*d);
+        if (affinity >= min_affinity) total_affinity += affinity;
+      }
+      if (i+j < NShapes()) {
+        RNScalar d = parameterization[i+j] - parameterization[i];
+        RNScalar affinity = exp(f*d*d);
+        if (affinity >= min_affinity) total_affinity += affinity;
+      }
+    }
+  }
+
+  // Add residuals between shapes nearby on trajectory
+  if (total_affinity > 0) {
+    RNScalar w = total_weight / total_affinity; 
+    for (int i = 0; i < NShapes(); i++) {
+      FETShape *shape1 = Shape(i);
+      for (int j = 1; j <= 16; j *= 2) {
+        for (int k = -1; k <= 1; k += 2) {
+          int i2 = i + k*j;
+          if ((i2 < 0) || (i2 >= NShapes())) continue;
+          RNScalar d = parameterization[i2] - parameterization[i];
+          RNScalar affinity = exp(f*d*d);
+          if (affinity < min_affinity) continue;
+          FETShape *shape2 = Shape(i2);
+          R3Affine transformation21 = R3identity_affine;
+          transformation21.InverseTransform(shape1->initial_transformation);
+          transformation21.Transform(shape2->initial_transformation);
+          AddPairwiseTransformationResiduals(graph, shape1, shape2, transformation21, w * affinity);
+        }
+      }
+    }
+  }
+  
+  // Delete parameterization
+  delete [] parameterization;
+}
+
+
+
+void FETReconstruction::
+OptimizeTransformationsWithPoseGraph(void)
+{
+  // Check the shapes
+  if (NShapes() < 2) return;
+
+  // Update variable indices
+  int n = 0;
+  for (int i = 0; i < NShapes(); i++) {
+    FETShape *shape = Shape(i);
+    shape->UpdateVariableIndex(n);
+  }
+
+  // Initialize pose graph (kept between calls to reuse its factorization)
+  if (!pose_graph) pose_graph = new FETPoseGraph();
+  pose_graph->Reset(NShapes());
+  for (int i = 0; i < NShapes(); i++) {
+    FETShape *shape = Shape(i);
+    R3Point center = shape->Origin();
+    center.Transform(shape->Transformation());
+    RNBoolean variable_is_free[FET_NUM_VARIABLES];
+    for (int j = 0; j < FET_NUM_VARIABLES; j++) variable_is_free[j] = (shape->variable_index[j] >= 0);
+    pose_graph->SetShape(i, center, variable_is_free);
+  }
+
+  // Add residuals
+  AddInertiaResiduals(pose_graph, total_inertia_weight);
+  AddMatchResiduals(pose_graph, total_match_weight);
+  AddTrajectoryResiduals(pose_graph, total_trajectory_weight);
+  AddCorrespondenceResiduals(pose_graph, total_correspondence_weights);
+  if (pose_graph->NResiduals() == 0) return;
+
+  // Solve for variables of all shapes
+  RNScalar *y = new RNScalar [ FET_NUM_VARIABLES * NShapes() ];
+  if (!pose_graph->Solve(y)) {
+    fprintf(stderr, "Unable to solve pose graph\n");
+    delete [] y;
+    return;
+  }
+
+  // Extract solution
+  RNScalar *x = new RNScalar [ n + 1 ];
+  for (int i = 0; i < NShapes(); i++) {
+    FETShape *shape = Shape(i);
+    for (int j = 0; j < FET_NUM_VARIABLES; j++) {
+      if (shape->variable_index[j] < 0) continue;
+      x[shape->variable_index[j]] = y[FET_NUM_VARIABLES*i + j];
+    }
+  }
+  for (int i = 0; i < NShapes(); i++) {
+    FETShape *shape = Shape(i);
+    shape->UpdateVariableValues(x);
+  }
+
+  // Delete variables
+  delete [] x;
+  delete [] y;
+}
+
+
+void FETReconstruction::
+OptimizeTransformationsWithClosedFormEquations(void)
+{
+  // Check the correspondences
+  if (NShapes() != 2) return;
+  if (correspondences.NEntries() == 0) return;
+
+  // Compute the aligning transformation
+  R3Affine transformation21 = AligningTransformation(correspondences);
+
+  // Update transformation for second shape
+  FETShape *shape1 = Shape(0);
+  FETShape *shape2 = Shape(1);
+  shape2->current_transformation = R3identity_affine;
+  shape2->current_transformation.Transform(shape1->current_transformation);
+  shape2->current_transformation.Transform(transformation21);
+}
+
+
+
+void FETReconstruction::
+OptimizeTransformationsWithGlobalRelaxation(void)
+{
+#if 1
+  // ELENA: COMMENT THIS OUT 
+  if (NShapes() < 2) return;
+  FETShape *shape0 = Shape(0);
+  shape0->SetTransformation(R3identity_affine);
+  for (int i = 0; i < 8; i++) {
+    for (int j = 0; j < NMatches(); j++) {
+      FETMatch *match = Match(j);
+      FETShape *shape1 = match->Shape(0);
+      FETShape *shape2 = match->Shape(1);
+      R3Affine transformation21 = match->Transformation();
+      if (shape1->reconstruction_index < shape2->reconstruction_index) {
+        R3Affine transformation2 = R3identity_affine;
+        transformation2.InverseTransform(shape1->Transformation());
+        transformation2.Transform(transformation21);
+        shape2->SetTransformation(transformation2);
+      }
+      else {
+        R3Affine transformation1 = R3identity_affine;
+        transformation1.Transform(shape2->Transformation());
+        transformation1.InverseTransform(transformation21);
+        shape1->SetTransformation(transformation1);
+      }
+    }
+  }
+#else
+#endif
+}
+
+
+
+////////////////////////////////////////////////////////////////////////
+// ICP alignment
+////////////////////////////////////////////////////////////////////////
+
+static R3Affine
+ComputeTransformationWithICP(FETReconstruction *reconstruction1, FETShape *shape1A, FETShape *shape1B, int max_iterations)
+{
+  // Create a new reconstruction
+  FETReconstruction *reconstruction2 = new FETReconstruction(*reconstruction1);
+  reconstruction2->InitializeOptimizationParameters();
+
+  // Copy shape1A
+  FETShape *shape2A = new FETShape(*shape1A);
+  reconstruction2->InsertShape(shape2A);
+  for (int i = 0; i < shape1A->NFeatures(); i++) {
+    FETFeature *feature1A = shape1A->Feature(i);
+    FETFeature *feature2A = new FETFeature(*feature1A);
+    reconstruction2->InsertFeature(feature2A);
+    shape2A->InsertFeature(feature2A);
+  }
+
+  // Copy shape1B
+  FETShape *shape2B = new FETShape(*shape1B);
+  reconstruction2->InsertShape(shape2B);
+  for (int i = 0; i < shape1B->NFeatures(); i++) {
+    FETFeature *feature1B = shape1B->Feature(i);
+    FETFeature *feature2B = new FETFeature(*feature1B);
+    reconstruction2->InsertFeature(feature2B);
+    shape2B->InsertFeature(feature2B);
+  }
+
+  // Optimize transformations with ICP
+  reconstruction2->OptimizeTransformationsWithICP(max_iterations);
+
+  // Compute transformation from shape2B to shape2A
+  R3Affine transformation = R3null_affine;
+  if (reconstruction2->NCorrespondences() > 0) {
+    transformation = R3identity_affine;
+    transformation.InverseTransform(shape2A->Transformation());
+    transformation.Transform(shape2B->Transformation());
+  }
+ 
+  // Delete reconstruction
+  delete reconstruction2;
+
+  // Return transformation
+  return transformation;
+}
+
+
+static FETMatch *
+CreateMatchWithICP(FETReconstruction *reconstruction,
+  FETShape *shape1, FETShape *shape2,
+  int max_iterations = 1)
+{
+  // Compute transformation with ICP
+  R3Affine transformation21 = ComputeTransformationWithICP(reconstruction, shape1, shape2, max_iterations);
   if (transformation21 == R3null_affine) return NULL;
   
   // Allocate match
@@ -2731,9 +3294,220 @@ OptimizeTransformationsWithICP(int max_iterations,
 // RANSAC alignment
 ////////////////////////////////////////////////////////////////////////
 
+struct FETRandomStream {
+public:
+  FETRandomStream(unsigned long long key1, unsigned long long key2 = 0, 
+    unsigned long long key3 = 0, unsigned long long key4 = 0);
+  RNScalar Scalar(void);
+  unsigned long long Next(void);
+public:
+  unsigned long long state;
+};
+
+
+
+FETRandomStream::
+FETRandomStream(unsigned long long key1, unsigned long long key2, unsigned long long key3, unsigned long long key4)
+  : state(0)
+{
+  // Mix keys into state, so that nearby keys give independent streams
+  state ^= key1; Next();
+  state ^= key2; Next();
+  state ^= key3; Next();
+  state ^= key4; Next();
+}
+
+
+
+unsigned long long FETRandomStream::
+Next(void)
+{
+  // Return next 64-bit random number (splitmix64)
+  unsigned long long z = (state += 0x9E3779B97F4A7C15ULL);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  return z ^ (z >> 31);
+}
+
+
+
+RNScalar FETRandomStream::
+Scalar(void)
+{
+  // Return random number uniformly distributed in [0,1)
+  return (Next() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+
+
+struct FETInlierGrid {
+public:
+  FETInlierGrid(FETShape *shape, RNLength tolerance);
+  ~FETInlierGrid(void);
+  RNBoolean IsInlier(float x, float y, float z) const;
+public:
+  float origin[3];
+  float cell_size;
+  int dimensions[3];
+  int *cell_starts;
+  float *positions[3];
+  float tolerance_squared;
+  RNBoolean is_empty;
+  RNBoolean is_infinite;
+};
+
+
+
+FETInlierGrid::
+FETInlierGrid(FETShape *shape, RNLength tolerance)
+  : cell_size(1),
+    cell_starts(NULL),
+    tolerance_squared(0),
+    is_empty(shape->NFeatures() == 0),
+    is_infinite(tolerance >= RN_INFINITY)
+{
+  // Initialize grid
+  int nfeatures = shape->NFeatures();
+  for (int i = 0; i < 3; i++) {
+    origin[i] = 0;
+    dimensions[i] = 1;
+    positions[i] = NULL;
+  }
+
+  // Check if there is anything to search
+  if (is_empty || is_infinite || (tolerance < 0)) return;
+  tolerance_squared = tolerance * tolerance;
+
+  // Compute bounding box of feature positions
+  R3Box bbox = R3null_box;
+  for (int i = 0; i < nfeatures; i++) bbox.Union(shape->Feature(i)->Position());
+
+  // Compute cells no smaller than tolerance (so only neighbor cells must be searched)
+  const int max_resolution = 64;
+  cell_size = bbox.LongestAxisLength() / max_resolution;
+  if (cell_size < tolerance) cell_size = tolerance;
+  if (cell_size <= 0) cell_size = 1;
+  for (int i = 0; i < 3; i++) {
+    origin[i] = bbox.Min()[i];
+    dimensions[i] = (int) (bbox.AxisLength(i) / cell_size) + 1;
+  }
+
+  // Count features in every cell
+  int ncells = dimensions[0] * dimensions[1] * dimensions[2];
+  int *feature_cells = new int [ nfeatures ];
+  cell_starts = new int [ ncells + 1 ];
+  for (int i = 0; i <= ncells; i++) cell_starts[i] = 0;
+  for (int i = 0; i < nfeatures; i++) {
+    const R3Point& position = shape->Feature(i)->Position();
+    int index[3];
+    for (int j = 0; j < 3; j++) {
+      index[j] = (int) ((position[j] - origin[j]) / cell_size);
+      if (index[j] < 0) index[j] = 0;
+      else if (index[j] >= dimensions[j]) index[j] = dimensions[j] - 1;
+    }
+    feature_cells[i] = (index[2] * dimensions[1] + index[1]) * dimensions[0] + index[0];
+    cell_starts[feature_cells[i] + 1]++;
+  }
+  for (int i = 0; i < ncells; i++) cell_starts[i+1] += cell_starts[i];
+
+  // Pack positions sorted by cell (one array per coordinate)
+  for (int j = 0; j < 3; j++) positions[j] = new float [ nfeatures ];
+  int *counts = new int [ ncells ];
+  for (int i = 0; i < ncells; i++) counts[i] = cell_starts[i];
+  for (int i = 0; i < nfeatures; i++) {
+    const R3Point& position = shape->Feature(i)->Position();
+    int k = counts[feature_cells[i]]++;
+    for (int j = 0; j < 3; j++) positions[j][k] = position[j];
+  }
+
+  // Delete temporary data
+  delete [] feature_cells;
+  delete [] counts;
+}
+
+
+
+FETInlierGrid::
+~FETInlierGrid(void)
+{
+  // Delete data
+  if (cell_starts) delete [] cell_starts;
+  for (int i = 0; i < 3; i++) {
+    if (positions[i]) delete [] positions[i];
+  }
+}
+
+
+
+RNBoolean FETInlierGrid::
+IsInlier(float x, float y, float z) const
+{
+  // Check trivial cases
+  if (is_empty) return FALSE;
+  if (is_infinite) return TRUE;
+  if (!cell_starts) return FALSE;
+
+  // Compute range of cells within tolerance
+  int index[3], imin[3], imax[3];
+  index[0] = (int) floorf((x - origin[0]) / cell_size);
+  index[1] = (int) floorf((y - origin[1]) / cell_size);
+  index[2] = (int) floorf((z - origin[2]) / cell_size);
+  for (int j = 0; j < 3; j++) {
+    if ((index[j] < -1) || (index[j] > dimensions[j])) return FALSE;
+    imin[j] = (index[j] > 0) ? index[j] - 1 : 0;
+    imax[j] = (index[j] < dimensions[j] - 1) ? index[j] + 1 : dimensions[j] - 1;
+  }
+
+  // Check packed positions in cells (inner loop vectorizes)
+  const float *px = positions[0], *py = positions[1], *pz = positions[2];
+  for (int iz = imin[2]; iz <= imax[2]; iz++) {
+    for (int iy = imin[1]; iy <= imax[1]; iy++) {
+      int row = (iz * dimensions[1] + iy) * dimensions[0];
+      int start = cell_starts[row + imin[0]];
+      int end = cell_starts[row + imax[0] + 1];
+      int hit = 0;
+      for (int k = start; k < end; k++) {
+        float dx = px[k] - x, dy = py[k] - y, dz = pz[k] - z;
+        hit |= (dx*dx + dy*dy + dz*dz <= tolerance_squared);
+      }
+      if (hit) return TRUE;
+    }
+  }
+
+  // No position within tolerance
+  return FALSE;
+}
+
+
+
+struct FETRansacParameters {
+public:
+  // Shapes and features
+  FETShape *shape1;
+  FETShape *shape2;
+  RNArray<FETFeature *> features[NUM_FEATURE_TYPES][2];
+
+  // Descriptor matches
+  float max_descriptor_distance_squared[NUM_FEATURE_TYPES];
+  const int *descriptor_matches;
+  const float *descriptor_distances;
+  int max_descriptor_matches;
+  int num_feature2_samples;
+
+  // Geometric tolerances
+  RNLength target_distance;
+  RNLength generator_tolerance;
+  RNAngle max_normal_angle;
+};
+
+
+
 static FETFeature *
-SelectRandomFeature(const RNArray<FETFeature *>& features)
+SelectRandomFeature(const RNArray<FETFeature *>& features, FETRandomStream& random)
 {
+  // Check features
+  if (features.IsEmpty()) return NULL;
+
   // Compute total salience
   RNScalar total_salience = 0;
   for (int i = 0; i < features.NEntries(); i++) {
@@ -2745,7 +3519,7 @@ SelectRandomFeature(const RNArray<FETFeature *>& features)
   if (total_salience > 0) {
     // Select feature according to salience distribution
     RNScalar current_salience = 0;
-    RNScalar r = RNRandomScalar() * total_salience;
+    RNScalar r = random.Scalar() * total_salience;
     for (int i = 0; i < features.NEntries(); i++) {
       FETFeature *feature = features.Kth(i);
       current_salience += feature->Salience();
@@ -2754,7 +3528,247 @@ SelectRandomFeature(const RNArray<FETFeature *>& features)
   }
 
   // Select feature according to uniform distribution
-  return features.Kth((int) RNRandomScalar() * features.NEntries());
+  return features.Kth((int) (random.Scalar() * features.NEntries()));
+}
+
+
+
+static int
+CreateRansacHypothesis(const FETRansacParameters& parameters, FETRandomStream& random,
+  FETFeature& query, R3Affine& transformation21)
+{
+  // Get convenient variables
+  FETShape *shape1 = parameters.shape1;
+  FETShape *shape2 = parameters.shape2;
+  RNLength target_distance = parameters.target_distance;
+  RNLength generator_tolerance = parameters.generator_tolerance;
+  RNAngle max_normal_angle = parameters.max_normal_angle;
+  const float *max_descriptor_distance_squared = parameters.max_descriptor_distance_squared;
+  FETCompatibilityParameters compatibility;
+  FETFeature *features1[3] = { NULL, NULL, NULL };
+  FETFeature *features2[3] = { NULL, NULL, NULL };
+
+  ////////
+
+  // Get first feature point on shape1
+  features1[0] = SelectRandomFeature(shape1->features, random);
+  if (!features1[0]) return 0;
+
+  // Get second feature point on shape1
+  RNArray<FETFeature *> listA, listB;
+  RNLength d01 = (3*random.Scalar()/2 + 0.5) * target_distance;
+  InitializeQueryFeature(query, features1[0], R3identity_affine, shape1->current_transformation);
+  shape1->FindAllFeatures(&query, compatibility, listA, d01 - generator_tolerance, d01 + generator_tolerance);
+  if (listA.IsEmpty()) return 0;
+  features1[1] = SelectRandomFeature(listA, random);
+  if (!features1[1]) return 0;
+  if (features1[1] == features1[0]) return 0;
+  R3Vector v01 = features1[1]->Position() - features1[0]->Position();
+  RNAngle angle010 = R3InteriorAngle(v01, features1[0]->normal);
+  RNAngle angle011 = R3InteriorAngle(v01, features1[1]->normal);
+  d01 = v01.Length();
+
+  // Get third feature point on shape1
+  listA.Empty();
+  RNLength d02 = (3*random.Scalar()/2 + 0.5) * target_distance;
+  RNLength d12 = (3*random.Scalar()/2 + 0.5) * target_distance;
+  shape1->FindAllFeatures(&query, compatibility, listA, d02 - generator_tolerance, d02 + generator_tolerance);
+  if (listA.IsEmpty()) return 0;
+  listB.Empty();
+  for (int j = 0; j < listA.NEntries(); j++) {
+    FETFeature *feature = listA.Kth(j);     
+    if (feature == features1[0]) continue;
+    if (feature == features1[1]) continue;
+
+    // Check distance
+    RNScalar d = R3Distance(features1[1]->Position(), feature->Position());
+    if (d < d12 - generator_tolerance) continue;
+    if (d > d12 + generator_tolerance) continue;
+
+    // Passed tests
+    listB.Insert(feature);
+  }
+  if (listB.IsEmpty()) return 0;
+  features1[2] = SelectRandomFeature(listB, random);
+  if (!features1[2]) return 0;
+  R3Vector v02 = features1[2]->Position() - features1[0]->Position();
+  R3Vector v12 = features1[2]->Position() - features1[1]->Position();
+  RNAngle angle020 = R3InteriorAngle(v02, features1[0]->normal);
+  RNAngle angle022 = R3InteriorAngle(v02, features1[2]->normal);
+  RNAngle angle121 = R3InteriorAngle(v12, features1[1]->normal);
+  RNAngle angle122 = R3InteriorAngle(v12, features1[2]->normal);
+  d02 = v02.Length();
+  d12 = v12.Length();
+
+  ////////
+
+  // Get first feature point on shape2 from best descriptor matches
+  listA.Empty();
+  listB.Empty();
+  int generator_type = features1[0]->GeneratorType();
+  int max_descriptor_matches = parameters.max_descriptor_matches;
+  const int *matches1 = &parameters.descriptor_matches[features1[0]->shape_index * max_descriptor_matches];
+  const float *distances1 = &parameters.descriptor_distances[features1[0]->shape_index * max_descriptor_matches];
+  for (int j = 0; j < max_descriptor_matches; j++) {
+    if (matches1[j] < 0) break;
+    if (distances1[j] >= max_descriptor_distance_squared[generator_type]) break;
+    listA.Insert(shape2->Feature(matches1[j]));
+  }
+  if (!listA.IsEmpty()) {
+    features2[0] = SelectRandomFeature(listA, random);
+  }
+  else {
+    // Sample features randomly (e.g., if features do not have descriptors)
+    RNScalar best_descriptor_distance_squared = max_descriptor_distance_squared[generator_type];
+    for (int j = 0; j < parameters.num_feature2_samples; j++) {
+      FETFeature *feature = SelectRandomFeature(parameters.features[generator_type][1], random);
+      if (!feature) break;
+      RNScalar descriptor_distance_squared = feature->descriptor.SquaredDistance(features1[0]->descriptor);
+      if (descriptor_distance_squared < best_descriptor_distance_squared) {
+        best_descriptor_distance_squared = descriptor_distance_squared;
+        features2[0] = feature;
+      }
+    }
+  }
+
+  // Check if found first feature
+  if (!features2[0]) return 0;
+
+  // Get second feature point on shape2
+  listA.Empty();
+  listB.Empty();
+  InitializeQueryFeature(query, features2[0], R3identity_affine, shape2->current_transformation);
+  query.descriptor.values = features1[1]->descriptor.values;
+  query.descriptor.nvalues = features1[1]->descriptor.nvalues;
+  shape2->FindAllFeatures(&query, compatibility, listA, d01 - generator_tolerance, d01 + generator_tolerance);
+  if (listA.IsEmpty()) return 0;
+  for (int j = 0; j < listA.NEntries(); j++) {
+    FETFeature *feature = listA.Kth(j);     
+    if (feature == features2[0]) continue;
+
+    // Check angle relationship to v01
+    if (max_normal_angle != RN_UNKNOWN) {
+      R3Vector v = feature->Position() - features2[0]->Position();
+      if (fabs(R3InteriorAngle(v, features2[0]->normal) - angle010) > max_normal_angle) continue;
+      if (fabs(R3InteriorAngle(v, feature->normal) - angle011) > max_normal_angle) continue;
+    }
+
+    // Check descriptor relationship to features1[1]
+    int generator_type = feature->GeneratorType();
+    if (max_descriptor_distance_squared[generator_type] < FLT_MAX) {
+      RNScalar descriptor_distance_squared = feature->descriptor.SquaredDistance(features1[1]->descriptor);
+      if (descriptor_distance_squared > max_descriptor_distance_squared[generator_type]) continue;
+    }
+
+    // Passed all tests
+    listB.Insert(feature);
+  }
+
+  // Check if found a second feature point on shape2
+  if (listB.IsEmpty()) return 0;
+  features2[1] = SelectRandomFeature(listB, random);
+  if (!features2[1]) return 0;
+
+  // Get third feature point on shape2
+  listA.Empty();
+  listB.Empty();
+  query.descriptor.values = features1[2]->descriptor.values;
+  query.descriptor.nvalues = features1[2]->descriptor.nvalues;
+  shape2->FindAllFeatures(&query, compatibility, listA, d02 - generator_tolerance, d02 + generator_tolerance);
+  if (listA.IsEmpty()) return 0;
+  for (int j = 0; j < listA.NEntries(); j++) {
+    FETFeature *feature = listA.Kth(j);     
+    if (feature == features2[0]) continue;
+    if (feature == features2[1]) continue;
+
+    // Check distance relationship 
+    RNLength d = R3Distance(feature->Position(), features2[0]->Position());
+    if (d < d12 - generator_tolerance) continue;
+    if (d > d12 + generator_tolerance) continue;
+
+    // Check angle relationship to v02
+    if (max_normal_angle != RN_UNKNOWN) {
+      R3Vector v = feature->Position() - features2[0]->Position();
+      if (fabs(R3InteriorAngle(v, features2[0]->normal) - angle020) > max_normal_angle) continue;
+      if (fabs(R3InteriorAngle(v, feature->normal) - angle022) > max_normal_angle) continue;
+    }
+
+    // Check angle relationship to v12
+    if (max_normal_angle != RN_UNKNOWN) {
+      R3Vector v = feature->Position() - features2[1]->Position();
+      if (fabs(R3InteriorAngle(v, features2[1]->normal) - angle121) > max_normal_angle) continue;
+      if (fabs(R3InteriorAngle(v, feature->normal) - angle122) > max_normal_angle) continue;
+    }
+
+    // Check descriptor relationship to features1[2]
+    int generator_type = feature->GeneratorType();
+    if (max_descriptor_distance_squared[generator_type] < FLT_MAX) {
+      RNScalar descriptor_distance_squared = feature->descriptor.SquaredDistance(features1[2]->descriptor);
+      if (descriptor_distance_squared > max_descriptor_distance_squared[generator_type]) continue;
+    }
+
+    // Passed all tests
+    listB.Insert(feature);
+  }
+
+  // Check if found a third feature point on shape2
+  if (listB.IsEmpty()) return 0;
+  features2[2] = SelectRandomFeature(listB, random);
+  if (!features2[2]) return 0;
+
+  // Find the transformation that minimizes the distance between the feature triplets
+  R3Point points1[3], points2[3];
+  points1[0] = features1[0]->Position();
+  points1[1] = features1[1]->Position();
+  points1[2] = features1[2]->Position();
+  points2[0] = features2[0]->Position();
+  points2[1] = features2[1]->Position();
+  points2[2] = features2[2]->Position();
+  R4Matrix matrix21 = R3AlignPoints(3, points1, points2, NULL, TRUE, TRUE, 0);
+  transformation21 = R3Affine(matrix21, 0);
+
+  // Check the normals for compatibility
+  if (max_normal_angle > 0) {
+    for (int j = 0; j < 3; j++) {
+      R3Vector normal1 = features1[j]->Normal();
+      R3Vector normal2 = features2[j]->Normal();
+      normal2.Transform(transformation21);
+      RNAngle angle = R3InteriorAngle(normal1, normal2);
+      if (angle > max_normal_angle) return 0;
+    }
+  }
+
+  // Return success
+  return 1;
+}
+
+
+
+static int
+CountRansacInliers(const FETInlierGrid& grid, const R3Affine& transformation21,
+  int nsamples, float *const samples[3], float *transformed_samples[3])
+{
+  // Transform samples from shape1 into shape2 (packed, so the loop vectorizes)
+  const R4Matrix& m = transformation21.InverseMatrix();
+  float m00 = m[0][0], m01 = m[0][1], m02 = m[0][2], m03 = m[0][3];
+  float m10 = m[1][0], m11 = m[1][1], m12 = m[1][2], m13 = m[1][3];
+  float m20 = m[2][0], m21 = m[2][1], m22 = m[2][2], m23 = m[2][3];
+  const float *sx = samples[0], *sy = samples[1], *sz = samples[2];
+  float *tx = transformed_samples[0], *ty = transformed_samples[1], *tz = transformed_samples[2];
+  for (int i = 0; i < nsamples; i++) {
+    tx[i] = m00*sx[i] + m01*sy[i] + m02*sz[i] + m03;
+    ty[i] = m10*sx[i] + m11*sy[i] + m12*sz[i] + m13;
+    tz[i] = m20*sx[i] + m21*sy[i] + m22*sz[i] + m23;
+  }
+
+  // Count samples with a shape2 feature within the inlier tolerance
+  int count = 0;
+  for (int i = 0; i < nsamples; i++) {
+    if (grid.IsInlier(tx[i], ty[i], tz[i])) count++;
+  }
+
+  // Return number of inliers
+  return count;
 }
 
 
@@ -2768,26 +3782,27 @@ CreateMatchWithRANSAC(FETReconstruction *reconstruction,
   if (shape2->NFeatures() == 0) return NULL;
 
   // Parameters
-  // int max_icp_iterations = 4;
-  int max_icp_iterations = 0;
-  // int max_ransac_iterations_per_feature = 4;
   int max_ransac_iterations_per_feature = 1;
   int num_feature2_samples = 256;
   int num_inlier_samples = 128;
+  int hypotheses_per_block = 64;
   RNScalar target_overlap = 0.1;
+  RNScalar target_inlier_fraction = 0.9;
   RNLength target_distance = target_overlap * shape1->BBox().DiagonalRadius();
   RNLength generator_tolerance = reconstruction->max_euclidean_distance;
   RNLength inlier_tolerance = reconstruction->max_euclidean_distance;
   RNAngle max_normal_angle = reconstruction->max_normal_angle;
   if (generator_tolerance < 0) generator_tolerance = RN_INFINITY;
-  if (inlier_tolerance < 0) generator_tolerance = RN_INFINITY;
-  
-  // Save the shape transformations
-  R3Affine saved_transformation1 = shape1->current_transformation;
-  R3Affine saved_transformation2 = shape2->current_transformation;
+  if (inlier_tolerance < 0) inlier_tolerance = RN_INFINITY;
+
+  // Random stream for setup (hypotheses use separate streams)
+  FETRandomStream random(reconstruction->random_seed, 
+    shape1->reconstruction_index, shape2->reconstruction_index, (unsigned long long) -1);
 
   // Make arrays of features within each generator type and shape
-  RNArray<FETFeature *> features[NUM_FEATURE_TYPES][2];
+  FETRansacParameters parameters;
+  parameters.shape1 = shape1;
+  parameters.shape2 = shape2;
   for (int i = 0; i < 2; i++) {
     FETShape *shape = (i == 0) ? shape1 : shape2;
     for (int j = 0; j < shape->NFeatures(); j++) {
@@ -2795,22 +3810,22 @@ CreateMatchWithRANSAC(FETReconstruction *reconstruction,
       int generator_type = feature->GeneratorType();
       if (generator_type < 0) continue;
       if (generator_type >= NUM_FEATURE_TYPES) continue;
-      features[generator_type][i].Insert(feature);
+      parameters.features[generator_type][i].Insert(feature);
     }
   }
 
   // Compute descriptor distance limits within each generator type
-  float max_descriptor_distance_squared[NUM_FEATURE_TYPES];
   for (int i = 0; i < NUM_FEATURE_TYPES; i++) {
-    max_descriptor_distance_squared[i] = FLT_MAX;
-    int mdds = features[i][0].NEntries() + features[i][1].NEntries();
+    parameters.max_descriptor_distance_squared[i] = FLT_MAX;
+    RNArray<FETFeature *> *features = parameters.features[i];
+    int mdds = features[0].NEntries() + features[1].NEntries();
     if (mdds > 2) {
       int ndds = 0;
       RNScalar *dds = new RNScalar [ mdds ];
       for (int j = 0; j < 2; j++) {
-        for (int k = 0; k < features[i][j].NEntries(); k++) {
-          FETFeature *featureA = features[i][j][k];
-          FETFeature *featureB = features[i][j][(int) (RNRandomScalar() * features[i][j].NEntries())];
+        for (int k = 0; k < features[j].NEntries(); k++) {
+          FETFeature *featureA = features[j][k];
+          FETFeature *featureB = features[j][(int) (random.Scalar() * features[j].NEntries())];
           const FETDescriptor& descriptorA = featureA->Descriptor();
           if (descriptorA.NValues() == 0) continue;
           const FETDescriptor& descriptorB = featureB->Descriptor();
@@ -2822,247 +3837,124 @@ CreateMatchWithRANSAC(FETReconstruction *reconstruction,
       }
       if (ndds > 0) {
         qsort(dds, ndds, sizeof(RNScalar), RNCompareScalars);
-        max_descriptor_distance_squared[i] = dds[1 * shape1->NFeatures() / 10];
+        int k = 1 * shape1->NFeatures() / 10;
+        parameters.max_descriptor_distance_squared[i] = dds[(k < ndds) ? k : ndds-1];
       }
       delete [] dds;
     }
   }
   
-  // For N iterations
-  RNScalar best_score = 0;
-  R3Affine best_transformation = R3identity_affine;
-  int niterations = max_ransac_iterations_per_feature * shape1->NFeatures();
-  for (int i = 0; i < niterations; i++) {
-    FETFeature *features1[3] = { NULL, NULL, NULL };
-    FETFeature *features2[3] = { NULL, NULL, NULL };
-
-    ////////
-
-    // Get first feature point on shape1
-    features1[0] = SelectRandomFeature(shape1->features);
-    if (!features1[0]) continue;
-
-    // Get second feature point on shape1
-    RNArray<FETFeature *> listA, listB;
-    RNLength d01 = (3*RNRandomScalar()/2 + 0.5) * target_distance;
-    shape1->FindAllFeatures(features1[0], R3identity_affine, listA, d01 - generator_tolerance, d01 + generator_tolerance);
-    if (listA.IsEmpty()) continue;
-    features1[1] = SelectRandomFeature(listA);
-    if (!features1[1]) continue;
-    if (features1[1] == features1[0]) continue;
-    R3Vector v01 = features1[1]->Position() - features1[0]->Position();
-    RNAngle angle010 = R3InteriorAngle(v01, features1[0]->normal);
-    RNAngle angle011 = R3InteriorAngle(v01, features1[1]->normal);
-    d01 = v01.Length();
-
-    // Get third feature point on shape1
-    listA.Empty();
-    RNLength d02 = (3*RNRandomScalar()/2 + 0.5) * target_distance;
-    RNLength d12 = (3*RNRandomScalar()/2 + 0.5) * target_distance;
-    shape1->FindAllFeatures(features1[0], R3identity_affine, listA, d02 - generator_tolerance, d02 + generator_tolerance);
-    if (listA.IsEmpty()) continue;
-    listB.Empty();
-    for (int j = 0; j < listA.NEntries(); j++) {
-      FETFeature *feature = listA.Kth(j);     
-      if (feature == features1[0]) continue;
-      if (feature == features1[1]) continue;
-
-      // Check distance
-      RNScalar d = R3Distance(features1[1]->Position(), feature->Position());
-      if (d < d12 - generator_tolerance) continue;
-      if (d > d12 + generator_tolerance) continue;
-
-      // Passed tests
-      listB.Insert(feature);
-    }
-    if (listB.IsEmpty()) continue;
-    features1[2] = SelectRandomFeature(listB);
-    if (!features1[2]) continue;
-    R3Vector v02 = features1[2]->Position() - features1[0]->Position();
-    R3Vector v12 = features1[2]->Position() - features1[1]->Position();
-    RNAngle angle020 = R3InteriorAngle(v02, features1[0]->normal);
-    RNAngle angle022 = R3InteriorAngle(v02, features1[2]->normal);
-    RNAngle angle121 = R3InteriorAngle(v12, features1[1]->normal);
-    RNAngle angle122 = R3InteriorAngle(v12, features1[2]->normal);
-    d02 = v02.Length();
-    d12 = v12.Length();
-
-    ////////
-
-    // Get first feature point on shape2
-    // Do this with ANN
-    listA.Empty();
-    listB.Empty();
-    // for (int j = 0; j < shape2->NFeatures(); j++) {
-    //   FETFeature *feature = shape2->Feature(j);
-    int generator_type = features1[0]->GeneratorType();
-    RNScalar best_descriptor_distance_squared = max_descriptor_distance_squared[generator_type];
-    for (int j = 0; j < num_feature2_samples; j++) {
-      FETFeature *feature = SelectRandomFeature(features[generator_type][1]);
-      RNScalar descriptor_distance_squared = feature->descriptor.SquaredDistance(features1[0]->descriptor);
-      if (descriptor_distance_squared < best_descriptor_distance_squared) {
-        best_descriptor_distance_squared = descriptor_distance_squared;
-        features2[0] = feature;
-      }
-    }
-
-    // Check if found first feature
-    if (!features2[0]) continue;
-
-    // Get second feature point on shape2
-    listA.Empty();
-    listB.Empty();
-    FETFeature query1(*features2[0]);
-    query1.SetDescriptor(features1[1]->descriptor);
-    shape2->FindAllFeatures(&query1, R3identity_affine, listA, d01 - generator_tolerance, d01 + generator_tolerance);
-    if (listA.IsEmpty()) continue;
-    for (int j = 0; j < listA.NEntries(); j++) {
-      FETFeature *feature = listA.Kth(j);     
-      if (feature == features2[0]) continue;
-
-      // Check angle relationship to v01
-      if (max_normal_angle != RN_UNKNOWN) {
-        R3Vector v = feature->Position() - features2[0]->Position();
-        if (fabs(R3InteriorAngle(v, features2[0]->normal) - angle010) > max_normal_angle) continue;
-        if (fabs(R3InteriorAngle(v, feature->normal) - angle011) > max_normal_angle) continue;
-      }
-
-      // Check descriptor relationship to features1[1]
-      int generator_type = feature->GeneratorType();
-      if (max_descriptor_distance_squared[generator_type] < FLT_MAX) {
-        RNScalar descriptor_distance_squared = feature->descriptor.SquaredDistance(features1[1]->descriptor);
-        if (descriptor_distance_squared > max_descriptor_distance_squared[generator_type]) continue;
-      }
-
-      // Passed all tests
-      listB.Insert(feature);
-    }
-
-    // Check if found a second feature point on shape2
-    if (listB.IsEmpty()) continue;
-    features2[1] = SelectRandomFeature(listB);
-    if (!features2[1]) continue;
-
-    // Get third feature point on shape2
-    listA.Empty();
-    listB.Empty();
-    FETFeature query2(*features2[0]);
-    query2.SetDescriptor(features1[2]->descriptor);
-    shape2->FindAllFeatures(&query2, R3identity_affine, listA, d02 - generator_tolerance, d02 + generator_tolerance);
-    if (listA.IsEmpty()) continue;
-    for (int j = 0; j < listA.NEntries(); j++) {
-      FETFeature *feature = listA.Kth(j);     
-      if (feature == features2[0]) continue;
-      if (feature == features2[1]) continue;
-
-      // Check distance relationship 
-      RNLength d = R3Distance(feature->Position(), features2[0]->Position());
-      if (d < d12 - generator_tolerance) continue;
-      if (d > d12 + generator_tolerance) continue;
-
-      // Check angle relationship to v02
-      if (max_normal_angle != RN_UNKNOWN) {
-        R3Vector v = feature->Position() - features2[0]->Position();
-        if (fabs(R3InteriorAngle(v, features2[0]->normal) - angle020) > max_normal_angle) continue;
-        if (fabs(R3InteriorAngle(v, feature->normal) - angle022) > max_normal_angle) continue;
-      }
-
-      // Check angle relationship to v12
-      if (max_normal_angle != RN_UNKNOWN) {
-        R3Vector v = feature->Position() - features2[1]->Position();
-        if (fabs(R3InteriorAngle(v, features2[1]->normal) - angle121) > max_normal_angle) continue;
-        if (fabs(R3InteriorAngle(v, feature->normal) - angle122) > max_normal_angle) continue;
-      }
+  // Find best descriptor matches on shape2 for every feature of shape1 (with same generator type)
+  const int max_descriptor_matches = 8;
+  const FETDescriptorMatrix *descriptors1 = shape1->DescriptorMatrix();
+  const FETDescriptorMatrix *descriptors2 = shape2->DescriptorMatrix();
+  int *descriptor_matches = new int [ shape1->NFeatures() * max_descriptor_matches ];
+  float *descriptor_distances = new float [ shape1->NFeatures() * max_descriptor_matches ];
+  descriptors1->FindBestMatches(*descriptors2, max_descriptor_matches, descriptor_matches, descriptor_distances);
+  parameters.descriptor_matches = descriptor_matches;
+  parameters.descriptor_distances = descriptor_distances;
+  parameters.max_descriptor_matches = max_descriptor_matches;
+  parameters.num_feature2_samples = num_feature2_samples;
+  parameters.target_distance = target_distance;
+  parameters.generator_tolerance = generator_tolerance;
+  parameters.max_normal_angle = max_normal_angle;
+
+  // Build kdtrees before searching them in parallel
+  shape1->UpdateKdtree();
+  shape2->UpdateKdtree();
+
+  // Build grid of shape2 feature positions for counting inliers
+  FETInlierGrid grid(shape2, inlier_tolerance);
+
+  // Pack positions of shape1 features sampled for counting inliers
+  int inlier_skip = shape1->NFeatures() / num_inlier_samples + 1;
+  int nsamples = (shape1->NFeatures() + inlier_skip - 1) / inlier_skip;
+  float *samples[3];
+  for (int j = 0; j < 3; j++) samples[j] = new float [ nsamples ];
+  for (int i = 0; i < nsamples; i++) {
+    const R3Point& position = shape1->Feature(i * inlier_skip)->Position();
+    for (int j = 0; j < 3; j++) samples[j][i] = position[j];
+  }
 
-      // Check descriptor relationship to features1[2]
-      int generator_type = feature->GeneratorType();
-      if (max_descriptor_distance_squared[generator_type] < FLT_MAX) {
-        RNScalar descriptor_distance_squared = feature->descriptor.SquaredDistance(features1[2]->descriptor);
-        if (descriptor_distance_squared > max_descriptor_distance_squared[generator_type]) continue;
+  // Allocate best hypothesis of every block
+  int niterations = max_ransac_iterations_per_feature * shape1->NFeatures();
+  int nblocks = (niterations + hypotheses_per_block - 1) / hypotheses_per_block;
+  RNScalar *block_scores = new RNScalar [ nblocks ];
+  R3Affine *block_transformations = new R3Affine [ nblocks ];
+  RNScalar target_score = target_inlier_fraction * nsamples * inlier_skip;
+  int first_finished_block = nblocks;
+
+  // Create and score hypotheses in blocks, each with its own random stream.
+  // Once a block finds a hypothesis with the target score, later blocks are 
+  // skipped, and the result is the same as when hypotheses are tried in order.
+#pragma omp parallel for schedule(dynamic, 1)
+  for (int b = 0; b < nblocks; b++) {
+    // Initialize block
+    block_scores[b] = 0;
+    FETRandomStream block_random(reconstruction->random_seed,
+      shape1->reconstruction_index, shape2->reconstruction_index, b);
+    float *transformed_samples[3];
+    for (int j = 0; j < 3; j++) transformed_samples[j] = new float [ nsamples ];
+    FETFeature query;
+
+    // Try hypotheses in block
+    int block_end = (b + 1) * hypotheses_per_block;
+    if (block_end > niterations) block_end = niterations;
+    for (int i = b * hypotheses_per_block; i < block_end; i++) {
+      // Check if an earlier block has finished
+      int first_finished;
+#pragma omp atomic read
+      first_finished = first_finished_block;
+      if (b > first_finished) break;
+
+      // Create hypothesis
+      R3Affine transformation21;
+      if (!CreateRansacHypothesis(parameters, block_random, query, transformation21)) continue;
+
+      // Count the inliers
+      RNScalar score = inlier_skip * CountRansacInliers(grid, transformation21, nsamples, samples, transformed_samples);
+
+      // Remember transformation, if best score
+      if (score > block_scores[b]) {
+        block_transformations[b] = transformation21;
+        block_scores[b] = score;
       }
 
-      // Passed all tests
-      listB.Insert(feature);
-    }
-
-    // Check if found a third feature point on shape2
-    if (listB.IsEmpty()) continue;
-    features2[2] = SelectRandomFeature(listB);
-    if (!features2[2]) continue;
-
-    // Find the transformation that minimizes the distance between the feature triplets
-    R3Point points1[3], points2[3];
-    points1[0] = features1[0]->Position();
-    points1[1] = features1[1]->Position();
-    points1[2] = features1[2]->Position();
-    points2[0] = features2[0]->Position();
-    points2[1] = features2[1]->Position();
-    points2[2] = features2[2]->Position();
-
-#if 1
-    R4Matrix matrix21 = R3AlignPoints(3, points1, points2, NULL, TRUE, TRUE, 0);
-    R3Affine transformation21(matrix21, 0);
-#else
-    R3CoordSystem cs1(points1[0], R3Triad(points1[1] - points1[0], points1[2] - points1[0]));
-    R3CoordSystem cs2(points2[0], R3Triad(points2[1] - points2[0], points2[2] - points2[0]));
-    R3Affine transformation21 = R3identity_affine;
-    transformation21.Transform(R3Affine(cs1.Matrix(), 0));
-    transformation21.InverseTransform(R3Affine(cs2.Matrix(), 0));
-#endif
-
-    // Check the normals for compatibility
-    if (max_normal_angle > 0) {
-      RNBoolean normals_are_compatible = TRUE;
-      for (int j = 0; j < 3; j++) {
-        R3Vector normal1 = features1[j]->Normal();
-        R3Vector normal2 = features2[j]->Normal();
-        normal2.Transform(transformation21);
-        RNAngle angle = R3InteriorAngle(normal1, normal2);
-        if (angle > max_normal_angle) {
-          normals_are_compatible = FALSE;
-          break;
+      // Check if reached target score
+      if (score >= target_score) {
+#pragma omp critical(FETRansacTermination)
+        {
+          if (b < first_finished_block) {
+#pragma omp atomic write
+            first_finished_block = b;
+          }
         }
-      }
-      if (!normals_are_compatible) continue;
-    }
-
-    if (max_icp_iterations > 0) {
-#if 0
-      // Optimize transformation with ICP
-      FETShape *s1 = new FETShape(*shape1);
-      FETShape *s2 = new FETShape(*shape2);
-      s1->current_transformation = R3identity_affine;
-      s2->current_transformation = R3identity_affine;
-      FETMatch match(s1, s2, transformation21);
-      // XXX match.OptimizeTransformationsWithICP(8);
-      // RNScalar score = match.Score();
-      transformation21 = R3identity_affine;
-      transformation21.InverseTransform(s1->Transformation());
-      transformation21.Transform(s2->Transformation());
-#endif
-    }
-
-    // Count the inliers
-    RNScalar score = 0;
-    int inlier_skip = shape1->NFeatures() / num_inlier_samples + 1;
-    for (int j = 0; j < shape1->NFeatures(); j += inlier_skip) {
-      FETFeature *feature1 = shape1->Feature(j);
-      R3Point position1 = feature1->Position();
-      position1.InverseTransform(transformation21);
-      if (shape2->FindClosestFeature(position1, 0, inlier_tolerance)) {
-        score += inlier_skip;
+        break;
       }
     }
 
-    // printf("%d %g\n", i, score);
+    // Release block data
+    ReleaseQueryFeature(query);
+    for (int j = 0; j < 3; j++) delete [] transformed_samples[j];
+  }
 
-    // Remember transformation, if best score
-    if (score > best_score) {
-      best_transformation = transformation21;
-      best_score = score;
+  // Find best hypothesis among blocks up to first finished one
+  RNScalar best_score = 0;
+  R3Affine best_transformation = R3identity_affine;
+  for (int b = 0; (b < nblocks) && (b <= first_finished_block); b++) {
+    if (block_scores[b] > best_score) {
+      best_transformation = block_transformations[b];
+      best_score = block_scores[b];
     }
   }
 
+  // Delete temporary data
+  for (int j = 0; j < 3; j++) delete [] samples[j];
+  delete [] block_scores;
+  delete [] block_transformations;
+  delete [] descriptor_matches;
+  delete [] descriptor_distances;
+
   if (best_score == 0) return NULL;
 
   R4Matrix m = best_transformation.Matrix();
@@ -3076,10 +3968,6 @@ CreateMatchWithRANSAC(FETReconstruction *reconstruction,
   // Create match
   FETMatch *match = new FETMatch(reconstruction, shape1, shape2, best_transformation, best_score);
 
-  // Restore the saved transformations
-  shape1->current_transformation = saved_transformation1;
-  shape2->current_transformation = saved_transformation2;
-
   // Return match
   return match;
 }
@@ -3163,7 +4051,8 @@ OptimizeTransformationsWithLinearSystemOfEquations(void)
 
   // Solve system of equations
   if (equations.NEquations() >= n) {
-    if (!equations.Minimize(x, solver, 1E-3)) {
+    int system_solver = (solver == FET_POSE_GRAPH_SOLVER) ? RN_CSPARSE_SOLVER : solver;
+    if (!equations.Minimize(x, system_solver, 1E-3)) {
       fprintf(stderr, "Unable to minimize system of equations\n");
       delete [] x;
       return;
@@ -3224,6 +4113,9 @@ OptimizeTransformations(void)
     (total_trajectory_weight == 0)) {
     OptimizeTransformationsWithGlobalRelaxation();
   }
+  else if (solver == FET_POSE_GRAPH_SOLVER) {
+    OptimizeTransformationsWithPoseGraph();
+  }
   else {
     OptimizeTransformationsWithLinearSystemOfEquations();
   }
@@ -34,11 +34,13 @@ public:
   int ReadFile(const char *filename);
   int ReadAsciiFile(const char *filename);
   int ReadBinaryFile(const char *filename);
+  int ReadColumnarFile(const char *filename);
   int ReadAscii(FILE *fp);
   int ReadBinary(FILE *fp);
   int WriteFile(const char *filename) const;
   int WriteAsciiFile(const char *filename) const;
   int WriteBinaryFile(const char *filename) const;
+  int WriteColumnarFile(const char *filename) const;
   int WriteAscii(FILE *fp) const;
   int WriteBinary(FILE *fp) const;
 
@@ -80,6 +82,7 @@ public:
   // Internal transformation functions
   void OptimizeTransformationsWithClosedFormEquations(void);
   void OptimizeTransformationsWithLinearSystemOfEquations(void);
+  void OptimizeTransformationsWithPoseGraph(void);
  
   // Internal system of equation functions
   void AddPointPointCorrespondenceEquations(RNSystemOfEquations *system, FETShape *shape1, FETShape *shape2, 
@@ -102,10 +105,22 @@ public:
   void AddCorrespondenceEquations(RNSystemOfEquations *system, RNScalar *w);
   void AddCorrespondenceEquations(RNSystemOfEquations *system, FETCorrespondence *correspondence, RNScalar w);
 
+  // Internal pose graph functions
+  void AddPairwiseTransformationResiduals(FETPoseGraph *graph, FETShape *shape1, FETShape *shape2,
+    const R3Affine& transformation, RNScalar w);
+  void AddInertiaResiduals(FETPoseGraph *graph, RNScalar w);
+  void AddTrajectoryResiduals(FETPoseGraph *graph, RNScalar w, RNScalar sigma = 0.25);
+  void AddMatchResiduals(FETPoseGraph *graph, RNScalar w);
+  void AddCorrespondenceResiduals(FETPoseGraph *graph, RNScalar *w);
+  void AddCorrespondenceResiduals(FETPoseGraph *graph, FETCorrespondence *correspondence, RNScalar w);
+
  // Correspondence manipulation
   void EmptyCorrespondences(void);
   void CreateCorrespondences(void);
   void CreateCorrespondences(FETShape *shape1, FETShape *shape2, RNScalar max_correspondences = RN_UNKNOWN);
+  int SelectQueryFeatures(FETShape *shape1, FETShape *shape2, RNScalar max_correspondences, RNArray<FETFeature *>& query_features2);
+  int FindCorrespondences(FETShape *shape1, FETShape *shape2, const RNArray<FETFeature *>& query_features2,
+    FETFeature **features1, RNScalar *affinities) const;
   void DiscardOutlierCorrespondences(RNScalar max_zscore = 3, int max_iterations = 8, int min_correspondences = 5);
   void SelectCorrespondences(int max_correspondences = -1);
   void TruncateCorrespondences(int max_correspondences = 0);
@@ -144,6 +159,9 @@ public:
   RNBoolean discard_not_mutually_closest;
   RNBoolean discard_outliers;
 
+  // Match parameters
+  int random_seed;
+
   // Transformation parameters
   RNScalar total_match_weight;
   RNScalar total_correspondence_weights[NUM_FEATURE_TYPES];
@@ -153,10 +171,21 @@ public:
 
   // Geometry parameters
   R3Box bbox;
+
+  // Optimization data (reused by successive optimizations)
+  FETPoseGraph *pose_graph;
 };
 
 
 
+////////////////////////////////////////////////////////////////////////
+// Solver names (in addition to RN solvers)
+////////////////////////////////////////////////////////////////////////
+
+#define FET_POSE_GRAPH_SOLVER RN_NUM_SOLVERS
+
+
+
 ////////////////////////////////////////////////////////////////////////
 // Inline functions
 ////////////////////////////////////////////////////////////////////////
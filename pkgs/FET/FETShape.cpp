@@ -22,6 +22,7 @@ FETShape(FETReconstruction *reconstruction)
     current_transformation(R3identity_affine),
     ground_truth_transformation(R3identity_affine),
     kdtree(NULL),
+    descriptor_matrix(NULL),
     viewpoint(0, 0, 0),
     towards(0, 0, 0),
     up(0, 0, 0),
@@ -56,6 +57,7 @@ FETShape(const FETShape& shape)
     current_transformation(shape.current_transformation),
     ground_truth_transformation(shape.ground_truth_transformation),
     kdtree(NULL),
+    descriptor_matrix(NULL),
     viewpoint(shape.viewpoint),
     towards(shape.towards),
     up(shape.up),
@@ -137,6 +139,12 @@ FETShape::
     delete kdtree;
     kdtree = NULL;
   }
+
+  // Delete descriptor matrix
+  if (descriptor_matrix) {
+    delete descriptor_matrix;
+    descriptor_matrix = NULL;
+  }
   
   // Remove from reconstruction
   if (reconstruction) reconstruction->RemoveShape(this);
@@ -158,6 +166,16 @@ BBox(void) const
 
 
 
+const FETDescriptorMatrix *FETShape::
+DescriptorMatrix(void) const
+{
+  // Return matrix of feature descriptors
+  if (!descriptor_matrix) ((FETShape *) this)->UpdateDescriptorMatrix();
+  return descriptor_matrix;
+}
+
+
+
 RNLength FETShape::
 AverageFeatureRadius(void) const
 {
@@ -230,6 +248,9 @@ InsertFeature(FETFeature *feature)
   if (!bbox.IsEmpty()) {
     bbox.Union(feature->Position(TRUE));
   }
+
+  // Invalidate descriptor matrix
+  InvalidateDescriptorMatrix();
 }
 
 
@@ -254,6 +275,7 @@ RemoveFeature(FETFeature *feature)
   // Reset stuff
   InvalidateBBox();
   InvalidateKdtree();
+  InvalidateDescriptorMatrix();
 }
 
 
@@ -755,6 +777,32 @@ InvalidateKdtree(void)
 
 
 
+void FETShape::
+UpdateDescriptorMatrix(void)
+{
+  // Check if already uptodate
+  if (descriptor_matrix) return;
+
+  // Pack descriptors of features into matrix (row index is shape_index)
+  descriptor_matrix = new FETDescriptorMatrix(features);
+  if (!descriptor_matrix) RNAbort("Cannot build descriptor matrix");
+}
+
+
+
+void FETShape::
+InvalidateDescriptorMatrix(void)
+{
+  // Check if already invalid
+  if (!descriptor_matrix) return;
+
+  // Delete descriptor matrix
+  delete descriptor_matrix;
+  descriptor_matrix = NULL;
+}
+
+
+
 
 ////////////////////////////////////////////////////////////////////////
 // Search functions
@@ -814,6 +862,22 @@ FindClosestFeature(FETFeature *query_feature, const R3Affine& query_transformati
 
 
 
+FETFeature *FETShape::
+FindClosestFeature(FETFeature *query_feature, const FETCompatibilityParameters& compatibility,
+  RNLength min_euclidean_distance, RNLength max_euclidean_distance) const
+{
+  // Query feature is already in this shape's coordinate system, and it is
+  // not modified, so concurrent searches are safe once the kdtree is built
+  if (!kdtree) ((FETShape *) this)->UpdateKdtree();
+
+  // Find closest feature
+  return kdtree->FindClosest(query_feature, 
+    min_euclidean_distance, max_euclidean_distance, 
+    AreFeaturesCompatible, (void *) &compatibility);
+}
+
+
+
 int FETShape::
 FindAllFeatures(FETFeature *query_feature, const R3Affine& query_transformation, RNArray<FETFeature *>& result,
   RNLength min_euclidean_distance, RNLength max_euclidean_distance, 
@@ -857,6 +921,26 @@ FindAllFeatures(FETFeature *query_feature, const R3Affine& query_transformation,
 
 
 
+int FETShape::
+FindAllFeatures(FETFeature *query_feature, const FETCompatibilityParameters& compatibility, RNArray<FETFeature *>& result,
+  RNLength min_euclidean_distance, RNLength max_euclidean_distance) const
+{
+  // Query feature is already in this shape's coordinate system, and it is
+  // not modified, so concurrent searches are safe once the kdtree is built
+  if (!kdtree) ((FETShape *) this)->UpdateKdtree();
+
+  // Find all features
+  kdtree->FindAll(query_feature, 
+    min_euclidean_distance, max_euclidean_distance, 
+    AreFeaturesCompatible, (void *) &compatibility, 
+    result);
+
+  // Return number of features found
+  return result.NEntries();
+}
+
+
+
 int FETShape::
 ComputeTransformedPointCoordinates(const R3Point& position, 
   RNAlgebraic *& px, RNAlgebraic *& py, RNAlgebraic *& pz) const
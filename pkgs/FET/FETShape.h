@@ -35,6 +35,7 @@ public:
   RNLength AverageFeatureRadius(void) const;
   const R3Affine& Transformation(int transformation_type = 0) const;
   const char *Name(void) const;
+  const FETDescriptorMatrix *DescriptorMatrix(void) const;
 
   // Manipulation
   void ResetTransformation(void);
@@ -63,11 +64,15 @@ public:
     RNLength *max_descriptor_distances = NULL, RNAngle max_normal_angle = RN_UNKNOWN,
     RNScalar min_distinction = RN_UNKNOWN, RNScalar min_salience = RN_UNKNOWN,
     RNBoolean discard_boundaries = FALSE);
+  FETFeature *FindClosestFeature(FETFeature *query_feature, const FETCompatibilityParameters& compatibility,
+    RNLength min_euclidean_distance = RN_UNKNOWN, RNLength max_euclidean_distance = RN_UNKNOWN) const;
   int FindAllFeatures(FETFeature *query_feature, const R3Affine& query_transformation, RNArray<FETFeature *>& result,
     RNLength min_euclidean_distance = RN_UNKNOWN, RNLength max_euclidean_distance = RN_UNKNOWN, 
     RNLength *max_descriptor_distances = NULL, RNAngle max_normal_angle = RN_UNKNOWN,
     RNScalar min_distinction = RN_UNKNOWN, RNScalar min_salience = RN_UNKNOWN,
     RNBoolean discard_boundaries = FALSE);
+  int FindAllFeatures(FETFeature *query_feature, const FETCompatibilityParameters& compatibility, RNArray<FETFeature *>& result,
+    RNLength min_euclidean_distance = RN_UNKNOWN, RNLength max_euclidean_distance = RN_UNKNOWN) const;
 
 public:
   // Internal properties
@@ -95,6 +100,8 @@ public:
   void UpdateBBox(void);
   void InvalidateKdtree(void);
   void UpdateKdtree(void);
+  void InvalidateDescriptorMatrix(void);
+  void UpdateDescriptorMatrix(void);
 
   // Variable stuff
   int NVariables(void) const;
@@ -132,6 +139,7 @@ public:
   
   // Geometric properties
   R3Kdtree<struct FETFeature *> *kdtree;
+  FETDescriptorMatrix *descriptor_matrix;
   R3Point viewpoint; // untransformed
   R3Vector towards, up; // untransformed
   R3Box bbox; // transformed
@@ -21,6 +21,7 @@ class PDBChain;
 class PDBModel;
 class PDBFile;
 class PDBBond;
+class PDBAtomIndex;
 
 
 
@@ -60,6 +61,7 @@ extern RNMark PDBmark;
 #include "PDBModel.h"
 #include "PDBFile.h"
 #include "PDBBond.h"
+#include "PDBAtomIndex.h"
 #include "PDBDistance.h"
 
 
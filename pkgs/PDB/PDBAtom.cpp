@@ -50,7 +50,7 @@ PDBAtom(PDBModel *model, PDBChain *chain, PDBResidue *residue, PDBElement *eleme
   // Insert atome into residue, chain, and model
   if (residue) { residue->atoms.Insert(this); residue->bbox.Union(bbox); }
   if (chain) { chain->atoms.Insert(this); chain->bbox.Union(bbox); }
-  if (model) { model->atoms.Insert(this); model->bbox.Union(bbox); }
+  if (model) { model->atoms.Insert(this); model->bbox.Union(bbox); model->InvalidateAtomIndex(); }
 }
 
 
@@ -70,6 +70,7 @@ PDBAtom::
       PDBModel *model = chain->Model();
       if (model) {
         model->atoms.Remove(this);
+        model->InvalidateAtomIndex();
       }
     }
   }
@@ -163,7 +164,7 @@ SetPosition(const R3Point& position)
     if (chain) { 
       chain->bbox.Union(bbox); 
       PDBModel *model = chain->model;
-      if (model) model->bbox.Union(bbox); 
+      if (model) { model->bbox.Union(bbox); model->InvalidateAtomIndex(); }
     }
   }
 }
@@ -188,7 +189,7 @@ Transform(const R3Affine& affine)
     if (chain) { 
       chain->bbox.Union(bbox); 
       PDBModel *model = chain->model;
-      if (model) model->bbox.Union(bbox); 
+      if (model) { model->bbox.Union(bbox); model->InvalidateAtomIndex(); }
     }
   }
 }
@@ -0,0 +1,360 @@
+// Source file for PDBAtomIndex
+
+
+
+// Include files
+
+#include "PDB.h"
+
+
+
+PDBAtomIndex::
+PDBAtomIndex(const RNArray<PDBAtom *>& input_atoms, RNLength min_cell_size)
+  : atoms(NULL),
+    coordinates(NULL),
+    radii(NULL),
+    natoms(0),
+    origin(0, 0, 0),
+    cell_size(min_cell_size),
+    cell_starts(NULL),
+    max_radius(0)
+{
+  // Allocate arrays
+  natoms = input_atoms.NEntries();
+  atoms = new PDBAtom * [ natoms + 1 ];
+  coordinates = new RNCoord [ 3 * natoms + 1 ];
+  radii = new RNLength [ natoms + 1 ];
+
+  // Compute bounding box of atom centers and maximum radius
+  R3Box box = R3null_box;
+  for (int i = 0; i < natoms; i++) {
+    PDBAtom *atom = input_atoms.Kth(i);
+    box.Union(atom->Position());
+    if (atom->Radius() > max_radius) max_radius = atom->Radius();
+  }
+  if (natoms == 0) box = R3Box(0, 0, 0, 0, 0, 0);
+
+  // Compute cell resolution (grow cells until there are not many more cells than atoms)
+  if (cell_size < 1.0E-3) cell_size = 1.0E-3;
+  origin = box.Min();
+  while (TRUE) {
+    RNScalar ncells = 1;
+    for (int dim = 0; dim < 3; dim++) {
+      resolution[dim] = (int) (box.AxisLength(dim) / cell_size) + 1;
+      ncells *= resolution[dim];
+    }
+    if (ncells <= 8.0 * natoms + 64) break;
+    cell_size *= 1.25;
+  }
+
+  // Compute cell of every atom
+  int ncells = resolution[0] * resolution[1] * resolution[2];
+  int *atom_cells = new int [ natoms + 1 ];
+  cell_starts = new int [ ncells + 1 ];
+  for (int i = 0; i <= ncells; i++) cell_starts[i] = 0;
+  for (int i = 0; i < natoms; i++) {
+    const R3Point& position = input_atoms.Kth(i)->Position();
+    int cell[3];
+    for (int dim = 0; dim < 3; dim++) {
+      cell[dim] = (int) ((position[dim] - origin[dim]) / cell_size);
+      if (cell[dim] < 0) cell[dim] = 0;
+      else if (cell[dim] >= resolution[dim]) cell[dim] = resolution[dim] - 1;
+    }
+    atom_cells[i] = (cell[2] * resolution[1] + cell[1]) * resolution[0] + cell[0];
+    cell_starts[atom_cells[i] + 1]++;
+  }
+
+  // Sort atoms by cell (stable, so atoms in each cell remain in input order)
+  for (int i = 0; i < ncells; i++) cell_starts[i+1] += cell_starts[i];
+  int *cell_fill = new int [ ncells ];
+  for (int i = 0; i < ncells; i++) cell_fill[i] = cell_starts[i];
+  for (int i = 0; i < natoms; i++) {
+    PDBAtom *atom = input_atoms.Kth(i);
+    int slot = cell_fill[atom_cells[i]]++;
+    atoms[slot] = atom;
+    coordinates[3*slot+0] = atom->Position().X();
+    coordinates[3*slot+1] = atom->Position().Y();
+    coordinates[3*slot+2] = atom->Position().Z();
+    radii[slot] = atom->Radius();
+  }
+
+  // Delete temporary memory
+  delete [] atom_cells;
+  delete [] cell_fill;
+}
+
+
+
+PDBAtomIndex::
+~PDBAtomIndex(void)
+{
+  // Delete arrays
+  if (atoms) delete [] atoms;
+  if (coordinates) delete [] coordinates;
+  if (radii) delete [] radii;
+  if (cell_starts) delete [] cell_starts;
+}
+
+
+
+void PDBAtomIndex::
+FindCells(const R3Box& box, RNLength offset, int min_cell[3], int max_cell[3]) const
+{
+  // Find range of cells overlapping box grown by offset (empty if min_cell > max_cell)
+  for (int dim = 0; dim < 3; dim++) {
+    RNScalar lo = (box.Min()[dim] - offset - origin[dim]) / cell_size;
+    RNScalar hi = (box.Max()[dim] + offset - origin[dim]) / cell_size;
+    if ((hi < 0) || (lo >= resolution[dim])) {
+      min_cell[0] = min_cell[1] = min_cell[2] = 1;
+      max_cell[0] = max_cell[1] = max_cell[2] = 0;
+      return;
+    }
+    min_cell[dim] = (lo > 0) ? (int) lo : 0;
+    max_cell[dim] = (hi < resolution[dim] - 1) ? (int) hi : resolution[dim] - 1;
+  }
+}
+
+
+
+void PDBAtomIndex::
+FindCells(const R3Point& position, RNLength offset, int min_cell[3], int max_cell[3]) const
+{
+  // Find range of cells within offset of position
+  FindCells(R3Box(position, position), offset, min_cell, max_cell);
+}
+
+
+
+int PDBAtomIndex::
+FindAtoms(const R3Point& position, RNLength max_distance, RNArray<PDBAtom *>& result) const
+{
+  // Find cells that may contain atoms within max_distance
+  int min_cell[3], max_cell[3];
+  FindCells(position, max_distance + max_radius, min_cell, max_cell);
+
+  // Insert atoms whose surface is within max_distance of position
+  int count = 0;
+  for (int k = min_cell[2]; k <= max_cell[2]; k++) {
+    for (int j = min_cell[1]; j <= max_cell[1]; j++) {
+      int row = (k * resolution[1] + j) * resolution[0];
+      for (int slot = cell_starts[row + min_cell[0]]; slot < cell_starts[row + max_cell[0] + 1]; slot++) {
+        RNLength r = max_distance + radii[slot];
+        if (r < 0) continue;
+        RNCoord dx = coordinates[3*slot+0] - position.X();
+        RNCoord dy = coordinates[3*slot+1] - position.Y();
+        RNCoord dz = coordinates[3*slot+2] - position.Z();
+        if (dx*dx + dy*dy + dz*dz > r*r) continue;
+        result.Insert(atoms[slot]);
+        count++;
+      }
+    }
+  }
+
+  // Return number of atoms found
+  return count;
+}
+
+
+
+int PDBAtomIndex::
+FindAtoms(PDBAtom *atom, RNLength max_distance, RNArray<PDBAtom *>& result) const
+{
+  // Find cells that may contain atoms within max_distance
+  const R3Point& position = atom->Position();
+  RNLength atom_radius = atom->Radius();
+  int min_cell[3], max_cell[3];
+  FindCells(position, max_distance + atom_radius + max_radius, min_cell, max_cell);
+
+  // Insert other atoms within max_distance of atom
+  int count = 0;
+  for (int k = min_cell[2]; k <= max_cell[2]; k++) {
+    for (int j = min_cell[1]; j <= max_cell[1]; j++) {
+      int row = (k * resolution[1] + j) * resolution[0];
+      for (int slot = cell_starts[row + min_cell[0]]; slot < cell_starts[row + max_cell[0] + 1]; slot++) {
+        if (atoms[slot] == atom) continue;
+        RNLength r = max_distance + atom_radius + radii[slot];
+        if (r < 0) continue;
+        RNCoord dx = coordinates[3*slot+0] - position.X();
+        RNCoord dy = coordinates[3*slot+1] - position.Y();
+        RNCoord dz = coordinates[3*slot+2] - position.Z();
+        if (dx*dx + dy*dy + dz*dz > r*r) continue;
+        result.Insert(atoms[slot]);
+        count++;
+      }
+    }
+  }
+
+  // Return number of atoms found
+  return count;
+}
+
+
+
+int PDBAtomIndex::
+FindAtoms(PDBResidue *residue, RNLength max_distance, RNArray<PDBAtom *>& result) const
+{
+  // Check residue
+  if (residue->NAtoms() == 0) return 0;
+
+  // Compute bounding box of atom centers in residue
+  R3Box box = R3null_box;
+  RNLength residue_radius = 0;
+  for (int i = 0; i < residue->NAtoms(); i++) {
+    PDBAtom *atom = residue->Atom(i);
+    box.Union(atom->Position());
+    if (atom->Radius() > residue_radius) residue_radius = atom->Radius();
+  }
+
+  // Find cells that may contain atoms within max_distance
+  int min_cell[3], max_cell[3];
+  FindCells(box, max_distance + residue_radius + max_radius, min_cell, max_cell);
+
+  // Insert atoms of other residues within max_distance of any atom in residue (each once)
+  int count = 0;
+  for (int k = min_cell[2]; k <= max_cell[2]; k++) {
+    for (int j = min_cell[1]; j <= max_cell[1]; j++) {
+      int row = (k * resolution[1] + j) * resolution[0];
+      for (int slot = cell_starts[row + min_cell[0]]; slot < cell_starts[row + max_cell[0] + 1]; slot++) {
+        if (atoms[slot]->Residue() == residue) continue;
+        for (int i = 0; i < residue->NAtoms(); i++) {
+          PDBAtom *atom = residue->Atom(i);
+          RNLength r = max_distance + atom->Radius() + radii[slot];
+          if (r < 0) continue;
+          RNCoord dx = coordinates[3*slot+0] - atom->Position().X();
+          RNCoord dy = coordinates[3*slot+1] - atom->Position().Y();
+          RNCoord dz = coordinates[3*slot+2] - atom->Position().Z();
+          if (dx*dx + dy*dy + dz*dz > r*r) continue;
+          result.Insert(atoms[slot]);
+          count++;
+          break;
+        }
+      }
+    }
+  }
+
+  // Return number of atoms found
+  return count;
+}
+
+
+
+int PDBAtomIndex::
+FindAtomPairs(RNLength max_distance, RNArray<PDBAtom *>& result1, RNArray<PDBAtom *>& result2) const
+{
+  // Determine how many cells to search in each direction
+  int extent = (int) ((max_distance + 2 * max_radius) / cell_size) + 1;
+
+  // Visit every pair of cells once (second cell is in the same cell or after the first one)
+  int count = 0;
+  for (int k1 = 0; k1 < resolution[2]; k1++) {
+    for (int j1 = 0; j1 < resolution[1]; j1++) {
+      for (int i1 = 0; i1 < resolution[0]; i1++) {
+        int cell1 = (k1 * resolution[1] + j1) * resolution[0] + i1;
+        if (cell_starts[cell1] == cell_starts[cell1+1]) continue;
+        for (int k2 = k1; (k2 <= k1 + extent) && (k2 < resolution[2]); k2++) {
+          int min_j2 = (k2 == k1) ? j1 : j1 - extent;
+          if (min_j2 < 0) min_j2 = 0;
+          for (int j2 = min_j2; (j2 <= j1 + extent) && (j2 < resolution[1]); j2++) {
+            int min_i2 = ((k2 == k1) && (j2 == j1)) ? i1 : i1 - extent;
+            if (min_i2 < 0) min_i2 = 0;
+            int max_i2 = i1 + extent;
+            if (max_i2 >= resolution[0]) max_i2 = resolution[0] - 1;
+            int row2 = (k2 * resolution[1] + j2) * resolution[0];
+            for (int slot1 = cell_starts[cell1]; slot1 < cell_starts[cell1+1]; slot1++) {
+              int start2 = cell_starts[row2 + min_i2];
+              if (row2 + min_i2 == cell1) start2 = slot1 + 1;
+              for (int slot2 = start2; slot2 < cell_starts[row2 + max_i2 + 1]; slot2++) {
+                RNLength r = max_distance + radii[slot1] + radii[slot2];
+                if (r < 0) continue;
+                RNCoord dx = coordinates[3*slot2+0] - coordinates[3*slot1+0];
+                RNCoord dy = coordinates[3*slot2+1] - coordinates[3*slot1+1];
+                RNCoord dz = coordinates[3*slot2+2] - coordinates[3*slot1+2];
+                if (dx*dx + dy*dy + dz*dz > r*r) continue;
+                result1.Insert(atoms[slot1]);
+                result2.Insert(atoms[slot2]);
+                count++;
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+
+  // Return number of pairs found
+  return count;
+}
+
+
+
+PDBAtom *PDBAtomIndex::
+FindClosestAtom(PDBAtom *atom, PDBChain *chain, RNLength max_distance, RNLength *closest_distance) const
+{
+  // Initialize result
+  PDBAtom *closest_atom = NULL;
+  RNLength closest_squared_distance = RN_INFINITY;
+  if (closest_distance) *closest_distance = RN_INFINITY;
+  if (natoms == 0) return NULL;
+
+  // Find cell containing atom (clamped to grid)
+  const R3Point& position = atom->Position();
+  RNLength atom_radius = atom->Radius();
+  int center[3];
+  for (int dim = 0; dim < 3; dim++) {
+    RNScalar c = (position[dim] - origin[dim]) / cell_size;
+    if (c < 0) center[dim] = 0;
+    else if (c >= resolution[dim]) center[dim] = resolution[dim] - 1;
+    else center[dim] = (int) c;
+  }
+
+  // Search shells of cells at increasing distance from atom's cell
+  int max_ring = resolution[0];
+  if (max_ring < resolution[1]) max_ring = resolution[1];
+  if (max_ring < resolution[2]) max_ring = resolution[2];
+  RNLength best_distance = max_distance;
+  for (int ring = 0; ring < max_ring; ring++) {
+    // Check whether atoms in this shell can be closer than best so far
+    RNLength shell_distance = (ring - 1) * cell_size - atom_radius - max_radius;
+    if ((ring > 0) && (shell_distance > best_distance)) break;
+    if (closest_atom && (best_distance <= 0)) break;
+
+    // Visit cells in shell
+    int min_cell[3], max_cell[3];
+    for (int dim = 0; dim < 3; dim++) {
+      min_cell[dim] = (center[dim] - ring > 0) ? center[dim] - ring : 0;
+      max_cell[dim] = (center[dim] + ring < resolution[dim] - 1) ? center[dim] + ring : resolution[dim] - 1;
+    }
+    for (int k = min_cell[2]; k <= max_cell[2]; k++) {
+      RNBoolean k_face = ((k == center[2] - ring) || (k == center[2] + ring));
+      for (int j = min_cell[1]; j <= max_cell[1]; j++) {
+        RNBoolean j_face = ((j == center[1] - ring) || (j == center[1] + ring));
+        int step = (k_face || j_face) ? 1 : 2 * ring;
+        for (int i = center[0] - ring; i <= center[0] + ring; i += (step > 0) ? step : 1) {
+          if ((i < 0) || (i >= resolution[0])) continue;
+          int cell = (k * resolution[1] + j) * resolution[0] + i;
+          for (int slot = cell_starts[cell]; slot < cell_starts[cell+1]; slot++) {
+            if (chain && (atoms[slot]->Chain() != chain)) continue;
+            RNCoord dx = coordinates[3*slot+0] - position.X();
+            RNCoord dy = coordinates[3*slot+1] - position.Y();
+            RNCoord dz = coordinates[3*slot+2] - position.Z();
+            RNLength squared_distance = dx*dx + dy*dy + dz*dz;
+            RNLength d = sqrt(squared_distance) - atom_radius - radii[slot];
+            if (d < 0) d = 0;
+            if (d > best_distance) continue;
+            if (closest_atom && (d == best_distance) && (squared_distance >= closest_squared_distance)) continue;
+            closest_squared_distance = squared_distance;
+            closest_atom = atoms[slot];
+            best_distance = d;
+          }
+        }
+      }
+    }
+  }
+
+  // Return closest atom
+  if (closest_distance && closest_atom) *closest_distance = best_distance;
+  return closest_atom;
+}
+
+
+
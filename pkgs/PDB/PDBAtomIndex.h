@@ -0,0 +1,86 @@
+// Include file for PDBAtomIndex class
+
+
+
+// Class declaration
+
+class PDBAtomIndex {
+public:
+  // Constructor (cells are cubes with sides of at least cell_size)
+  PDBAtomIndex(const RNArray<PDBAtom *>& atoms, RNLength cell_size = 4.0);
+  ~PDBAtomIndex(void);
+
+  // Property functions
+  int NAtoms(void) const;
+  PDBAtom *Atom(int k) const;
+  RNLength CellSize(void) const;
+  RNLength MaxAtomRadius(void) const;
+
+  // Query functions (distances are between atom surfaces, as in PDBDistance)
+  int FindAtoms(const R3Point& position, RNLength max_distance, RNArray<PDBAtom *>& result) const;
+  int FindAtoms(PDBAtom *atom, RNLength max_distance, RNArray<PDBAtom *>& result) const;
+  int FindAtoms(PDBResidue *residue, RNLength max_distance, RNArray<PDBAtom *>& result) const;
+  int FindAtomPairs(RNLength max_distance, RNArray<PDBAtom *>& result1, RNArray<PDBAtom *>& result2) const;
+  PDBAtom *FindClosestAtom(PDBAtom *atom, PDBChain *chain,
+    RNLength max_distance = RN_INFINITY, RNLength *closest_distance = NULL) const;
+
+private:
+  // Internal functions
+  void FindCells(const R3Point& position, RNLength offset, int min_cell[3], int max_cell[3]) const;
+  void FindCells(const R3Box& box, RNLength offset, int min_cell[3], int max_cell[3]) const;
+
+private:
+  // Atoms sorted by cell
+  PDBAtom **atoms;
+  RNCoord *coordinates;
+  RNLength *radii;
+  int natoms;
+
+  // Cells
+  R3Point origin;
+  RNLength cell_size;
+  int resolution[3];
+  int *cell_starts;
+  RNLength max_radius;
+};
+
+
+
+// Inline functions
+
+inline int PDBAtomIndex::
+NAtoms(void) const
+{
+  // Return number of atoms
+  return natoms;
+}
+
+
+
+inline PDBAtom *PDBAtomIndex::
+Atom(int k) const
+{
+  // Return Kth atom (in cell order)
+  return atoms[k];
+}
+
+
+
+inline RNLength PDBAtomIndex::
+CellSize(void) const
+{
+  // Return length of cell sides
+  return cell_size;
+}
+
+
+
+inline RNLength PDBAtomIndex::
+MaxAtomRadius(void) const
+{
+  // Return largest radius of any atom
+  return max_radius;
+}
+
+
+
@@ -7,6 +7,12 @@
 
 
 
+// Chains with at least this many atoms are searched with the model's atom index
+
+static const int PDBmin_indexed_chain_atoms = 256;
+
+
+
 RNLength 
 PDBDistance(PDBAtom *atom1, PDBAtom *atom2)
 {
@@ -44,6 +50,13 @@ PDBDistance(PDBAtom *atom, PDBChain *chain)
   // Initialize distance
   RNLength distance = RN_INFINITY;
 
+  // Search atom index of model for closest atom in large chains
+  PDBModel *model = chain->Model();
+  if (model && (chain->NAtoms() >= PDBmin_indexed_chain_atoms)) {
+    model->AtomIndex()->FindClosestAtom(atom, chain, RN_INFINITY, &distance);
+    return distance;
+  }
+
   // Find distance from atom to closest atom in chain
   for (int i = 0; i < chain->NResidues(); i++) {
     PDBResidue *residue = chain->Residue(i);
@@ -86,6 +99,19 @@ PDBDistance(PDBResidue *residue1, PDBChain *chain)
   // Initialize distance
   RNLength distance = RN_INFINITY;
 
+  // Search atom index of model for closest atom in large chains
+  PDBModel *model = chain->Model();
+  if (model && (chain->NAtoms() >= PDBmin_indexed_chain_atoms)) {
+    const PDBAtomIndex *index = model->AtomIndex();
+    for (int i = 0; i < residue1->NAtoms(); i++) {
+      PDBAtom *atom1 = residue1->Atom(i);
+      RNLength d = RN_INFINITY;
+      if (!index->FindClosestAtom(atom1, chain, distance, &d)) continue;
+      if (d < distance) distance = d;
+    }
+    return distance;
+  }
+
   // Find distance between closest atoms from residue and chain
   for (int i = 0; i < chain->NResidues(); i++) {
     PDBResidue *residue2 = chain->Residue(i);
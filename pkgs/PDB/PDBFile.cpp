@@ -1628,6 +1628,17 @@ ReadGrowFile(const char *filename)
 
 
 
+static int
+PDBCompareAtomIDs(const void *data1, const void *data2)
+{
+  // Compare atoms by ID (i.e., in order of creation)
+  PDBAtom *atom1 = *((PDBAtom **) data1);
+  PDBAtom *atom2 = *((PDBAtom **) data2);
+  return atom1->ID() - atom2->ID();
+}
+
+
+
 void PDBFile::
 CreateBonds(PDBResidue *ligand, RNLength max_distance)
 {
@@ -1635,19 +1646,20 @@ CreateBonds(PDBResidue *ligand, RNLength max_distance)
   PDBModel *model = ligand->Model();
   if (!model) return;
 
+  // Get atom index
+  const PDBAtomIndex *index = model->AtomIndex();
+
   // Create bond for each pair of atoms within max_distance distance
   for (int i = 0; i < ligand->NAtoms(); i++) {
     PDBAtom *atom1 = ligand->Atom(i);
-    for (int j = 0; j < model->NResidues(); j++) {
-      PDBResidue *residue2 = model->Residue(j);
-      if (residue2 == ligand) continue;
-      if (R3Distance(atom1->Position(), residue2->BBox()) > max_distance) continue;
-      for (int k = 0; k < residue2->NAtoms(); k++) {
-        PDBAtom *atom2 = residue2->Atom(k);
-        if (PDBDistance(atom1, atom2) > max_distance) continue;
-        PDBBond *bond = new PDBBond(atom1, atom2, PDB_UNKNOWN_BOND);
-        if (!bond) RNAbort("Unable to allocate bond");
-      }
+    RNArray<PDBAtom *> atoms2;
+    index->FindAtoms(atom1, max_distance, atoms2);
+    atoms2.Sort(PDBCompareAtomIDs);
+    for (int k = 0; k < atoms2.NEntries(); k++) {
+      PDBAtom *atom2 = atoms2.Kth(k);
+      if (atom2->Residue() == ligand) continue;
+      PDBBond *bond = new PDBBond(atom1, atom2, PDB_UNKNOWN_BOND);
+      if (!bond) RNAbort("Unable to allocate bond");
     }
   }
 }
@@ -12,6 +12,7 @@ PDBModel::
 PDBModel(PDBFile *file, const char *name)
   : bbox(R3null_box),
     file(file),
+    atom_index(NULL),
     mark(0),
     value(0),
     data(NULL)
@@ -36,6 +37,9 @@ PDBModel::
   // Delete chains
   while (NChains()) delete chains.Tail();
 
+  // Delete atom index
+  if (atom_index) delete atom_index;
+
   // Remove model from file
   if (file) file->models.Remove(this);
 }
@@ -54,6 +58,27 @@ Color(void) const
 
 
 
+const PDBAtomIndex *PDBModel::
+AtomIndex(void) const
+{
+  // Build atom index if it is not up to date
+  if (!atom_index) ((PDBModel *) this)->atom_index = new PDBAtomIndex(atoms);
+  return atom_index;
+}
+
+
+
+void PDBModel::
+InvalidateAtomIndex(void)
+{
+  // Delete atom index (it will be rebuilt when next requested)
+  if (!atom_index) return;
+  delete atom_index;
+  atom_index = NULL;
+}
+
+
+
 PDBStructureType PDBModel::
 FindAny(const char *str, PDBChain **c, PDBResidue **r, PDBAtom **a, PDBStructureType maxlevel) const
 {
@@ -40,6 +40,10 @@ public:
   int NBonds(void) const;
   PDBBond *Bond(int k) const;
 
+  // Spatial index of atoms (built when first requested, shared by all queries)
+  const PDBAtomIndex *AtomIndex(void) const;
+  void InvalidateAtomIndex(void);
+
   // Search access functions
   PDBAtom *FindAtom(const char *str) const;
   PDBResidue *FindResidue(const char *str) const;
@@ -67,6 +71,7 @@ public:
   RNArray<PDBChain *> chains;
   RNArray<PDBBond *> bonds;
   PDBFile *file;
+  PDBAtomIndex *atom_index;
   RNMark mark;
   RNScalar value;
   void *data;
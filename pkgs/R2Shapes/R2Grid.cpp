@@ -16,6 +16,12 @@
 
 
 
+// Useful constants
+
+static const int R2_GRID_DISTANCE_TRANSFORM_CHUNK_SIZE = 16;
+
+
+
 R2Grid::
 R2Grid(int xresolution, int yresolution)
 {
@@ -862,60 +868,15 @@ AddNoise(RNScalar sigma_fraction)
 void R2Grid::
 BilateralFilter(RNLength grid_sigma, RNLength value_sigma)
 {
-  // Make copy of grid
-  R2Grid copy(*this);
-
   // Determine reasonable value sigma
   if (value_sigma == -1) {
     RNInterval range = Range();
     value_sigma = 0.01 * (range.Max() - range.Min());
   }
 
-  // Get convenient variables
-  double grid_denom = 2.0 * grid_sigma * grid_sigma;
-  double value_denom = 2.0 * value_sigma * value_sigma;
-  RNScalar grid_radius = 3 * grid_sigma;
-  int r = (int) (grid_radius + 1);
-  int r_squared = r * r;
-
-  // Set every sample to be filter of surrounding region in input grid
-  for (int cy = 0; cy < YResolution(); cy++) {
-    for (int cx = 0; cx < XResolution(); cx++) {
-      // Check if current value is unknown - if so, don't update
-      RNScalar value = copy.GridValue(cx, cy);
-      if (value != R2_GRID_UNKNOWN_VALUE) {
-        RNScalar sum = 0;
-        RNScalar weight = 0;
-        int ymin = cy - r;
-        int ymax = cy + r;
-        if (ymin < 0) ymin = 0;
-        if (ymax >= YResolution()) ymax = YResolution() - 1;
-        for (int y = ymin; y <= ymax; y++) {
-          int xmin = cx - r;
-          int xmax = cx + r;
-          if (xmin < 0) xmin = 0;
-          if (xmax >= XResolution()) xmax = XResolution() - 1;
-          int dy = y - cy;
-          for (int x = xmin; x <= xmax; x++) {
-            int dx = x - cx;
-            int grid_distance_squared = dx*dx + dy*dy;
-            if (grid_distance_squared > r_squared) continue;
-            RNScalar sample = copy.GridValue(x, y);
-            if (sample == R2_GRID_UNKNOWN_VALUE) continue;
-            RNScalar value_distance_squared = value - sample;
-            value_distance_squared *= value_distance_squared;
-            RNScalar w = exp(-grid_distance_squared/grid_denom) * exp(-value_distance_squared/value_denom);
-            sum += w * sample;
-            weight += w;
-          }
-        }
-
-        // Set grid value
-        if (weight == 0) SetGridValue(cx, cy, R2_GRID_UNKNOWN_VALUE);
-        else SetGridValue(cx, cy, sum / weight);
-      }
-    }
-  }
+  // Set every sample to be bilateral filter of surrounding region in input grid
+  // (unknown values are skipped, and remain unknown)
+  RNBilateralFilter(grid_values, 2, grid_resolution, grid_sigma, value_sigma, TRUE, R2_GRID_UNKNOWN_VALUE);
 }
 
 
@@ -923,7 +884,71 @@ BilateralFilter(RNLength grid_sigma, RNLength value_sigma)
 void R2Grid::
 AnisotropicDiffusion(RNLength grid_sigma, RNLength gradient_sigma)
 {
-  RNAbort("Not implemented");
+  // Perona-Malik diffusion with conductance exp(-(|gradient|/gradient_sigma)^2),
+  // run for the time it takes isotropic diffusion to blur by grid_sigma
+  // (unknown values are skipped, and remain unknown)
+  if (grid_sigma <= 0) return;
+
+  // Determine reasonable gradient sigma
+  if (gradient_sigma == -1) {
+    RNInterval range = Range();
+    gradient_sigma = 0.01 * (range.Max() - range.Min());
+  }
+  if (gradient_sigma <= 0) return;
+
+  // Determine number of explicit steps (time step must be at most 0.25 for stability)
+  RNScalar total_time = 0.5 * grid_sigma * grid_sigma;
+  int nsteps = (int) ceil(total_time / 0.2);
+  RNScalar dt = total_time / nsteps;
+
+  // Compute lookup table for conductance (indexed by gradient / gradient_sigma)
+  const int lut_bins_per_sigma = 1024;
+  const int lut_max_sigmas = 4;
+  const int nlut = lut_max_sigmas * lut_bins_per_sigma + 2;
+  RNScalar lut[nlut];
+  for (int i = 0; i < nlut; i++) {
+    RNScalar u = (RNScalar) i / lut_bins_per_sigma;
+    lut[i] = exp(-u * u);
+  }
+  RNScalar lut_scale = lut_bins_per_sigma / gradient_sigma;
+  RNScalar lut_max = nlut - 2;
+
+  // Iterate diffusion steps
+  int xres = grid_resolution[0];
+  int yres = grid_resolution[1];
+  RNScalar *copy = new RNScalar [ grid_size ];
+  for (int step = 0; step < nsteps; step++) {
+    // Copy grid values
+    for (int i = 0; i < grid_size; i++) copy[i] = grid_values[i];
+
+    // Update every known value with flux from known neighbors
+#pragma omp parallel for schedule(static)
+    for (int cy = 0; cy < yres; cy++) {
+      for (int cx = 0; cx < xres; cx++) {
+        int i = cy * xres + cx;
+        RNScalar value = copy[i];
+        if (value == R2_GRID_UNKNOWN_VALUE) continue;
+        int neighbors[4] = { (cx > 0) ? i - 1 : -1, (cx < xres-1) ? i + 1 : -1,
+          (cy > 0) ? i - xres : -1, (cy < yres-1) ? i + xres : -1 };
+        RNScalar flux = 0;
+        for (int k = 0; k < 4; k++) {
+          if (neighbors[k] < 0) continue;
+          RNScalar sample = copy[neighbors[k]];
+          if (sample == R2_GRID_UNKNOWN_VALUE) continue;
+          RNScalar delta = sample - value;
+          RNScalar u = fabs(delta) * lut_scale;
+          if (u >= lut_max) continue;
+          int j = (int) u;
+          RNScalar t = u - j;
+          flux += ((1.0 - t) * lut[j] + t * lut[j+1]) * delta;
+        }
+        grid_values[i] = value + dt * flux;
+      }
+    }
+  }
+
+  // Delete temporary memory
+  delete [] copy;
 }
 
 
@@ -931,64 +956,10 @@ AnisotropicDiffusion(RNLength grid_sigma, RNLength gradient_sigma)
 void R2Grid::
 PercentileFilter(RNLength grid_radius, RNScalar percentile)
 {
-  // Make copy of grid
-  R2Grid copy(*this);
-
-  // Get convenient variables
-  RNScalar grid_radius_squared = grid_radius * grid_radius;
-  int r = (int) grid_radius;
-  assert(r >= 0);
-  int max_samples = (2*r+1) * (2*r+1);
-  RNScalar *samples = new RNScalar [ max_samples ];
-  assert(samples);
-
   // Set every sample to be Kth percentile of surrounding region in input grid
-  for (int cy = 0; cy < YResolution(); cy++) {
-    for (int cx = 0; cx < XResolution(); cx++) {
-      // Check if current value is unknown - if so, don't update
-      if (GridValue(cx, cy) != R2_GRID_UNKNOWN_VALUE) {
-        // Build list of grid values in neighborhood
-        int nsamples = 0;
-        int ymin = cy - r;
-        int ymax = cy + r;
-        if (ymin < 0) ymin = 0;
-        if (ymax >= YResolution()) ymax = YResolution() - 1;
-        for (int y = ymin; y <= ymax; y++) {
-          int xmin = cx - r;
-          int xmax = cx + r;
-          if (xmin < 0) xmin = 0;
-          if (xmax >= XResolution()) xmax = XResolution() - 1;
-          int dy = y - cy;
-          for (int x = xmin; x <= xmax; x++) {
-            int dx = x - cx;
-            int d_squared = dx*dx + dy*dy;
-            if (d_squared > grid_radius_squared) continue;
-            RNScalar sample = copy.GridValue(x, y);
-            if (sample == R2_GRID_UNKNOWN_VALUE) continue;
-            samples[nsamples++] = sample;
-          }
-        }
-
-        // Check number of grid values in neighborhood
-        if (nsamples == 0) {
-          SetGridValue(cx, cy, R2_GRID_UNKNOWN_VALUE);
-        }
-        else {
-          // Sort samples found in neighborhood
-          qsort(samples, nsamples, sizeof(RNScalar), RNCompareScalars);
-
-          // Set grid value to percentile of neighborhood
-          int index = (int) (percentile * nsamples);
-          if (index < 0) index = 0;
-          else if (index >= nsamples) index = nsamples-1;
-          SetGridValue(cx, cy, samples[index]);
-        }
-      }
-    }
-  }
-
-  // Delete temporary memory
-  delete [] samples;
+  // (unknown values are skipped, and remain unknown)
+  assert(grid_radius >= 0);
+  RNRankFilter(grid_values, 2, grid_resolution, grid_radius, percentile, TRUE, R2_GRID_UNKNOWN_VALUE);
 }
 
 
@@ -1625,6 +1596,107 @@ Threshold(const R2Grid& threshold, RNScalar low, RNScalar high)
 
 
 
+static void
+SquaredDistanceTransformLine(const RNScalar *f, const int *fi, int n,
+  RNScalar *d, int *di, int *v, RNScalar *z)
+{
+  // Compute lower envelope of parabolas rooted at (q, f[q])
+  // (Felzenszwalb and Huttenlocher, "Distance Transforms of Sampled Functions")
+  int k = 0;
+  v[0] = 0;
+  z[0] = -FLT_MAX;
+  z[1] = FLT_MAX;
+  for (int q = 1; q < n; q++) {
+    RNScalar fq = f[q] + (RNScalar) q*q;
+    RNScalar s = (fq - (f[v[k]] + (RNScalar) v[k]*v[k])) / (2*q - 2*v[k]);
+    while (s <= z[k]) {
+      k--;
+      s = (fq - (f[v[k]] + (RNScalar) v[k]*v[k])) / (2*q - 2*v[k]);
+    }
+    k++;
+    v[k] = q;
+    z[k] = s;
+    z[k+1] = FLT_MAX;
+  }
+
+  // Fill in values (and nearest site indices) from lower envelope
+  k = 0;
+  for (int q = 0; q < n; q++) {
+    while (z[k+1] < q) k++;
+    d[q] = (RNScalar) (q - v[k])*(q - v[k]) + f[v[k]];
+    if (di) di[q] = fi[v[k]];
+  }
+}
+
+
+
+static void
+SquaredDistanceTransformAxis(RNScalar *values, int *indices, const int resolution[2], int dim)
+{
+  // Get line structure along dimension
+  int n = resolution[dim];
+  if (n < 2) return;
+  int row_size = resolution[0];
+  int stride = (dim == 0) ? 1 : row_size;
+
+  // Group lines into chunks (lines adjacent in x are gathered together
+  // for passes along y, so that strided memory accesses are shared)
+  int chunk_size = (dim == 0) ? 1 : R2_GRID_DISTANCE_TRANSFORM_CHUNK_SIZE;
+  int chunks_per_row = (dim == 0) ? 1 : (row_size + chunk_size - 1) / chunk_size;
+  int nrows = (dim == 0) ? resolution[1] : 1;
+  int row_step = row_size;
+  int nchunks = nrows * chunks_per_row;
+
+  // Transform independent chunks of lines in parallel
+#pragma omp parallel
+  {
+    // Allocate per-thread buffers
+    RNScalar *f = new RNScalar [ chunk_size * n ];
+    RNScalar *d = new RNScalar [ chunk_size * n ];
+    RNScalar *z = new RNScalar [ n + 1 ];
+    int *v = new int [ n ];
+    int *fi = (indices) ? new int [ chunk_size * n ] : NULL;
+    int *di = (indices) ? new int [ chunk_size * n ] : NULL;
+
+#pragma omp for schedule(static)
+    for (int chunk = 0; chunk < nchunks; chunk++) {
+      // Compute index of first entry on first line of chunk
+      int row = chunk / chunks_per_row;
+      int x0 = (chunk % chunks_per_row) * chunk_size;
+      int count = (dim == 0) ? 1 : ((x0 + chunk_size <= row_size) ? chunk_size : row_size - x0);
+      int base = row * row_step + x0;
+
+      // Gather lines
+      for (int q = 0; q < n; q++) {
+        for (int c = 0; c < count; c++) f[c*n + q] = values[base + q*stride + c];
+        if (indices) for (int c = 0; c < count; c++) fi[c*n + q] = indices[base + q*stride + c];
+      }
+
+      // Transform lines
+      for (int c = 0; c < count; c++) {
+        SquaredDistanceTransformLine(&f[c*n], (fi) ? &fi[c*n] : NULL, n,
+          &d[c*n], (di) ? &di[c*n] : NULL, v, z);
+      }
+
+      // Scatter lines
+      for (int q = 0; q < n; q++) {
+        for (int c = 0; c < count; c++) values[base + q*stride + c] = d[c*n + q];
+        if (indices) for (int c = 0; c < count; c++) indices[base + q*stride + c] = di[c*n + q];
+      }
+    }
+
+    // Delete per-thread buffers
+    delete [] f;
+    delete [] d;
+    delete [] z;
+    delete [] v;
+    if (fi) delete [] fi;
+    if (di) delete [] di;
+  }
+}
+
+
+
 void R2Grid::
 SignedDistanceTransform(void)
 {
@@ -1642,117 +1714,31 @@ SignedDistanceTransform(void)
 
 
 void R2Grid::
-SquaredDistanceTransform(void)
+SquaredDistanceTransform(int *nearest_site_indices)
 {
-  int x,y,s,t;
-  int dist,square,new_dist;
-  int* oldBuffer;
-  int* newBuffer;
-  int first;
-  int i;
-
-  // Allocate temporary buffers
+  // Compute squared distance to nearest non-zero, known entry
+  // (and, optionally, the index of that entry, or -1 if there are none)
   int res = XResolution();
   if (res < YResolution()) res = YResolution();
-  oldBuffer = new int[res];
-  assert(oldBuffer);
-  newBuffer = new int[res];
-  assert(newBuffer);
 
   // Initalize values (0 if was set, max_value if not)
-  RNScalar max_value = 2 * (res+1) * (res+1);
-  RNScalar *grid_valuesp = grid_values;
-  for (i = 0; i < grid_size; i++) {
-    if (*grid_valuesp == 0.0) *grid_valuesp = max_value;
-    else if (*grid_valuesp == R2_GRID_UNKNOWN_VALUE) *grid_valuesp = max_value;
-    else *grid_valuesp = 0.0;
-    grid_valuesp++;
-  }
-
-  // Scan along x axis
-  for (y = 0; y < YResolution(); y++) {
-    first = 1;
-    dist = 0;
-    for (x = 0; x < XResolution(); x++) {
-      if (GridValue(x,y) == 0.0) {
-        dist=0;
-        first=0;
-        SetGridValue(x, y, 0);
-      }
-      else if (first == 0) {
-        dist++;
-        square = dist*dist;
-        SetGridValue(x, y, square);
-      }
+  RNScalar max_value = 2.0 * (res+1) * (res+1);
+#pragma omp parallel for schedule(static)
+  for (int i = 0; i < grid_size; i++) {
+    if ((grid_values[i] == 0.0) || (grid_values[i] == R2_GRID_UNKNOWN_VALUE)) {
+      grid_values[i] = max_value;
+      if (nearest_site_indices) nearest_site_indices[i] = -1;
     }
-      		
-    // backward scan
-    dist = 0;
-    first = 1;
-    for (x = XResolution()-1; x >= 0; x--) {
-      if (GridValue(x,y) == 0.0) {
-        dist = 0;
-        first = 0;
-        SetGridValue(x, y, 0);
-      }
-      else if (first == 0) {
-        dist++;
-        square = dist*dist;
-        if (square < GridValue(x, y)) {
-          SetGridValue(x, y, square);
-        }
-      }
+    else {
+      grid_values[i] = 0.0;
+      if (nearest_site_indices) nearest_site_indices[i] = i;
     }
   }
 
-  // Scan along y axis
-  for (x = 0; x < XResolution(); x++) {
-    // Copy grid values
-    for (y = 0; y < YResolution(); y++) 
-      oldBuffer[y] = (int) (GridValue(x, y) + 0.5);
-      		
-    // forward scan
-    s = 0;
-    for (y = 0; y < YResolution(); y++) {
-      dist = oldBuffer[y];
-      if (dist) {
-        for (t = s; t <= y ; t++) {
-          new_dist = oldBuffer[t] + (y - t) * (y - t);
-          if (new_dist <= dist){
-            dist = new_dist;
-            s = t;
-          }
-        }
-      }
-      else { 
-        s = y;
-      }
-      newBuffer[y] = dist;
-    }
-  
-    // backward scan
-    s = YResolution() - 1;
-    for(y = YResolution()-1; y >=0 ; y--) {
-      dist = newBuffer[y];
-      if (dist) {
-        for (t = s; t > y ; t--) {
-          new_dist = oldBuffer[t] + (y - t) * (y - t);
-          if (new_dist <= dist){
-            dist = new_dist;
-            s = t;
-          }
-        }
-        SetGridValue(x, y, dist);
-      }
-      else { 
-        s = y; 
-      }
-    }
+  // Compute exact squared distances with separable passes
+  for (int dim = 0; dim < 2; dim++) {
+    SquaredDistanceTransformAxis(grid_values, nearest_site_indices, grid_resolution, dim);
   }
-	
-  // Delete temporary buffers
-  delete[] oldBuffer;
-  delete[] newBuffer;
 }
 
 
@@ -1760,140 +1746,42 @@ SquaredDistanceTransform(void)
 void R2Grid::
 Voronoi(R2Grid *squared_distance_grid)
 {
-  int dist;
-  int* old_dist;
-  int* new_dist;
-  RNScalar value;
-  RNScalar *old_value;
-  RNScalar *new_value;
-  R2Grid *dgrid;
-  int res,square,tmp_dist,first;
-  int x,y,s,t,i;
-
   // Allocate distance grid
+  R2Grid *dgrid;
   if (squared_distance_grid) dgrid = squared_distance_grid;
   else dgrid = new R2Grid(XResolution(), YResolution());
   assert(dgrid);
   dgrid->SetWorldToGridTransformation(WorldToGridTransformation());
 
-  // Allocate temporary buffers
-  res = XResolution();
-  if (res < YResolution()) res = YResolution();
-  old_dist = new int[res];
-  new_dist = new int[res];
-  old_value = new RNScalar[res];
-  new_value = new RNScalar[res];
-  assert(old_dist && new_dist && old_value && new_value);
+  // Allocate nearest site indices
+  int *nearest_site_indices = new int [ grid_size ];
+  assert(nearest_site_indices);
 
   // Initalize distance grid values (0 if was set, max_value if not)
-  RNScalar max_value = 3 * (res+1) * (res+1);
-  for (i = 0; i < grid_size; i++) {
-    if (grid_values[i] == 0.0) dgrid->grid_values[i] = max_value;
-    else dgrid->grid_values[i] = 0.0;
-  }
-
-  // Scan along x axis
-  for (y = 0; y < YResolution(); y++) {
-    first = 1;
-    value = 0;
-    dist = 0;
-    for (x = 0; x < XResolution(); x++) {
-      if (dgrid->GridValue(x,y) == 0.0) {
-        first=0;
-        dist=0;
-        value = GridValue(x,y);
-        assert(value != 0);
-      }
-      else if (first == 0) {
-        dist++;
-        square = dist*dist;
-        dgrid->SetGridValue(x, y, square);
-        SetGridValue(x, y, value);
-        assert(value != 0);
-      }
-    }
-			
-    // backward scan
-    dist = 0;
-    first = 1;
-    for (x = XResolution()-1; x >= 0; x--) {
-      if (dgrid->GridValue(x,y) == 0.0){
-        dist = 0;
-        first = 0;
-        value = GridValue(x,y);
-        assert(value != 0);
-      }
-      else if (first == 0) {
-        dist++;
-        square = dist*dist;
-        if (square < dgrid->GridValue(x, y)) {
-          dgrid->SetGridValue(x, y, square);
-          SetGridValue(x, y, value);
-          assert(value != 0);
-        }
-      }
-    }
+  int res = XResolution();
+  if (res < YResolution()) res = YResolution();
+  RNScalar max_value = 3.0 * (res+1) * (res+1);
+#pragma omp parallel for schedule(static)
+  for (int i = 0; i < grid_size; i++) {
+    if (grid_values[i] == 0.0) { dgrid->grid_values[i] = max_value; nearest_site_indices[i] = -1; }
+    else { dgrid->grid_values[i] = 0.0; nearest_site_indices[i] = i; }
   }
 
-  // Scan along y axis
-  for (x = 0; x < XResolution(); x++) {
-    // Copy grid values
-    for (y = 0; y < YResolution(); y++) {
-      old_dist[y] = (int) (dgrid->GridValue(x, y));
-      old_value[y] = GridValue(x, y);
-    }
-			
-    // forward scan
-    s = 0;
-    for (y = 0; y < YResolution(); y++) {
-      dist = old_dist[y];
-      value = old_value[y];
-      if (dist) {
-        for (t = s; t <= y ; t++) {
-          tmp_dist = old_dist[t] + (y - t) * (y - t);
-          if (tmp_dist <= dist){
-            dist = tmp_dist;
-            value = old_value[t];
-            s = t;
-          }
-        }
-      }
-      else { 
-        s = y;
-      }
-      new_dist[y] = dist;
-      new_value[y] = value;
-    }
-
-    // backward scan
-    s = YResolution() - 1;
-    for(y = YResolution()-1; y >=0 ; y--) {
-      dist = new_dist[y];
-      value = new_value[y];
-      if (dist) {
-        for (t = s; t > y ; t--) {
-          tmp_dist = old_dist[t] + (y - t) * (y - t);
-          if (tmp_dist <= dist){
-            dist = tmp_dist;
-            value = old_value[t];
-            s = t;
-          }
-        }
-        dgrid->SetGridValue(x, y, dist);
-        SetGridValue(x, y, value);
-      }
-      else { 
-        s = y; 
-      }
-    }
+  // Compute squared distances and nearest sites with separable passes
+  for (int dim = 0; dim < 2; dim++) {
+    SquaredDistanceTransformAxis(dgrid->grid_values, nearest_site_indices, grid_resolution, dim);
   }
-	
+
+  // Copy value from nearest site (sites keep their own values, so can do in place)
+#pragma omp parallel for schedule(static)
+  for (int i = 0; i < grid_size; i++) {
+    if (nearest_site_indices[i] < 0) continue;
+    grid_values[i] = grid_values[nearest_site_indices[i]];
+  }
+
   // Delete temporary buffers
   if (!squared_distance_grid) delete dgrid;
-  delete[] old_dist;
-  delete[] new_dist;
-  delete[] old_value;
-  delete[] new_value;
+  delete [] nearest_site_indices;
 }
 
 
@@ -100,7 +100,7 @@ public:
   void Threshold(RNScalar threshold, RNScalar low, RNScalar high);
   void Threshold(const R2Grid& threshold, RNScalar low, RNScalar high);
   void SignedDistanceTransform(void);
-  void SquaredDistanceTransform(void);
+  void SquaredDistanceTransform(int *nearest_site_indices = NULL);
   void Voronoi(R2Grid *squared_distance_grid = NULL);
   void PointSymmetryTransform(int radius = -1);
   void Gauss(RNLength sigma = sqrt(8.0), RNBoolean square = TRUE);
@@ -50,7 +50,7 @@ R2Image(int width, int height, int ncomponents)
   pixels = new unsigned char [nbytes];
   assert(pixels);
   unsigned char *p = pixels;
-  while (--nbytes) *(p++) = 0;
+  while (nbytes-- > 0) *(p++) = 0;
 }
 
 
@@ -70,7 +70,7 @@ R2Image(int width, int height, int ncomponents, unsigned char *data)
   pixels = new unsigned char [nbytes];
   assert(pixels);
   unsigned char *p = pixels;
-  while (--nbytes) *(p++) = *(data++);
+  while (nbytes-- > 0) *(p++) = *(data++);
 }
 
 
@@ -89,7 +89,7 @@ R2Image(const R2Image& image)
   assert(pixels);
   unsigned char *p = pixels;
   unsigned char *data = image.pixels;
-  while (--nbytes) *(p++) = *(data++);
+  while (nbytes-- > 0) *(p++) = *(data++);
 }
 
 
@@ -148,7 +148,7 @@ operator=(const R2Image& image)
   assert(this->pixels);
   unsigned char *p =this-> pixels;
   unsigned char *data = image.pixels;
-  while (--nbytes) *(p++) = *(data++);
+  while (nbytes-- > 0) *(p++) = *(data++);
 
   // Return this
   return *this;
@@ -162,7 +162,7 @@ Add(const R2Image& image)
   int nbytes = rowsize * height;
   unsigned char *p1 = pixels;
   unsigned char *p2 = image.pixels;
-  while (--nbytes) {
+  while (nbytes-- > 0) {
     int value = *p1;
     value += *(p2++);
     if (value > 255) value = 255;
@@ -178,7 +178,7 @@ Subtract(const R2Image& image)
   int nbytes = rowsize * height;
   unsigned char *p1 = pixels;
   unsigned char *p2 = image.pixels;
-  while (--nbytes) {
+  while (nbytes-- > 0) {
     int value = *p1 - *p2 + 128;
     if (value < 0) value = 0;
     if (value > 255) value = 255;
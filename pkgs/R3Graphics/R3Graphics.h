@@ -43,6 +43,7 @@ class R3SceneElement;
 #include "R3Graphics/R3Camera.h"
 #include "R3Graphics/R3Frustum.h"
 #include "R3Graphics/R3Viewer.h"
+#include "R3Graphics/R3Rasterizer.h"
 
 
 
@@ -0,0 +1,689 @@
+// Source file for R3 rasterizer class
+
+
+
+////////////////////////////////////////////////////////////////////////
+// Include files
+////////////////////////////////////////////////////////////////////////
+
+#include "R3Graphics.h"
+
+
+
+////////////////////////////////////////////////////////////////////////
+// Internal constants and types
+////////////////////////////////////////////////////////////////////////
+
+// Width/height of tiles (in pixels)
+static const int R3_RASTERIZER_TILE_SIZE = 32;
+
+
+
+// Triangle in screen coordinates (part of a mesh face, after near clipping)
+struct R3RasterizerTriangle {
+  // Screen coordinates and inverse depths of vertices
+  RNScalar32 x[3], y[3];
+  RNScalar32 inverse_depth[3];
+
+  // Face barycentric coordinates (1 and 2) of vertices (not identity only if clipped)
+  RNScalar32 face_barycentrics[3][2];
+
+  // Pixel bounding box (inclusive)
+  int xmin, ymin, xmax, ymax;
+};
+
+
+
+////////////////////////////////////////////////////////////////////////
+// Constructors/destructors
+////////////////////////////////////////////////////////////////////////
+
+R3Rasterizer::
+R3Rasterizer(int width, int height)
+  : width(width),
+    height(height),
+    intrinsics(R3identity_matrix),
+    camera_to_world(R4identity_matrix),
+    neardist(0.01),
+    fardist(100),
+    depths(NULL),
+    face_indices(NULL),
+    barycentrics(NULL),
+    mesh(NULL),
+    camera_positions(NULL),
+    nallocated_vertices(0),
+    triangles(NULL),
+    face_ntriangles(NULL),
+    nallocated_faces(0),
+    tile_triangles(NULL),
+    nallocated_tile_triangles(0)
+{
+  // Set default intrinsics (90 degree horizontal field of view)
+  intrinsics[0][0] = 0.5 * width;
+  intrinsics[1][1] = 0.5 * width;
+  intrinsics[0][2] = 0.5 * width;
+  intrinsics[1][2] = 0.5 * height;
+
+  // Allocate buffers
+  UpdateBuffers();
+}
+
+
+
+R3Rasterizer::
+~R3Rasterizer(void)
+{
+  // Delete buffers
+  if (depths) delete [] depths;
+  if (face_indices) delete [] face_indices;
+  if (barycentrics) delete [] barycentrics;
+
+  // Delete temporary buffers
+  if (camera_positions) delete [] camera_positions;
+  if (triangles) delete [] triangles;
+  if (face_ntriangles) delete [] face_ntriangles;
+  if (tile_triangles) delete [] tile_triangles;
+}
+
+
+
+////////////////////////////////////////////////////////////////////////
+// Manipulation functions
+////////////////////////////////////////////////////////////////////////
+
+void R3Rasterizer::
+SetResolution(int width, int height)
+{
+  // Check if resolution changed
+  if ((width == this->width) && (height == this->height)) return;
+
+  // Set resolution
+  this->width = width;
+  this->height = height;
+
+  // Reallocate buffers
+  UpdateBuffers();
+}
+
+
+
+void R3Rasterizer::
+SetCamera(const R3Matrix& intrinsics, const R4Matrix& camera_to_world)
+{
+  // Set camera
+  this->intrinsics = intrinsics;
+  this->camera_to_world = camera_to_world;
+}
+
+
+
+void R3Rasterizer::
+SetCamera(const R3Camera& camera)
+{
+  // Set intrinsics from field of view (centered principal point)
+  R3Matrix intrinsics(R3identity_matrix);
+  intrinsics[0][0] = 0.5 * width / tan(camera.XFOV());
+  intrinsics[1][1] = 0.5 * height / tan(camera.YFOV());
+  intrinsics[0][2] = 0.5 * width;
+  intrinsics[1][2] = 0.5 * height;
+
+  // Set camera-to-world from camera frame (right, up, backwards)
+  const R3Point& origin = camera.Origin();
+  const R3Vector& right = camera.Right();
+  const R3Vector& up = camera.Up();
+  const R3Vector& backwards = camera.Backwards();
+  R4Matrix camera_to_world(
+    right.X(), up.X(), backwards.X(), origin.X(),
+    right.Y(), up.Y(), backwards.Y(), origin.Y(),
+    right.Z(), up.Z(), backwards.Z(), origin.Z(),
+    0, 0, 0, 1);
+
+  // Set camera
+  SetCamera(intrinsics, camera_to_world);
+  SetNearFar(camera.Near(), camera.Far());
+}
+
+
+
+void R3Rasterizer::
+SetNearFar(RNLength neardist, RNLength fardist)
+{
+  // Set clipping distances
+  this->neardist = neardist;
+  this->fardist = fardist;
+}
+
+
+
+void R3Rasterizer::
+Clear(void)
+{
+  // Clear buffers
+  int npixels = width * height;
+  for (int i = 0; i < npixels; i++) {
+    depths[i] = FLT_MAX;
+    face_indices[i] = -1;
+    barycentrics[2*i+0] = 0;
+    barycentrics[2*i+1] = 0;
+  }
+
+  // Forget mesh
+  mesh = NULL;
+}
+
+
+
+void R3Rasterizer::
+UpdateBuffers(void)
+{
+  // Delete previous buffers
+  if (depths) delete [] depths;
+  if (face_indices) delete [] face_indices;
+  if (barycentrics) delete [] barycentrics;
+
+  // Allocate buffers
+  int npixels = width * height;
+  depths = new RNScalar32 [ npixels ];
+  face_indices = new int [ npixels ];
+  barycentrics = new RNScalar32 [ 2 * npixels ];
+
+  // Clear buffers
+  Clear();
+}
+
+
+
+////////////////////////////////////////////////////////////////////////
+// Rasterization functions
+////////////////////////////////////////////////////////////////////////
+
+static int
+SetupTriangle(R3RasterizerTriangle& triangle,
+  const R3Point camera_positions[3], const double face_barycentrics[3][2],
+  const R3Matrix& intrinsics, int width, int height)
+{
+  // Get intrinsics
+  double fx = intrinsics[0][0];
+  double fy = intrinsics[1][1];
+  double cx = intrinsics[0][2];
+  double cy = intrinsics[1][2];
+
+  // Project vertices (camera looks down -Z)
+  for (int j = 0; j < 3; j++) {
+    double depth = -camera_positions[j].Z();
+    triangle.inverse_depth[j] = 1.0 / depth;
+    triangle.x[j] = cx + fx * camera_positions[j].X() / depth;
+    triangle.y[j] = cy + fy * camera_positions[j].Y() / depth;
+    triangle.face_barycentrics[j][0] = face_barycentrics[j][0];
+    triangle.face_barycentrics[j][1] = face_barycentrics[j][1];
+  }
+
+  // Compute bounding box
+  double xmin = triangle.x[0], xmax = triangle.x[0];
+  double ymin = triangle.y[0], ymax = triangle.y[0];
+  for (int j = 1; j < 3; j++) {
+    if (triangle.x[j] < xmin) xmin = triangle.x[j];
+    if (triangle.x[j] > xmax) xmax = triangle.x[j];
+    if (triangle.y[j] < ymin) ymin = triangle.y[j];
+    if (triangle.y[j] > ymax) ymax = triangle.y[j];
+  }
+
+  // Compute range of pixels whose centers (ix+0.5, iy+0.5) may be covered
+  if ((xmax < 0) || (xmin > width) || (ymax < 0) || (ymin > height)) return 0;
+  triangle.xmin = (xmin > 0) ? (int) floor(xmin - 0.5) : 0;
+  triangle.ymin = (ymin > 0) ? (int) floor(ymin - 0.5) : 0;
+  triangle.xmax = (xmax < width) ? (int) ceil(xmax - 0.5) : width - 1;
+  triangle.ymax = (ymax < height) ? (int) ceil(ymax - 0.5) : height - 1;
+  if (triangle.xmin < 0) triangle.xmin = 0;
+  if (triangle.ymin < 0) triangle.ymin = 0;
+  if (triangle.xmax >= width) triangle.xmax = width - 1;
+  if (triangle.ymax >= height) triangle.ymax = height - 1;
+  if ((triangle.xmin > triangle.xmax) || (triangle.ymin > triangle.ymax)) return 0;
+
+  // Check area
+  double area = (triangle.x[1] - triangle.x[0]) * (triangle.y[2] - triangle.y[0]) -
+    (triangle.x[2] - triangle.x[0]) * (triangle.y[1] - triangle.y[0]);
+  if (area == 0) return 0;
+
+  // Return success
+  return 1;
+}
+
+
+
+static int
+SetupFaceTriangles(R3RasterizerTriangle *triangles[2],
+  const R3Point camera_positions[3], RNLength neardist,
+  const R3Matrix& intrinsics, int width, int height)
+{
+  // Barycentric coordinates (1 and 2) of face vertices
+  static const double vertex_barycentrics[3][2] = { { 0, 0 }, { 1, 0 }, { 0, 1 } };
+
+  // Check which vertices are in front of near plane
+  int ninside = 0;
+  RNBoolean inside[3];
+  for (int j = 0; j < 3; j++) {
+    inside[j] = (-camera_positions[j].Z() >= neardist) ? TRUE : FALSE;
+    if (inside[j]) ninside++;
+  }
+
+  // Check trivial cases
+  if (ninside == 0) return 0;
+  if (ninside == 3) {
+    return SetupTriangle(*triangles[0], camera_positions, vertex_barycentrics, intrinsics, width, height);
+  }
+
+  // Clip polygon against near plane
+  int npolygon = 0;
+  R3Point polygon_positions[4];
+  double polygon_barycentrics[4][2];
+  for (int j0 = 0; j0 < 3; j0++) {
+    int j1 = (j0 + 1) % 3;
+    if (inside[j0]) {
+      polygon_positions[npolygon] = camera_positions[j0];
+      polygon_barycentrics[npolygon][0] = vertex_barycentrics[j0][0];
+      polygon_barycentrics[npolygon][1] = vertex_barycentrics[j0][1];
+      npolygon++;
+    }
+    if (inside[j0] != inside[j1]) {
+      double d0 = -camera_positions[j0].Z() - neardist;
+      double d1 = -camera_positions[j1].Z() - neardist;
+      double t = d0 / (d0 - d1);
+      polygon_positions[npolygon] = camera_positions[j0] + t * (camera_positions[j1] - camera_positions[j0]);
+      polygon_positions[npolygon][2] = -neardist;
+      polygon_barycentrics[npolygon][0] = (1 - t) * vertex_barycentrics[j0][0] + t * vertex_barycentrics[j1][0];
+      polygon_barycentrics[npolygon][1] = (1 - t) * vertex_barycentrics[j0][1] + t * vertex_barycentrics[j1][1];
+      npolygon++;
+    }
+  }
+
+  // Triangulate clipped polygon (fan)
+  int ntriangles = 0;
+  for (int k = 1; k < npolygon - 1; k++) {
+    R3Point positions[3] = { polygon_positions[0], polygon_positions[k], polygon_positions[k+1] };
+    double barycentrics[3][2] = {
+      { polygon_barycentrics[0][0], polygon_barycentrics[0][1] },
+      { polygon_barycentrics[k][0], polygon_barycentrics[k][1] },
+      { polygon_barycentrics[k+1][0], polygon_barycentrics[k+1][1] } };
+    if (SetupTriangle(*triangles[ntriangles], positions, barycentrics, intrinsics, width, height)) {
+      ntriangles++;
+    }
+  }
+
+  // Return number of triangles
+  return ntriangles;
+}
+
+
+
+int R3Rasterizer::
+RasterizeMesh(const R3Mesh& mesh)
+{
+  // Clear buffers
+  Clear();
+  this->mesh = &mesh;
+
+  // Check mesh
+  int nvertices = mesh.NVertices();
+  int nfaces = mesh.NFaces();
+  if ((nfaces == 0) || (width <= 0) || (height <= 0)) return 1;
+
+  // Allocate temporary buffers (kept for next mesh/camera)
+  if (nvertices > nallocated_vertices) {
+    if (camera_positions) delete [] camera_positions;
+    camera_positions = new R3Point [ nvertices ];
+    nallocated_vertices = nvertices;
+  }
+  if (nfaces > nallocated_faces) {
+    if (triangles) delete [] triangles;
+    if (face_ntriangles) delete [] face_ntriangles;
+    triangles = new R3RasterizerTriangle [ 2 * nfaces ];
+    face_ntriangles = new unsigned char [ nfaces ];
+    nallocated_faces = nfaces;
+  }
+
+  // Transform vertices into camera coordinates
+  R4Matrix world_to_camera = camera_to_world.Inverse();
+#pragma omp parallel for schedule(static)
+  for (int i = 0; i < nvertices; i++) {
+    R3MeshVertex *vertex = mesh.Vertex(i);
+    camera_positions[i] = world_to_camera * mesh.VertexPosition(vertex);
+  }
+
+  // Clip and project faces (second triangle of clipped face i is at nfaces+i)
+#pragma omp parallel for schedule(static)
+  for (int i = 0; i < nfaces; i++) {
+    R3MeshFace *face = mesh.Face(i);
+    R3Point positions[3];
+    for (int j = 0; j < 3; j++) {
+      R3MeshVertex *vertex = mesh.VertexOnFace(face, j);
+      positions[j] = camera_positions[mesh.VertexID(vertex)];
+    }
+    R3RasterizerTriangle *face_triangles[2] = { &triangles[i], &triangles[nallocated_faces + i] };
+    face_ntriangles[i] = SetupFaceTriangles(face_triangles, positions, neardist, intrinsics, width, height);
+  }
+
+  // Count triangles overlapping each tile
+  int ntiles_x = (width + R3_RASTERIZER_TILE_SIZE - 1) / R3_RASTERIZER_TILE_SIZE;
+  int ntiles_y = (height + R3_RASTERIZER_TILE_SIZE - 1) / R3_RASTERIZER_TILE_SIZE;
+  int ntiles = ntiles_x * ntiles_y;
+  int *tile_offsets = new int [ ntiles + 1 ];
+  int *tile_counts = new int [ ntiles ];
+  for (int i = 0; i <= ntiles; i++) tile_offsets[i] = 0;
+  for (int i = 0; i < nfaces; i++) {
+    for (int k = 0; k < face_ntriangles[i]; k++) {
+      const R3RasterizerTriangle& triangle = triangles[k*nallocated_faces + i];
+      for (int ty = triangle.ymin / R3_RASTERIZER_TILE_SIZE; ty <= triangle.ymax / R3_RASTERIZER_TILE_SIZE; ty++) {
+        for (int tx = triangle.xmin / R3_RASTERIZER_TILE_SIZE; tx <= triangle.xmax / R3_RASTERIZER_TILE_SIZE; tx++) {
+          tile_offsets[ty*ntiles_x + tx + 1]++;
+        }
+      }
+    }
+  }
+
+  // Bin triangles into tiles (in face order, so results do not depend on threads)
+  for (int i = 0; i < ntiles; i++) tile_offsets[i+1] += tile_offsets[i];
+  for (int i = 0; i < ntiles; i++) tile_counts[i] = 0;
+  if (tile_offsets[ntiles] > nallocated_tile_triangles) {
+    if (tile_triangles) delete [] tile_triangles;
+    tile_triangles = new int [ tile_offsets[ntiles] ];
+    nallocated_tile_triangles = tile_offsets[ntiles];
+  }
+  for (int i = 0; i < nfaces; i++) {
+    for (int k = 0; k < face_ntriangles[i]; k++) {
+      const R3RasterizerTriangle& triangle = triangles[k*nallocated_faces + i];
+      for (int ty = triangle.ymin / R3_RASTERIZER_TILE_SIZE; ty <= triangle.ymax / R3_RASTERIZER_TILE_SIZE; ty++) {
+        for (int tx = triangle.xmin / R3_RASTERIZER_TILE_SIZE; tx <= triangle.xmax / R3_RASTERIZER_TILE_SIZE; tx++) {
+          int tile = ty*ntiles_x + tx;
+          tile_triangles[tile_offsets[tile] + tile_counts[tile]++] = k*nallocated_faces + i;
+        }
+      }
+    }
+  }
+
+  // Rasterize tiles (each pixel belongs to one tile, so no locking is needed)
+#pragma omp parallel for schedule(dynamic, 1)
+  for (int tile = 0; tile < ntiles; tile++) {
+    int tile_xmin = (tile % ntiles_x) * R3_RASTERIZER_TILE_SIZE;
+    int tile_ymin = (tile / ntiles_x) * R3_RASTERIZER_TILE_SIZE;
+    int tile_xmax = tile_xmin + R3_RASTERIZER_TILE_SIZE - 1;
+    int tile_ymax = tile_ymin + R3_RASTERIZER_TILE_SIZE - 1;
+    if (tile_xmax >= width) tile_xmax = width - 1;
+    if (tile_ymax >= height) tile_ymax = height - 1;
+    for (int k = tile_offsets[tile]; k < tile_offsets[tile+1]; k++) {
+      int triangle_index = tile_triangles[k];
+      const R3RasterizerTriangle& triangle = triangles[triangle_index];
+      int face_index = triangle_index % nallocated_faces;
+
+      // Compute edge functions normalized to barycentric coordinates (either winding)
+      double a[3], b[3], c[3];
+      const RNScalar32 *x = triangle.x, *y = triangle.y;
+      double area = ((double) x[1] - x[0]) * ((double) y[2] - y[0]) - ((double) x[2] - x[0]) * ((double) y[1] - y[0]);
+      for (int j = 0; j < 3; j++) {
+        int j1 = (j + 1) % 3;
+        int j2 = (j + 2) % 3;
+        a[j] = ((double) y[j1] - y[j2]) / area;
+        b[j] = ((double) x[j2] - x[j1]) / area;
+        c[j] = ((double) x[j1] * y[j2] - (double) x[j2] * y[j1]) / area;
+      }
+
+      // Rasterize part of triangle in tile
+      int xmin = (triangle.xmin > tile_xmin) ? triangle.xmin : tile_xmin;
+      int ymin = (triangle.ymin > tile_ymin) ? triangle.ymin : tile_ymin;
+      int xmax = (triangle.xmax < tile_xmax) ? triangle.xmax : tile_xmax;
+      int ymax = (triangle.ymax < tile_ymax) ? triangle.ymax : tile_ymax;
+      for (int iy = ymin; iy <= ymax; iy++) {
+        double px = xmin + 0.5;
+        double py = iy + 0.5;
+        double s0 = a[0]*px + b[0]*py + c[0];
+        double s1 = a[1]*px + b[1]*py + c[1];
+        double s2 = a[2]*px + b[2]*py + c[2];
+        for (int ix = xmin; ix <= xmax; ix++, s0 += a[0], s1 += a[1], s2 += a[2]) {
+          // Check if pixel center is inside triangle (with slack, so that shared edges leave no cracks)
+          if ((s0 < -1.0E-9) || (s1 < -1.0E-9) || (s2 < -1.0E-9)) continue;
+
+          // Compute depth (inverse depth is linear in screen space)
+          double w0 = s0 * triangle.inverse_depth[0];
+          double w1 = s1 * triangle.inverse_depth[1];
+          double w2 = s2 * triangle.inverse_depth[2];
+          double inverse_depth = w0 + w1 + w2;
+          if (inverse_depth <= 0) continue;
+          double depth = 1.0 / inverse_depth;
+
+          // Check depth
+          int pixel = iy*width + ix;
+          if (depth >= depths[pixel]) continue;
+          if (depth > fardist) continue;
+
+          // Update buffers with perspective-correct face barycentric coordinates
+          w0 *= depth; w1 *= depth; w2 *= depth;
+          depths[pixel] = depth;
+          face_indices[pixel] = face_index;
+          barycentrics[2*pixel+0] = w0*triangle.face_barycentrics[0][0] + w1*triangle.face_barycentrics[1][0] + w2*triangle.face_barycentrics[2][0];
+          barycentrics[2*pixel+1] = w0*triangle.face_barycentrics[0][1] + w1*triangle.face_barycentrics[1][1] + w2*triangle.face_barycentrics[2][1];
+        }
+      }
+    }
+  }
+
+  // Delete tile offsets
+  delete [] tile_offsets;
+  delete [] tile_counts;
+
+  // Return success
+  return 1;
+}
+
+
+
+////////////////////////////////////////////////////////////////////////
+// Image creation functions
+////////////////////////////////////////////////////////////////////////
+
+static void
+ResetImage(R2Grid& image, int width, int height, RNScalar value)
+{
+  // Make image match rasterizer resolution and fill it with value
+  if ((image.XResolution() != width) || (image.YResolution() != height)) {
+    image = R2Grid(width, height);
+  }
+  image.Clear(value);
+}
+
+
+
+int R3Rasterizer::
+CreateDepthImage(R2Grid& image) const
+{
+  // Fill image with depths
+  ResetImage(image, width, height, R2_GRID_UNKNOWN_VALUE);
+  RNScalar *values = (RNScalar *) image.GridValues();
+  int npixels = width * height;
+  for (int i = 0; i < npixels; i++) {
+    if (face_indices[i] < 0) continue;
+    values[i] = depths[i];
+  }
+
+  // Return success
+  return 1;
+}
+
+
+
+int R3Rasterizer::
+CreateFaceIndexImage(R2Grid& image) const
+{
+  // Fill image with face indices
+  ResetImage(image, width, height, R2_GRID_UNKNOWN_VALUE);
+  RNScalar *values = (RNScalar *) image.GridValues();
+  int npixels = width * height;
+  for (int i = 0; i < npixels; i++) {
+    if (face_indices[i] < 0) continue;
+    values[i] = face_indices[i];
+  }
+
+  // Return success
+  return 1;
+}
+
+
+
+int R3Rasterizer::
+CreateSegmentImage(R2Grid& image) const
+{
+  // Check mesh
+  ResetImage(image, width, height, 0);
+  if (!mesh) return 0;
+
+  // Fill image with face segments
+  RNScalar *values = (RNScalar *) image.GridValues();
+  int npixels = width * height;
+  for (int i = 0; i < npixels; i++) {
+    if (face_indices[i] < 0) continue;
+    R3MeshFace *face = mesh->Face(face_indices[i]);
+    values[i] = mesh->FaceSegment(face) + 1;
+  }
+
+  // Return success
+  return 1;
+}
+
+
+
+int R3Rasterizer::
+CreateMaterialImage(R2Grid& image) const
+{
+  // Check mesh
+  ResetImage(image, width, height, 0);
+  if (!mesh) return 0;
+
+  // Fill image with face materials
+  RNScalar *values = (RNScalar *) image.GridValues();
+  int npixels = width * height;
+  for (int i = 0; i < npixels; i++) {
+    if (face_indices[i] < 0) continue;
+    R3MeshFace *face = mesh->Face(face_indices[i]);
+    values[i] = mesh->FaceMaterial(face) + 1;
+  }
+
+  // Return success
+  return 1;
+}
+
+
+
+int R3Rasterizer::
+CreatePositionImages(R2Grid& px, R2Grid& py, R2Grid& pz) const
+{
+  // Check mesh
+  ResetImage(px, width, height, R2_GRID_UNKNOWN_VALUE);
+  ResetImage(py, width, height, R2_GRID_UNKNOWN_VALUE);
+  ResetImage(pz, width, height, R2_GRID_UNKNOWN_VALUE);
+  if (!mesh) return 0;
+
+  // Fill images with interpolated vertex positions
+  RNScalar *px_values = (RNScalar *) px.GridValues();
+  RNScalar *py_values = (RNScalar *) py.GridValues();
+  RNScalar *pz_values = (RNScalar *) pz.GridValues();
+  int npixels = width * height;
+#pragma omp parallel for schedule(static)
+  for (int i = 0; i < npixels; i++) {
+    if (face_indices[i] < 0) continue;
+    R3MeshFace *face = mesh->Face(face_indices[i]);
+    RNScalar b1 = barycentrics[2*i+0];
+    RNScalar b2 = barycentrics[2*i+1];
+    const R3Point& p0 = mesh->VertexPosition(mesh->VertexOnFace(face, 0));
+    const R3Point& p1 = mesh->VertexPosition(mesh->VertexOnFace(face, 1));
+    const R3Point& p2 = mesh->VertexPosition(mesh->VertexOnFace(face, 2));
+    R3Point position = (1.0 - b1 - b2) * p0 + b1 * p1.Vector() + b2 * p2.Vector();
+    px_values[i] = position.X();
+    py_values[i] = position.Y();
+    pz_values[i] = position.Z();
+  }
+
+  // Return success
+  return 1;
+}
+
+
+
+int R3Rasterizer::
+CreateNormalImages(R2Grid& nx, R2Grid& ny, R2Grid& nz) const
+{
+  // Check mesh
+  ResetImage(nx, width, height, R2_GRID_UNKNOWN_VALUE);
+  ResetImage(ny, width, height, R2_GRID_UNKNOWN_VALUE);
+  ResetImage(nz, width, height, R2_GRID_UNKNOWN_VALUE);
+  if (!mesh) return 0;
+
+  // Transform vertex normals into camera coordinates (serially, since they are computed lazily)
+  R4Matrix world_to_camera = camera_to_world.Inverse();
+  R3Vector *camera_normals = new R3Vector [ mesh->NVertices() ];
+  for (int i = 0; i < mesh->NVertices(); i++) {
+    R3MeshVertex *vertex = mesh->Vertex(i);
+    camera_normals[i] = world_to_camera * mesh->VertexNormal(vertex);
+    camera_normals[i].Normalize();
+  }
+
+  // Fill images with interpolated vertex normals
+  RNScalar *nx_values = (RNScalar *) nx.GridValues();
+  RNScalar *ny_values = (RNScalar *) ny.GridValues();
+  RNScalar *nz_values = (RNScalar *) nz.GridValues();
+  int npixels = width * height;
+#pragma omp parallel for schedule(static)
+  for (int i = 0; i < npixels; i++) {
+    if (face_indices[i] < 0) continue;
+    R3MeshFace *face = mesh->Face(face_indices[i]);
+    RNScalar b1 = barycentrics[2*i+0];
+    RNScalar b2 = barycentrics[2*i+1];
+    const R3Vector& n0 = camera_normals[mesh->VertexID(mesh->VertexOnFace(face, 0))];
+    const R3Vector& n1 = camera_normals[mesh->VertexID(mesh->VertexOnFace(face, 1))];
+    const R3Vector& n2 = camera_normals[mesh->VertexID(mesh->VertexOnFace(face, 2))];
+    R3Vector normal = (1.0 - b1 - b2) * n0 + b1 * n1 + b2 * n2;
+    normal.Normalize();
+    nx_values[i] = normal.X();
+    ny_values[i] = normal.Y();
+    nz_values[i] = normal.Z();
+  }
+
+  // Delete camera normals
+  delete [] camera_normals;
+
+  // Return success
+  return 1;
+}
+
+
+
+int R3Rasterizer::
+CreateColorImage(R2Image& image, const RNRgb& background) const
+{
+  // Make image match rasterizer resolution
+  if ((image.Width() != width) || (image.Height() != height)) {
+    image = R2Image(width, height, 3);
+  }
+
+  // Fill image with interpolated vertex colors
+#pragma omp parallel for schedule(static)
+  for (int iy = 0; iy < height; iy++) {
+    for (int ix = 0; ix < width; ix++) {
+      int i = iy*width + ix;
+      if (!mesh || (face_indices[i] < 0)) { image.SetPixelRGB(ix, iy, background); continue; }
+      R3MeshFace *face = mesh->Face(face_indices[i]);
+      RNScalar b1 = barycentrics[2*i+0];
+      RNScalar b2 = barycentrics[2*i+1];
+      const RNRgb& c0 = mesh->VertexColor(mesh->VertexOnFace(face, 0));
+      const RNRgb& c1 = mesh->VertexColor(mesh->VertexOnFace(face, 1));
+      const RNRgb& c2 = mesh->VertexColor(mesh->VertexOnFace(face, 2));
+      RNRgb color = (1.0 - b1 - b2) * c0 + b1 * c1 + b2 * c2;
+      for (int k = 0; k < 3; k++) {
+        if (color[k] < 0) color[k] = 0;
+        else if (color[k] > 1) color[k] = 1;
+      }
+      image.SetPixelRGB(ix, iy, color);
+    }
+  }
+
+  // Return success
+  return mesh ? 1 : 0;
+}
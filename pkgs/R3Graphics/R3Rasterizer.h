@@ -0,0 +1,191 @@
+// Include file for R3 rasterizer class
+
+
+
+////////////////////////////////////////////////////////////////////////
+// NOTE:
+// A rasterizer renders triangle meshes into z-buffered image buffers
+// on the CPU, without OpenGL.  The camera is given as a pinhole
+// intrinsics matrix and a camera-to-world transformation (camera looks
+// down -Z, with image x = cx + fx*x/depth and image y = cy + fy*y/depth,
+// as for RGBD images).  The screen is split into tiles, triangles are
+// binned into the tiles they overlap, and tiles are rasterized in
+// parallel.  Each pixel keeps the depth, face index, and perspective-
+// correct barycentric coordinates of its closest triangle, from which
+// all other attributes (normals, positions, colors, ids) are derived.
+////////////////////////////////////////////////////////////////////////
+
+
+
+////////////////////////////////////////////////////////////////////////
+// Class definition
+////////////////////////////////////////////////////////////////////////
+
+class R3Rasterizer {
+public:
+  // Constructors/destructors
+  R3Rasterizer(int width = 640, int height = 480);
+  ~R3Rasterizer(void);
+
+  // Property functions
+  int Width(void) const;
+  int Height(void) const;
+  const R3Matrix& Intrinsics(void) const;
+  const R4Matrix& CameraToWorld(void) const;
+  RNLength Near(void) const;
+  RNLength Far(void) const;
+  const R3Mesh *Mesh(void) const;
+
+  // Pixel access functions (results of most recent rasterization)
+  RNLength PixelDepth(int ix, int iy) const;
+  int PixelFaceIndex(int ix, int iy) const;
+  R3Point PixelBarycentricCoordinates(int ix, int iy) const;
+
+  // Manipulation functions
+  void SetResolution(int width, int height);
+  void SetCamera(const R3Matrix& intrinsics, const R4Matrix& camera_to_world);
+  void SetCamera(const R3Camera& camera);
+  void SetNearFar(RNLength neardist, RNLength fardist);
+  void Clear(void);
+
+  // Rasterization functions
+  int RasterizeMesh(const R3Mesh& mesh);
+
+  // Image creation functions (empty pixels are R2_GRID_UNKNOWN_VALUE, except where noted)
+  int CreateDepthImage(R2Grid& image) const;
+  int CreateFaceIndexImage(R2Grid& image) const;
+  int CreateSegmentImage(R2Grid& image) const;  // FaceSegment+1, 0 if empty
+  int CreateMaterialImage(R2Grid& image) const;  // FaceMaterial+1, 0 if empty
+  int CreatePositionImages(R2Grid& px, R2Grid& py, R2Grid& pz) const;  // world coordinates
+  int CreateNormalImages(R2Grid& nx, R2Grid& ny, R2Grid& nz) const;  // camera coordinates
+  int CreateColorImage(R2Image& image, const RNRgb& background = RNblack_rgb) const;
+
+private:
+  void UpdateBuffers(void);
+
+private:
+  // Camera
+  int width, height;
+  R3Matrix intrinsics;
+  R4Matrix camera_to_world;
+  RNLength neardist, fardist;
+
+  // Buffers (one entry per pixel)
+  RNScalar32 *depths;
+  int *face_indices;
+  RNScalar32 *barycentrics;
+
+  // Mesh rasterized into buffers
+  const R3Mesh *mesh;
+
+  // Temporary buffers (reused for every rasterization)
+  R3Point *camera_positions;
+  int nallocated_vertices;
+  struct R3RasterizerTriangle *triangles;
+  unsigned char *face_ntriangles;
+  int nallocated_faces;
+  int *tile_triangles;
+  int nallocated_tile_triangles;
+};
+
+
+
+////////////////////////////////////////////////////////////////////////
+// Inline functions
+////////////////////////////////////////////////////////////////////////
+
+inline int R3Rasterizer::
+Width(void) const
+{
+  // Return number of pixels in x
+  return width;
+}
+
+
+
+inline int R3Rasterizer::
+Height(void) const
+{
+  // Return number of pixels in y
+  return height;
+}
+
+
+
+inline const R3Matrix& R3Rasterizer::
+Intrinsics(void) const
+{
+  // Return intrinsics matrix
+  return intrinsics;
+}
+
+
+
+inline const R4Matrix& R3Rasterizer::
+CameraToWorld(void) const
+{
+  // Return camera-to-world transformation
+  return camera_to_world;
+}
+
+
+
+inline RNLength R3Rasterizer::
+Near(void) const
+{
+  // Return near clipping distance
+  return neardist;
+}
+
+
+
+inline RNLength R3Rasterizer::
+Far(void) const
+{
+  // Return far clipping distance
+  return fardist;
+}
+
+
+
+inline const R3Mesh *R3Rasterizer::
+Mesh(void) const
+{
+  // Return mesh rasterized most recently
+  return mesh;
+}
+
+
+
+inline RNLength R3Rasterizer::
+PixelDepth(int ix, int iy) const
+{
+  // Return depth of closest surface at pixel (0 if empty)
+  int face_index = face_indices[iy*width + ix];
+  if (face_index < 0) return 0;
+  return depths[iy*width + ix];
+}
+
+
+
+inline int R3Rasterizer::
+PixelFaceIndex(int ix, int iy) const
+{
+  // Return index of closest face at pixel (-1 if empty)
+  return face_indices[iy*width + ix];
+}
+
+
+
+inline R3Point R3Rasterizer::
+PixelBarycentricCoordinates(int ix, int iy) const
+{
+  // Return barycentric coordinates of pixel center with respect to closest face
+  int i = iy*width + ix;
+  RNScalar b1 = barycentrics[2*i+0];
+  RNScalar b2 = barycentrics[2*i+1];
+  return R3Point(1.0 - b1 - b2, b1, b2);
+}
+
+
+
@@ -20,6 +20,7 @@
 // Useful constants
 
 const float R3_GRID_KEEP_VALUE = R2_GRID_KEEP_VALUE;
+static const int R3_GRID_DISTANCE_TRANSFORM_CHUNK_SIZE = 16;
 
 
 
@@ -745,67 +746,14 @@ Blur(RNLength grid_sigma)
 void R3Grid::
 BilateralFilter(RNLength grid_sigma, RNLength value_sigma)
 {
-  // Make copy of grid
-  R3Grid copy(*this);
-
   // Determine reasonable value sigma
   if (value_sigma == -1) {
     RNInterval range = Range();
     value_sigma = 0.01 * (range.Max() - range.Min());
   }
 
-  // Get convenient variables
-  double grid_denom = -2.0 * grid_sigma * grid_sigma;
-  double value_denom = -2.0 * value_sigma * value_sigma;
-  RNScalar grid_radius = 3 * grid_sigma;
-  int r = (int) (grid_radius + 1);
-  int r_squared = r * r;
-
-  // Set every sample to be median of surrounding region in input grid
-  for (int cz = 0; cz < ZResolution(); cz++) {
-    for (int cy = 0; cy < YResolution(); cy++) {
-      for (int cx = 0; cx < XResolution(); cx++) {
-        // Get current value
-        RNScalar value = copy.GridValue(cx, cy, cz);
-
-        // Compute new value
-        RNScalar sum = 0;
-        RNScalar weight = 0;
-        int zmin = cz - r;
-        int zmax = cz + r;
-        if (zmin < 0) zmin = 0;
-        if (zmax >= ZResolution()) zmax = ZResolution() - 1;
-        for (int z = zmin; z <= zmax; z++) {
-          int ymin = cy - r;
-          int ymax = cy + r;
-          if (ymin < 0) ymin = 0;
-          if (ymax >= YResolution()) ymax = YResolution() - 1;
-          int dz = z - cz;
-          for (int y = ymin; y <= ymax; y++) {
-            int xmin = cx - r;
-            int xmax = cx + r;
-            if (xmin < 0) xmin = 0;
-            if (xmax >= XResolution()) xmax = XResolution() - 1;
-            int dy = y - cy;
-            for (int x = xmin; x <= xmax; x++) {
-              int dx = x - cx;
-              int grid_distance_squared = dx*dx + dy*dy + dz*dz;
-              if (grid_distance_squared > r_squared) continue;
-              RNScalar sample = copy.GridValue(x, y, z);
-              RNScalar value_distance_squared = value - sample;
-              value_distance_squared *= value_distance_squared;
-              RNScalar w = exp(grid_distance_squared/grid_denom) * exp(value_distance_squared/value_denom);
-              sum += w * sample;
-              weight += w;
-            }
-          }
-        }
-
-        // Set new value
-        if (weight > 0) SetGridValue(cx, cy, cz, sum / weight);
-      }
-    }
-  }
+  // Set every sample to be bilateral filter of surrounding region in input grid
+  RNBilateralFilter(grid_values, 3, grid_resolution, grid_sigma, value_sigma);
 }
 
 
@@ -934,69 +882,9 @@ DetectEdges(void)
 void R3Grid::
 PercentileFilter(RNLength grid_radius, RNScalar percentile)
 {
-  // Make copy of grid
-  R3Grid copy(*this);
-
-  // Get convenient variables
-  RNScalar grid_radius_squared = grid_radius * grid_radius;
-  int r = (int) grid_radius;
-  assert(r >= 0);
-  int max_samples = (2*r+1) * (2*r+1) * (2*r+1);
-  RNScalar *samples = new RNScalar [ max_samples ];
-  assert(samples);
-
   // Set every sample to be Kth percentile of surrounding region in input grid
-  for (int cz = 0; cz < ZResolution(); cz++) {
-    for (int cy = 0; cy < YResolution(); cy++) {
-      for (int cx = 0; cx < XResolution(); cx++) {
-        // Build list of grid values in neighborhood
-        int nsamples = 0;
-        int zmin = cz - r;
-        int zmax = cz + r;
-        if (zmin < 0) zmin = 0;
-        if (zmax >= ZResolution()) zmax = ZResolution() - 1;
-        for (int z = zmin; z <= zmax; z++) {
-          int dz = z - cz;
-          int ymin = cy - r;
-          int ymax = cy + r;
-          if (ymin < 0) ymin = 0;
-          if (ymax >= YResolution()) ymax = YResolution() - 1;
-          for (int y = ymin; y <= ymax; y++) {
-            int dy = y - cy;
-            int xmin = cx - r;
-            int xmax = cx + r;
-            if (xmin < 0) xmin = 0;
-            if (xmax >= XResolution()) xmax = XResolution() - 1;
-            for (int x = xmin; x <= xmax; x++) {
-              int dx = x - cx;
-              int d_squared = dx*dx + dy*dy + dz*dz;
-              if (d_squared > grid_radius_squared) continue;
-              RNScalar sample = copy.GridValue(x, y, z);
-              samples[nsamples++] = sample;
-            }
-          }
-        }
-
-        // Check number of grid values in neighborhood
-        if (nsamples == 0) {
-          SetGridValue(cx, cy, cz, 0);
-        }
-        else {
-          // Sort samples found in neighborhood
-          qsort(samples, nsamples, sizeof(RNScalar), RNCompareScalars);
-
-          // Set grid value to percentile of neighborhood
-          int index = (int) (percentile * nsamples);
-          if (index < 0) index = 0;
-          else if (index >= nsamples) index = nsamples-1;
-          SetGridValue(cx, cy, cz, samples[index]);
-        }
-      }
-    }
-  }
-
-  // Delete temporary memory
-  delete [] samples;
+  assert(grid_radius >= 0);
+  RNRankFilter(grid_values, 3, grid_resolution, grid_radius, percentile);
 }
 
 
@@ -1264,203 +1152,149 @@ Threshold(RNScalar threshold, RNScalar low, RNScalar high)
 
 
 
+static void
+SquaredDistanceTransformLine(const RNScalar *f, const int *fi, int n,
+  RNScalar *d, int *di, int *v, RNScalar *z)
+{
+  // Compute lower envelope of parabolas rooted at (q, f[q])
+  // (Felzenszwalb and Huttenlocher, "Distance Transforms of Sampled Functions")
+  int k = 0;
+  v[0] = 0;
+  z[0] = -FLT_MAX;
+  z[1] = FLT_MAX;
+  for (int q = 1; q < n; q++) {
+    RNScalar fq = f[q] + (RNScalar) q*q;
+    RNScalar s = (fq - (f[v[k]] + (RNScalar) v[k]*v[k])) / (2*q - 2*v[k]);
+    while (s <= z[k]) {
+      k--;
+      s = (fq - (f[v[k]] + (RNScalar) v[k]*v[k])) / (2*q - 2*v[k]);
+    }
+    k++;
+    v[k] = q;
+    z[k] = s;
+    z[k+1] = FLT_MAX;
+  }
+
+  // Fill in values (and nearest site indices) from lower envelope
+  k = 0;
+  for (int q = 0; q < n; q++) {
+    while (z[k+1] < q) k++;
+    d[q] = (RNScalar) (q - v[k])*(q - v[k]) + f[v[k]];
+    if (di) di[q] = fi[v[k]];
+  }
+}
+
+
+
+static void
+SquaredDistanceTransformAxis(RNScalar *values, int *indices, const int resolution[3], int dim)
+{
+  // Get line structure along dimension
+  int n = resolution[dim];
+  if (n < 2) return;
+  int row_size = resolution[0];
+  int sheet_size = resolution[0] * resolution[1];
+  int stride = (dim == 0) ? 1 : ((dim == 1) ? row_size : sheet_size);
+  int nlines = resolution[0] * resolution[1] * resolution[2] / n;
+
+  // Group lines into chunks (lines adjacent in x are gathered together
+  // for passes along y and z, so that strided memory accesses are shared)
+  int chunk_size = (dim == 0) ? 1 : R3_GRID_DISTANCE_TRANSFORM_CHUNK_SIZE;
+  int chunks_per_row = (dim == 0) ? 1 : (row_size + chunk_size - 1) / chunk_size;
+  int nrows = (dim == 0) ? nlines : nlines / row_size;
+  int row_step = (dim == 0) ? row_size : ((dim == 1) ? sheet_size : row_size);
+  int nchunks = nrows * chunks_per_row;
+
+  // Transform independent chunks of lines in parallel
+#pragma omp parallel
+  {
+    // Allocate per-thread buffers
+    RNScalar *f = new RNScalar [ chunk_size * n ];
+    RNScalar *d = new RNScalar [ chunk_size * n ];
+    RNScalar *z = new RNScalar [ n + 1 ];
+    int *v = new int [ n ];
+    int *fi = (indices) ? new int [ chunk_size * n ] : NULL;
+    int *di = (indices) ? new int [ chunk_size * n ] : NULL;
+
+#pragma omp for schedule(static)
+    for (int chunk = 0; chunk < nchunks; chunk++) {
+      // Compute index of first entry on first line of chunk
+      int row = chunk / chunks_per_row;
+      int x0 = (chunk % chunks_per_row) * chunk_size;
+      int count = (dim == 0) ? 1 : ((x0 + chunk_size <= row_size) ? chunk_size : row_size - x0);
+      int base = row * row_step + x0;
+
+      // Gather lines
+      for (int q = 0; q < n; q++) {
+        for (int c = 0; c < count; c++) f[c*n + q] = values[base + q*stride + c];
+        if (indices) for (int c = 0; c < count; c++) fi[c*n + q] = indices[base + q*stride + c];
+      }
+
+      // Transform lines
+      for (int c = 0; c < count; c++) {
+        SquaredDistanceTransformLine(&f[c*n], (fi) ? &fi[c*n] : NULL, n,
+          &d[c*n], (di) ? &di[c*n] : NULL, v, z);
+      }
+
+      // Scatter lines
+      for (int q = 0; q < n; q++) {
+        for (int c = 0; c < count; c++) values[base + q*stride + c] = d[c*n + q];
+        if (indices) for (int c = 0; c < count; c++) indices[base + q*stride + c] = di[c*n + q];
+      }
+    }
+
+    // Delete per-thread buffers
+    delete [] f;
+    delete [] d;
+    delete [] z;
+    delete [] v;
+    if (fi) delete [] fi;
+    if (di) delete [] di;
+  }
+}
+
+
+
 void R3Grid::
 Voronoi(R3Grid *squared_distance_grid)
 {
-  int dist;
-  int* old_dist;
-  int* new_dist;
-  RNScalar value;
-  RNScalar *old_value;
-  RNScalar *new_value;
-  R3Grid *dgrid;
-  int res,square,tmp_dist,first;
-  int x,y,z,s,t,i;
-
   // Allocate distance grid
+  R3Grid *dgrid;
   if (squared_distance_grid) dgrid = squared_distance_grid;
   else dgrid = new R3Grid(XResolution(), YResolution(), ZResolution());
   assert(dgrid);
   dgrid->SetWorldToGridTransformation(WorldToGridTransformation());
 
-  // Allocate temporary buffers
-  res = XResolution();
+  // Allocate nearest site indices
+  int *nearest_site_indices = new int [ grid_size ];
+  assert(nearest_site_indices);
+
+  // Initalize distance grid values (0 if was set, max_value if not)
+  int res = XResolution();
   if (res < YResolution()) res = YResolution();
   if (res < ZResolution()) res = ZResolution();
-  old_dist = new int[res];
-  new_dist = new int[res];
-  old_value = new RNScalar[res];
-  new_value = new RNScalar[res];
-  assert(old_dist && new_dist && old_value && new_value);
+  RNScalar max_value = 3.0 * (res+1) * (res+1) * (res+1);
+#pragma omp parallel for schedule(static)
+  for (int i = 0; i < grid_size; i++) {
+    if (grid_values[i] == 0.0) { dgrid->grid_values[i] = max_value; nearest_site_indices[i] = -1; }
+    else { dgrid->grid_values[i] = 0.0; nearest_site_indices[i] = i; }
+  }
 
-  // Initalize distance grid values (0 if was set, max_value if not)
-  RNScalar max_value = 3 * (res+1) * (res+1) * (res+1);
-  for (i = 0; i < grid_size; i++) {
-    if (grid_values[i] == 0.0) dgrid->grid_values[i] = max_value;
-    else dgrid->grid_values[i] = 0.0;
-  }
-
-  // Scan along z axis
-  for (x = 0; x < XResolution(); x++) {
-    for (y = 0; y < YResolution(); y++) {
-      first = 1;
-      value = 0;
-      dist = 0;
-      for (z = 0; z < ZResolution(); z++) {
-        if (dgrid->GridValue(x,y,z) == 0.0) {
-          first=0;
-          dist=0;
-          value = GridValue(x,y,z);
-          assert(value != 0);
-        }
-        else if (first == 0) {
-          dist++;
-          square = dist*dist;
-          dgrid->SetGridValue(x, y, z, square);
-          SetGridValue(x, y, z, value);
-          assert(value != 0);
-        }
-      }
-			
-      // backward scan
-      dist = 0;
-      first = 1;
-      for (z = ZResolution()-1; z >= 0; z--) {
-        if (dgrid->GridValue(x,y,z) == 0.0){
-          dist = 0;
-          first = 0;
-          value = GridValue(x,y,z);
-          assert(value != 0);
-        }
-        else if (first == 0) {
-          dist++;
-          square = dist*dist;
-          if (square < dgrid->GridValue(x, y, z)) {
-            dgrid->SetGridValue(x, y, z, square);
-            SetGridValue(x, y, z, value);
-            assert(value != 0);
-          }
-        }
-      }
-    }
-  } 
-
-  // Scan along x axis
-  for (z = 0; z < ZResolution(); z++) {
-    for (y = 0; y < YResolution(); y++) {
-      // Copy grid values
-      for(x = 0; x < XResolution(); x++) {
-        old_dist[x] = (int) (dgrid->GridValue(x, y, z) + 0.5);
-        old_value[x] = GridValue(x, y, z);
-      }
-		
-      // forward scan
-      s = 0;
-      for (x = 0; x < XResolution(); x++) {
-        dist = old_dist[x];
-        value = old_value[x];
-        if (dist) {
-          for(t = s; t <= x; t++) {
-            tmp_dist = old_dist[t] + (x - t) * (x - t);
-            if (tmp_dist <= dist) {
-              dist = tmp_dist;
-              value = old_value[t];
-              s = t;
-            }
-          }
-        }
-        else {
-          s = x;
-        }
-        new_dist[x] = dist;
-        new_value[x] = value;
-      }
-			
-      // backwards scan
-      s = XResolution() - 1;
-      for (x = XResolution()-1; x >= 0 ; x--) {
-        dist = new_dist[x];
-        value = new_value[x];
-        if (dist) {
-          for (t = s; t >= x; t--) {
-            tmp_dist = old_dist[t] + (x - t) * (x - t);
-            if (tmp_dist <= dist) {
-              dist = tmp_dist;
-              value = old_value[t];
-              s = t;
-            }
-          }
-          dgrid->SetGridValue(x, y, z, dist);
-          SetGridValue(x, y, z, value);
-        }
-        else {
-          s=x;
-        }
-      }
-    }
+  // Compute squared distances and nearest sites with separable passes
+  for (int dim = 0; dim < 3; dim++) {
+    SquaredDistanceTransformAxis(dgrid->grid_values, nearest_site_indices, grid_resolution, dim);
   }
-		
-  // along y axis
-  for (z = 0; z < ZResolution(); z++) {
-    for (x = 0; x < XResolution(); x++) {
-      // Copy grid values
-      for (y = 0; y < YResolution(); y++) {
-        old_dist[y] = (int) (dgrid->GridValue(x, y, z));
-        old_value[y] = GridValue(x, y, z);
-      }
-			
-      // forward scan
-      s = 0;
-      for (y = 0; y < YResolution(); y++) {
-        dist = old_dist[y];
-        value = old_value[y];
-        if (dist) {
-          for (t = s; t <= y ; t++) {
-            tmp_dist = old_dist[t] + (y - t) * (y - t);
-            if (tmp_dist <= dist){
-              dist = tmp_dist;
-              value = old_value[t];
-              s = t;
-            }
-          }
-        }
-        else { 
-          s = y;
-        }
-        new_dist[y] = dist;
-        new_value[y] = value;
-      }
 
-      // backward scan
-      s = YResolution() - 1;
-      for(y = YResolution()-1; y >=0 ; y--) {
-        dist = new_dist[y];
-        value = new_value[y];
-        if (dist) {
-          for (t = s; t > y ; t--) {
-            tmp_dist = old_dist[t] + (y - t) * (y - t);
-            if (tmp_dist <= dist){
-              dist = tmp_dist;
-              value = old_value[t];
-              s = t;
-            }
-          }
-          dgrid->SetGridValue(x, y, z, dist);
-          SetGridValue(x, y, z, value);
-        }
-        else { 
-          s = y; 
-        }
-      }
-    }
+  // Copy value from nearest site (sites keep their own values, so can do in place)
+#pragma omp parallel for schedule(static)
+  for (int i = 0; i < grid_size; i++) {
+    if (nearest_site_indices[i] < 0) continue;
+    grid_values[i] = grid_values[nearest_site_indices[i]];
   }
-	
+
   // Delete temporary buffers
   if (!squared_distance_grid) delete dgrid;
-  delete[] old_dist;
-  delete[] new_dist;
-  delete[] old_value;
-  delete[] new_value;
+  delete [] nearest_site_indices;
 }
 
 
@@ -1482,168 +1316,32 @@ SignedDistanceTransform(void)
 
 
 void R3Grid::
-SquaredDistanceTransform(void)
+SquaredDistanceTransform(int *nearest_site_indices)
 {
-  int x,y,z,s,t;
-  long long dist,square,new_dist;
-  long long* oldBuffer;
-  long long* newBuffer;
-  int first;
-  int i;
-
-  // Allocate temporary buffers
+  // Compute squared distance to nearest non-zero entry
+  // (and, optionally, the index of that entry, or -1 if there are none)
   int res = XResolution();
   if (res < YResolution()) res = YResolution();
   if (res < ZResolution()) res = ZResolution();
-  oldBuffer = new long long [res];
-  assert(oldBuffer);
-  newBuffer = new long long[res];
-  assert(newBuffer);
 
   // Initalize values (0 if was set, max_value if not)
   RNScalar max_value = 3.0 * (res+1) * (res+1);
-  RNScalar *grid_valuesp = grid_values;
-  for (i = 0; i < grid_size; i++) {
-    if (*grid_valuesp == 0.0) *grid_valuesp = max_value;
-    else *grid_valuesp = 0.0;
-    grid_valuesp++;
-  }
-
-  // Scan along z axis
-  for (x = 0; x < XResolution(); x++) {
-    for (y = 0; y < YResolution(); y++) {
-      first = 1;
-      dist = 0;
-      for (z = 0; z < ZResolution(); z++) {
-        if (GridValue(x,y,z) == 0.0) {
-          dist=0;
-          first=0;
-          SetGridValue(x, y, z, 0);
-        }
-        else if (first == 0) {
-          dist++;
-          square = dist*dist;
-          SetGridValue(x, y, z, square);
-        }
-      }
-			
-      // backward scan
-      dist = 0;
-      first = 1;
-      for (z = ZResolution()-1; z >= 0; z--) {
-        if (GridValue(x,y,z) == 0.0){
-          dist = 0;
-          first = 0;
-          SetGridValue(x, y, z, 0);
-        }
-        else if (first == 0) {
-          dist++;
-          square = dist*dist;
-          if (square < GridValue(x, y, z)) {
-            SetGridValue(x, y, z, square);
-          }
-        }
-      }
+#pragma omp parallel for schedule(static)
+  for (int i = 0; i < grid_size; i++) {
+    if (grid_values[i] == 0.0) {
+      grid_values[i] = max_value;
+      if (nearest_site_indices) nearest_site_indices[i] = -1;
     }
-  }
-
-  // Scan along x axis
-  for (z = 0; z < ZResolution(); z++) {
-    for (y = 0; y < YResolution(); y++) {
-      // Copy grid values
-      for(x = 0; x < XResolution(); x++) 
-        oldBuffer[x] = (int) (GridValue(x, y, z) + 0.5);
-		
-      // forward scan
-      s = 0;
-      for (x = 0; x < XResolution(); x++) {
-        dist = oldBuffer[x];
-        if (dist) {
-          for(t = s; t <= x; t++) {
-            new_dist = oldBuffer[t] + (x - t) * (x - t);
-            if (new_dist <= dist) {
-              dist = new_dist;
-              s = t;
-            }
-          }
-        }
-        else {
-          s = x;
-        }
-        newBuffer[x] = dist;
-      }
-			
-      // backwards scan
-      s = XResolution() - 1;
-      for (x = XResolution()-1; x >= 0 ; x--) {
-        dist = newBuffer[x];
-        if (dist) {
-          for (t = s; t >= x; t--) {
-            new_dist = oldBuffer[t] + (x - t) * (x - t);
-            if (new_dist <= dist) {
-              dist = new_dist;
-              s = t;
-            }
-          }
-          SetGridValue(x, y, z, dist);
-        }
-        else {
-          s=x;
-        }
-      }
+    else {
+      grid_values[i] = 0.0;
+      if (nearest_site_indices) nearest_site_indices[i] = i;
     }
   }
-		
-  // along y axis
-  for (z = 0; z < ZResolution(); z++) {
-    for (x = 0; x < XResolution(); x++) {
-      // Copy grid values
-      for (y = 0; y < YResolution(); y++)
-        oldBuffer[y] = (int) (GridValue(x, y, z) + 0.5);
-			
-      // forward scan
-      s = 0;
-      for (y = 0; y < YResolution(); y++) {
-        dist = oldBuffer[y];
-        if (dist) {
-          for (t = s; t <= y ; t++) {
-            new_dist = oldBuffer[t] + (y - t) * (y - t);
-            if (new_dist <= dist){
-              dist = new_dist;
-              s = t;
-            }
-          }
-        }
-        else { 
-          s = y;
-        }
-        newBuffer[y] = dist;
-      }
 
-      // backward scan
-      s = YResolution() - 1;
-      for(y = YResolution()-1; y >=0 ; y--) {
-        dist = newBuffer[y];
-        if (dist) {
-          for (t = s; t > y ; t--) {
-            new_dist = oldBuffer[t] + (y - t) * (y - t);
-            if (new_dist <= dist){
-              dist = new_dist;
-              s = t;
-            }
-          }
-          SetGridValue(x, y, z, dist);
-        }
-        else { 
-          s = y; 
-        }
-      }
-    }
+  // Compute exact squared distances with separable passes
+  for (int dim = 0; dim < 3; dim++) {
+    SquaredDistanceTransformAxis(grid_values, nearest_site_indices, grid_resolution, dim);
   }
-	
-  // Delete temporary buffers
-  delete[] oldBuffer;
-  delete[] newBuffer;
 }
 
 
@@ -4558,36 +4256,201 @@ ConnectedComponents(RNScalar isolevel, int max_components, int *seeds, int *size
 
 
 
-static R3MeshVertex *
-InterpolatedVertex(const R3Grid *grid, int ix0, int iy0, int iz0, int dim,
-  R3Mesh *mesh, R3MeshVertex **vertices, RNScalar isolevel)
+////////////////////////////////////////////////////////////////////////
+// Isosurface extraction
+// Marching cubes runs in parallel over slabs of cells along the z axis.
+// Each slab emits an indexed triangle buffer (vertices are shared along
+// cell edges within the slab), and the slab buffers are then stitched
+// into the mesh in z order, so that the vertex and face order matches
+// a serial traversal of the cells.
+////////////////////////////////////////////////////////////////////////
+
+static const int R3_GRID_ISOSURFACE_BLOCK_SIZE = 8;
+
+
+
+struct R3GridIsoSurfaceSlab {
+  // Vertices (keyed by grid edge: 3*grid_index + dim)
+  R3Point *positions;
+  RNInt64 *keys;
+  int nvertices;
+  int nallocated_vertices;
+
+  // Faces (triplets of indices into slab vertices)
+  int *face_vertices;
+  int nfaces;
+  int nallocated_faces;
+};
+
+
+
+static int
+IsoSurfaceSlabVertex(const R3Grid *grid, int ix0, int iy0, int iz0, int dim,
+  RNScalar isolevel, int *plane_maps[2], int *vertical_map, R3GridIsoSurfaceSlab *slab)
 {
   // Check indices
   assert(dim < 3);
-  int grid_index;
   int ix1 = (dim == 0) ? ix0+1 : ix0;
   int iy1 = (dim == 1) ? iy0+1 : iy0;
   int iz1 = (dim == 2) ? iz0+1 : iz0;
-  assert(ix0 < grid->XResolution());
-  assert(iy0 < grid->YResolution());
-  assert(iz0 < grid->ZResolution());
   assert(ix1 < grid->XResolution());
   assert(iy1 < grid->YResolution());
   assert(iz1 < grid->ZResolution());
+
+  // Find entry in edge map (entries are validated by key, so maps never need to be cleared)
+  int grid_index;
   grid->IndicesToIndex(ix0, iy0, iz0, grid_index);
-  if (!vertices[3*grid_index+dim]) {
-    RNScalar value0 = grid->GridValue(ix0, iy0, iz0);
-    RNScalar value1 = grid->GridValue(ix1, iy1, iz1);
-    RNScalar delta0 = fabs(value0 - isolevel);
-    RNScalar delta1 = fabs(value1 - isolevel);
-    RNScalar denom = delta0 + delta1;
-    RNScalar t = (RNIsNotZero(denom)) ? delta0 / denom : 0.5;
-    R3Point p0 = grid->WorldPosition(ix0, iy0, iz0);
-    R3Point p1 = grid->WorldPosition(ix1, iy1, iz1);
-    R3Point p = (1.0-t)*p0 + t*p1;
-    vertices[3*grid_index+dim] = mesh->CreateVertex(p);
-  }
-  return vertices[3*grid_index+dim];
+  RNInt64 key = 3 * (RNInt64) grid_index + dim;
+  int pixel_index = iy0 * grid->XResolution() + ix0;
+  int *entry = (dim == 2) ? &vertical_map[pixel_index] : &plane_maps[iz0 & 1][2*pixel_index + dim];
+  if ((*entry >= 0) && (*entry < slab->nvertices) && (slab->keys[*entry] == key)) return *entry;
+
+  // Make space for vertex
+  if (slab->nvertices == slab->nallocated_vertices) {
+    slab->nallocated_vertices = (slab->nallocated_vertices > 0) ? 2 * slab->nallocated_vertices : 1024;
+    R3Point *positions = new R3Point [ slab->nallocated_vertices ];
+    RNInt64 *keys = new RNInt64 [ slab->nallocated_vertices ];
+    for (int i = 0; i < slab->nvertices; i++) {
+      positions[i] = slab->positions[i];
+      keys[i] = slab->keys[i];
+    }
+    if (slab->positions) delete [] slab->positions;
+    if (slab->keys) delete [] slab->keys;
+    slab->positions = positions;
+    slab->keys = keys;
+  }
+
+  // Compute interpolated position
+  RNScalar value0 = grid->GridValue(ix0, iy0, iz0);
+  RNScalar value1 = grid->GridValue(ix1, iy1, iz1);
+  RNScalar delta0 = fabs(value0 - isolevel);
+  RNScalar delta1 = fabs(value1 - isolevel);
+  RNScalar denom = delta0 + delta1;
+  RNScalar t = (RNIsNotZero(denom)) ? delta0 / denom : 0.5;
+  R3Point p0 = grid->WorldPosition(ix0, iy0, iz0);
+  R3Point p1 = grid->WorldPosition(ix1, iy1, iz1);
+  R3Point p = (1.0-t)*p0 + t*p1;
+
+  // Insert vertex
+  int index = slab->nvertices++;
+  slab->positions[index] = p;
+  slab->keys[index] = key;
+  *entry = index;
+  return index;
+}
+
+
+
+static void
+IsoSurfaceSlabFace(int i0, int i1, int i2, R3GridIsoSurfaceSlab *slab)
+{
+  // Make space for face
+  if (slab->nfaces == slab->nallocated_faces) {
+    slab->nallocated_faces = (slab->nallocated_faces > 0) ? 2 * slab->nallocated_faces : 1024;
+    int *face_vertices = new int [ 3 * slab->nallocated_faces ];
+    for (int i = 0; i < 3 * slab->nfaces; i++) face_vertices[i] = slab->face_vertices[i];
+    if (slab->face_vertices) delete [] slab->face_vertices;
+    slab->face_vertices = face_vertices;
+  }
+
+  // Insert face
+  int *face_vertices = &slab->face_vertices[3 * slab->nfaces++];
+  face_vertices[0] = i0;
+  face_vertices[1] = i1;
+  face_vertices[2] = i2;
+}
+
+
+
+static void
+IsoSurfaceSlab(const R3Grid *grid, RNScalar isolevel, int bz,
+  const unsigned char *active_blocks, const int edgeTable[256], const int triTable[256][16],
+  R3GridIsoSurfaceSlab *slab)
+{
+  // Get convenient variables
+  const int bs = R3_GRID_ISOSURFACE_BLOCK_SIZE;
+  const int xres = grid->XResolution();
+  const int yres = grid->YResolution();
+  const int zres = grid->ZResolution();
+  const int nbx = (xres - 2) / bs + 1;
+  const int nby = (yres - 2) / bs + 1;
+  const int z0 = bz * bs;
+  const int z1 = (z0 + bs < zres - 1) ? z0 + bs : zres - 1;
+
+  // Allocate edge maps (x/y edges on two alternating z planes, plus z edges)
+  int *plane_maps[2];
+  plane_maps[0] = new int [ 2 * xres * yres ];
+  plane_maps[1] = new int [ 2 * xres * yres ];
+  int *vertical_map = new int [ xres * yres ];
+  for (int i = 0; i < 2 * xres * yres; i++) { plane_maps[0][i] = -1; plane_maps[1][i] = -1; }
+  for (int i = 0; i < xres * yres; i++) vertical_map[i] = -1;
+
+  // Create faces for cells in slab
+  RNScalar corner_levels[8];
+  for (int iz0 = z0; iz0 < z1; iz0++) {
+    for (int iy0 = 0; iy0 < yres-1; iy0++) {
+      const unsigned char *active_row = &active_blocks[(bz * nby + iy0 / bs) * nbx];
+      for (int bx = 0; bx < nbx; bx++) {
+        // Skip blocks entirely above/below the surface
+        if (!active_row[bx]) continue;
+        int x1 = (bx*bs + bs < xres - 1) ? bx*bs + bs : xres - 1;
+        for (int ix0 = bx*bs; ix0 < x1; ix0++) {
+          // Compute cube corner values
+          corner_levels[0] = grid->GridValue(ix0,iy0,iz0);
+          corner_levels[1] = grid->GridValue(ix0+1,iy0,iz0);
+          corner_levels[2] = grid->GridValue(ix0+1,iy0,iz0+1);
+          corner_levels[3] = grid->GridValue(ix0,iy0,iz0+1);
+          corner_levels[4] = grid->GridValue(ix0,iy0+1,iz0);
+          corner_levels[5] = grid->GridValue(ix0+1,iy0+1,iz0);
+          corner_levels[6] = grid->GridValue(ix0+1,iy0+1,iz0+1);
+          corner_levels[7] = grid->GridValue(ix0,iy0+1,iz0+1);
+
+          // Compute cube index
+          int cubeindex = 0;
+          if (corner_levels[0] < isolevel) cubeindex |= 1;
+          if (corner_levels[1] < isolevel) cubeindex |= 2;
+          if (corner_levels[2] < isolevel) cubeindex |= 4;
+          if (corner_levels[3] < isolevel) cubeindex |= 8;
+          if (corner_levels[4] < isolevel) cubeindex |= 16;
+          if (corner_levels[5] < isolevel) cubeindex |= 32;
+          if (corner_levels[6] < isolevel) cubeindex |= 64;
+          if (corner_levels[7] < isolevel) cubeindex |= 128;
+
+          // Check if cube is entirely above/below the surface
+          int edges = edgeTable[cubeindex];
+          if (edges == 0) continue;
+
+          // Find the vertices where the surface intersects the cube 
+          int vertlist[12];
+          if (edges & 1) vertlist[0] = IsoSurfaceSlabVertex(grid, ix0, iy0, iz0, 0, isolevel, plane_maps, vertical_map, slab);
+          if (edges & 2) vertlist[1] = IsoSurfaceSlabVertex(grid, ix0+1, iy0, iz0, 2, isolevel, plane_maps, vertical_map, slab);
+          if (edges & 4) vertlist[2] = IsoSurfaceSlabVertex(grid, ix0, iy0, iz0+1, 0, isolevel, plane_maps, vertical_map, slab);
+          if (edges & 8) vertlist[3] = IsoSurfaceSlabVertex(grid, ix0, iy0, iz0, 2, isolevel, plane_maps, vertical_map, slab);
+          if (edges & 16) vertlist[4] = IsoSurfaceSlabVertex(grid, ix0, iy0+1, iz0, 0, isolevel, plane_maps, vertical_map, slab);
+          if (edges & 32) vertlist[5] = IsoSurfaceSlabVertex(grid, ix0+1, iy0+1, iz0, 2, isolevel, plane_maps, vertical_map, slab);
+          if (edges & 64) vertlist[6] = IsoSurfaceSlabVertex(grid, ix0, iy0+1, iz0+1, 0, isolevel, plane_maps, vertical_map, slab);
+          if (edges & 128) vertlist[7] = IsoSurfaceSlabVertex(grid, ix0, iy0+1, iz0, 2, isolevel, plane_maps, vertical_map, slab);
+          if (edges & 256) vertlist[8] = IsoSurfaceSlabVertex(grid, ix0, iy0, iz0, 1, isolevel, plane_maps, vertical_map, slab);
+          if (edges & 512) vertlist[9] = IsoSurfaceSlabVertex(grid, ix0+1, iy0, iz0, 1, isolevel, plane_maps, vertical_map, slab);
+          if (edges & 1024) vertlist[10] = IsoSurfaceSlabVertex(grid, ix0+1, iy0, iz0+1, 1, isolevel, plane_maps, vertical_map, slab);
+          if (edges & 2048) vertlist[11] = IsoSurfaceSlabVertex(grid, ix0, iy0, iz0+1, 1, isolevel, plane_maps, vertical_map, slab);
+
+          // Create the triangles
+          for (int i = 0; triTable[cubeindex][i] != -1; i+=3) {
+            int i0 = vertlist[triTable[cubeindex][i  ]];
+            int i1 = vertlist[triTable[cubeindex][i+1]];
+            int i2 = vertlist[triTable[cubeindex][i+2]];
+            IsoSurfaceSlabFace(i0, i1, i2, slab);
+          }
+        }
+      }
+    }
+  }
+
+  // Delete edge maps
+  delete [] plane_maps[0];
+  delete [] plane_maps[1];
+  delete [] vertical_map;
 }
 
 
@@ -4890,93 +4753,116 @@ GenerateIsoSurface(RNScalar isolevel, R3Mesh *mesh) const
      {0, 3, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
      {-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1}};
 
-  // Allocate vertex pointers
-  R3MeshVertex **vertices = new R3MeshVertex * [3*NEntries()];
-  for (int i = 0; i < 3*NEntries(); i++) vertices[i] = NULL;
-  
-  // Create faces
-  RNScalar corner_levels[8];
-  for (int iz0 = 0; iz0 < ZResolution()-1; iz0++) {
-    for (int iy0 = 0; iy0 < YResolution()-1; iy0++) {
-      for (int ix0 = 0; ix0 < XResolution()-1; ix0++) {
-
-        // Compute cube corner values
-        corner_levels[0] = GridValue(ix0,iy0,iz0);
-        corner_levels[1] = GridValue(ix0+1,iy0,iz0);
-        corner_levels[2] = GridValue(ix0+1,iy0,iz0+1);
-        corner_levels[3] = GridValue(ix0,iy0,iz0+1);
-        corner_levels[4] = GridValue(ix0,iy0+1,iz0);
-        corner_levels[5] = GridValue(ix0+1,iy0+1,iz0);
-        corner_levels[6] = GridValue(ix0+1,iy0+1,iz0+1);
-        corner_levels[7] = GridValue(ix0,iy0+1,iz0+1);
-
-        // Compute cube index
-        int cubeindex = 0;
-        if (corner_levels[0] < isolevel) cubeindex |= 1;
-        if (corner_levels[1] < isolevel) cubeindex |= 2;
-        if (corner_levels[2] < isolevel) cubeindex |= 4;
-        if (corner_levels[3] < isolevel) cubeindex |= 8;
-        if (corner_levels[4] < isolevel) cubeindex |= 16;
-        if (corner_levels[5] < isolevel) cubeindex |= 32;
-        if (corner_levels[6] < isolevel) cubeindex |= 64;
-        if (corner_levels[7] < isolevel) cubeindex |= 128;
-
-        // Check if cube is entirely above/below the surface
-        if (edgeTable[cubeindex] == 0) continue;
-
-        // Find the vertices where the surface intersects the cube 
-        R3MeshVertex *vertlist[12];
-        if (edgeTable[cubeindex] & 1) {
-          vertlist[0] = InterpolatedVertex(this, ix0, iy0, iz0, 0, mesh, vertices, isolevel);
-        }
-        if (edgeTable[cubeindex] & 2) {
-          vertlist[1] = InterpolatedVertex(this, ix0+1, iy0, iz0, 2, mesh, vertices, isolevel);
-        }
-        if (edgeTable[cubeindex] & 4) {
-          vertlist[2] = InterpolatedVertex(this, ix0, iy0, iz0+1, 0, mesh, vertices, isolevel);
-        }
-        if (edgeTable[cubeindex] & 8) {
-          vertlist[3] = InterpolatedVertex(this, ix0, iy0, iz0, 2, mesh, vertices, isolevel);
-        }
-        if (edgeTable[cubeindex] & 16) {
-          vertlist[4] = InterpolatedVertex(this, ix0, iy0+1, iz0, 0, mesh, vertices, isolevel);
-        }
-        if (edgeTable[cubeindex] & 32) {
-          vertlist[5] = InterpolatedVertex(this, ix0+1, iy0+1, iz0, 2, mesh, vertices, isolevel);
-        }
-        if (edgeTable[cubeindex] & 64) {
-          vertlist[6] = InterpolatedVertex(this, ix0, iy0+1, iz0+1, 0, mesh, vertices, isolevel);
-        }
-        if (edgeTable[cubeindex] & 128) {
-          vertlist[7] = InterpolatedVertex(this, ix0, iy0+1, iz0, 2, mesh, vertices, isolevel);
-        }
-        if (edgeTable[cubeindex] & 256) {
-          vertlist[8] = InterpolatedVertex(this, ix0, iy0, iz0, 1, mesh, vertices, isolevel);
-        }
-        if (edgeTable[cubeindex] & 512) {
-          vertlist[9] = InterpolatedVertex(this, ix0+1, iy0, iz0, 1, mesh, vertices, isolevel);
-        }
-        if (edgeTable[cubeindex] & 1024) {
-          vertlist[10] = InterpolatedVertex(this, ix0+1, iy0, iz0+1, 1, mesh, vertices, isolevel);
-        }
-        if (edgeTable[cubeindex] & 2048) {
-          vertlist[11] = InterpolatedVertex(this, ix0, iy0, iz0+1, 1, mesh, vertices, isolevel);
+  // Check resolution
+  if ((XResolution() < 2) || (YResolution() < 2) || (ZResolution() < 2)) return 1;
+
+  // Get block dimensions (each block covers bs^3 cells)
+  const int bs = R3_GRID_ISOSURFACE_BLOCK_SIZE;
+  const int nbx = (XResolution() - 2) / bs + 1;
+  const int nby = (YResolution() - 2) / bs + 1;
+  const int nbz = (ZResolution() - 2) / bs + 1;
+
+  // Mark blocks whose value range straddles the isolevel (finest level of min/max pyramid)
+  unsigned char *active_blocks = new unsigned char [ nbx * nby * nbz ];
+  unsigned char *active_slabs = new unsigned char [ nbz ];
+#pragma omp parallel for schedule(dynamic)
+  for (int bz = 0; bz < nbz; bz++) {
+    active_slabs[bz] = 0;
+    for (int by = 0; by < nby; by++) {
+      for (int bx = 0; bx < nbx; bx++) {
+        RNScalar minimum = FLT_MAX;
+        RNScalar maximum = -FLT_MAX;
+        int x1 = (bx*bs + bs < XResolution() - 1) ? bx*bs + bs : XResolution() - 1;
+        int y1 = (by*bs + bs < YResolution() - 1) ? by*bs + bs : YResolution() - 1;
+        int z1 = (bz*bs + bs < ZResolution() - 1) ? bz*bs + bs : ZResolution() - 1;
+        for (int iz = bz*bs; iz <= z1; iz++) {
+          for (int iy = by*bs; iy <= y1; iy++) {
+            const RNScalar *valuesp = &grid_values[iz * grid_sheet_size + iy * grid_row_size];
+            for (int ix = bx*bs; ix <= x1; ix++) {
+              RNScalar value = valuesp[ix];
+              if (value < minimum) minimum = value;
+              if (value > maximum) maximum = value;
+            }
+          }
         }
+        unsigned char active = ((minimum < isolevel) && (maximum >= isolevel)) ? 1 : 0;
+        active_blocks[(bz * nby + by) * nbx + bx] = active;
+        if (active) active_slabs[bz] = 1;
+      }
+    }
+  }
 
-        // Create the triangles
-        for (int i = 0; triTable[cubeindex][i] != -1; i+=3) {
-          R3MeshVertex *v0 = vertlist[triTable[cubeindex][i  ]];
-          R3MeshVertex *v1 = vertlist[triTable[cubeindex][i+1]];
-          R3MeshVertex *v2 = vertlist[triTable[cubeindex][i+2]];
-          if (!v0 || !v1 || !v2) continue;
-          mesh->CreateFace(v0, v1, v2);
+  // Extract triangles for every slab of blocks in parallel
+  R3GridIsoSurfaceSlab *slabs = new R3GridIsoSurfaceSlab [ nbz ];
+  for (int bz = 0; bz < nbz; bz++) {
+    R3GridIsoSurfaceSlab *slab = &slabs[bz];
+    slab->positions = NULL;
+    slab->keys = NULL;
+    slab->nvertices = 0;
+    slab->nallocated_vertices = 0;
+    slab->face_vertices = NULL;
+    slab->nfaces = 0;
+    slab->nallocated_faces = 0;
+  }
+#pragma omp parallel for schedule(dynamic)
+  for (int bz = 0; bz < nbz; bz++) {
+    if (!active_slabs[bz]) continue;
+    IsoSurfaceSlab(this, isolevel, bz, active_blocks, edgeTable, triTable, &slabs[bz]);
+  }
+
+  // Stitch slabs into mesh in z order (vertices on the bottom plane of
+  // a slab were already created by the slab below)
+  R3MeshVertex **plane_vertices = new R3MeshVertex * [ 2 * XResolution() * YResolution() ];
+  RNInt64 *plane_keys = new RNInt64 [ 2 * XResolution() * YResolution() ];
+  for (int i = 0; i < 2 * XResolution() * YResolution(); i++) {
+    plane_vertices[i] = NULL;
+    plane_keys[i] = -1;
+  }
+  for (int bz = 0; bz < nbz; bz++) {
+    R3GridIsoSurfaceSlab *slab = &slabs[bz];
+    if (slab->nvertices == 0) continue;
+
+    // Create vertices
+    R3MeshVertex **slab_vertices = new R3MeshVertex * [ slab->nvertices ];
+    for (int i = 0; i < slab->nvertices; i++) {
+      RNInt64 key = slab->keys[i];
+      int dim = (int) (key % 3);
+      int grid_index = (int) (key / 3);
+      int iz = grid_index / grid_sheet_size;
+      int plane_index = 2 * (grid_index - iz * grid_sheet_size) + dim;
+      if ((dim < 2) && (iz == bz*bs) && (plane_keys[plane_index] == key)) {
+        slab_vertices[i] = plane_vertices[plane_index];
+      }
+      else {
+        slab_vertices[i] = mesh->CreateVertex(slab->positions[i]);
+        if ((dim < 2) && (iz > bz*bs)) {
+          plane_vertices[plane_index] = slab_vertices[i];
+          plane_keys[plane_index] = key;
         }
       }
     }
+
+    // Create faces
+    for (int i = 0; i < slab->nfaces; i++) {
+      R3MeshVertex *v0 = slab_vertices[slab->face_vertices[3*i+0]];
+      R3MeshVertex *v1 = slab_vertices[slab->face_vertices[3*i+1]];
+      R3MeshVertex *v2 = slab_vertices[slab->face_vertices[3*i+2]];
+      mesh->CreateFace(v0, v1, v2);
+    }
+
+    // Delete slab buffers
+    delete [] slab_vertices;
+    delete [] slab->positions;
+    delete [] slab->keys;
+    delete [] slab->face_vertices;
   }
 
-  // Delete vertex pointers
-  delete [] vertices;
+  // Delete temporary memory
+  delete [] plane_vertices;
+  delete [] plane_keys;
+  delete [] slabs;
+  delete [] active_blocks;
+  delete [] active_slabs;
 
   // Return success
   return 1;
@@ -46,6 +46,7 @@ class R3Polyline;
 class R3CatmullRomSpline;
 class R3PlanarGrid;
 class R3Grid;
+class R3SparseGrid;
 
 
 
@@ -120,6 +121,7 @@ class R3Grid;
 #include "R3Shapes/R3Sphere.h"
 #include "R3Shapes/R3Ellipsoid.h"
 #include "R3Shapes/R3Grid.h"        
+#include "R3Shapes/R3SparseGrid.h"
 
 
 
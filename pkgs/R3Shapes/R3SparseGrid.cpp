@@ -0,0 +1,1633 @@
+// Source file for GAPS sparse scalar grid class
+
+
+
+////////////////////////////////////////////////////////////////////////
+// NOTE:
+// Grid values are defined as samples at the grid positions ranging from
+// (0, 0, 0) to (xres-1, yres-1, zres-1), as in R3Grid.  Only blocks of
+// 8x8x8 samples that have been written are allocated.  This allows
+// narrow-band computations (e.g., distance fields near a surface) at
+// resolutions where a dense grid would not fit in memory.
+////////////////////////////////////////////////////////////////////////
+
+
+
+// Include files
+
+#include "R3Shapes/R3Shapes.h"
+
+
+
+// Useful constants
+
+static const RNScalar R3_SPARSE_GRID_INFINITY = 1.0E20;
+
+
+
+////////////////////////////////////////////////////////////////////////
+// Constructors/destructors
+////////////////////////////////////////////////////////////////////////
+
+R3SparseGrid::
+R3SparseGrid(int xresolution, int yresolution, int zresolution, RNScalar background_value)
+  : background_value(background_value)
+{
+  // Set grid resolution
+  grid_resolution[0] = xresolution;
+  grid_resolution[1] = yresolution;
+  grid_resolution[2] = zresolution;
+
+  // Initialize blocks
+  InitializeBlocks();
+
+  // Set transformations
+  grid_to_world_transform = R3identity_affine;
+  world_to_grid_transform = R3identity_affine;
+  world_to_grid_scale_factor = 1.0;
+  grid_to_world_scale_factor = 1.0;
+}
+
+
+
+R3SparseGrid::
+R3SparseGrid(int xresolution, int yresolution, int zresolution, const R3Box& bbox, RNScalar background_value)
+  : background_value(background_value)
+{
+  // Set grid resolution
+  grid_resolution[0] = xresolution;
+  grid_resolution[1] = yresolution;
+  grid_resolution[2] = zresolution;
+
+  // Initialize blocks
+  InitializeBlocks();
+
+  // Set transformations
+  SetWorldToGridTransformation(bbox);
+}
+
+
+
+R3SparseGrid::
+R3SparseGrid(const R3Box& bbox, RNLength spacing, int min_resolution, int max_resolution, RNScalar background_value)
+  : background_value(background_value)
+{
+  // Initialize resolution
+  grid_resolution[0] = 0;
+  grid_resolution[1] = 0;
+  grid_resolution[2] = 0;
+
+  // Check for empty bounding box
+  if (bbox.IsEmpty() || (RNIsZero(spacing))) {
+    InitializeBlocks();
+    SetWorldToGridTransformation(R3identity_affine);
+    return;
+  }
+
+  // Enforce max resolution
+  if (max_resolution > 0) {
+    if (bbox.XLength() / spacing > max_resolution) spacing = bbox.XLength() / max_resolution;
+    if (bbox.YLength() / spacing > max_resolution) spacing = bbox.YLength() / max_resolution;
+    if (bbox.ZLength() / spacing > max_resolution) spacing = bbox.ZLength() / max_resolution;
+  }
+
+  // Compute resolution
+  grid_resolution[0] = (int) (bbox.XLength() / spacing + 0.5);
+  grid_resolution[1] = (int) (bbox.YLength() / spacing + 0.5);
+  grid_resolution[2] = (int) (bbox.ZLength() / spacing + 0.5);
+
+  // Enforce min resolution
+  if (min_resolution > 0) {
+    if (grid_resolution[0] < min_resolution) grid_resolution[0] = min_resolution;
+    if (grid_resolution[1] < min_resolution) grid_resolution[1] = min_resolution;
+    if (grid_resolution[2] < min_resolution) grid_resolution[2] = min_resolution;
+  }
+
+  // Initialize blocks
+  InitializeBlocks();
+
+  // Set transformations
+  SetWorldToGridTransformation(bbox);
+}
+
+
+
+R3SparseGrid::
+R3SparseGrid(const R3Grid& grid, RNScalar background_value)
+  : background_value(background_value)
+{
+  // Set grid resolution
+  grid_resolution[0] = grid.XResolution();
+  grid_resolution[1] = grid.YResolution();
+  grid_resolution[2] = grid.ZResolution();
+
+  // Initialize blocks
+  InitializeBlocks();
+
+  // Set transformations
+  SetWorldToGridTransformation(grid.WorldToGridTransformation());
+
+  // Copy values
+  Copy(grid);
+}
+
+
+
+R3SparseGrid::
+R3SparseGrid(const R3SparseGrid& grid)
+{
+  // Initialize blocks
+  grid_resolution[0] = 0;
+  grid_resolution[1] = 0;
+  grid_resolution[2] = 0;
+  InitializeBlocks();
+
+  // Copy everything
+  *this = grid;
+}
+
+
+
+R3SparseGrid::
+~R3SparseGrid(void)
+{
+  // Delete blocks
+  DeleteBlocks();
+}
+
+
+
+////////////////////////////////////////////////////////////////////////
+// Block management functions
+////////////////////////////////////////////////////////////////////////
+
+void R3SparseGrid::
+InitializeBlocks(void)
+{
+  // Compute block resolution
+  const int bs = R3_SPARSE_GRID_BLOCK_SIZE;
+  for (int dim = 0; dim < 3; dim++) {
+    block_resolution[dim] = (grid_resolution[dim] + bs - 1) / bs;
+  }
+
+  // Initialize empty set of blocks
+  block_values = NULL;
+  block_keys = NULL;
+  nblocks = 0;
+  nallocated_blocks = 0;
+  hash_table = NULL;
+  hash_size = 0;
+}
+
+
+
+void R3SparseGrid::
+DeleteBlocks(void)
+{
+  // Delete blocks
+  for (int i = 0; i < nblocks; i++) delete [] block_values[i];
+  if (block_values) delete [] block_values;
+  if (block_keys) delete [] block_keys;
+  if (hash_table) delete [] hash_table;
+
+  // Reset empty set of blocks
+  block_values = NULL;
+  block_keys = NULL;
+  nblocks = 0;
+  nallocated_blocks = 0;
+  hash_table = NULL;
+  hash_size = 0;
+}
+
+
+
+void R3SparseGrid::
+RehashBlocks(int size)
+{
+  // Allocate hash table (size must be power of two)
+  assert((size & (size - 1)) == 0);
+  if (hash_table) delete [] hash_table;
+  hash_table = new int [ size ];
+  hash_size = size;
+  for (int i = 0; i < hash_size; i++) hash_table[i] = -1;
+
+  // Insert blocks (linear probing)
+  int mask = hash_size - 1;
+  for (int i = 0; i < nblocks; i++) {
+    RNUInt64 h = ((RNUInt64) block_keys[i] * 0x9E3779B97F4A7C15ULL) >> 32;
+    int slot = (int) (h & mask);
+    while (hash_table[slot] >= 0) slot = (slot + 1) & mask;
+    hash_table[slot] = i;
+  }
+}
+
+
+
+int R3SparseGrid::
+AllocateBlock(int bx, int by, int bz)
+{
+  // Check if block is already allocated
+  int block_index = FindBlock(bx, by, bz);
+  if (block_index >= 0) return block_index;
+
+  // Check block coordinates
+  assert((0 <= bx) && (bx < block_resolution[0]));
+  assert((0 <= by) && (by < block_resolution[1]));
+  assert((0 <= bz) && (bz < block_resolution[2]));
+
+  // Make space for block
+  if (nblocks == nallocated_blocks) {
+    nallocated_blocks = (nallocated_blocks > 0) ? 2 * nallocated_blocks : 64;
+    RNScalar **new_block_values = new RNScalar * [ nallocated_blocks ];
+    RNInt64 *new_block_keys = new RNInt64 [ nallocated_blocks ];
+    for (int i = 0; i < nblocks; i++) {
+      new_block_values[i] = block_values[i];
+      new_block_keys[i] = block_keys[i];
+    }
+    if (block_values) delete [] block_values;
+    if (block_keys) delete [] block_keys;
+    block_values = new_block_values;
+    block_keys = new_block_keys;
+  }
+
+  // Create block filled with background value
+  block_index = nblocks++;
+  block_keys[block_index] = ((RNInt64) bz * block_resolution[1] + by) * block_resolution[0] + bx;
+  block_values[block_index] = new RNScalar [ R3_SPARSE_GRID_BLOCK_ENTRIES ];
+  for (int i = 0; i < R3_SPARSE_GRID_BLOCK_ENTRIES; i++) block_values[block_index][i] = background_value;
+
+  // Insert block into hash table (keep load factor below 1/2)
+  if (2 * nblocks > hash_size) {
+    RehashBlocks((hash_size > 0) ? 2 * hash_size : 128);
+  }
+  else {
+    int mask = hash_size - 1;
+    RNUInt64 h = ((RNUInt64) block_keys[block_index] * 0x9E3779B97F4A7C15ULL) >> 32;
+    int slot = (int) (h & mask);
+    while (hash_table[slot] >= 0) slot = (slot + 1) & mask;
+    hash_table[slot] = block_index;
+  }
+
+  // Return index of new block
+  return block_index;
+}
+
+
+
+////////////////////////////////////////////////////////////////////////
+// Property functions
+////////////////////////////////////////////////////////////////////////
+
+RNInterval R3SparseGrid::
+Range(void) const
+{
+  // Find smallest and largest values in allocated blocks
+  const int bs = R3_SPARSE_GRID_BLOCK_SIZE;
+  RNScalar minimum = FLT_MAX;
+  RNScalar maximum = -FLT_MAX;
+  for (int b = 0; b < nblocks; b++) {
+    int bx, by, bz;
+    BlockIndices(b, bx, by, bz);
+    const RNScalar *values = block_values[b];
+    for (int k = 0; k < bs; k++) {
+      if (bz*bs + k >= grid_resolution[2]) break;
+      for (int j = 0; j < bs; j++) {
+        if (by*bs + j >= grid_resolution[1]) break;
+        for (int i = 0; i < bs; i++) {
+          if (bx*bs + i >= grid_resolution[0]) break;
+          RNScalar value = values[(k*bs + j)*bs + i];
+          if (value < minimum) minimum = value;
+          if (value > maximum) maximum = value;
+        }
+      }
+    }
+  }
+
+  // Include background value if some blocks are not allocated
+  RNInt64 total_blocks = (RNInt64) block_resolution[0] * block_resolution[1] * block_resolution[2];
+  if (nblocks < total_blocks) {
+    if (background_value < minimum) minimum = background_value;
+    if (background_value > maximum) maximum = background_value;
+  }
+
+  // Return range
+  return RNInterval(minimum, maximum);
+}
+
+
+
+////////////////////////////////////////////////////////////////////////
+// Grid value access functions
+////////////////////////////////////////////////////////////////////////
+
+RNScalar R3SparseGrid::
+GridValue(RNScalar x, RNScalar y, RNScalar z) const
+{
+  // Check if within bounds
+  if ((x < 0) || (x > grid_resolution[0]-1)) return background_value;
+  if ((y < 0) || (y > grid_resolution[1]-1)) return background_value;
+  if ((z < 0) || (z > grid_resolution[2]-1)) return background_value;
+
+  // Trilinear interpolation
+  int ix1 = (int) x;
+  int iy1 = (int) y;
+  int iz1 = (int) z;
+  int ix2 = ix1 + 1;
+  int iy2 = iy1 + 1;
+  int iz2 = iz1 + 1;
+  if (ix2 >= grid_resolution[0]) ix2 = ix1;
+  if (iy2 >= grid_resolution[1]) iy2 = iy1;
+  if (iz2 >= grid_resolution[2]) iz2 = iz1;
+  RNScalar dx = x - ix1;
+  RNScalar dy = y - iy1;
+  RNScalar dz = z - iz1;
+  RNScalar value = 0.0;
+  value += GridValue(ix1, iy1, iz1) * (1.0-dx) * (1.0-dy) * (1.0-dz);
+  value += GridValue(ix1, iy1, iz2) * (1.0-dx) * (1.0-dy) * dz;
+  value += GridValue(ix1, iy2, iz1) * (1.0-dx) * dy * (1.0-dz);
+  value += GridValue(ix1, iy2, iz2) * (1.0-dx) * dy * dz;
+  value += GridValue(ix2, iy1, iz1) * dx * (1.0-dy) * (1.0-dz);
+  value += GridValue(ix2, iy1, iz2) * dx * (1.0-dy) * dz;
+  value += GridValue(ix2, iy2, iz1) * dx * dy * (1.0-dz);
+  value += GridValue(ix2, iy2, iz2) * dx * dy * dz;
+  return value;
+}
+
+
+
+////////////////////////////////////////////////////////////////////////
+// Grid manipulation functions
+////////////////////////////////////////////////////////////////////////
+
+R3SparseGrid& R3SparseGrid::
+operator=(const R3SparseGrid& grid)
+{
+  // Check for self assignment
+  if (this == &grid) return *this;
+
+  // Delete previous blocks
+  DeleteBlocks();
+
+  // Copy resolution and transformations
+  grid_resolution[0] = grid.grid_resolution[0];
+  grid_resolution[1] = grid.grid_resolution[1];
+  grid_resolution[2] = grid.grid_resolution[2];
+  block_resolution[0] = grid.block_resolution[0];
+  block_resolution[1] = grid.block_resolution[1];
+  block_resolution[2] = grid.block_resolution[2];
+  background_value = grid.background_value;
+  grid_to_world_transform = grid.grid_to_world_transform;
+  world_to_grid_transform = grid.world_to_grid_transform;
+  world_to_grid_scale_factor = grid.world_to_grid_scale_factor;
+  grid_to_world_scale_factor = grid.grid_to_world_scale_factor;
+
+  // Copy blocks
+  if (grid.nblocks > 0) {
+    nblocks = grid.nblocks;
+    nallocated_blocks = grid.nblocks;
+    block_values = new RNScalar * [ nallocated_blocks ];
+    block_keys = new RNInt64 [ nallocated_blocks ];
+    for (int i = 0; i < nblocks; i++) {
+      block_keys[i] = grid.block_keys[i];
+      block_values[i] = new RNScalar [ R3_SPARSE_GRID_BLOCK_ENTRIES ];
+      for (int j = 0; j < R3_SPARSE_GRID_BLOCK_ENTRIES; j++) block_values[i][j] = grid.block_values[i][j];
+    }
+    RehashBlocks(grid.hash_size);
+  }
+
+  // Return this
+  return *this;
+}
+
+
+
+void R3SparseGrid::
+Clear(RNScalar value)
+{
+  // Delete all blocks and set background value
+  DeleteBlocks();
+  background_value = value;
+}
+
+
+
+void R3SparseGrid::
+Copy(const R3Grid& grid)
+{
+  // Check resolution
+  assert(grid.XResolution() == XResolution());
+  assert(grid.YResolution() == YResolution());
+  assert(grid.ZResolution() == ZResolution());
+
+  // Remove previous blocks
+  DeleteBlocks();
+
+  // Copy blocks that contain values different from background
+  const int bs = R3_SPARSE_GRID_BLOCK_SIZE;
+  for (int bz = 0; bz < block_resolution[2]; bz++) {
+    int k1 = (bz*bs + bs < grid_resolution[2]) ? bz*bs + bs : grid_resolution[2];
+    for (int by = 0; by < block_resolution[1]; by++) {
+      int j1 = (by*bs + bs < grid_resolution[1]) ? by*bs + bs : grid_resolution[1];
+      for (int bx = 0; bx < block_resolution[0]; bx++) {
+        int i1 = (bx*bs + bs < grid_resolution[0]) ? bx*bs + bs : grid_resolution[0];
+        RNScalar *values = NULL;
+        for (int k = bz*bs; k < k1; k++) {
+          for (int j = by*bs; j < j1; j++) {
+            for (int i = bx*bs; i < i1; i++) {
+              RNScalar value = grid.GridValue(i, j, k);
+              if (!values) {
+                if (value == background_value) continue;
+                int block_index = AllocateBlock(bx, by, bz);
+                values = block_values[block_index];
+              }
+              values[((k - bz*bs)*bs + (j - by*bs))*bs + (i - bx*bs)] = value;
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+
+
+void R3SparseGrid::
+Prune(void)
+{
+  // Remove blocks whose values all equal the background value
+  const int bs = R3_SPARSE_GRID_BLOCK_SIZE;
+  int count = 0;
+  for (int b = 0; b < nblocks; b++) {
+    int bx, by, bz;
+    BlockIndices(b, bx, by, bz);
+    RNBoolean uniform = TRUE;
+    const RNScalar *values = block_values[b];
+    for (int k = 0; uniform && (k < bs) && (bz*bs + k < grid_resolution[2]); k++) {
+      for (int j = 0; uniform && (j < bs) && (by*bs + j < grid_resolution[1]); j++) {
+        for (int i = 0; (i < bs) && (bx*bs + i < grid_resolution[0]); i++) {
+          if (values[(k*bs + j)*bs + i] != background_value) { uniform = FALSE; break; }
+        }
+      }
+    }
+    if (uniform) {
+      delete [] block_values[b];
+    }
+    else {
+      block_values[count] = block_values[b];
+      block_keys[count] = block_keys[b];
+      count++;
+    }
+  }
+
+  // Rebuild hash table
+  if (count < nblocks) {
+    nblocks = count;
+    if (nblocks == 0) DeleteBlocks();
+    else RehashBlocks(hash_size);
+  }
+}
+
+
+
+void R3SparseGrid::
+SetGridValue(int i, int j, int k, RNScalar value)
+{
+  // Set value at grid point (allocating block if necessary)
+  assert((0 <= i) && (i < XResolution()));
+  assert((0 <= j) && (j < YResolution()));
+  assert((0 <= k) && (k < ZResolution()));
+  const int bs = R3_SPARSE_GRID_BLOCK_SIZE;
+  int block_index = FindBlock(i / bs, j / bs, k / bs);
+  if (block_index < 0) {
+    if (value == background_value) return;
+    block_index = AllocateBlock(i / bs, j / bs, k / bs);
+  }
+  block_values[block_index][((k % bs) * bs + (j % bs)) * bs + (i % bs)] = value;
+}
+
+
+
+void R3SparseGrid::
+AddGridValue(int i, int j, int k, RNScalar value)
+{
+  // Add value at grid point (allocating block if necessary)
+  assert((0 <= i) && (i < XResolution()));
+  assert((0 <= j) && (j < YResolution()));
+  assert((0 <= k) && (k < ZResolution()));
+  const int bs = R3_SPARSE_GRID_BLOCK_SIZE;
+  int block_index = FindBlock(i / bs, j / bs, k / bs);
+  if (block_index < 0) {
+    if (value == 0) return;
+    block_index = AllocateBlock(i / bs, j / bs, k / bs);
+  }
+  block_values[block_index][((k % bs) * bs + (j % bs)) * bs + (i % bs)] += value;
+}
+
+
+
+////////////////////////////////////////////////////////////////////////
+// Narrow-band distance transforms
+////////////////////////////////////////////////////////////////////////
+
+static void
+SquaredDistanceTransform1D(const RNScalar *f, int n, int stride, RNScalar *d, int *v, RNScalar *z)
+{
+  // Compute lower envelope of parabolas rooted at (q, f[q])
+  // (Felzenszwalb and Huttenlocher, "Distance Transforms of Sampled Functions")
+  int k = 0;
+  v[0] = 0;
+  z[0] = -FLT_MAX;
+  z[1] = FLT_MAX;
+  for (int q = 1; q < n; q++) {
+    RNScalar fq = f[q*stride] + q*q;
+    RNScalar s = (fq - (f[v[k]*stride] + v[k]*v[k])) / (2*q - 2*v[k]);
+    while (s <= z[k]) {
+      k--;
+      s = (fq - (f[v[k]*stride] + v[k]*v[k])) / (2*q - 2*v[k]);
+    }
+    k++;
+    v[k] = q;
+    z[k] = s;
+    z[k+1] = FLT_MAX;
+  }
+
+  // Fill in values of lower envelope
+  k = 0;
+  for (int q = 0; q < n; q++) {
+    while (z[k+1] < q) k++;
+    d[q] = (q - v[k])*(q - v[k]) + f[v[k]*stride];
+  }
+}
+
+
+
+static void
+SquaredDistanceTransformWindow(RNScalar *window, const int size[3], RNScalar *d, int *v, RNScalar *z)
+{
+  // Compute exact squared distance transform of window with separable passes
+  int row_size = size[0];
+  int sheet_size = size[0] * size[1];
+  for (int dim = 0; dim < 3; dim++) {
+    int stride = (dim == 0) ? 1 : ((dim == 1) ? row_size : sheet_size);
+    int dim1 = (dim + 1) % 3;
+    int dim2 = (dim + 2) % 3;
+    int stride1 = (dim1 == 0) ? 1 : ((dim1 == 1) ? row_size : sheet_size);
+    int stride2 = (dim2 == 0) ? 1 : ((dim2 == 1) ? row_size : sheet_size);
+    for (int i2 = 0; i2 < size[dim2]; i2++) {
+      for (int i1 = 0; i1 < size[dim1]; i1++) {
+        RNScalar *f = &window[i1*stride1 + i2*stride2];
+        SquaredDistanceTransform1D(f, size[dim], stride, d, v, z);
+        for (int q = 0; q < size[dim]; q++) f[q*stride] = d[q];
+      }
+    }
+  }
+}
+
+
+
+static void
+NarrowBandDistanceTransform(R3SparseGrid *grid, RNLength grid_band_width, RNBoolean sign)
+{
+  // Get convenient variables
+  const int bs = R3_SPARSE_GRID_BLOCK_SIZE;
+  int r = (int) ceil(grid_band_width);
+  if (r < 1) r = 1;
+  int rb = (r + bs - 1) / bs;
+  int block_resolution[3];
+  for (int dim = 0; dim < 3; dim++) block_resolution[dim] = (grid->Resolution(dim) + bs - 1) / bs;
+  RNScalar band_squared = grid_band_width * grid_band_width;
+
+  // Create output grid (background is outside the band)
+  RNScalar background = (sign) ? grid_band_width : band_squared;
+  R3SparseGrid result(grid->XResolution(), grid->YResolution(), grid->ZResolution(), background);
+  result.SetWorldToGridTransformation(grid->WorldToGridTransformation());
+
+  // Allocate output blocks within band of blocks containing sites (non-zero values)
+  for (int b = 0; b < grid->NBlocks(); b++) {
+    const RNScalar *values = grid->BlockValues(b);
+    RNBoolean site = FALSE;
+    for (int i = 0; i < R3_SPARSE_GRID_BLOCK_ENTRIES; i++) {
+      if (values[i] != 0) { site = TRUE; break; }
+    }
+    if (!site) continue;
+    int bx, by, bz;
+    grid->BlockIndices(b, bx, by, bz);
+    for (int cz = bz - rb; cz <= bz + rb; cz++) {
+      if ((cz < 0) || (cz >= block_resolution[2])) continue;
+      for (int cy = by - rb; cy <= by + rb; cy++) {
+        if ((cy < 0) || (cy >= block_resolution[1])) continue;
+        for (int cx = bx - rb; cx <= bx + rb; cx++) {
+          if ((cx < 0) || (cx >= block_resolution[0])) continue;
+          result.AllocateBlock(cx, cy, cz);
+        }
+      }
+    }
+  }
+
+  // Compute distances for every output block from a window padded by band width
+#pragma omp parallel
+  {
+    // Allocate per-thread buffers
+    int max_size = bs + 2*r;
+    int max_window_size = max_size * max_size * max_size;
+    RNScalar *outside = new RNScalar [ max_window_size ];
+    RNScalar *inside = (sign) ? new RNScalar [ max_window_size ] : NULL;
+    RNScalar *d = new RNScalar [ max_size ];
+    RNScalar *z = new RNScalar [ max_size + 1 ];
+    int *v = new int [ max_size ];
+
+#pragma omp for schedule(dynamic)
+    for (int b = 0; b < result.NBlocks(); b++) {
+      int bx, by, bz;
+      result.BlockIndices(b, bx, by, bz);
+
+      // Compute window
+      int wmin[3], wmax[3], size[3];
+      int bmin[3] = { bx*bs, by*bs, bz*bs };
+      for (int dim = 0; dim < 3; dim++) {
+        wmin[dim] = bmin[dim] - r;
+        if (wmin[dim] < 0) wmin[dim] = 0;
+        wmax[dim] = bmin[dim] + bs - 1 + r;
+        if (wmax[dim] > grid->Resolution(dim)-1) wmax[dim] = grid->Resolution(dim)-1;
+        size[dim] = wmax[dim] - wmin[dim] + 1;
+      }
+
+      // Initialize window from sites in overlapping input blocks
+      int window_size = size[0] * size[1] * size[2];
+      for (int i = 0; i < window_size; i++) outside[i] = R3_SPARSE_GRID_INFINITY;
+      if (sign) for (int i = 0; i < window_size; i++) inside[i] = 0;
+      for (int cz = wmin[2] / bs; cz <= wmax[2] / bs; cz++) {
+        for (int cy = wmin[1] / bs; cy <= wmax[1] / bs; cy++) {
+          for (int cx = wmin[0] / bs; cx <= wmax[0] / bs; cx++) {
+            int c = grid->FindBlock(cx, cy, cz);
+            if (c < 0) continue;
+            const RNScalar *values = grid->BlockValues(c);
+            for (int k = 0; k < bs; k++) {
+              int wk = cz*bs + k - wmin[2];
+              if ((wk < 0) || (wk >= size[2])) continue;
+              for (int j = 0; j < bs; j++) {
+                int wj = cy*bs + j - wmin[1];
+                if ((wj < 0) || (wj >= size[1])) continue;
+                for (int i = 0; i < bs; i++) {
+                  int wi = cx*bs + i - wmin[0];
+                  if ((wi < 0) || (wi >= size[0])) continue;
+                  if (values[(k*bs + j)*bs + i] == 0) continue;
+                  int w = (wk*size[1] + wj)*size[0] + wi;
+                  outside[w] = 0;
+                  if (sign) inside[w] = R3_SPARSE_GRID_INFINITY;
+                }
+              }
+            }
+          }
+        }
+      }
+
+      // Compute squared distances within window
+      SquaredDistanceTransformWindow(outside, size, d, v, z);
+      if (sign) SquaredDistanceTransformWindow(inside, size, d, v, z);
+
+      // Copy distances for block entries
+      RNScalar *values = result.BlockValues(b);
+      for (int k = 0; k < bs; k++) {
+        int wk = bz*bs + k - wmin[2];
+        if (wk >= size[2]) break;
+        for (int j = 0; j < bs; j++) {
+          int wj = by*bs + j - wmin[1];
+          if (wj >= size[1]) break;
+          for (int i = 0; i < bs; i++) {
+            int wi = bx*bs + i - wmin[0];
+            if (wi >= size[0]) break;
+            int w = (wk*size[1] + wj)*size[0] + wi;
+            RNScalar value = (outside[w] < band_squared) ? outside[w] : band_squared;
+            if (sign) {
+              RNScalar inside_value = (inside[w] < band_squared) ? inside[w] : band_squared;
+              value = sqrt(value) - sqrt(inside_value);
+            }
+            values[(k*bs + j)*bs + i] = value;
+          }
+        }
+      }
+    }
+
+    // Delete per-thread buffers
+    delete [] outside;
+    if (inside) delete [] inside;
+    delete [] d;
+    delete [] z;
+    delete [] v;
+  }
+
+  // Replace grid with result
+  result.Prune();
+  *grid = result;
+}
+
+
+
+void R3SparseGrid::
+SquaredDistanceTransform(RNLength grid_band_width)
+{
+  // Compute squared distance to nearest non-zero entry for entries
+  // within grid_band_width (entries further away get grid_band_width^2)
+  NarrowBandDistanceTransform(this, grid_band_width, FALSE);
+}
+
+
+
+void R3SparseGrid::
+SignedDistanceTransform(RNLength grid_band_width)
+{
+  // Compute distance from boundary into interior (negative) and into exterior (positive),
+  // clamped to [-grid_band_width, grid_band_width]
+  NarrowBandDistanceTransform(this, grid_band_width, TRUE);
+}
+
+
+
+////////////////////////////////////////////////////////////////////////
+// Rasterization functions
+////////////////////////////////////////////////////////////////////////
+
+void R3SparseGrid::
+RasterizeGridValue(int ix, int iy, int iz, RNScalar value, int operation)
+{
+  // Check if within bounds
+  if ((ix < 0) || (ix > grid_resolution[0]-1)) return;
+  if ((iy < 0) || (iy > grid_resolution[1]-1)) return;
+  if ((iz < 0) || (iz > grid_resolution[2]-1)) return;
+
+  // Update grid based on operation
+  if (operation == R3_GRID_ADD_OPERATION) AddGridValue(ix, iy, iz, value);
+  else if (operation == R3_GRID_SUBTRACT_OPERATION) AddGridValue(ix, iy, iz, -value);
+  else if (operation == R3_GRID_REPLACE_OPERATION) SetGridValue(ix, iy, iz, value);
+  else RNAbort("Unrecognized grid rasterization operation\n");
+}
+
+
+
+void R3SparseGrid::
+RasterizeGridPoint(RNScalar x, RNScalar y, RNScalar z, RNScalar value, int operation)
+{
+  // Check if within bounds
+  if ((x < 0) || (x > grid_resolution[0]-1)) return;
+  if ((y < 0) || (y > grid_resolution[1]-1)) return;
+  if ((z < 0) || (z > grid_resolution[2]-1)) return;
+
+  // Trilinear interpolation
+  int ix1 = (int) x;
+  int iy1 = (int) y;
+  int iz1 = (int) z;
+  int ix2 = ix1 + 1;
+  int iy2 = iy1 + 1;
+  int iz2 = iz1 + 1;
+  if (ix2 >= grid_resolution[0]) ix2 = ix1;
+  if (iy2 >= grid_resolution[1]) iy2 = iy1;
+  if (iz2 >= grid_resolution[2]) iz2 = iz1;
+  RNScalar dx = x - ix1;
+  RNScalar dy = y - iy1;
+  RNScalar dz = z - iz1;
+  RasterizeGridValue(ix1, iy1, iz1, value * (1.0-dx) * (1.0-dy) * (1.0-dz), operation);
+  RasterizeGridValue(ix1, iy1, iz2, value * (1.0-dx) * (1.0-dy) * dz, operation);
+  RasterizeGridValue(ix1, iy2, iz1, value * (1.0-dx) * dy * (1.0-dz), operation);
+  RasterizeGridValue(ix1, iy2, iz2, value * (1.0-dx) * dy * dz, operation);
+  RasterizeGridValue(ix2, iy1, iz1, value * dx * (1.0-dy) * (1.0-dz), operation);
+  RasterizeGridValue(ix2, iy1, iz2, value * dx * (1.0-dy) * dz, operation);
+  RasterizeGridValue(ix2, iy2, iz1, value * dx * dy * (1.0-dz), operation);
+  RasterizeGridValue(ix2, iy2, iz2, value * dx * dy * dz, operation);
+}
+
+
+
+void R3SparseGrid::
+RasterizeGridSpan(const int p1[3], const int p2[3], RNScalar value, int operation)
+{
+  // Get some convenient variables
+  int d[3],p[3],dd[3],s[3];
+  for (int i = 0; i < 3; i++) {
+    d[i]= p2[i] - p1[i];
+    if(d[i]<0){
+      dd[i] = -d[i];
+      s[i] = -1;
+    }
+    else{
+      dd[i] = d[i];
+      s[i] = 1;
+    }
+    p[i] = p1[i];
+  }
+
+  // Choose dimensions
+  int i1=0;
+  if(dd[1]>dd[i1]){i1=1;}
+  if(dd[2]>dd[i1]){i1=2;}
+  int i2=(i1+1)%3;
+  int i3=(i1+2)%3;
+
+  // Check span extent
+  if(dd[i1]==0){
+    // Span is a point - rasterize it
+    RasterizeGridValue(p[0], p[1], p[2], value, operation);
+  }
+  else {
+    // Step along span
+    int off[3] = { 0, 0, 0 };
+    for (int i = 0; i <= dd[i1]; i++) {
+      RasterizeGridValue(p[0], p[1], p[2], value, operation);
+      off[i2]+=dd[i2];
+      off[i3]+=dd[i3];
+      p[i1]+=s[i1];
+      p[i2]+=s[i2]*off[i2]/dd[i1];
+      p[i3]+=s[i3]*off[i3]/dd[i1];
+      off[i2]%=dd[i1];
+      off[i3]%=dd[i1];
+    }
+  }
+}
+
+
+
+void R3SparseGrid::
+RasterizeGridTriangle(const int p1[3], const int p2[3], const int p3[3], RNScalar value, int operation)
+{
+  // Same scan conversion as R3Grid::RasterizeGridTriangle
+  int i,j;
+
+  // Figure out the min, max, and delta in each dimension
+  int mn[3], mx[3], delta[3];
+  for (i = 0; i < 3; i++) {
+    mx[i]=mn[i]=p1[i];
+    if (p2[i] < mn[i]) mn[i]=p2[i];
+    if (p3[i] < mn[i]) mn[i]=p3[i];
+    if (p2[i] > mx[i]) mx[i]=p2[i];
+    if (p3[i] > mx[i]) mx[i]=p3[i];
+    delta[i] = mx[i] - mn[i];
+  }
+
+  // Determine direction of maximal delta
+  int d = 0;
+  if ((delta[1] > delta[0]) && (delta[1] > delta[2])) d = 1;
+  else if (delta[2] > delta[0]) d = 2;
+
+  // Sort by d-value
+  const int *q1,*q2,*q3;
+  if(p1[d]>=p2[d] && p1[d]>=p3[d]){
+    q1=p1;
+    if(p2[d]>=p3[d]){ q2=p2; q3=p3; }
+    else{ q2=p3; q3=p2; }
+  }
+  else if(p2[d]>=p1[d] && p2[d]>=p3[d]){
+    q1=p2;
+    if(p1[d]>=p3[d]){ q2=p1; q3=p3; }
+    else{ q2=p3; q3=p1; }
+  }
+  else{
+    q1=p3;
+    if(p1[d]>=p2[d]){ q2=p1; q3=p2; }
+    else{ q2=p2; q3=p1; }
+  }
+
+  // Init state
+  int dx,dx1,dx2,ddx;
+  dx=q1[d]-q2[d];
+  dx1=q1[d]-q2[d];
+  dx2=q1[d]-q3[d];
+  ddx=dx1*dx2;
+
+  int r1[3],r2[3];
+  int last1[3],last2[3];
+  int off1[3],off2[3];
+  for(i=0;i<3;i++){
+    last1[i]=q1[i];
+    last2[i]=q1[i];
+    off1[i]=0;
+    off2[i]=0;
+    r1[i]=(-q1[i]+q2[i])*dx2;
+    r2[i]=(-q1[i]+q3[i])*dx1;
+  }
+
+  // Draw Top triangle
+  if(dx==0){
+    for(i=0;i<3;i++){
+      last1[i]=q1[i];
+      last2[i]=q2[i];
+    }
+  }
+  else{
+    for(i=0;i<dx;i++){
+      RasterizeGridSpan(last1,last2,value,operation);
+      for(j=0;j<3;j++){
+        off1[j]+=r1[j];
+        off2[j]+=r2[j];
+
+        last1[j]+=off1[j]/ddx;
+        if(off1[j]<0){off1[j]=-((-off1[j])%ddx);}
+        else{off1[j]%=ddx;}
+
+        last2[j]+=off2[j]/ddx;
+        if(off2[j]<0){off2[j]=-((-off2[j])%ddx);}
+        else{off2[j]%=ddx;}
+      }
+    }
+  }
+
+  // Init
+  dx=q2[d]-q3[d];
+  dx1=last1[d]-q3[d];
+  dx2=last2[d]-q3[d];
+  ddx=dx1*dx2;
+  if(dx==0){
+    RasterizeGridSpan(q2,q3,value,operation);
+    return;
+  }
+
+  for(i=0;i<3;i++){
+    off1[i]=0;
+    off2[i]=0;
+    r1[i]=(-last1[i]+q3[i])*dx2;
+    r2[i]=(-last2[i]+q3[i])*dx1;
+  }
+
+  // Draw Bottom parrallelogram
+  for(i=0;i<=dx;i++){
+    RasterizeGridSpan(last1,last2,value,operation);
+    for(j=0;j<3;j++){
+      off1[j]+=r1[j];
+      off2[j]+=r2[j];
+
+      last1[j]+=off1[j]/ddx;
+      if(off1[j]<0){off1[j]=-((-off1[j])%ddx);}
+      else{off1[j]%=ddx;}
+
+      last2[j]+=off2[j]/ddx;
+      if(off2[j]<0){off2[j]=-((-off2[j])%ddx);}
+      else{off2[j]%=ddx;}
+    }
+  }
+}
+
+
+
+void R3SparseGrid::
+RasterizeGridSphere(const R3Point& center, RNLength radius, RNScalar value, RNBoolean solid, int operation)
+{
+  // Figure out the min and max in each dimension
+  int mn[3], mx[3];
+  for (int i = 0; i < 3; i++) {
+    mx[i]= (int) (center[i]+radius);
+    if (mx[i] < 0) return;
+    if (mx[i] > Resolution(i)-1) mx[i] = Resolution(i)-1;
+    mn[i]= (int) (center[i]-radius);
+    if (mn[i] > Resolution(i)-1) return;
+    if (mn[i] < 0) mn[i] = 0;
+  }
+
+  // Rasterize sphere
+  RNScalar radius_squared = radius * radius;
+  for (int k = mn[2]; k <= mx[2]; k++) {
+    RNCoord z = (int) (k - center[2]);
+    RNCoord z_squared = z*z;
+    RNLength xy_radius_squared = radius_squared - z_squared;
+    RNLength y = sqrt(xy_radius_squared);
+    int y1 = (int) (center[1] - y + 0.5);
+    int y2 = (int) (center[1] + y + 0.5);
+    if (y1 < mn[1]) y1 = mn[1];
+    if (y2 > mx[1]) y2 = mx[1];
+    for (int j = y1; j <= y2; j++) {
+      RNCoord y = (int) (j - center[1]);
+      RNCoord y_squared = y*y;
+      RNLength x_squared = xy_radius_squared - y_squared;
+      RNLength x = sqrt(x_squared);
+      int x1 = (int) (center[0] - x + 0.5);
+      int x2 = (int) (center[0] + x + 0.5);
+      if (x1 < mn[0]) x1 = mn[0];
+      if (x2 > mx[0]) x2 = mx[0];
+      if (solid || (j == y1) || (j == y2)) {
+        for (int i = x1; i <= x2; i++) {
+          RasterizeGridValue(i, j, k, value, operation);
+        }
+      }
+      else {
+        RasterizeGridValue(x1, j, k, value, operation);
+        RasterizeGridValue(x2, j, k, value, operation);
+      }
+    }
+  }
+}
+
+
+
+////////////////////////////////////////////////////////////////////////
+// Transformation functions
+////////////////////////////////////////////////////////////////////////
+
+void R3SparseGrid::
+SetWorldToGridTransformation(const R3Affine& affine)
+{
+  // Set transformations
+  world_to_grid_transform = affine;
+  grid_to_world_transform = affine.Inverse();
+  world_to_grid_scale_factor = affine.ScaleFactor();
+  grid_to_world_scale_factor = (world_to_grid_scale_factor != 0) ? 1 / world_to_grid_scale_factor : 1.0;
+}
+
+
+
+void R3SparseGrid::
+SetWorldToGridTransformation(const R3Box& world_box)
+{
+  // Just checking
+  if ((grid_resolution[0] == 0) || (grid_resolution[1] == 0) || (grid_resolution[2] == 0)) {
+    SetWorldToGridTransformation(R3identity_affine);
+    return;
+  }
+
+  // Compute grid origin
+  R3Vector grid_diagonal(XResolution()-1, YResolution()-1, ZResolution()-1);
+  R3Vector grid_origin = 0.5 * grid_diagonal;
+
+  // Compute world origin
+  R3Vector world_diagonal(world_box.XLength(), world_box.YLength(), world_box.ZLength());
+  R3Vector world_origin = world_box.Centroid().Vector();
+
+  // Compute scale
+  RNScalar scale = FLT_MAX;
+  RNScalar xscale = (world_diagonal[0] > 0) ? grid_diagonal[0] / world_diagonal[0] : FLT_MAX;
+  if (xscale < scale) scale = xscale;
+  RNScalar yscale = (world_diagonal[1] > 0) ? grid_diagonal[1] / world_diagonal[1] : FLT_MAX;
+  if (yscale < scale) scale = yscale;
+  RNScalar zscale = (world_diagonal[2] > 0) ? grid_diagonal[2] / world_diagonal[2] : FLT_MAX;
+  if (zscale < scale) scale = zscale;
+  if (scale == FLT_MAX) scale = 1;
+
+  // Compute world-to-grid transformation
+  R3Affine affine(R3identity_affine);
+  affine.Translate(grid_origin);
+  if (scale != 1) affine.Scale(scale);
+  affine.Translate(-world_origin);
+
+  // Set transformations
+  SetWorldToGridTransformation(affine);
+}
+
+
+
+////////////////////////////////////////////////////////////////////////
+// Conversion functions
+////////////////////////////////////////////////////////////////////////
+
+R3Grid *R3SparseGrid::
+DenseGrid(void) const
+{
+  // Allocate dense grid
+  R3Grid *grid = new R3Grid(XResolution(), YResolution(), ZResolution());
+  grid->SetWorldToGridTransformation(world_to_grid_transform);
+  if (background_value != 0) grid->Clear(background_value);
+
+  // Copy values from allocated blocks
+  const int bs = R3_SPARSE_GRID_BLOCK_SIZE;
+  for (int b = 0; b < nblocks; b++) {
+    int bx, by, bz;
+    BlockIndices(b, bx, by, bz);
+    const RNScalar *values = block_values[b];
+    for (int k = 0; (k < bs) && (bz*bs + k < grid_resolution[2]); k++) {
+      for (int j = 0; (j < bs) && (by*bs + j < grid_resolution[1]); j++) {
+        for (int i = 0; (i < bs) && (bx*bs + i < grid_resolution[0]); i++) {
+          grid->SetGridValue(bx*bs + i, by*bs + j, bz*bs + k, values[(k*bs + j)*bs + i]);
+        }
+      }
+    }
+  }
+
+  // Return dense grid
+  return grid;
+}
+
+
+
+////////////////////////////////////////////////////////////////////////
+// Isosurface extraction
+// Marching cubes tables from http://astronomy.swin.edu.au/~pbourke/modelling/polygonise/
+////////////////////////////////////////////////////////////////////////
+
+static const int marching_cubes_edge_table[256]={
+  0x0  , 0x109, 0x203, 0x30a, 0x406, 0x50f, 0x605, 0x70c,
+  0x80c, 0x905, 0xa0f, 0xb06, 0xc0a, 0xd03, 0xe09, 0xf00,
+  0x190, 0x99 , 0x393, 0x29a, 0x596, 0x49f, 0x795, 0x69c,
+  0x99c, 0x895, 0xb9f, 0xa96, 0xd9a, 0xc93, 0xf99, 0xe90,
+  0x230, 0x339, 0x33 , 0x13a, 0x636, 0x73f, 0x435, 0x53c,
+  0xa3c, 0xb35, 0x83f, 0x936, 0xe3a, 0xf33, 0xc39, 0xd30,
+  0x3a0, 0x2a9, 0x1a3, 0xaa , 0x7a6, 0x6af, 0x5a5, 0x4ac,
+  0xbac, 0xaa5, 0x9af, 0x8a6, 0xfaa, 0xea3, 0xda9, 0xca0,
+  0x460, 0x569, 0x663, 0x76a, 0x66 , 0x16f, 0x265, 0x36c,
+  0xc6c, 0xd65, 0xe6f, 0xf66, 0x86a, 0x963, 0xa69, 0xb60,
+  0x5f0, 0x4f9, 0x7f3, 0x6fa, 0x1f6, 0xff , 0x3f5, 0x2fc,
+  0xdfc, 0xcf5, 0xfff, 0xef6, 0x9fa, 0x8f3, 0xbf9, 0xaf0,
+  0x650, 0x759, 0x453, 0x55a, 0x256, 0x35f, 0x55 , 0x15c,
+  0xe5c, 0xf55, 0xc5f, 0xd56, 0xa5a, 0xb53, 0x859, 0x950,
+  0x7c0, 0x6c9, 0x5c3, 0x4ca, 0x3c6, 0x2cf, 0x1c5, 0xcc ,
+  0xfcc, 0xec5, 0xdcf, 0xcc6, 0xbca, 0xac3, 0x9c9, 0x8c0,
+  0x8c0, 0x9c9, 0xac3, 0xbca, 0xcc6, 0xdcf, 0xec5, 0xfcc,
+  0xcc , 0x1c5, 0x2cf, 0x3c6, 0x4ca, 0x5c3, 0x6c9, 0x7c0,
+  0x950, 0x859, 0xb53, 0xa5a, 0xd56, 0xc5f, 0xf55, 0xe5c,
+  0x15c, 0x55 , 0x35f, 0x256, 0x55a, 0x453, 0x759, 0x650,
+  0xaf0, 0xbf9, 0x8f3, 0x9fa, 0xef6, 0xfff, 0xcf5, 0xdfc,
+  0x2fc, 0x3f5, 0xff , 0x1f6, 0x6fa, 0x7f3, 0x4f9, 0x5f0,
+  0xb60, 0xa69, 0x963, 0x86a, 0xf66, 0xe6f, 0xd65, 0xc6c,
+  0x36c, 0x265, 0x16f, 0x66 , 0x76a, 0x663, 0x569, 0x460,
+  0xca0, 0xda9, 0xea3, 0xfaa, 0x8a6, 0x9af, 0xaa5, 0xbac,
+  0x4ac, 0x5a5, 0x6af, 0x7a6, 0xaa , 0x1a3, 0x2a9, 0x3a0,
+  0xd30, 0xc39, 0xf33, 0xe3a, 0x936, 0x83f, 0xb35, 0xa3c,
+  0x53c, 0x435, 0x73f, 0x636, 0x13a, 0x33 , 0x339, 0x230,
+  0xe90, 0xf99, 0xc93, 0xd9a, 0xa96, 0xb9f, 0x895, 0x99c,
+  0x69c, 0x795, 0x49f, 0x596, 0x29a, 0x393, 0x99 , 0x190,
+  0xf00, 0xe09, 0xd03, 0xc0a, 0xb06, 0xa0f, 0x905, 0x80c,
+  0x70c, 0x605, 0x50f, 0x406, 0x30a, 0x203, 0x109, 0x0   
+};
+
+// Initialize marching cubes triangle table
+static const int marching_cubes_triangle_table[256][16] =
+  {{-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+   {0, 8, 3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+   {0, 1, 9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+   {1, 8, 3, 9, 8, 1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+   {1, 2, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+   {0, 8, 3, 1, 2, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+   {9, 2, 10, 0, 2, 9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+   {2, 8, 3, 2, 10, 8, 10, 9, 8, -1, -1, -1, -1, -1, -1, -1},
+   {3, 11, 2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+   {0, 11, 2, 8, 11, 0, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+   {1, 9, 0, 2, 3, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+   {1, 11, 2, 1, 9, 11, 9, 8, 11, -1, -1, -1, -1, -1, -1, -1},
+   {3, 10, 1, 11, 10, 3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+   {0, 10, 1, 0, 8, 10, 8, 11, 10, -1, -1, -1, -1, -1, -1, -1},
+   {3, 9, 0, 3, 11, 9, 11, 10, 9, -1, -1, -1, -1, -1, -1, -1},
+   {9, 8, 10, 10, 8, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+   {4, 7, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+   {4, 3, 0, 7, 3, 4, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+   {0, 1, 9, 8, 4, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+   {4, 1, 9, 4, 7, 1, 7, 3, 1, -1, -1, -1, -1, -1, -1, -1},
+   {1, 2, 10, 8, 4, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+   {3, 4, 7, 3, 0, 4, 1, 2, 10, -1, -1, -1, -1, -1, -1, -1},
+   {9, 2, 10, 9, 0, 2, 8, 4, 7, -1, -1, -1, -1, -1, -1, -1},
+   {2, 10, 9, 2, 9, 7, 2, 7, 3, 7, 9, 4, -1, -1, -1, -1},
+   {8, 4, 7, 3, 11, 2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+   {11, 4, 7, 11, 2, 4, 2, 0, 4, -1, -1, -1, -1, -1, -1, -1},
+   {9, 0, 1, 8, 4, 7, 2, 3, 11, -1, -1, -1, -1, -1, -1, -1},
+   {4, 7, 11, 9, 4, 11, 9, 11, 2, 9, 2, 1, -1, -1, -1, -1},
+   {3, 10, 1, 3, 11, 10, 7, 8, 4, -1, -1, -1, -1, -1, -1, -1},
+   {1, 11, 10, 1, 4, 11, 1, 0, 4, 7, 11, 4, -1, -1, -1, -1},
+   {4, 7, 8, 9, 0, 11, 9, 11, 10, 11, 0, 3, -1, -1, -1, -1},
+   {4, 7, 11, 4, 11, 9, 9, 11, 10, -1, -1, -1, -1, -1, -1, -1},
+   {9, 5, 4, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+   {9, 5, 4, 0, 8, 3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+   {0, 5, 4, 1, 5, 0, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+   {8, 5, 4, 8, 3, 5, 3, 1, 5, -1, -1, -1, -1, -1, -1, -1},
+   {1, 2, 10, 9, 5, 4, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+   {3, 0, 8, 1, 2, 10, 4, 9, 5, -1, -1, -1, -1, -1, -1, -1},
+   {5, 2, 10, 5, 4, 2, 4, 0, 2, -1, -1, -1, -1, -1, -1, -1},
+   {2, 10, 5, 3, 2, 5, 3, 5, 4, 3, 4, 8, -1, -1, -1, -1},
+   {9, 5, 4, 2, 3, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+   {0, 11, 2, 0, 8, 11, 4, 9, 5, -1, -1, -1, -1, -1, -1, -1},
+   {0, 5, 4, 0, 1, 5, 2, 3, 11, -1, -1, -1, -1, -1, -1, -1},
+   {2, 1, 5, 2, 5, 8, 2, 8, 11, 4, 8, 5, -1, -1, -1, -1},
+   {10, 3, 11, 10, 1, 3, 9, 5, 4, -1, -1, -1, -1, -1, -1, -1},
+   {4, 9, 5, 0, 8, 1, 8, 10, 1, 8, 11, 10, -1, -1, -1, -1},
+   {5, 4, 0, 5, 0, 11, 5, 11, 10, 11, 0, 3, -1, -1, -1, -1},
+   {5, 4, 8, 5, 8, 10, 10, 8, 11, -1, -1, -1, -1, -1, -1, -1},
+   {9, 7, 8, 5, 7, 9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+   {9, 3, 0, 9, 5, 3, 5, 7, 3, -1, -1, -1, -1, -1, -1, -1},
+   {0, 7, 8, 0, 1, 7, 1, 5, 7, -1, -1, -1, -1, -1, -1, -1},
+   {1, 5, 3, 3, 5, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+   {9, 7, 8, 9, 5, 7, 10, 1, 2, -1, -1, -1, -1, -1, -1, -1},
+   {10, 1, 2, 9, 5, 0, 5, 3, 0, 5, 7, 3, -1, -1, -1, -1},
+   {8, 0, 2, 8, 2, 5, 8, 5, 7, 10, 5, 2, -1, -1, -1, -1},
+   {2, 10, 5, 2, 5, 3, 3, 5, 7, -1, -1, -1, -1, -1, -1, -1},
+   {7, 9, 5, 7, 8, 9, 3, 11, 2, -1, -1, -1, -1, -1, -1, -1},
+   {9, 5, 7, 9, 7, 2, 9, 2, 0, 2, 7, 11, -1, -1, -1, -1},
+   {2, 3, 11, 0, 1, 8, 1, 7, 8, 1, 5, 7, -1, -1, -1, -1},
+   {11, 2, 1, 11, 1, 7, 7, 1, 5, -1, -1, -1, -1, -1, -1, -1},
+   {9, 5, 8, 8, 5, 7, 10, 1, 3, 10, 3, 11, -1, -1, -1, -1},
+   {5, 7, 0, 5, 0, 9, 7, 11, 0, 1, 0, 10, 11, 10, 0, -1},
+   {11, 10, 0, 11, 0, 3, 10, 5, 0, 8, 0, 7, 5, 7, 0, -1},
+   {11, 10, 5, 7, 11, 5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+   {10, 6, 5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+   {0, 8, 3, 5, 10, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+   {9, 0, 1, 5, 10, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+   {1, 8, 3, 1, 9, 8, 5, 10, 6, -1, -1, -1, -1, -1, -1, -1},
+   {1, 6, 5, 2, 6, 1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+   {1, 6, 5, 1, 2, 6, 3, 0, 8, -1, -1, -1, -1, -1, -1, -1},
+   {9, 6, 5, 9, 0, 6, 0, 2, 6, -1, -1, -1, -1, -1, -1, -1},
+   {5, 9, 8, 5, 8, 2, 5, 2, 6, 3, 2, 8, -1, -1, -1, -1},
+   {2, 3, 11, 10, 6, 5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+   {11, 0, 8, 11, 2, 0, 10, 6, 5, -1, -1, -1, -1, -1, -1, -1},
+   {0, 1, 9, 2, 3, 11, 5, 10, 6, -1, -1, -1, -1, -1, -1, -1},
+   {5, 10, 6, 1, 9, 2, 9, 11, 2, 9, 8, 11, -1, -1, -1, -1},
+   {6, 3, 11, 6, 5, 3, 5, 1, 3, -1, -1, -1, -1, -1, -1, -1},
+   {0, 8, 11, 0, 11, 5, 0, 5, 1, 5, 11, 6, -1, -1, -1, -1},
+   {3, 11, 6, 0, 3, 6, 0, 6, 5, 0, 5, 9, -1, -1, -1, -1},
+   {6, 5, 9, 6, 9, 11, 11, 9, 8, -1, -1, -1, -1, -1, -1, -1},
+   {5, 10, 6, 4, 7, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+   {4, 3, 0, 4, 7, 3, 6, 5, 10, -1, -1, -1, -1, -1, -1, -1},
+   {1, 9, 0, 5, 10, 6, 8, 4, 7, -1, -1, -1, -1, -1, -1, -1},
+   {10, 6, 5, 1, 9, 7, 1, 7, 3, 7, 9, 4, -1, -1, -1, -1},
+   {6, 1, 2, 6, 5, 1, 4, 7, 8, -1, -1, -1, -1, -1, -1, -1},
+   {1, 2, 5, 5, 2, 6, 3, 0, 4, 3, 4, 7, -1, -1, -1, -1},
+   {8, 4, 7, 9, 0, 5, 0, 6, 5, 0, 2, 6, -1, -1, -1, -1},
+   {7, 3, 9, 7, 9, 4, 3, 2, 9, 5, 9, 6, 2, 6, 9, -1},
+   {3, 11, 2, 7, 8, 4, 10, 6, 5, -1, -1, -1, -1, -1, -1, -1},
+   {5, 10, 6, 4, 7, 2, 4, 2, 0, 2, 7, 11, -1, -1, -1, -1},
+   {0, 1, 9, 4, 7, 8, 2, 3, 11, 5, 10, 6, -1, -1, -1, -1},
+   {9, 2, 1, 9, 11, 2, 9, 4, 11, 7, 11, 4, 5, 10, 6, -1},
+   {8, 4, 7, 3, 11, 5, 3, 5, 1, 5, 11, 6, -1, -1, -1, -1},
+   {5, 1, 11, 5, 11, 6, 1, 0, 11, 7, 11, 4, 0, 4, 11, -1},
+   {0, 5, 9, 0, 6, 5, 0, 3, 6, 11, 6, 3, 8, 4, 7, -1},
+   {6, 5, 9, 6, 9, 11, 4, 7, 9, 7, 11, 9, -1, -1, -1, -1},
+   {10, 4, 9, 6, 4, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+   {4, 10, 6, 4, 9, 10, 0, 8, 3, -1, -1, -1, -1, -1, -1, -1},
+   {10, 0, 1, 10, 6, 0, 6, 4, 0, -1, -1, -1, -1, -1, -1, -1},
+   {8, 3, 1, 8, 1, 6, 8, 6, 4, 6, 1, 10, -1, -1, -1, -1},
+   {1, 4, 9, 1, 2, 4, 2, 6, 4, -1, -1, -1, -1, -1, -1, -1},
+   {3, 0, 8, 1, 2, 9, 2, 4, 9, 2, 6, 4, -1, -1, -1, -1},
+   {0, 2, 4, 4, 2, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+   {8, 3, 2, 8, 2, 4, 4, 2, 6, -1, -1, -1, -1, -1, -1, -1},
+   {10, 4, 9, 10, 6, 4, 11, 2, 3, -1, -1, -1, -1, -1, -1, -1},
+   {0, 8, 2, 2, 8, 11, 4, 9, 10, 4, 10, 6, -1, -1, -1, -1},
+   {3, 11, 2, 0, 1, 6, 0, 6, 4, 6, 1, 10, -1, -1, -1, -1},
+   {6, 4, 1, 6, 1, 10, 4, 8, 1, 2, 1, 11, 8, 11, 1, -1},
+   {9, 6, 4, 9, 3, 6, 9, 1, 3, 11, 6, 3, -1, -1, -1, -1},
+   {8, 11, 1, 8, 1, 0, 11, 6, 1, 9, 1, 4, 6, 4, 1, -1},
+   {3, 11, 6, 3, 6, 0, 0, 6, 4, -1, -1, -1, -1, -1, -1, -1},
+   {6, 4, 8, 11, 6, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+   {7, 10, 6, 7, 8, 10, 8, 9, 10, -1, -1, -1, -1, -1, -1, -1},
+   {0, 7, 3, 0, 10, 7, 0, 9, 10, 6, 7, 10, -1, -1, -1, -1},
+   {10, 6, 7, 1, 10, 7, 1, 7, 8, 1, 8, 0, -1, -1, -1, -1},
+   {10, 6, 7, 10, 7, 1, 1, 7, 3, -1, -1, -1, -1, -1, -1, -1},
+   {1, 2, 6, 1, 6, 8, 1, 8, 9, 8, 6, 7, -1, -1, -1, -1},
+   {2, 6, 9, 2, 9, 1, 6, 7, 9, 0, 9, 3, 7, 3, 9, -1},
+   {7, 8, 0, 7, 0, 6, 6, 0, 2, -1, -1, -1, -1, -1, -1, -1},
+   {7, 3, 2, 6, 7, 2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+   {2, 3, 11, 10, 6, 8, 10, 8, 9, 8, 6, 7, -1, -1, -1, -1},
+   {2, 0, 7, 2, 7, 11, 0, 9, 7, 6, 7, 10, 9, 10, 7, -1},
+   {1, 8, 0, 1, 7, 8, 1, 10, 7, 6, 7, 10, 2, 3, 11, -1},
+   {11, 2, 1, 11, 1, 7, 10, 6, 1, 6, 7, 1, -1, -1, -1, -1},
+   {8, 9, 6, 8, 6, 7, 9, 1, 6, 11, 6, 3, 1, 3, 6, -1},
+   {0, 9, 1, 11, 6, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+   {7, 8, 0, 7, 0, 6, 3, 11, 0, 11, 6, 0, -1, -1, -1, -1},
+   {7, 11, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+   {7, 6, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+   {3, 0, 8, 11, 7, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+   {0, 1, 9, 11, 7, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+   {8, 1, 9, 8, 3, 1, 11, 7, 6, -1, -1, -1, -1, -1, -1, -1},
+   {10, 1, 2, 6, 11, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+   {1, 2, 10, 3, 0, 8, 6, 11, 7, -1, -1, -1, -1, -1, -1, -1},
+   {2, 9, 0, 2, 10, 9, 6, 11, 7, -1, -1, -1, -1, -1, -1, -1},
+   {6, 11, 7, 2, 10, 3, 10, 8, 3, 10, 9, 8, -1, -1, -1, -1},
+   {7, 2, 3, 6, 2, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+   {7, 0, 8, 7, 6, 0, 6, 2, 0, -1, -1, -1, -1, -1, -1, -1},
+   {2, 7, 6, 2, 3, 7, 0, 1, 9, -1, -1, -1, -1, -1, -1, -1},
+   {1, 6, 2, 1, 8, 6, 1, 9, 8, 8, 7, 6, -1, -1, -1, -1},
+   {10, 7, 6, 10, 1, 7, 1, 3, 7, -1, -1, -1, -1, -1, -1, -1},
+   {10, 7, 6, 1, 7, 10, 1, 8, 7, 1, 0, 8, -1, -1, -1, -1},
+   {0, 3, 7, 0, 7, 10, 0, 10, 9, 6, 10, 7, -1, -1, -1, -1},
+   {7, 6, 10, 7, 10, 8, 8, 10, 9, -1, -1, -1, -1, -1, -1, -1},
+   {6, 8, 4, 11, 8, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+   {3, 6, 11, 3, 0, 6, 0, 4, 6, -1, -1, -1, -1, -1, -1, -1},
+   {8, 6, 11, 8, 4, 6, 9, 0, 1, -1, -1, -1, -1, -1, -1, -1},
+   {9, 4, 6, 9, 6, 3, 9, 3, 1, 11, 3, 6, -1, -1, -1, -1},
+   {6, 8, 4, 6, 11, 8, 2, 10, 1, -1, -1, -1, -1, -1, -1, -1},
+   {1, 2, 10, 3, 0, 11, 0, 6, 11, 0, 4, 6, -1, -1, -1, -1},
+   {4, 11, 8, 4, 6, 11, 0, 2, 9, 2, 10, 9, -1, -1, -1, -1},
+   {10, 9, 3, 10, 3, 2, 9, 4, 3, 11, 3, 6, 4, 6, 3, -1},
+   {8, 2, 3, 8, 4, 2, 4, 6, 2, -1, -1, -1, -1, -1, -1, -1},
+   {0, 4, 2, 4, 6, 2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+   {1, 9, 0, 2, 3, 4, 2, 4, 6, 4, 3, 8, -1, -1, -1, -1},
+   {1, 9, 4, 1, 4, 2, 2, 4, 6, -1, -1, -1, -1, -1, -1, -1},
+   {8, 1, 3, 8, 6, 1, 8, 4, 6, 6, 10, 1, -1, -1, -1, -1},
+   {10, 1, 0, 10, 0, 6, 6, 0, 4, -1, -1, -1, -1, -1, -1, -1},
+   {4, 6, 3, 4, 3, 8, 6, 10, 3, 0, 3, 9, 10, 9, 3, -1},
+   {10, 9, 4, 6, 10, 4, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+   {4, 9, 5, 7, 6, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+   {0, 8, 3, 4, 9, 5, 11, 7, 6, -1, -1, -1, -1, -1, -1, -1},
+   {5, 0, 1, 5, 4, 0, 7, 6, 11, -1, -1, -1, -1, -1, -1, -1},
+   {11, 7, 6, 8, 3, 4, 3, 5, 4, 3, 1, 5, -1, -1, -1, -1},
+   {9, 5, 4, 10, 1, 2, 7, 6, 11, -1, -1, -1, -1, -1, -1, -1},
+   {6, 11, 7, 1, 2, 10, 0, 8, 3, 4, 9, 5, -1, -1, -1, -1},
+   {7, 6, 11, 5, 4, 10, 4, 2, 10, 4, 0, 2, -1, -1, -1, -1},
+   {3, 4, 8, 3, 5, 4, 3, 2, 5, 10, 5, 2, 11, 7, 6, -1},
+   {7, 2, 3, 7, 6, 2, 5, 4, 9, -1, -1, -1, -1, -1, -1, -1},
+   {9, 5, 4, 0, 8, 6, 0, 6, 2, 6, 8, 7, -1, -1, -1, -1},
+   {3, 6, 2, 3, 7, 6, 1, 5, 0, 5, 4, 0, -1, -1, -1, -1},
+   {6, 2, 8, 6, 8, 7, 2, 1, 8, 4, 8, 5, 1, 5, 8, -1},
+   {9, 5, 4, 10, 1, 6, 1, 7, 6, 1, 3, 7, -1, -1, -1, -1},
+   {1, 6, 10, 1, 7, 6, 1, 0, 7, 8, 7, 0, 9, 5, 4, -1},
+   {4, 0, 10, 4, 10, 5, 0, 3, 10, 6, 10, 7, 3, 7, 10, -1},
+   {7, 6, 10, 7, 10, 8, 5, 4, 10, 4, 8, 10, -1, -1, -1, -1},
+   {6, 9, 5, 6, 11, 9, 11, 8, 9, -1, -1, -1, -1, -1, -1, -1},
+   {3, 6, 11, 0, 6, 3, 0, 5, 6, 0, 9, 5, -1, -1, -1, -1},
+   {0, 11, 8, 0, 5, 11, 0, 1, 5, 5, 6, 11, -1, -1, -1, -1},
+   {6, 11, 3, 6, 3, 5, 5, 3, 1, -1, -1, -1, -1, -1, -1, -1},
+   {1, 2, 10, 9, 5, 11, 9, 11, 8, 11, 5, 6, -1, -1, -1, -1},
+   {0, 11, 3, 0, 6, 11, 0, 9, 6, 5, 6, 9, 1, 2, 10, -1},
+   {11, 8, 5, 11, 5, 6, 8, 0, 5, 10, 5, 2, 0, 2, 5, -1},
+   {6, 11, 3, 6, 3, 5, 2, 10, 3, 10, 5, 3, -1, -1, -1, -1},
+   {5, 8, 9, 5, 2, 8, 5, 6, 2, 3, 8, 2, -1, -1, -1, -1},
+   {9, 5, 6, 9, 6, 0, 0, 6, 2, -1, -1, -1, -1, -1, -1, -1},
+   {1, 5, 8, 1, 8, 0, 5, 6, 8, 3, 8, 2, 6, 2, 8, -1},
+   {1, 5, 6, 2, 1, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+   {1, 3, 6, 1, 6, 10, 3, 8, 6, 5, 6, 9, 8, 9, 6, -1},
+   {10, 1, 0, 10, 0, 6, 9, 5, 0, 5, 6, 0, -1, -1, -1, -1},
+   {0, 3, 8, 5, 6, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+   {10, 5, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+   {11, 5, 10, 7, 5, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+   {11, 5, 10, 11, 7, 5, 8, 3, 0, -1, -1, -1, -1, -1, -1, -1},
+   {5, 11, 7, 5, 10, 11, 1, 9, 0, -1, -1, -1, -1, -1, -1, -1},
+   {10, 7, 5, 10, 11, 7, 9, 8, 1, 8, 3, 1, -1, -1, -1, -1},
+   {11, 1, 2, 11, 7, 1, 7, 5, 1, -1, -1, -1, -1, -1, -1, -1},
+   {0, 8, 3, 1, 2, 7, 1, 7, 5, 7, 2, 11, -1, -1, -1, -1},
+   {9, 7, 5, 9, 2, 7, 9, 0, 2, 2, 11, 7, -1, -1, -1, -1},
+   {7, 5, 2, 7, 2, 11, 5, 9, 2, 3, 2, 8, 9, 8, 2, -1},
+   {2, 5, 10, 2, 3, 5, 3, 7, 5, -1, -1, -1, -1, -1, -1, -1},
+   {8, 2, 0, 8, 5, 2, 8, 7, 5, 10, 2, 5, -1, -1, -1, -1},
+   {9, 0, 1, 5, 10, 3, 5, 3, 7, 3, 10, 2, -1, -1, -1, -1},
+   {9, 8, 2, 9, 2, 1, 8, 7, 2, 10, 2, 5, 7, 5, 2, -1},
+   {1, 3, 5, 3, 7, 5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+   {0, 8, 7, 0, 7, 1, 1, 7, 5, -1, -1, -1, -1, -1, -1, -1},
+   {9, 0, 3, 9, 3, 5, 5, 3, 7, -1, -1, -1, -1, -1, -1, -1},
+   {9, 8, 7, 5, 9, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+   {5, 8, 4, 5, 10, 8, 10, 11, 8, -1, -1, -1, -1, -1, -1, -1},
+   {5, 0, 4, 5, 11, 0, 5, 10, 11, 11, 3, 0, -1, -1, -1, -1},
+   {0, 1, 9, 8, 4, 10, 8, 10, 11, 10, 4, 5, -1, -1, -1, -1},
+   {10, 11, 4, 10, 4, 5, 11, 3, 4, 9, 4, 1, 3, 1, 4, -1},
+   {2, 5, 1, 2, 8, 5, 2, 11, 8, 4, 5, 8, -1, -1, -1, -1},
+   {0, 4, 11, 0, 11, 3, 4, 5, 11, 2, 11, 1, 5, 1, 11, -1},
+   {0, 2, 5, 0, 5, 9, 2, 11, 5, 4, 5, 8, 11, 8, 5, -1},
+   {9, 4, 5, 2, 11, 3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+   {2, 5, 10, 3, 5, 2, 3, 4, 5, 3, 8, 4, -1, -1, -1, -1},
+   {5, 10, 2, 5, 2, 4, 4, 2, 0, -1, -1, -1, -1, -1, -1, -1},
+   {3, 10, 2, 3, 5, 10, 3, 8, 5, 4, 5, 8, 0, 1, 9, -1},
+   {5, 10, 2, 5, 2, 4, 1, 9, 2, 9, 4, 2, -1, -1, -1, -1},
+   {8, 4, 5, 8, 5, 3, 3, 5, 1, -1, -1, -1, -1, -1, -1, -1},
+   {0, 4, 5, 1, 0, 5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+   {8, 4, 5, 8, 5, 3, 9, 0, 5, 0, 3, 5, -1, -1, -1, -1},
+   {9, 4, 5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+   {4, 11, 7, 4, 9, 11, 9, 10, 11, -1, -1, -1, -1, -1, -1, -1},
+   {0, 8, 3, 4, 9, 7, 9, 11, 7, 9, 10, 11, -1, -1, -1, -1},
+   {1, 10, 11, 1, 11, 4, 1, 4, 0, 7, 4, 11, -1, -1, -1, -1},
+   {3, 1, 4, 3, 4, 8, 1, 10, 4, 7, 4, 11, 10, 11, 4, -1},
+   {4, 11, 7, 9, 11, 4, 9, 2, 11, 9, 1, 2, -1, -1, -1, -1},
+   {9, 7, 4, 9, 11, 7, 9, 1, 11, 2, 11, 1, 0, 8, 3, -1},
+   {11, 7, 4, 11, 4, 2, 2, 4, 0, -1, -1, -1, -1, -1, -1, -1},
+   {11, 7, 4, 11, 4, 2, 8, 3, 4, 3, 2, 4, -1, -1, -1, -1},
+   {2, 9, 10, 2, 7, 9, 2, 3, 7, 7, 4, 9, -1, -1, -1, -1},
+   {9, 10, 7, 9, 7, 4, 10, 2, 7, 8, 7, 0, 2, 0, 7, -1},
+   {3, 7, 10, 3, 10, 2, 7, 4, 10, 1, 10, 0, 4, 0, 10, -1},
+   {1, 10, 2, 8, 7, 4, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+   {4, 9, 1, 4, 1, 7, 7, 1, 3, -1, -1, -1, -1, -1, -1, -1},
+   {4, 9, 1, 4, 1, 7, 0, 8, 1, 8, 7, 1, -1, -1, -1, -1},
+   {4, 0, 3, 7, 4, 3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+   {4, 8, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+   {9, 10, 8, 10, 11, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+   {3, 0, 9, 3, 9, 11, 11, 9, 10, -1, -1, -1, -1, -1, -1, -1},
+   {0, 1, 10, 0, 10, 8, 8, 10, 11, -1, -1, -1, -1, -1, -1, -1},
+   {3, 1, 10, 11, 3, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+   {1, 2, 11, 1, 11, 9, 9, 11, 8, -1, -1, -1, -1, -1, -1, -1},
+   {3, 0, 9, 3, 9, 11, 1, 2, 9, 2, 11, 9, -1, -1, -1, -1},
+   {0, 2, 11, 8, 0, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+   {3, 2, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+   {2, 3, 8, 2, 8, 10, 10, 8, 9, -1, -1, -1, -1, -1, -1, -1},
+   {9, 10, 2, 0, 9, 2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+   {2, 3, 8, 2, 8, 10, 0, 1, 8, 1, 10, 8, -1, -1, -1, -1},
+   {1, 10, 2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+   {1, 3, 8, 9, 1, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+   {0, 9, 1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+   {0, 3, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+   {-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1}};
+
+
+
+static int
+CompareBlockKeys(const void *data1, const void *data2)
+{
+  // Compare block keys for qsort
+  RNInt64 key1 = *((const RNInt64 *) data1);
+  RNInt64 key2 = *((const RNInt64 *) data2);
+  if (key1 < key2) return -1;
+  else if (key1 > key2) return 1;
+  else return 0;
+}
+
+
+
+struct R3SparseGridVertexTable {
+  // Open-addressing hash table mapping grid edge keys to mesh vertices
+  RNInt64 *keys;
+  R3MeshVertex **vertices;
+  int nentries;
+  int size;
+};
+
+
+
+static R3MeshVertex **
+FindVertexTableEntry(R3SparseGridVertexTable *table, RNInt64 key)
+{
+  // Grow table (keep load factor below 1/2)
+  if (2 * (table->nentries + 1) > table->size) {
+    int old_size = table->size;
+    RNInt64 *old_keys = table->keys;
+    R3MeshVertex **old_vertices = table->vertices;
+    table->size = (old_size > 0) ? 2 * old_size : 4096;
+    table->keys = new RNInt64 [ table->size ];
+    table->vertices = new R3MeshVertex * [ table->size ];
+    for (int i = 0; i < table->size; i++) { table->keys[i] = -1; table->vertices[i] = NULL; }
+    table->nentries = 0;
+    for (int i = 0; i < old_size; i++) {
+      if (old_keys[i] < 0) continue;
+      R3MeshVertex **entry = FindVertexTableEntry(table, old_keys[i]);
+      *entry = old_vertices[i];
+    }
+    if (old_keys) delete [] old_keys;
+    if (old_vertices) delete [] old_vertices;
+  }
+
+  // Find slot with key (linear probing)
+  int mask = table->size - 1;
+  RNUInt64 h = ((RNUInt64) key * 0x9E3779B97F4A7C15ULL) >> 32;
+  int slot = (int) (h & mask);
+  while ((table->keys[slot] >= 0) && (table->keys[slot] != key)) slot = (slot + 1) & mask;
+  if (table->keys[slot] < 0) { table->keys[slot] = key; table->nentries++; }
+  return &table->vertices[slot];
+}
+
+
+
+static R3MeshVertex *
+InterpolatedVertex(const R3SparseGrid *grid, const RNScalar *samples, int ix0, int iy0, int iz0,
+  int bmin[3], int dim, RNScalar isolevel, R3Mesh *mesh, R3SparseGridVertexTable *table)
+{
+  // Find entry for edge in vertex table
+  int ix1 = (dim == 0) ? ix0+1 : ix0;
+  int iy1 = (dim == 1) ? iy0+1 : iy0;
+  int iz1 = (dim == 2) ? iz0+1 : iz0;
+  RNInt64 grid_index = ((RNInt64) iz0 * grid->YResolution() + iy0) * grid->XResolution() + ix0;
+  R3MeshVertex **entry = FindVertexTableEntry(table, 3 * grid_index + dim);
+  if (*entry) return *entry;
+
+  // Create vertex at interpolated position
+  const int ss = R3_SPARSE_GRID_BLOCK_SIZE + 1;
+  RNScalar value0 = samples[((iz0 - bmin[2])*ss + (iy0 - bmin[1]))*ss + (ix0 - bmin[0])];
+  RNScalar value1 = samples[((iz1 - bmin[2])*ss + (iy1 - bmin[1]))*ss + (ix1 - bmin[0])];
+  RNScalar delta0 = fabs(value0 - isolevel);
+  RNScalar delta1 = fabs(value1 - isolevel);
+  RNScalar denom = delta0 + delta1;
+  RNScalar t = (RNIsNotZero(denom)) ? delta0 / denom : 0.5;
+  R3Point p0 = grid->WorldPosition(ix0, iy0, iz0);
+  R3Point p1 = grid->WorldPosition(ix1, iy1, iz1);
+  R3Point p = (1.0-t)*p0 + t*p1;
+  *entry = mesh->CreateVertex(p);
+  return *entry;
+}
+
+
+
+int R3SparseGrid::
+GenerateIsoSurface(RNScalar isolevel, R3Mesh *mesh) const
+{
+  // Check resolution
+  if ((XResolution() < 2) || (YResolution() < 2) || (ZResolution() < 2)) return 1;
+
+  // Find blocks of cells that touch allocated blocks (cells of a block extend one sample into neighbors)
+  const int bs = R3_SPARSE_GRID_BLOCK_SIZE;
+  const int ss = bs + 1;
+  RNInt64 *cell_block_keys = new RNInt64 [ 8 * nblocks + 1 ];
+  int ncell_blocks = 0;
+  for (int b = 0; b < nblocks; b++) {
+    int bx, by, bz;
+    BlockIndices(b, bx, by, bz);
+    for (int dz = 0; dz <= 1; dz++) {
+      if (bz - dz < 0) continue;
+      for (int dy = 0; dy <= 1; dy++) {
+        if (by - dy < 0) continue;
+        for (int dx = 0; dx <= 1; dx++) {
+          if (bx - dx < 0) continue;
+          RNInt64 key = ((RNInt64) (bz - dz) * block_resolution[1] + (by - dy)) * block_resolution[0] + (bx - dx);
+          cell_block_keys[ncell_blocks++] = key;
+        }
+      }
+    }
+  }
+
+  // Sort blocks of cells in z-major order and remove duplicates
+  qsort(cell_block_keys, ncell_blocks, sizeof(RNInt64), CompareBlockKeys);
+  int nunique = 0;
+  for (int i = 0; i < ncell_blocks; i++) {
+    if ((nunique > 0) && (cell_block_keys[nunique-1] == cell_block_keys[i])) continue;
+    cell_block_keys[nunique++] = cell_block_keys[i];
+  }
+  ncell_blocks = nunique;
+
+  // Initialize vertex table
+  R3SparseGridVertexTable table;
+  table.keys = NULL;
+  table.vertices = NULL;
+  table.nentries = 0;
+  table.size = 0;
+
+  // Create faces for every block of cells
+  RNScalar *samples = new RNScalar [ ss * ss * ss ];
+  for (int b = 0; b < ncell_blocks; b++) {
+    RNInt64 key = cell_block_keys[b];
+    int bx = (int) (key % block_resolution[0]);
+    int by = (int) ((key / block_resolution[0]) % block_resolution[1]);
+    int bz = (int) (key / block_resolution[0] / block_resolution[1]);
+    int bmin[3] = { bx*bs, by*bs, bz*bs };
+    int bmax[3];
+    for (int dim = 0; dim < 3; dim++) {
+      bmax[dim] = bmin[dim] + bs;
+      if (bmax[dim] > grid_resolution[dim] - 1) bmax[dim] = grid_resolution[dim] - 1;
+    }
+
+    // Gather samples and check whether block straddles isolevel
+    RNScalar minimum = FLT_MAX;
+    RNScalar maximum = -FLT_MAX;
+    for (int k = bmin[2]; k <= bmax[2]; k++) {
+      for (int j = bmin[1]; j <= bmax[1]; j++) {
+        for (int i = bmin[0]; i <= bmax[0]; i++) {
+          RNScalar value = GridValue(i, j, k);
+          samples[((k - bmin[2])*ss + (j - bmin[1]))*ss + (i - bmin[0])] = value;
+          if (value < minimum) minimum = value;
+          if (value > maximum) maximum = value;
+        }
+      }
+    }
+    if ((minimum >= isolevel) || (maximum < isolevel)) continue;
+
+    // Create faces for cells
+    RNScalar corner_levels[8];
+    for (int iz0 = bmin[2]; iz0 < bmax[2]; iz0++) {
+      for (int iy0 = bmin[1]; iy0 < bmax[1]; iy0++) {
+        for (int ix0 = bmin[0]; ix0 < bmax[0]; ix0++) {
+          // Compute cube corner values
+          const RNScalar *s = &samples[((iz0 - bmin[2])*ss + (iy0 - bmin[1]))*ss + (ix0 - bmin[0])];
+          corner_levels[0] = s[0];
+          corner_levels[1] = s[1];
+          corner_levels[2] = s[ss*ss + 1];
+          corner_levels[3] = s[ss*ss];
+          corner_levels[4] = s[ss];
+          corner_levels[5] = s[ss + 1];
+          corner_levels[6] = s[ss*ss + ss + 1];
+          corner_levels[7] = s[ss*ss + ss];
+
+          // Skip cubes with unknown values
+          RNBoolean unknown = FALSE;
+          for (int c = 0; c < 8; c++) {
+            if (corner_levels[c] == R2_GRID_UNKNOWN_VALUE) { unknown = TRUE; break; }
+          }
+          if (unknown) continue;
+
+          // Compute cube index
+          int cubeindex = 0;
+          for (int c = 0; c < 8; c++) {
+            if (corner_levels[c] < isolevel) cubeindex |= (1 << c);
+          }
+
+          // Check if cube is entirely above/below the surface
+          int edges = marching_cubes_edge_table[cubeindex];
+          if (edges == 0) continue;
+
+          // Find the vertices where the surface intersects the cube
+          R3MeshVertex *vertlist[12];
+          if (edges & 1) vertlist[0] = InterpolatedVertex(this, samples, ix0, iy0, iz0, bmin, 0, isolevel, mesh, &table);
+          if (edges & 2) vertlist[1] = InterpolatedVertex(this, samples, ix0+1, iy0, iz0, bmin, 2, isolevel, mesh, &table);
+          if (edges & 4) vertlist[2] = InterpolatedVertex(this, samples, ix0, iy0, iz0+1, bmin, 0, isolevel, mesh, &table);
+          if (edges & 8) vertlist[3] = InterpolatedVertex(this, samples, ix0, iy0, iz0, bmin, 2, isolevel, mesh, &table);
+          if (edges & 16) vertlist[4] = InterpolatedVertex(this, samples, ix0, iy0+1, iz0, bmin, 0, isolevel, mesh, &table);
+          if (edges & 32) vertlist[5] = InterpolatedVertex(this, samples, ix0+1, iy0+1, iz0, bmin, 2, isolevel, mesh, &table);
+          if (edges & 64) vertlist[6] = InterpolatedVertex(this, samples, ix0, iy0+1, iz0+1, bmin, 0, isolevel, mesh, &table);
+          if (edges & 128) vertlist[7] = InterpolatedVertex(this, samples, ix0, iy0+1, iz0, bmin, 2, isolevel, mesh, &table);
+          if (edges & 256) vertlist[8] = InterpolatedVertex(this, samples, ix0, iy0, iz0, bmin, 1, isolevel, mesh, &table);
+          if (edges & 512) vertlist[9] = InterpolatedVertex(this, samples, ix0+1, iy0, iz0, bmin, 1, isolevel, mesh, &table);
+          if (edges & 1024) vertlist[10] = InterpolatedVertex(this, samples, ix0+1, iy0, iz0+1, bmin, 1, isolevel, mesh, &table);
+          if (edges & 2048) vertlist[11] = InterpolatedVertex(this, samples, ix0, iy0, iz0+1, bmin, 1, isolevel, mesh, &table);
+
+          // Create the triangles
+          for (int i = 0; marching_cubes_triangle_table[cubeindex][i] != -1; i+=3) {
+            R3MeshVertex *v0 = vertlist[marching_cubes_triangle_table[cubeindex][i  ]];
+            R3MeshVertex *v1 = vertlist[marching_cubes_triangle_table[cubeindex][i+1]];
+            R3MeshVertex *v2 = vertlist[marching_cubes_triangle_table[cubeindex][i+2]];
+            mesh->CreateFace(v0, v1, v2);
+          }
+        }
+      }
+    }
+  }
+
+  // Delete temporary memory
+  if (table.keys) delete [] table.keys;
+  if (table.vertices) delete [] table.vertices;
+  delete [] cell_block_keys;
+  delete [] samples;
+
+  // Return success
+  return 1;
+}
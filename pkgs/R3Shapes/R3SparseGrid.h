@@ -0,0 +1,441 @@
+// Header file for GAPS sparse scalar grid class
+
+
+
+////////////////////////////////////////////////////////////////////////
+// NOTE:
+// Grid values are stored in 8x8x8 blocks that are allocated on demand
+// and found through a hash table.  Values in unallocated blocks are
+// equal to the background value.  Functions that allocate blocks
+// (SetGridValue, rasterization, etc.) are not thread-safe.
+// GenerateIsoSurface skips cells with a corner equal to
+// R2_GRID_UNKNOWN_VALUE, so unobserved regions can be left unknown.
+////////////////////////////////////////////////////////////////////////
+
+
+
+// Class definition
+
+class R3SparseGrid {
+public:
+  // Constructors
+  R3SparseGrid(int xresolution = 0, int yresolution = 0, int zresolution = 0, RNScalar background_value = 0);
+  R3SparseGrid(int xresolution, int yresolution, int zresolution, const R3Box& bbox, RNScalar background_value = 0);
+  R3SparseGrid(const R3Box& bbox, RNLength spacing, int min_resolution = 0, int max_resolution = 0, RNScalar background_value = 0);
+  R3SparseGrid(const R3Grid& grid, RNScalar background_value = 0);
+  R3SparseGrid(const R3SparseGrid& grid);
+  ~R3SparseGrid(void);
+
+  // Grid property functions
+  int XResolution(void) const;
+  int YResolution(void) const;
+  int ZResolution(void) const;
+  int Resolution(RNDimension dim) const;
+  RNScalar BackgroundValue(void) const;
+  RNInterval Range(void) const;
+  R3Box GridBox(void) const;
+  R3Box WorldBox(void) const;
+
+  // Block property functions
+  int NBlocks(void) const;
+  int NAllocatedEntries(void) const;
+  RNBoolean IsAllocated(int i, int j, int k) const;
+
+  // Transformation property functions
+  const R3Affine& WorldToGridTransformation(void) const;
+  const R3Affine& GridToWorldTransformation(void) const;
+  RNScalar WorldToGridScaleFactor(void) const;
+  RNScalar GridToWorldScaleFactor(void) const;
+
+  // Grid value access functions
+  RNScalar GridValue(int i, int j, int k) const;
+  RNScalar GridValue(RNCoord x, RNCoord y, RNCoord z) const;
+  RNScalar GridValue(const R3Point& grid_point) const;
+  RNScalar WorldValue(RNCoord x, RNCoord y, RNCoord z) const;
+  RNScalar WorldValue(const R3Point& world_point) const;
+
+  // Grid manipulation functions
+  void Clear(RNScalar background_value = 0);
+  void Copy(const R3Grid& grid);
+  void Prune(void);
+  void SetGridValue(int i, int j, int k, RNScalar value);
+  void AddGridValue(int i, int j, int k, RNScalar value);
+  void SquaredDistanceTransform(RNLength grid_band_width);
+  void SignedDistanceTransform(RNLength grid_band_width);
+
+  // Assignment operator
+  R3SparseGrid& operator=(const R3SparseGrid& grid);
+
+  // Rasterization functions
+  void RasterizeGridValue(int ix, int iy, int iz, RNScalar value, int operation = 0);
+  void RasterizeGridPoint(RNCoord x, RNCoord y, RNCoord z, RNScalar value, int operation = 0);
+  void RasterizeWorldPoint(RNCoord x, RNCoord y, RNCoord z, RNScalar value, int operation = 0);
+  void RasterizeGridPoint(const R3Point& point, RNScalar value, int operation = 0);
+  void RasterizeWorldPoint(const R3Point& point, RNScalar value, int operation = 0);
+  void RasterizeGridSpan(const int p1[3], const int p2[3], RNScalar value, int operation = 0);
+  void RasterizeGridTriangle(const int p1[3], const int p2[3], const int p3[3], RNScalar value, int operation = 0);
+  void RasterizeGridTriangle(const R3Point& p1, const R3Point& p2, const R3Point& p3, RNScalar value, int operation = 0);
+  void RasterizeWorldTriangle(const R3Point& p1, const R3Point& p2, const R3Point& p3, RNScalar value, int operation = 0);
+  void RasterizeGridSphere(const R3Point& center, RNLength radius, RNScalar value, RNBoolean solid = TRUE, int operation = 0);
+  void RasterizeWorldSphere(const R3Point& center, RNLength radius, RNScalar value, RNBoolean solid = TRUE, int operation = 0);
+
+  // Transformation manipulation functions
+  void SetWorldToGridTransformation(const R3Affine& affine);
+  void SetWorldToGridTransformation(const R3Box& world_box);
+
+  // Transformation utility functions
+  R3Point WorldPosition(const R3Point& grid_point) const;
+  R3Point GridPosition(const R3Point& world_point) const;
+  R3Point WorldPosition(RNCoord x, RNCoord y, RNCoord z) const;
+  R3Point GridPosition(RNCoord x, RNCoord y, RNCoord z) const;
+
+  // Conversion functions
+  R3Grid *DenseGrid(void) const;
+
+  // Utility functions
+  int GenerateIsoSurface(RNScalar isolevel, R3Mesh *mesh) const;
+
+public:
+  // Block access functions (for use by algorithms that traverse blocks)
+  RNScalar *BlockValues(int block_index) const;
+  void BlockIndices(int block_index, int& bx, int& by, int& bz) const;
+  int FindBlock(int bx, int by, int bz) const;
+  int AllocateBlock(int bx, int by, int bz);
+
+private:
+  void InitializeBlocks(void);
+  void DeleteBlocks(void);
+  void RehashBlocks(int hash_size);
+
+private:
+  R3Affine grid_to_world_transform;
+  R3Affine world_to_grid_transform;
+  RNScalar world_to_grid_scale_factor;
+  RNScalar grid_to_world_scale_factor;
+  RNScalar background_value;
+  int grid_resolution[3];
+  int block_resolution[3];
+  RNScalar **block_values;
+  RNInt64 *block_keys;
+  int nblocks;
+  int nallocated_blocks;
+  int *hash_table;
+  int hash_size;
+};
+
+
+
+// Useful constants
+
+const int R3_SPARSE_GRID_BLOCK_SIZE = 8;
+const int R3_SPARSE_GRID_BLOCK_ENTRIES = 512;
+
+
+
+// Inline functions
+
+inline int R3SparseGrid::
+XResolution(void) const
+{
+  // Return resolution in X dimension
+  return grid_resolution[RN_X];
+}
+
+
+
+inline int R3SparseGrid::
+YResolution(void) const
+{
+  // Return resolution in Y dimension
+  return grid_resolution[RN_Y];
+}
+
+
+
+inline int R3SparseGrid::
+ZResolution(void) const
+{
+  // Return resolution in Z dimension
+  return grid_resolution[RN_Z];
+}
+
+
+
+inline int R3SparseGrid::
+Resolution(RNDimension dim) const
+{
+  // Return resolution in dimension
+  assert((0 <= dim) && (dim <= 2));
+  return grid_resolution[dim];
+}
+
+
+
+inline RNScalar R3SparseGrid::
+BackgroundValue(void) const
+{
+  // Return value of entries in unallocated blocks
+  return background_value;
+}
+
+
+
+inline int R3SparseGrid::
+NBlocks(void) const
+{
+  // Return number of allocated blocks
+  return nblocks;
+}
+
+
+
+inline int R3SparseGrid::
+NAllocatedEntries(void) const
+{
+  // Return number of entries in allocated blocks
+  return nblocks * R3_SPARSE_GRID_BLOCK_ENTRIES;
+}
+
+
+
+inline R3Box R3SparseGrid::
+GridBox(void) const
+{
+  // Return bounding box in grid coordinates
+  return R3Box(0, 0, 0, grid_resolution[0]-1, grid_resolution[1]-1, grid_resolution[2]-1);
+}
+
+
+
+inline R3Box R3SparseGrid::
+WorldBox(void) const
+{
+  // Return bounding box in world coordinates
+  R3Point p1(0, 0, 0);
+  R3Point p2(grid_resolution[0]-1, grid_resolution[1]-1, grid_resolution[2]-1);
+  return R3Box(WorldPosition(p1), WorldPosition(p2));
+}
+
+
+
+inline const R3Affine& R3SparseGrid::
+WorldToGridTransformation(void) const
+{
+  // Return transformation from world coordinates to grid coordinates
+  return world_to_grid_transform;
+}
+
+
+
+inline const R3Affine& R3SparseGrid::
+GridToWorldTransformation(void) const
+{
+  // Return transformation from grid coordinates to world coordinates
+  return grid_to_world_transform;
+}
+
+
+
+inline RNScalar R3SparseGrid::
+WorldToGridScaleFactor(void) const
+{
+  // Return scale factor from world coordinates to grid coordinates
+  return world_to_grid_scale_factor;
+}
+
+
+
+inline RNScalar R3SparseGrid::
+GridToWorldScaleFactor(void) const
+{
+  // Return scale factor from grid coordinates to world coordinates
+  return grid_to_world_scale_factor;
+}
+
+
+
+inline RNScalar *R3SparseGrid::
+BlockValues(int block_index) const
+{
+  // Return values of allocated block (indexed by (k*8 + j)*8 + i)
+  assert((0 <= block_index) && (block_index < nblocks));
+  return block_values[block_index];
+}
+
+
+
+inline void R3SparseGrid::
+BlockIndices(int block_index, int& bx, int& by, int& bz) const
+{
+  // Return block coordinates of allocated block
+  assert((0 <= block_index) && (block_index < nblocks));
+  RNInt64 key = block_keys[block_index];
+  bx = (int) (key % block_resolution[0]);
+  key /= block_resolution[0];
+  by = (int) (key % block_resolution[1]);
+  bz = (int) (key / block_resolution[1]);
+}
+
+
+
+inline int R3SparseGrid::
+FindBlock(int bx, int by, int bz) const
+{
+  // Return index of allocated block (or -1 if not allocated)
+  if (nblocks == 0) return -1;
+  RNInt64 key = ((RNInt64) bz * block_resolution[1] + by) * block_resolution[0] + bx;
+  RNUInt64 h = ((RNUInt64) key * 0x9E3779B97F4A7C15ULL) >> 32;
+  int mask = hash_size - 1;
+  for (int slot = (int) (h & mask); hash_table[slot] >= 0; slot = (slot + 1) & mask) {
+    if (block_keys[hash_table[slot]] == key) return hash_table[slot];
+  }
+  return -1;
+}
+
+
+
+inline RNBoolean R3SparseGrid::
+IsAllocated(int i, int j, int k) const
+{
+  // Return whether entry is stored in an allocated block
+  return (FindBlock(i / R3_SPARSE_GRID_BLOCK_SIZE, j / R3_SPARSE_GRID_BLOCK_SIZE, k / R3_SPARSE_GRID_BLOCK_SIZE) >= 0);
+}
+
+
+
+inline RNScalar R3SparseGrid::
+GridValue(int i, int j, int k) const
+{
+  // Return value at grid point
+  assert((0 <= i) && (i < XResolution()));
+  assert((0 <= j) && (j < YResolution()));
+  assert((0 <= k) && (k < ZResolution()));
+  const int bs = R3_SPARSE_GRID_BLOCK_SIZE;
+  int block_index = FindBlock(i / bs, j / bs, k / bs);
+  if (block_index < 0) return background_value;
+  return block_values[block_index][((k % bs) * bs + (j % bs)) * bs + (i % bs)];
+}
+
+
+
+inline RNScalar R3SparseGrid::
+GridValue(const R3Point& point) const
+{
+  // Return value at grid point
+  return GridValue(point[0], point[1], point[2]);
+}
+
+
+
+inline RNScalar R3SparseGrid::
+WorldValue(const R3Point& point) const
+{
+  // Return value at world point
+  return GridValue(GridPosition(point));
+}
+
+
+
+inline RNScalar R3SparseGrid::
+WorldValue(RNCoord x, RNCoord y, RNCoord z) const
+{
+  // Return value at world point
+  return GridValue(GridPosition(x, y, z));
+}
+
+
+
+inline void R3SparseGrid::
+RasterizeGridPoint(const R3Point& point, RNScalar value, int operation)
+{
+  // Splat value at grid point
+  RasterizeGridPoint(point[0], point[1], point[2], value, operation);
+}
+
+
+
+inline void R3SparseGrid::
+RasterizeWorldPoint(RNCoord x, RNCoord y, RNCoord z, RNScalar value, int operation)
+{
+  // Splat value at world point
+  RasterizeGridPoint(GridPosition(x, y, z), value, operation);
+}
+
+
+
+inline void R3SparseGrid::
+RasterizeWorldPoint(const R3Point& world_point, RNScalar value, int operation)
+{
+  // Splat value at world point
+  RasterizeGridPoint(GridPosition(world_point), value, operation);
+}
+
+
+
+inline void R3SparseGrid::
+RasterizeGridTriangle(const R3Point& p1, const R3Point& p2, const R3Point& p3, RNScalar value, int operation)
+{
+  // Splat value everywhere inside grid triangle
+  int i1[3] = { (int) (p1[0] + 0.5), (int) (p1[1] + 0.5), (int) (p1[2] + 0.5) };
+  int i2[3] = { (int) (p2[0] + 0.5), (int) (p2[1] + 0.5), (int) (p2[2] + 0.5) };
+  int i3[3] = { (int) (p3[0] + 0.5), (int) (p3[1] + 0.5), (int) (p3[2] + 0.5) };
+  RasterizeGridTriangle(i1, i2, i3, value, operation);
+}
+
+
+
+inline void R3SparseGrid::
+RasterizeWorldTriangle(const R3Point& p1, const R3Point& p2, const R3Point& p3, RNScalar value, int operation)
+{
+  // Splat value everywhere inside world triangle
+  RasterizeGridTriangle(GridPosition(p1), GridPosition(p2), GridPosition(p3), value, operation);
+}
+
+
+
+inline void R3SparseGrid::
+RasterizeWorldSphere(const R3Point& center, RNLength radius, RNScalar value, RNBoolean solid, int operation)
+{
+  // Splat value everywhere inside world sphere
+  RasterizeGridSphere(GridPosition(center), radius * WorldToGridScaleFactor(), value, solid, operation);
+}
+
+
+
+inline R3Point R3SparseGrid::
+WorldPosition(const R3Point& grid_point) const
+{
+  // Transform point from grid coordinates to world coordinates
+  return WorldPosition(grid_point[0], grid_point[1], grid_point[2]);
+}
+
+
+
+inline R3Point R3SparseGrid::
+GridPosition(const R3Point& world_point) const
+{
+  // Transform point from world coordinates to grid coordinates
+  return GridPosition(world_point[0], world_point[1], world_point[2]);
+}
+
+
+
+inline R3Point R3SparseGrid::
+WorldPosition(RNCoord x, RNCoord y, RNCoord z) const
+{
+  // Transform point from grid coordinates to world coordinates
+  R3Point world_point(x, y, z);
+  world_point.Transform(grid_to_world_transform);
+  return world_point;
+}
+
+
+
+inline R3Point R3SparseGrid::
+GridPosition(RNCoord x, RNCoord y, RNCoord z) const
+{
+  // Transform point from world coordinates to grid coordinates
+  R3Point grid_point(x, y, z);
+  grid_point.Transform(world_to_grid_transform);
+  return grid_point;
+}
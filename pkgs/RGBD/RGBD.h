@@ -21,6 +21,10 @@
 class RGBDImage;
 class RGBDSurface;
 class RGBDConfiguration;
+class RGBDConfigurationStream;
+class RGBDFusion;
+class RGBDRemapTable;
+struct RGBDChannelCacheEntry;
 
 
 
@@ -54,9 +58,12 @@ class RGBDConfiguration;
 ////////////////////////////////////////////////////////////////////////
 
 #include "RGBDCamera.h"
+#include "RGBDRemapTable.h"
 #include "RGBDImage.h"
 #include "RGBDSurface.h"
 #include "RGBDConfiguration.h"
+#include "RGBDConfigurationStream.h"
+#include "RGBDFusion.h"
 #include "RGBDTransform.h"
 #include "RGBDUtil.h"
 #include "RGBDSegmentation.h"
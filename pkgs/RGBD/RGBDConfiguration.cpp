@@ -12,6 +12,33 @@
 
 
 
+////////////////////////////////////////////////////////////////////////
+// Channel cache entry
+////////////////////////////////////////////////////////////////////////
+
+struct RGBDChannelCacheEntry {
+  RGBDImage *image;
+  int channel_index;
+  int width, height;
+  unsigned short *integer_depths;
+  float *float_depths;
+  RNScalar *double_depths;
+  R2Image *color_image;
+  unsigned long long nbytes;
+  RGBDChannelCacheEntry *prev;
+  RGBDChannelCacheEntry *next;
+};
+
+
+
+////////////////////////////////////////////////////////////////////////
+// Useful constants
+////////////////////////////////////////////////////////////////////////
+
+// Number of images decoded in parallel by ReadChannels
+static const int RGBD_READ_BATCH_SIZE = 16;
+
+
 
 ////////////////////////////////////////////////////////////////////////
 // Constructors/destructors
@@ -25,7 +52,12 @@ RGBDConfiguration(void)
     depth_directory(NULL),
     texture_directory(NULL),
     dataset_format(NULL),
-    world_bbox(FLT_MAX, FLT_MAX, FLT_MAX, -FLT_MAX, -FLT_MAX, -FLT_MAX)
+    world_bbox(FLT_MAX, FLT_MAX, FLT_MAX, -FLT_MAX, -FLT_MAX, -FLT_MAX),
+    cache_head(NULL),
+    cache_tail(NULL),
+    cache_size(0),
+    max_cache_size(0),
+    cache_double_precision_depth(FALSE)
 {
 }
 
@@ -38,6 +70,9 @@ RGBDConfiguration::
   while (NImages() > 0) delete Image(NImages()-1);
   while (NSurfaces() > 0) delete Surface(NSurfaces()-1);
 
+  // Delete channel cache
+  EmptyChannelCache();
+
   // Delete directory names
   if (color_directory) free(color_directory);
   if (depth_directory) free(depth_directory);
@@ -106,6 +141,9 @@ RemoveImage(RGBDImage *image)
   assert(image->configuration_index >= 0);
   assert(images.Kth(image->configuration_index) == image);
 
+  // Remove decoded channels from cache
+  UncacheImage(image);
+
   // Remove image from configuration
   RNArrayEntry *entry = images.KthEntry(image->configuration_index);
   RGBDImage *tail = images.Tail();
@@ -509,16 +547,8 @@ int RGBDConfiguration::
 ReadChannels(void)
 {
   // Read images
-  for (int i = 0; i < NImages(); i++) {
-    RGBDImage *image = Image(i);
-    image->ReadChannels();
-  }
-
-  // Read surfaces
-  for (int i = 0; i < NSurfaces(); i++) {
-    RGBDSurface *surface = Surface(i);
-    surface->ReadChannels();
-  }
+  if (!ReadColorChannels()) return 0;
+  if (!ReadDepthChannels()) return 0;
 
   // Return success
   return 1;
@@ -550,12 +580,39 @@ ReleaseChannels(void)
 int RGBDConfiguration::
 ReadDepthChannels(void)
 {
-  // Read images
-  for (int i = 0; i < NImages(); i++) {
-    RGBDImage *image = Image(i);
-    image->ReadDepthChannel();
+  // Allocate temporary images
+  R2Grid **depth_images = new R2Grid * [ RGBD_READ_BATCH_SIZE ];
+
+  // Read images in batches, decoding files in parallel
+  for (int i0 = 0; i0 < NImages(); i0 += RGBD_READ_BATCH_SIZE) {
+    int n = (i0 + RGBD_READ_BATCH_SIZE <= NImages()) ? RGBD_READ_BATCH_SIZE : NImages() - i0;
+
+    // Decode images that are not already resident
+#pragma omp parallel for schedule(dynamic)
+    for (int k = 0; k < n; k++) {
+      RGBDImage *image = Image(i0 + k);
+      depth_images[k] = NULL;
+      if (image->depth_resident_count > 0) continue;
+      R2Grid *depth_image = new R2Grid();
+      if (!ReadCachedDepthImage(image, *depth_image)) {
+        if (!image->ReadDepthImage(*depth_image)) { delete depth_image; continue; }
+        CacheDepthImage(image, *depth_image);
+      }
+      image->ProcessDepthImage(*depth_image);
+      depth_images[k] = depth_image;
+    }
+
+    // Create depth channels in order
+    for (int k = 0; k < n; k++) {
+      RGBDImage *image = Image(i0 + k);
+      if (!depth_images[k]) image->ReadDepthChannel();
+      else { image->CreateDepthChannel(*depth_images[k]); delete depth_images[k]; }
+    }
   }
 
+  // Delete temporary images
+  delete [] depth_images;
+
   // Return success
   return 1;
 }
@@ -580,12 +637,38 @@ ReleaseDepthChannels(void)
 int RGBDConfiguration::
 ReadColorChannels(void)
 {
-  // Read images
-  for (int i = 0; i < NImages(); i++) {
-    RGBDImage *image = Image(i);
-    image->ReadColorChannels();
+  // Allocate temporary images
+  R2Image **color_images = new R2Image * [ RGBD_READ_BATCH_SIZE ];
+
+  // Read images in batches, decoding files in parallel
+  for (int i0 = 0; i0 < NImages(); i0 += RGBD_READ_BATCH_SIZE) {
+    int n = (i0 + RGBD_READ_BATCH_SIZE <= NImages()) ? RGBD_READ_BATCH_SIZE : NImages() - i0;
+
+    // Decode images that are not already resident
+#pragma omp parallel for schedule(dynamic)
+    for (int k = 0; k < n; k++) {
+      RGBDImage *image = Image(i0 + k);
+      color_images[k] = NULL;
+      if (image->color_resident_count > 0) continue;
+      R2Image *color_image = new R2Image();
+      if (!ReadCachedColorImage(image, *color_image)) {
+        if (!image->ReadColorImage(*color_image)) { delete color_image; continue; }
+        CacheColorImage(image, *color_image);
+      }
+      color_images[k] = color_image;
+    }
+
+    // Create color channels in order
+    for (int k = 0; k < n; k++) {
+      RGBDImage *image = Image(i0 + k);
+      if (!color_images[k]) image->ReadColorChannels();
+      else { image->CreateColorChannels(*color_images[k]); delete color_images[k]; }
+    }
   }
 
+  // Delete temporary images
+  delete [] color_images;
+
   // Read surfaces
   for (int i = 0; i < NSurfaces(); i++) {
     RGBDSurface *surface = Surface(i);
@@ -619,6 +702,335 @@ ReleaseColorChannels(void)
 
 
 
+////////////////////////////////////////////////////////////////////////
+// Channel cache functions
+////////////////////////////////////////////////////////////////////////
+
+void RGBDConfiguration::
+SetChannelCacheSize(unsigned long long max_bytes, RNBoolean double_precision_depth)
+{
+  // Empty cache if depth precision changes
+  if (double_precision_depth != cache_double_precision_depth) EmptyChannelCache();
+
+  // Set parameters
+  max_cache_size = max_bytes;
+  cache_double_precision_depth = double_precision_depth;
+
+  // Evict least recently used entries
+  while (cache_head && (cache_size > max_cache_size)) DeleteCacheEntry(cache_head);
+}
+
+
+
+int RGBDConfiguration::
+PrefetchChannels(int first_image_index, int nimages)
+{
+  // Prefetch all channels
+  if (!PrefetchColorChannels(first_image_index, nimages)) return 0;
+  if (!PrefetchDepthChannels(first_image_index, nimages)) return 0;
+  return 1;
+}
+
+
+
+int RGBDConfiguration::
+PrefetchDepthChannels(int first_image_index, int nimages)
+{
+  // Check cache
+  if (max_cache_size == 0) return 0;
+
+  // Get range of images
+  if (first_image_index < 0) first_image_index = 0;
+  int end_image_index = (nimages < 0) ? NImages() : first_image_index + nimages;
+  if (end_image_index > NImages()) end_image_index = NImages();
+
+  // Decode images into cache in parallel (stop once the cache is full,
+  // so that prefetched images do not evict each other)
+#pragma omp parallel for schedule(dynamic)
+  for (int i = first_image_index; i < end_image_index; i++) {
+    RGBDImage *image = Image(i);
+    RNBoolean skip = FALSE;
+#pragma omp critical(RGBDChannelCache)
+    skip = image->depth_cache_entry || (cache_size >= max_cache_size);
+    if (skip || (image->depth_resident_count > 0)) continue;
+    R2Grid depth_image;
+    if (!image->ReadDepthImage(depth_image)) continue;
+    CacheDepthImage(image, depth_image);
+  }
+
+  // Return success
+  return 1;
+}
+
+
+
+int RGBDConfiguration::
+PrefetchColorChannels(int first_image_index, int nimages)
+{
+  // Check cache
+  if (max_cache_size == 0) return 0;
+
+  // Get range of images
+  if (first_image_index < 0) first_image_index = 0;
+  int end_image_index = (nimages < 0) ? NImages() : first_image_index + nimages;
+  if (end_image_index > NImages()) end_image_index = NImages();
+
+  // Decode images into cache in parallel (stop once the cache is full,
+  // so that prefetched images do not evict each other)
+#pragma omp parallel for schedule(dynamic)
+  for (int i = first_image_index; i < end_image_index; i++) {
+    RGBDImage *image = Image(i);
+    RNBoolean skip = FALSE;
+#pragma omp critical(RGBDChannelCache)
+    skip = image->color_cache_entry || (cache_size >= max_cache_size);
+    if (skip || (image->color_resident_count > 0)) continue;
+    R2Image color_image;
+    if (!image->ReadColorImage(color_image)) continue;
+    CacheColorImage(image, color_image);
+  }
+
+  // Return success
+  return 1;
+}
+
+
+
+void RGBDConfiguration::
+EmptyChannelCache(void)
+{
+  // Delete all entries
+  while (cache_head) DeleteCacheEntry(cache_head);
+}
+
+
+
+int RGBDConfiguration::
+ReadCachedDepthImage(RGBDImage *image, R2Grid& depth_image)
+{
+  // Check cache
+  if (max_cache_size == 0) return 0;
+
+  // Copy depths from cache entry
+  int found = 0;
+#pragma omp critical(RGBDChannelCache)
+  {
+    RGBDChannelCacheEntry *entry = image->depth_cache_entry;
+    if (entry) {
+      // Copy depths
+      depth_image = R2Grid(entry->width, entry->height);
+      int npixels = entry->width * entry->height;
+      if (entry->integer_depths) {
+        for (int i = 0; i < npixels; i++) depth_image.SetGridValue(i, entry->integer_depths[i]);
+      }
+      else if (entry->float_depths) {
+        for (int i = 0; i < npixels; i++) depth_image.SetGridValue(i, entry->float_depths[i]);
+      }
+      else {
+        for (int i = 0; i < npixels; i++) depth_image.SetGridValue(i, entry->double_depths[i]);
+      }
+
+      // Mark entry as most recently used
+      UnlinkCacheEntry(entry);
+      LinkCacheEntry(entry);
+      found = 1;
+    }
+  }
+
+  // Return whether found
+  return found;
+}
+
+
+
+int RGBDConfiguration::
+ReadCachedColorImage(RGBDImage *image, R2Image& color_image)
+{
+  // Check cache
+  if (max_cache_size == 0) return 0;
+
+  // Copy pixels from cache entry
+  int found = 0;
+#pragma omp critical(RGBDChannelCache)
+  {
+    RGBDChannelCacheEntry *entry = image->color_cache_entry;
+    if (entry) {
+      // Copy pixels
+      color_image = *(entry->color_image);
+
+      // Mark entry as most recently used
+      UnlinkCacheEntry(entry);
+      LinkCacheEntry(entry);
+      found = 1;
+    }
+  }
+
+  // Return whether found
+  return found;
+}
+
+
+
+void RGBDConfiguration::
+CacheDepthImage(RGBDImage *image, const R2Grid& depth_image)
+{
+  // Check cache
+  if (max_cache_size == 0) return;
+  int npixels = depth_image.NEntries();
+  if (npixels == 0) return;
+
+  // Check if values are 16-bit integers (e.g., read from a png file)
+  const RNScalar *depths = depth_image.GridValues();
+  RNBoolean integer = TRUE;
+  for (int i = 0; i < npixels; i++) {
+    RNScalar depth = depths[i];
+    if ((depth < 0) || (depth > 65535) || (depth != (int) depth)) { integer = FALSE; break; }
+  }
+
+  // Check size
+  unsigned long long nbytes = sizeof(RGBDChannelCacheEntry);
+  if (integer) nbytes += (unsigned long long) npixels * sizeof(unsigned short);
+  else if (cache_double_precision_depth) nbytes += (unsigned long long) npixels * sizeof(RNScalar);
+  else nbytes += (unsigned long long) npixels * sizeof(float);
+  if (nbytes > max_cache_size) return;
+
+  // Create entry (depths are stored as 16-bit integers if that is
+  // lossless, and otherwise in single precision unless requested otherwise)
+  RGBDChannelCacheEntry *entry = new RGBDChannelCacheEntry();
+  entry->image = image;
+  entry->channel_index = RGBD_DEPTH_CHANNEL;
+  entry->width = depth_image.XResolution();
+  entry->height = depth_image.YResolution();
+  entry->integer_depths = NULL;
+  entry->float_depths = NULL;
+  entry->double_depths = NULL;
+  entry->color_image = NULL;
+  entry->nbytes = nbytes;
+  entry->prev = entry->next = NULL;
+  if (integer) {
+    entry->integer_depths = new unsigned short [ npixels ];
+    for (int i = 0; i < npixels; i++) entry->integer_depths[i] = (unsigned short) depths[i];
+  }
+  else if (cache_double_precision_depth) {
+    entry->double_depths = new RNScalar [ npixels ];
+    for (int i = 0; i < npixels; i++) entry->double_depths[i] = depths[i];
+  }
+  else {
+    entry->float_depths = new float [ npixels ];
+    for (int i = 0; i < npixels; i++) entry->float_depths[i] = depths[i];
+  }
+
+  // Insert entry as most recently used, and evict least recently used entries
+#pragma omp critical(RGBDChannelCache)
+  {
+    if (image->depth_cache_entry) DeleteCacheEntry(image->depth_cache_entry);
+    image->depth_cache_entry = entry;
+    LinkCacheEntry(entry);
+    while (cache_head && (cache_size > max_cache_size)) DeleteCacheEntry(cache_head);
+  }
+}
+
+
+
+void RGBDConfiguration::
+CacheColorImage(RGBDImage *image, const R2Image& color_image)
+{
+  // Check cache
+  if (max_cache_size == 0) return;
+  if ((color_image.Width() == 0) || (color_image.Height() == 0)) return;
+  unsigned long long nbytes = sizeof(RGBDChannelCacheEntry) + sizeof(R2Image);
+  nbytes += (unsigned long long) color_image.RowSize() * color_image.Height();
+  if (nbytes > max_cache_size) return;
+
+  // Create entry (pixels are stored with 8 bits per component, as read)
+  RGBDChannelCacheEntry *entry = new RGBDChannelCacheEntry();
+  entry->image = image;
+  entry->channel_index = RGBD_RED_CHANNEL;
+  entry->width = color_image.Width();
+  entry->height = color_image.Height();
+  entry->integer_depths = NULL;
+  entry->float_depths = NULL;
+  entry->double_depths = NULL;
+  entry->color_image = new R2Image(color_image);
+  entry->nbytes = nbytes;
+  entry->prev = entry->next = NULL;
+
+  // Insert entry as most recently used, and evict least recently used entries
+#pragma omp critical(RGBDChannelCache)
+  {
+    if (image->color_cache_entry) DeleteCacheEntry(image->color_cache_entry);
+    image->color_cache_entry = entry;
+    LinkCacheEntry(entry);
+    while (cache_head && (cache_size > max_cache_size)) DeleteCacheEntry(cache_head);
+  }
+}
+
+
+
+void RGBDConfiguration::
+UncacheImage(RGBDImage *image)
+{
+  // Delete cache entries for image
+#pragma omp critical(RGBDChannelCache)
+  {
+    if (image->depth_cache_entry) DeleteCacheEntry(image->depth_cache_entry);
+    if (image->color_cache_entry) DeleteCacheEntry(image->color_cache_entry);
+  }
+}
+
+
+
+void RGBDConfiguration::
+LinkCacheEntry(RGBDChannelCacheEntry *entry)
+{
+  // Insert entry at tail of list
+  entry->prev = cache_tail;
+  entry->next = NULL;
+  if (cache_tail) cache_tail->next = entry;
+  else cache_head = entry;
+  cache_tail = entry;
+
+  // Update cache size
+  cache_size += entry->nbytes;
+}
+
+
+
+void RGBDConfiguration::
+UnlinkCacheEntry(RGBDChannelCacheEntry *entry)
+{
+  // Remove entry from list
+  if (entry->prev) entry->prev->next = entry->next;
+  else cache_head = entry->next;
+  if (entry->next) entry->next->prev = entry->prev;
+  else cache_tail = entry->prev;
+  entry->prev = entry->next = NULL;
+
+  // Update cache size
+  cache_size -= entry->nbytes;
+}
+
+
+
+void RGBDConfiguration::
+DeleteCacheEntry(RGBDChannelCacheEntry *entry)
+{
+  // Remove entry from list
+  UnlinkCacheEntry(entry);
+
+  // Remove entry from image
+  if (entry->channel_index == RGBD_DEPTH_CHANNEL) entry->image->depth_cache_entry = NULL;
+  else entry->image->color_cache_entry = NULL;
+
+  // Delete entry
+  if (entry->integer_depths) delete [] entry->integer_depths;
+  if (entry->float_depths) delete [] entry->float_depths;
+  if (entry->double_depths) delete [] entry->double_depths;
+  if (entry->color_image) delete entry->color_image;
+  delete entry;
+}
+
+
+
 ////////////////////////////////////////////////////////////////////////
 // Update functions
 ////////////////////////////////////////////////////////////////////////
@@ -56,10 +56,32 @@ public:
   virtual int ReadColorChannels(void);
   virtual int ReleaseColorChannels(void);
 
+  // Channel cache functions (decoded frames are kept in memory, up to
+  // max_bytes, and reused by subsequent reads of the same image)
+  virtual void SetChannelCacheSize(unsigned long long max_bytes, RNBoolean double_precision_depth = FALSE);
+  virtual int PrefetchChannels(int first_image_index = 0, int nimages = -1);
+  virtual int PrefetchDepthChannels(int first_image_index = 0, int nimages = -1);
+  virtual int PrefetchColorChannels(int first_image_index = 0, int nimages = -1);
+  virtual void EmptyChannelCache(void);
+  unsigned long long ChannelCacheSize(void) const;
+  unsigned long long MaxChannelCacheSize(void) const;
+
   // Update functions
   virtual void InvalidateWorldBBox(void);
   virtual void UpdateWorldBBox(void);
   
+private:
+  // Channel cache functions
+  friend class RGBDImage;
+  int ReadCachedDepthImage(RGBDImage *image, R2Grid& depth_image);
+  int ReadCachedColorImage(RGBDImage *image, R2Image& color_image);
+  void CacheDepthImage(RGBDImage *image, const R2Grid& depth_image);
+  void CacheColorImage(RGBDImage *image, const R2Image& color_image);
+  void UncacheImage(RGBDImage *image);
+  void LinkCacheEntry(RGBDChannelCacheEntry *entry);
+  void UnlinkCacheEntry(RGBDChannelCacheEntry *entry);
+  void DeleteCacheEntry(RGBDChannelCacheEntry *entry);
+
 private:
   // Internal variables
   RNArray<RGBDImage *> images;
@@ -69,6 +91,13 @@ private:
   char *texture_directory;
   char *dataset_format;
   R3Box world_bbox;
+
+  // Channel cache variables (least recently used entry is at head)
+  RGBDChannelCacheEntry *cache_head;
+  RGBDChannelCacheEntry *cache_tail;
+  unsigned long long cache_size;
+  unsigned long long max_cache_size;
+  RNBoolean cache_double_precision_depth;
 };
 
 
@@ -123,6 +152,24 @@ Surface(int k) const
 
 
 
+inline unsigned long long RGBDConfiguration::
+ChannelCacheSize(void) const
+{
+  // Return number of bytes used by channel cache
+  return cache_size;
+}
+
+
+
+inline unsigned long long RGBDConfiguration::
+MaxChannelCacheSize(void) const
+{
+  // Return maximum number of bytes used by channel cache
+  return max_cache_size;
+}
+
+
+
 inline const char *RGBDConfiguration::
 ColorDirectory(void) const
 {
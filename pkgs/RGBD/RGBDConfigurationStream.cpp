@@ -0,0 +1,615 @@
+////////////////////////////////////////////////////////////////////////
+// Source file for RGBDConfigurationStream class
+////////////////////////////////////////////////////////////////////////
+
+
+
+////////////////////////////////////////////////////////////////////////
+// Include files
+////////////////////////////////////////////////////////////////////////
+
+#include "RGBD.h"
+
+
+
+////////////////////////////////////////////////////////////////////////
+// Index file format
+////////////////////////////////////////////////////////////////////////
+
+// Header: magic, version, number of frames, offset of frame offset table,
+// then dataset format and directory names (as length-prefixed strings).
+// Records: intrinsics (9 doubles), camera_to_world (16 doubles),
+// then depth and color filenames (as length-prefixed strings).
+// Table: file offset of every record (64-bit integers).
+
+static const char *RGBD_INDEX_MAGIC = "RGBDIndex";
+static const int RGBD_INDEX_VERSION = 1;
+
+
+
+////////////////////////////////////////////////////////////////////////
+// Constructors/destructors
+////////////////////////////////////////////////////////////////////////
+
+RGBDConfigurationStream::
+RGBDConfigurationStream(void)
+  : RGBDConfiguration(),
+    index_fp(NULL),
+    frame_offsets(NULL),
+    nframes(0),
+    nallocated_frames(0),
+    window_images(NULL),
+    window_frames(NULL),
+    window_size(0),
+    read_ahead(0),
+    read_depth_channels(TRUE),
+    read_color_channels(TRUE),
+    current_frame_index(-1)
+{
+  // Set default window
+  SetWindow(1, 0);
+}
+
+
+
+RGBDConfigurationStream::
+~RGBDConfigurationStream(void)
+{
+  // Delete resident frames
+  ReleaseFrames();
+  if (window_images) delete [] window_images;
+  if (window_frames) delete [] window_frames;
+
+  // Close index
+  CloseIndex();
+}
+
+
+
+////////////////////////////////////////////////////////////////////////
+// Frame access functions
+////////////////////////////////////////////////////////////////////////
+
+RGBDImage *RGBDConfigurationStream::
+Frame(int frame_index)
+{
+  // Check frame index
+  if ((frame_index < 0) || (frame_index >= nframes)) return NULL;
+
+  // Compute range of frames that should be resident
+  int behind = window_size - 1 - read_ahead;
+  int start_frame_index = frame_index - behind;
+  if (start_frame_index < 0) start_frame_index = 0;
+  int end_frame_index = frame_index + read_ahead + 1;
+  if (end_frame_index > nframes) end_frame_index = nframes;
+
+  // Release frames outside range
+  for (int slot = 0; slot < window_size; slot++) {
+    int f = window_frames[slot];
+    if (f < 0) continue;
+    if ((f >= start_frame_index) && (f < end_frame_index)) continue;
+    ReleaseFrame(slot);
+  }
+
+  // Make frames in range resident
+  if (!LoadFrames(start_frame_index, end_frame_index)) return NULL;
+
+  // Update current frame
+  current_frame_index = frame_index;
+
+  // Return image of frame
+  return window_images[frame_index % window_size];
+}
+
+
+
+int RGBDConfigurationStream::
+FrameIndex(RGBDImage *image) const
+{
+  // Return index of resident frame (or -1 if image is not resident)
+  for (int slot = 0; slot < window_size; slot++) {
+    if (window_images[slot] == image) return window_frames[slot];
+  }
+  return -1;
+}
+
+
+
+////////////////////////////////////////////////////////////////////////
+// Frame metadata functions
+////////////////////////////////////////////////////////////////////////
+
+static int
+ReadIndexString(FILE *fp, char *buffer, int buffer_size)
+{
+  // Read length-prefixed string (buffer can be NULL to skip it)
+  int length = 0;
+  if (fread(&length, sizeof(int), 1, fp) != (unsigned int) 1) return 0;
+  if ((length < 0) || (length >= 4096)) return 0;
+  char tmp[4096];
+  if ((length > 0) && (fread(tmp, sizeof(char), length, fp) != (unsigned int) length)) return 0;
+  tmp[length] = '\0';
+  if (buffer) { strncpy(buffer, tmp, buffer_size); buffer[buffer_size-1] = '\0'; }
+  return 1;
+}
+
+
+
+static int
+WriteIndexString(FILE *fp, const char *str)
+{
+  // Write length-prefixed string
+  int length = (str) ? strlen(str) : 0;
+  if (fwrite(&length, sizeof(int), 1, fp) != (unsigned int) 1) return 0;
+  if ((length > 0) && (fwrite(str, sizeof(char), length, fp) != (unsigned int) length)) return 0;
+  return 1;
+}
+
+
+
+int RGBDConfigurationStream::
+ReadFrameInfo(int frame_index, R3Matrix& intrinsics, R4Matrix& camera_to_world,
+  char *depth_filename, char *color_filename) const
+{
+  // Check frame index
+  if (!index_fp) return 0;
+  if ((frame_index < 0) || (frame_index >= nframes)) return 0;
+
+  // Seek to record
+  if (!RNFileSeek(index_fp, frame_offsets[frame_index], RN_FILE_SEEK_SET)) {
+    fprintf(stderr, "Unable to seek to frame %d in index\n", frame_index);
+    return 0;
+  }
+
+  // Read matrices
+  RNScalar m[25];
+  if (fread(m, sizeof(RNScalar), 25, index_fp) != (unsigned int) 25) {
+    fprintf(stderr, "Unable to read frame %d from index\n", frame_index);
+    return 0;
+  }
+
+  // Read filenames
+  if (!ReadIndexString(index_fp, depth_filename, 4096) ||
+      !ReadIndexString(index_fp, color_filename, 4096)) {
+    fprintf(stderr, "Unable to read filenames of frame %d from index\n", frame_index);
+    return 0;
+  }
+
+  // Assign matrices
+  intrinsics = R3Matrix(&m[0]);
+  camera_to_world = R4Matrix(&m[9]);
+
+  // Return success
+  return 1;
+}
+
+
+
+RGBDImage *RGBDConfigurationStream::
+CreateFrameImage(int frame_index) const
+{
+  // Read frame info
+  R3Matrix intrinsics;
+  R4Matrix camera_to_world;
+  char depth_filename[4096], color_filename[4096];
+  if (!ReadFrameInfo(frame_index, intrinsics, camera_to_world, depth_filename, color_filename)) return NULL;
+
+  // Create image (not inserted into configuration)
+  return new RGBDImage((color_filename[0]) ? color_filename : NULL,
+    (depth_filename[0]) ? depth_filename : NULL, intrinsics, camera_to_world);
+}
+
+
+
+////////////////////////////////////////////////////////////////////////
+// Window manipulation functions
+////////////////////////////////////////////////////////////////////////
+
+void RGBDConfigurationStream::
+SetWindow(int window_size, int read_ahead,
+  RNBoolean read_depth_channels, RNBoolean read_color_channels)
+{
+  // Release all resident frames
+  ReleaseFrames();
+
+  // Check parameters
+  if (window_size < 1) window_size = 1;
+  if (read_ahead < 0) read_ahead = 0;
+  if (read_ahead > window_size - 1) read_ahead = window_size - 1;
+
+  // Allocate window
+  if (window_images) delete [] window_images;
+  if (window_frames) delete [] window_frames;
+  window_images = new RGBDImage * [ window_size ];
+  window_frames = new int [ window_size ];
+  for (int slot = 0; slot < window_size; slot++) {
+    window_images[slot] = NULL;
+    window_frames[slot] = -1;
+  }
+
+  // Remember parameters
+  this->window_size = window_size;
+  this->read_ahead = read_ahead;
+  this->read_depth_channels = read_depth_channels;
+  this->read_color_channels = read_color_channels;
+}
+
+
+
+void RGBDConfigurationStream::
+Rewind(void)
+{
+  // Reset current frame (next frame will be the first one)
+  current_frame_index = -1;
+}
+
+
+
+void RGBDConfigurationStream::
+ReleaseFrames(void)
+{
+  // Release all resident frames
+  for (int slot = 0; slot < window_size; slot++) {
+    if (window_frames[slot] >= 0) ReleaseFrame(slot);
+  }
+}
+
+
+
+int RGBDConfigurationStream::
+LoadFrames(int start_frame_index, int end_frame_index)
+{
+  // Create images for frames that are not resident
+  RNArray<RGBDImage *> new_images;
+  for (int f = start_frame_index; f < end_frame_index; f++) {
+    int slot = f % window_size;
+    if (window_frames[slot] == f) continue;
+    if (window_frames[slot] >= 0) ReleaseFrame(slot);
+    RGBDImage *image = CreateFrameImage(f);
+    if (!image) return 0;
+    RGBDConfiguration::InsertImage(image);
+    window_images[slot] = image;
+    window_frames[slot] = f;
+    new_images.Insert(image);
+  }
+
+  // Check if any frames were loaded
+  if (new_images.IsEmpty()) return 1;
+
+  // Decode files of new frames in parallel
+  int n = new_images.NEntries();
+  R2Grid **depth_images = new R2Grid * [ n ];
+  R2Image **color_images = new R2Image * [ n ];
+#pragma omp parallel for schedule(dynamic)
+  for (int k = 0; k < n; k++) {
+    RGBDImage *image = new_images.Kth(k);
+    depth_images[k] = NULL;
+    color_images[k] = NULL;
+    if (read_depth_channels) {
+      R2Grid *depth_image = new R2Grid();
+      if (image->ReadDepthImage(*depth_image) && image->ProcessDepthImage(*depth_image)) depth_images[k] = depth_image;
+      else delete depth_image;
+    }
+    if (read_color_channels) {
+      R2Image *color_image = new R2Image();
+      if (image->ReadColorImage(*color_image)) color_images[k] = color_image;
+      else delete color_image;
+    }
+  }
+
+  // Create channels in order
+  int status = 1;
+  for (int k = 0; k < n; k++) {
+    RGBDImage *image = new_images.Kth(k);
+    if (read_depth_channels) {
+      if (!depth_images[k]) { fprintf(stderr, "Unable to read depth channel of frame %d\n", FrameIndex(image)); status = 0; }
+      else { image->CreateDepthChannel(*depth_images[k]); delete depth_images[k]; }
+    }
+    if (read_color_channels) {
+      if (!color_images[k]) { fprintf(stderr, "Unable to read color channels of frame %d\n", FrameIndex(image)); status = 0; }
+      else { image->CreateColorChannels(*color_images[k]); delete color_images[k]; }
+    }
+  }
+
+  // Delete temporary images
+  delete [] depth_images;
+  delete [] color_images;
+
+  // Return status
+  return status;
+}
+
+
+
+void RGBDConfigurationStream::
+ReleaseFrame(int slot)
+{
+  // Check slot
+  RGBDImage *image = window_images[slot];
+  if (!image) return;
+
+  // Delete image (which removes it from configuration and deletes its channels)
+  delete image;
+  window_images[slot] = NULL;
+  window_frames[slot] = -1;
+}
+
+
+
+////////////////////////////////////////////////////////////////////////
+// Input/output functions
+////////////////////////////////////////////////////////////////////////
+
+int RGBDConfigurationStream::
+ReadFile(const char *filename, int read_every_kth_image)
+{
+  // Check if file is an index file
+  FILE *fp = fopen(filename, "rb");
+  if (!fp) {
+    fprintf(stderr, "Unable to open configuration file %s\n", filename);
+    return 0;
+  }
+  char magic[16] = { '\0' };
+  int count = fread(magic, sizeof(char), 16, fp);
+  fclose(fp);
+  if ((count == 16) && !strncmp(magic, RGBD_INDEX_MAGIC, 16)) {
+    return ReadIndexFile(filename);
+  }
+
+  // Start new index
+  ReleaseFrames();
+  if (!OpenIndex()) return 0;
+
+  // Parse configuration file (images are appended to index by InsertImage)
+  if (!RGBDConfiguration::ReadFile(filename, read_every_kth_image)) return 0;
+
+  // Return success
+  return 1;
+}
+
+
+
+int RGBDConfigurationStream::
+ReadIndexFile(const char *filename)
+{
+  // Release frames and previous index
+  ReleaseFrames();
+  CloseIndex();
+
+  // Open index file
+  FILE *fp = fopen(filename, "rb");
+  if (!fp) {
+    fprintf(stderr, "Unable to open index file %s\n", filename);
+    return 0;
+  }
+
+  // Read header
+  char magic[16];
+  int version, count;
+  RNInt64 table_offset;
+  if ((fread(magic, sizeof(char), 16, fp) != (unsigned int) 16) ||
+      (fread(&version, sizeof(int), 1, fp) != (unsigned int) 1) ||
+      (fread(&count, sizeof(int), 1, fp) != (unsigned int) 1) ||
+      (fread(&table_offset, sizeof(RNInt64), 1, fp) != (unsigned int) 1)) {
+    fprintf(stderr, "Unable to read header of index file %s\n", filename);
+    fclose(fp);
+    return 0;
+  }
+
+  // Check header
+  if (strncmp(magic, RGBD_INDEX_MAGIC, 16) || (version != RGBD_INDEX_VERSION) || (count < 0)) {
+    fprintf(stderr, "Invalid header in index file %s\n", filename);
+    fclose(fp);
+    return 0;
+  }
+
+  // Read dataset format and directory names
+  char dataset_format[4096], color_directory[4096], depth_directory[4096], texture_directory[4096];
+  if (!ReadIndexString(fp, dataset_format, 4096) ||
+      !ReadIndexString(fp, color_directory, 4096) ||
+      !ReadIndexString(fp, depth_directory, 4096) ||
+      !ReadIndexString(fp, texture_directory, 4096)) {
+    fprintf(stderr, "Unable to read directories from index file %s\n", filename);
+    fclose(fp);
+    return 0;
+  }
+
+  // Assign dataset format and directory names
+  if (dataset_format[0]) SetDatasetFormat(dataset_format);
+  if (color_directory[0]) SetColorDirectory(color_directory);
+  if (depth_directory[0]) SetDepthDirectory(depth_directory);
+  if (texture_directory[0]) SetTextureDirectory(texture_directory);
+
+  // Read table of record offsets
+  RNInt64 *offsets = new RNInt64 [ count + 1 ];
+  if (!RNFileSeek(fp, table_offset, RN_FILE_SEEK_SET) ||
+      (fread(offsets, sizeof(RNInt64), count, fp) != (unsigned int) count)) {
+    fprintf(stderr, "Unable to read frame table from index file %s\n", filename);
+    delete [] offsets;
+    fclose(fp);
+    return 0;
+  }
+
+  // Use index file for frame records
+  index_fp = fp;
+  frame_offsets = offsets;
+  nframes = count;
+  nallocated_frames = count + 1;
+  current_frame_index = -1;
+
+  // Return success
+  return 1;
+}
+
+
+
+int RGBDConfigurationStream::
+WriteIndexFile(const char *filename) const
+{
+  // Check index
+  if (!index_fp) return 0;
+
+  // Open index file
+  FILE *fp = fopen(filename, "wb");
+  if (!fp) {
+    fprintf(stderr, "Unable to open index file %s\n", filename);
+    return 0;
+  }
+
+  // Write header (offset of frame table is filled in at the end)
+  char magic[16] = { '\0' };
+  strncpy(magic, RGBD_INDEX_MAGIC, 16);
+  int version = RGBD_INDEX_VERSION;
+  RNInt64 table_offset = 0;
+  fwrite(magic, sizeof(char), 16, fp);
+  fwrite(&version, sizeof(int), 1, fp);
+  fwrite(&nframes, sizeof(int), 1, fp);
+  fwrite(&table_offset, sizeof(RNInt64), 1, fp);
+  WriteIndexString(fp, DatasetFormat());
+  WriteIndexString(fp, ColorDirectory());
+  WriteIndexString(fp, DepthDirectory());
+  WriteIndexString(fp, TextureDirectory());
+
+  // Write records (copied from index)
+  RNInt64 *offsets = new RNInt64 [ nframes + 1 ];
+  char buffer[4096];
+  for (int i = 0; i < nframes; i++) {
+    // Determine size of record
+    RNInt64 start = frame_offsets[i];
+    RNInt64 end = (i < nframes-1) ? frame_offsets[i+1] : -1;
+    if (end < 0) {
+      if (!RNFileSeek(index_fp, 0, RN_FILE_SEEK_END)) break;
+      end = RNFileTell(index_fp);
+    }
+
+    // Copy record
+    offsets[i] = RNFileTell(fp);
+    if (!RNFileSeek(index_fp, start, RN_FILE_SEEK_SET)) break;
+    for (RNInt64 remaining = end - start; remaining > 0; ) {
+      int n = (remaining < 4096) ? (int) remaining : 4096;
+      if (fread(buffer, sizeof(char), n, index_fp) != (unsigned int) n) { remaining = -1; break; }
+      fwrite(buffer, sizeof(char), n, fp);
+      remaining -= n;
+    }
+  }
+
+  // Write table of record offsets
+  table_offset = RNFileTell(fp);
+  int status = (fwrite(offsets, sizeof(RNInt64), nframes, fp) == (unsigned int) nframes);
+  delete [] offsets;
+
+  // Fill in offset of table
+  if (!RNFileSeek(fp, 16 + 2*sizeof(int), RN_FILE_SEEK_SET)) status = 0;
+  else if (fwrite(&table_offset, sizeof(RNInt64), 1, fp) != (unsigned int) 1) status = 0;
+
+  // Close index file
+  fclose(fp);
+
+  // Check status
+  if (!status) {
+    fprintf(stderr, "Unable to write index file %s\n", filename);
+    return 0;
+  }
+
+  // Return success
+  return 1;
+}
+
+
+
+////////////////////////////////////////////////////////////////////////
+// Image manipulation functions
+////////////////////////////////////////////////////////////////////////
+
+void RGBDConfigurationStream::
+InsertImage(RGBDImage *image)
+{
+  // Append frame to index
+  InsertFrame(image->DepthFilename(), image->ColorFilename(),
+    image->Intrinsics(), image->CameraToWorld().Matrix());
+
+  // Delete image (only frames in window are resident)
+  delete image;
+}
+
+
+
+////////////////////////////////////////////////////////////////////////
+// Index functions
+////////////////////////////////////////////////////////////////////////
+
+int RGBDConfigurationStream::
+OpenIndex(void)
+{
+  // Close previous index
+  CloseIndex();
+
+  // Open temporary file for frame records (deleted when closed)
+  index_fp = tmpfile();
+  if (!index_fp) {
+    fprintf(stderr, "Unable to create temporary index file\n");
+    return 0;
+  }
+
+  // Return success
+  return 1;
+}
+
+
+
+void RGBDConfigurationStream::
+CloseIndex(void)
+{
+  // Close index file
+  if (index_fp) fclose(index_fp);
+  index_fp = NULL;
+
+  // Delete frame offsets
+  if (frame_offsets) delete [] frame_offsets;
+  frame_offsets = NULL;
+  nframes = 0;
+  nallocated_frames = 0;
+  current_frame_index = -1;
+}
+
+
+
+int RGBDConfigurationStream::
+InsertFrame(const char *depth_filename, const char *color_filename,
+  const R3Matrix& intrinsics, const R4Matrix& camera_to_world)
+{
+  // Check index
+  if (!index_fp && !OpenIndex()) return 0;
+
+  // Allocate frame offsets
+  if (nframes == nallocated_frames) {
+    nallocated_frames = (nallocated_frames > 0) ? 2 * nallocated_frames : 1024;
+    RNInt64 *tmp = new RNInt64 [ nallocated_frames ];
+    for (int i = 0; i < nframes; i++) tmp[i] = frame_offsets[i];
+    if (frame_offsets) delete [] frame_offsets;
+    frame_offsets = tmp;
+  }
+
+  // Append record to end of index
+  if (!RNFileSeek(index_fp, 0, RN_FILE_SEEK_END)) return 0;
+  RNInt64 offset = RNFileTell(index_fp);
+  RNScalar m[25];
+  for (int i = 0; i < 3; i++)
+    for (int j = 0; j < 3; j++)
+      m[3*i+j] = intrinsics[i][j];
+  for (int i = 0; i < 4; i++)
+    for (int j = 0; j < 4; j++)
+      m[9+4*i+j] = camera_to_world[i][j];
+  if ((fwrite(m, sizeof(RNScalar), 25, index_fp) != (unsigned int) 25) ||
+      !WriteIndexString(index_fp, depth_filename) ||
+      !WriteIndexString(index_fp, color_filename)) {
+    fprintf(stderr, "Unable to write frame %d to index\n", nframes);
+    return 0;
+  }
+
+  // Remember offset of record
+  frame_offsets[nframes++] = offset;
+
+  // Return success
+  return 1;
+}
@@ -0,0 +1,138 @@
+////////////////////////////////////////////////////////////////////////
+// Include file for RGBDConfigurationStream class
+////////////////////////////////////////////////////////////////////////
+
+
+
+////////////////////////////////////////////////////////////////////////
+// NOTE:
+// A configuration stream reads the images of a configuration file into
+// a compact binary index (one record of filenames, intrinsics, and
+// camera pose per frame) rather than creating an RGBDImage for every
+// frame.  Only a bounded window of frames is resident at any time:
+// accessing a frame creates RGBDImages (and reads their channels) for
+// the frames just ahead of it, and deletes the ones that fall behind
+// the window, so arbitrarily long captures are processed in constant
+// memory.  The images of the window are the images of the underlying
+// configuration (i.e., NImages() and Image(k) refer to resident frames).
+// Surfaces and directories are read as usual.
+////////////////////////////////////////////////////////////////////////
+
+
+
+////////////////////////////////////////////////////////////////////////
+// Class definition
+////////////////////////////////////////////////////////////////////////
+
+class RGBDConfigurationStream : public RGBDConfiguration {
+public:
+  // Constructors/destructors
+  RGBDConfigurationStream(void);
+  virtual ~RGBDConfigurationStream(void);
+
+  // Frame property functions
+  int NFrames(void) const;
+  int CurrentFrameIndex(void) const;
+  int WindowSize(void) const;
+  int ReadAhead(void) const;
+
+  // Frame access functions (make frame resident, and release frames behind window)
+  RGBDImage *Frame(int frame_index);
+  RGBDImage *NextFrame(void);
+  int FrameIndex(RGBDImage *image) const;
+
+  // Frame metadata functions (read from index, do not make frames resident)
+  int ReadFrameInfo(int frame_index, R3Matrix& intrinsics, R4Matrix& camera_to_world,
+    char *depth_filename = NULL, char *color_filename = NULL) const;
+  RGBDImage *CreateFrameImage(int frame_index) const;
+
+  // Window manipulation functions
+  void SetWindow(int window_size, int read_ahead = 0,
+    RNBoolean read_depth_channels = TRUE, RNBoolean read_color_channels = TRUE);
+  void Rewind(void);
+  void ReleaseFrames(void);
+
+  // Input/output functions (configuration or index files)
+  virtual int ReadFile(const char *filename, int read_every_kth_image = 1);
+  int ReadIndexFile(const char *filename);
+  int WriteIndexFile(const char *filename) const;
+
+  // Image manipulation functions (images are appended to index, then deleted)
+  virtual void InsertImage(RGBDImage *image);
+
+private:
+  int OpenIndex(void);
+  void CloseIndex(void);
+  int InsertFrame(const char *depth_filename, const char *color_filename,
+    const R3Matrix& intrinsics, const R4Matrix& camera_to_world);
+  int LoadFrames(int start_frame_index, int end_frame_index);
+  void ReleaseFrame(int slot);
+
+private:
+  // Index variables
+  FILE *index_fp;
+  RNInt64 *frame_offsets;
+  int nframes;
+  int nallocated_frames;
+
+  // Window variables
+  RGBDImage **window_images;
+  int *window_frames;
+  int window_size;
+  int read_ahead;
+  RNBoolean read_depth_channels;
+  RNBoolean read_color_channels;
+  int current_frame_index;
+};
+
+
+
+////////////////////////////////////////////////////////////////////////
+// Inline functions
+////////////////////////////////////////////////////////////////////////
+
+inline int RGBDConfigurationStream::
+NFrames(void) const
+{
+  // Return number of frames in index
+  return nframes;
+}
+
+
+
+inline int RGBDConfigurationStream::
+CurrentFrameIndex(void) const
+{
+  // Return index of frame accessed most recently (-1 if none)
+  return current_frame_index;
+}
+
+
+
+inline int RGBDConfigurationStream::
+WindowSize(void) const
+{
+  // Return maximum number of resident frames
+  return window_size;
+}
+
+
+
+inline int RGBDConfigurationStream::
+ReadAhead(void) const
+{
+  // Return number of frames made resident ahead of current frame
+  return read_ahead;
+}
+
+
+
+inline RGBDImage *RGBDConfigurationStream::
+NextFrame(void)
+{
+  // Return frame after current one (NULL at end of stream)
+  return Frame(current_frame_index + 1);
+}
+
+
+
@@ -0,0 +1,569 @@
+////////////////////////////////////////////////////////////////////////
+// Source file for RGBDFusion class
+////////////////////////////////////////////////////////////////////////
+
+
+
+////////////////////////////////////////////////////////////////////////
+// Include files
+////////////////////////////////////////////////////////////////////////
+
+#include "RGBD.h"
+
+
+
+////////////////////////////////////////////////////////////////////////
+// Useful functions
+////////////////////////////////////////////////////////////////////////
+
+static inline int
+FloorDivide(int a, int b)
+{
+  // Return floor(a / b) for positive b (division in C rounds towards zero)
+  return (a >= 0) ? a / b : -((-a + b - 1) / b);
+}
+
+
+
+////////////////////////////////////////////////////////////////////////
+// Constructors/destructors
+////////////////////////////////////////////////////////////////////////
+
+RGBDFusion::
+RGBDFusion(RNLength voxel_spacing, RNLength truncation_distance)
+  : voxel_spacing(voxel_spacing),
+    truncation_distance(truncation_distance),
+    max_depth(0),
+    max_weight(128),
+    nintegrated_images(0),
+    block_voxels(NULL),
+    block_keys(NULL),
+    nblocks(0),
+    nallocated_blocks(0),
+    hash_table(NULL),
+    hash_size(0)
+{
+  // Check parameters
+  assert(voxel_spacing > 0);
+  assert(truncation_distance > 0);
+}
+
+
+
+RGBDFusion::
+~RGBDFusion(void)
+{
+  // Delete blocks
+  Empty();
+}
+
+
+
+////////////////////////////////////////////////////////////////////////
+// Property functions
+////////////////////////////////////////////////////////////////////////
+
+R3Box RGBDFusion::
+WorldBBox(void) const
+{
+  // Compute bounding box of allocated blocks
+  R3Box bbox = R3null_box;
+  RNLength block_spacing = RGBD_FUSION_BLOCK_SIZE * voxel_spacing;
+  for (int b = 0; b < nblocks; b++) {
+    int bx, by, bz;
+    BlockIndices(b, bx, by, bz);
+    bbox.Union(R3Point(bx * block_spacing, by * block_spacing, bz * block_spacing));
+    bbox.Union(R3Point((bx+1) * block_spacing, (by+1) * block_spacing, (bz+1) * block_spacing));
+  }
+
+  // Return bounding box
+  return bbox;
+}
+
+
+
+////////////////////////////////////////////////////////////////////////
+// Voxel access functions
+////////////////////////////////////////////////////////////////////////
+
+const RGBDFusionVoxel *RGBDFusion::
+Voxel(int i, int j, int k) const
+{
+  // Return voxel (or NULL if it is not in an allocated block)
+  const int bs = RGBD_FUSION_BLOCK_SIZE;
+  int bx = FloorDivide(i, bs);
+  int by = FloorDivide(j, bs);
+  int bz = FloorDivide(k, bs);
+  int block_index = FindBlock(bx, by, bz);
+  if (block_index < 0) return NULL;
+  return &block_voxels[block_index][((k - bz*bs)*bs + (j - by*bs))*bs + (i - bx*bs)];
+}
+
+
+
+////////////////////////////////////////////////////////////////////////
+// Manipulation functions
+////////////////////////////////////////////////////////////////////////
+
+void RGBDFusion::
+SetMaxDepth(RNLength max_depth)
+{
+  // Set maximum depth integrated (0 means no limit)
+  this->max_depth = max_depth;
+}
+
+
+
+void RGBDFusion::
+SetMaxWeight(RNScalar max_weight)
+{
+  // Set maximum weight of a voxel
+  this->max_weight = max_weight;
+}
+
+
+
+void RGBDFusion::
+Empty(void)
+{
+  // Delete blocks
+  for (int i = 0; i < nblocks; i++) delete [] block_voxels[i];
+  if (block_voxels) delete [] block_voxels;
+  if (block_keys) delete [] block_keys;
+  if (hash_table) delete [] hash_table;
+
+  // Reset empty set of blocks
+  block_voxels = NULL;
+  block_keys = NULL;
+  nblocks = 0;
+  nallocated_blocks = 0;
+  hash_table = NULL;
+  hash_size = 0;
+  nintegrated_images = 0;
+}
+
+
+
+////////////////////////////////////////////////////////////////////////
+// Block management functions
+////////////////////////////////////////////////////////////////////////
+
+void RGBDFusion::
+RehashBlocks(int size)
+{
+  // Allocate hash table (size must be power of two)
+  assert((size & (size - 1)) == 0);
+  if (hash_table) delete [] hash_table;
+  hash_table = new int [ size ];
+  hash_size = size;
+  for (int i = 0; i < hash_size; i++) hash_table[i] = -1;
+
+  // Insert blocks (linear probing)
+  int mask = hash_size - 1;
+  for (int i = 0; i < nblocks; i++) {
+    RNUInt64 h = ((RNUInt64) block_keys[i] * 0x9E3779B97F4A7C15ULL) >> 32;
+    int slot = (int) (h & mask);
+    while (hash_table[slot] >= 0) slot = (slot + 1) & mask;
+    hash_table[slot] = i;
+  }
+}
+
+
+
+int RGBDFusion::
+AllocateBlock(int bx, int by, int bz)
+{
+  // Check if block is already allocated
+  int block_index = FindBlock(bx, by, bz);
+  if (block_index >= 0) return block_index;
+
+  // Check block coordinates
+  assert((-0x100000 <= bx) && (bx < 0x100000));
+  assert((-0x100000 <= by) && (by < 0x100000));
+  assert((-0x100000 <= bz) && (bz < 0x100000));
+
+  // Make space for block
+  if (nblocks == nallocated_blocks) {
+    nallocated_blocks = (nallocated_blocks > 0) ? 2 * nallocated_blocks : 64;
+    RGBDFusionVoxel **new_block_voxels = new RGBDFusionVoxel * [ nallocated_blocks ];
+    RNInt64 *new_block_keys = new RNInt64 [ nallocated_blocks ];
+    for (int i = 0; i < nblocks; i++) {
+      new_block_voxels[i] = block_voxels[i];
+      new_block_keys[i] = block_keys[i];
+    }
+    if (block_voxels) delete [] block_voxels;
+    if (block_keys) delete [] block_keys;
+    block_voxels = new_block_voxels;
+    block_keys = new_block_keys;
+  }
+
+  // Create block of unobserved voxels
+  block_index = nblocks++;
+  block_keys[block_index] = ((RNInt64) (bz + 0x100000) << 42) | ((RNInt64) (by + 0x100000) << 21) | (RNInt64) (bx + 0x100000);
+  block_voxels[block_index] = new RGBDFusionVoxel [ RGBD_FUSION_BLOCK_VOXELS ];
+  for (int i = 0; i < RGBD_FUSION_BLOCK_VOXELS; i++) {
+    RGBDFusionVoxel& voxel = block_voxels[block_index][i];
+    voxel.distance = 1;
+    voxel.weight = 0;
+    voxel.color[0] = voxel.color[1] = voxel.color[2] = voxel.color[3] = 0;
+  }
+
+  // Insert block into hash table (keep load factor below 1/2)
+  if (2 * nblocks > hash_size) {
+    RehashBlocks((hash_size > 0) ? 2 * hash_size : 128);
+  }
+  else {
+    int mask = hash_size - 1;
+    RNUInt64 h = ((RNUInt64) block_keys[block_index] * 0x9E3779B97F4A7C15ULL) >> 32;
+    int slot = (int) (h & mask);
+    while (hash_table[slot] >= 0) slot = (slot + 1) & mask;
+    hash_table[slot] = block_index;
+  }
+
+  // Return index of new block
+  return block_index;
+}
+
+
+
+////////////////////////////////////////////////////////////////////////
+// Integration functions
+////////////////////////////////////////////////////////////////////////
+
+int RGBDFusion::
+IntegrateImage(RGBDImage *image)
+{
+  // Read channels
+  if (!image->ReadDepthChannel()) return 0;
+  RNBoolean color = image->ReadColorChannels();
+
+  // Integrate channels
+  R2Grid *depth_channel = image->DepthChannel();
+  int status = 0;
+  if (depth_channel) {
+    if (color) {
+      status = IntegrateImage(*depth_channel, image->Intrinsics(), image->CameraToWorld(),
+        image->RedChannel(), image->GreenChannel(), image->BlueChannel());
+    }
+    else {
+      status = IntegrateImage(*depth_channel, image->Intrinsics(), image->CameraToWorld());
+    }
+  }
+
+  // Release channels
+  if (color) image->ReleaseColorChannels();
+  image->ReleaseDepthChannel();
+
+  // Return status
+  return status;
+}
+
+
+
+int RGBDFusion::
+IntegrateImage(const R2Grid& depth_image,
+  const R3Matrix& intrinsics, const R3Affine& camera_to_world,
+  const R2Grid *red_image, const R2Grid *green_image, const R2Grid *blue_image)
+{
+  // Get/check camera parameters
+  const int width = depth_image.XResolution();
+  const int height = depth_image.YResolution();
+  if ((width == 0) || (height == 0)) return 0;
+  if (RNIsZero(intrinsics[0][0]) || RNIsZero(intrinsics[1][1])) return 0;
+  const RNScalar fx = intrinsics[0][0];
+  const RNScalar fy = intrinsics[1][1];
+  const RNScalar cx = intrinsics[0][2];
+  const RNScalar cy = intrinsics[1][2];
+  R4Matrix camera_to_world_matrix = camera_to_world.Matrix();
+  R4Matrix world_to_camera_matrix = camera_to_world_matrix.Inverse();
+  RNScalar c2w[3][4], w2c[3][4];
+  for (int i = 0; i < 3; i++) {
+    for (int j = 0; j < 4; j++) {
+      c2w[i][j] = camera_to_world_matrix[i][j];
+      w2c[i][j] = world_to_camera_matrix[i][j];
+    }
+  }
+  const RNScalar *depths = depth_image.GridValues();
+
+  // Check color images
+  RNBoolean color = FALSE;
+  int color_width = 0, color_height = 0;
+  if (red_image && green_image && blue_image) {
+    color_width = red_image->XResolution();
+    color_height = red_image->YResolution();
+    if ((color_width > 0) && (color_height > 0) &&
+        (green_image->XResolution() == color_width) && (green_image->YResolution() == color_height) &&
+        (blue_image->XResolution() == color_width) && (blue_image->YResolution() == color_height)) {
+      color = TRUE;
+    }
+  }
+
+  // Convenient variables
+  const int bs = RGBD_FUSION_BLOCK_SIZE;
+  const RNLength block_spacing = bs * voxel_spacing;
+  const RNLength max_integrated_depth = (max_depth > 0) ? max_depth : FLT_MAX;
+
+  // Allocate blocks within truncation distance of observed depths
+#pragma omp parallel
+  {
+    // Find blocks crossed by the truncation band around each observed depth
+    int nblock_indices = 0;
+    int nallocated_block_indices = 3 * 1024;
+    int *block_indices = new int [ nallocated_block_indices ];
+#pragma omp for schedule(dynamic)
+    for (int iy = 0; iy < height; iy++) {
+      for (int ix = 0; ix < width; ix++) {
+        // Get/check depth
+        RNScalar depth = depths[iy*width + ix];
+        if ((depth == R2_GRID_UNKNOWN_VALUE) || (depth <= 0)) continue;
+        if (depth > max_integrated_depth) continue;
+
+        // Compute ray through pixel (in camera coordinates, scaled to unit depth)
+        RNScalar rx = (ix + 0.5 - cx) / fx;
+        RNScalar ry = (iy + 0.5 - cy) / fy;
+        RNScalar ray_length = sqrt(rx*rx + ry*ry + 1);
+
+        // Step along ray by half a block through the truncation band
+        RNScalar t1 = depth - truncation_distance / ray_length;
+        RNScalar t2 = depth + truncation_distance / ray_length;
+        RNScalar dt = 0.5 * block_spacing / ray_length;
+        int nsteps = (int) ((t2 - t1) / dt) + 1;
+        int last_bx = 0, last_by = 0, last_bz = 0;
+        for (int s = 0; s <= nsteps; s++) {
+          RNScalar t = (s < nsteps) ? t1 + s * dt : t2;
+          if (t <= 0) continue;
+          RNScalar x = rx * t, y = ry * t, z = -t;
+          RNScalar wx = c2w[0][0]*x + c2w[0][1]*y + c2w[0][2]*z + c2w[0][3];
+          RNScalar wy = c2w[1][0]*x + c2w[1][1]*y + c2w[1][2]*z + c2w[1][3];
+          RNScalar wz = c2w[2][0]*x + c2w[2][1]*y + c2w[2][2]*z + c2w[2][3];
+          int bx = (int) floor(wx / block_spacing);
+          int by = (int) floor(wy / block_spacing);
+          int bz = (int) floor(wz / block_spacing);
+          if ((s > 0) && (bx == last_bx) && (by == last_by) && (bz == last_bz)) continue;
+          last_bx = bx; last_by = by; last_bz = bz;
+
+          // Remember block coordinates
+          if (nblock_indices + 3 > nallocated_block_indices) {
+            nallocated_block_indices *= 2;
+            int *new_block_indices = new int [ nallocated_block_indices ];
+            for (int i = 0; i < nblock_indices; i++) new_block_indices[i] = block_indices[i];
+            delete [] block_indices;
+            block_indices = new_block_indices;
+          }
+          block_indices[nblock_indices++] = bx;
+          block_indices[nblock_indices++] = by;
+          block_indices[nblock_indices++] = bz;
+        }
+      }
+    }
+
+    // Allocate blocks (one thread at a time)
+#pragma omp critical(RGBDFusion)
+    {
+      for (int i = 0; i < nblock_indices; i += 3) {
+        AllocateBlock(block_indices[i], block_indices[i+1], block_indices[i+2]);
+      }
+    }
+
+    // Delete block coordinates
+    delete [] block_indices;
+  }
+
+  // Update voxels of blocks in view frustum (each block is updated by one thread)
+  const RNLength block_radius = 0.5 * sqrt(3.0) * block_spacing;
+#pragma omp parallel for schedule(dynamic, 16)
+  for (int b = 0; b < nblocks; b++) {
+    int bx, by, bz;
+    BlockIndices(b, bx, by, bz);
+
+    // Compute position of block center in camera coordinates
+    RNScalar wx = (bx + 0.5) * block_spacing - 0.5 * voxel_spacing;
+    RNScalar wy = (by + 0.5) * block_spacing - 0.5 * voxel_spacing;
+    RNScalar wz = (bz + 0.5) * block_spacing - 0.5 * voxel_spacing;
+    RNScalar x = w2c[0][0]*wx + w2c[0][1]*wy + w2c[0][2]*wz + w2c[0][3];
+    RNScalar y = w2c[1][0]*wx + w2c[1][1]*wy + w2c[1][2]*wz + w2c[1][3];
+    RNScalar z = w2c[2][0]*wx + w2c[2][1]*wy + w2c[2][2]*wz + w2c[2][3];
+
+    // Check whether block can be in view frustum
+    RNScalar depth = -z;
+    if (depth + block_radius <= 0) continue;
+    if (depth - block_radius > max_integrated_depth + truncation_distance) continue;
+    if (depth - block_radius > 0) {
+      RNScalar u = cx + x * fx / depth;
+      RNScalar v = cy + y * fy / depth;
+      RNScalar du = block_radius * fx / (depth - block_radius);
+      RNScalar dv = block_radius * fy / (depth - block_radius);
+      if ((u + du < 0) || (u - du >= width)) continue;
+      if ((v + dv < 0) || (v - dv >= height)) continue;
+    }
+
+    // Compute camera coordinates of first voxel and steps between voxels
+    RNScalar ox = bx * bs * voxel_spacing;
+    RNScalar oy = by * bs * voxel_spacing;
+    RNScalar oz = bz * bs * voxel_spacing;
+    RNScalar origin[3], step[3][3];
+    for (int i = 0; i < 3; i++) {
+      origin[i] = w2c[i][0]*ox + w2c[i][1]*oy + w2c[i][2]*oz + w2c[i][3];
+      for (int j = 0; j < 3; j++) step[j][i] = w2c[i][j] * voxel_spacing;
+    }
+
+    // Update voxels
+    RGBDFusionVoxel *voxels = block_voxels[b];
+    for (int k = 0; k < bs; k++) {
+      for (int j = 0; j < bs; j++) {
+        RNScalar px = origin[0] + j*step[1][0] + k*step[2][0];
+        RNScalar py = origin[1] + j*step[1][1] + k*step[2][1];
+        RNScalar pz = origin[2] + j*step[1][2] + k*step[2][2];
+        for (int i = 0; i < bs; i++, px += step[0][0], py += step[0][1], pz += step[0][2]) {
+          // Project voxel center into depth image
+          RNScalar voxel_depth = -pz;
+          if (voxel_depth <= 0) continue;
+          RNScalar u = cx + px * fx / voxel_depth;
+          RNScalar v = cy + py * fy / voxel_depth;
+          if ((u < 0) || (u >= width)) continue;
+          if ((v < 0) || (v >= height)) continue;
+          int ix = (int) u;
+          int iy = (int) v;
+
+          // Get/check observed depth
+          RNScalar observed_depth = depths[iy*width + ix];
+          if ((observed_depth == R2_GRID_UNKNOWN_VALUE) || (observed_depth <= 0)) continue;
+          if (observed_depth > max_integrated_depth) continue;
+
+          // Compute truncated signed distance (skip voxels far behind the surface)
+          RNScalar distance = observed_depth - voxel_depth;
+          if (distance < -truncation_distance) continue;
+          RNScalar tsdf = (distance < truncation_distance) ? distance / truncation_distance : 1.0;
+
+          // Update running average of signed distance
+          RGBDFusionVoxel& voxel = voxels[(k*bs + j)*bs + i];
+          RNScalar weight = voxel.weight;
+          voxel.distance = (weight * voxel.distance + tsdf) / (weight + 1);
+          voxel.weight = (weight + 1 < max_weight) ? weight + 1 : max_weight;
+
+          // Update running average of color near surface
+          if (color && (distance < truncation_distance)) {
+            int color_ix = (color_width == width) ? ix : (int) (u * color_width / width);
+            int color_iy = (color_height == height) ? iy : (int) (v * color_height / height);
+            RNScalar rgb[3];
+            rgb[0] = red_image->GridValue(color_ix, color_iy);
+            rgb[1] = green_image->GridValue(color_ix, color_iy);
+            rgb[2] = blue_image->GridValue(color_ix, color_iy);
+            for (int c = 0; c < 3; c++) {
+              if (rgb[c] < 0) rgb[c] = 0;
+              else if (rgb[c] > 1) rgb[c] = 1;
+              voxel.color[c] = (RNUChar8) ((weight * voxel.color[c] + 255.0 * rgb[c]) / (weight + 1) + 0.5);
+            }
+          }
+        }
+      }
+    }
+  }
+
+  // Update number of integrated images
+  nintegrated_images++;
+
+  // Return success
+  return 1;
+}
+
+
+
+int RGBDFusion::
+IntegrateConfiguration(RGBDConfiguration *configuration)
+{
+  // Integrate every image
+  int status = 1;
+  for (int i = 0; i < configuration->NImages(); i++) {
+    RGBDImage *image = configuration->Image(i);
+    if (!IntegrateImage(image)) status = 0;
+  }
+
+  // Return status
+  return status;
+}
+
+
+
+////////////////////////////////////////////////////////////////////////
+// Surface extraction functions
+////////////////////////////////////////////////////////////////////////
+
+int RGBDFusion::
+ExtractMesh(R3Mesh *mesh, RNScalar min_weight) const
+{
+  // Check blocks
+  if (nblocks == 0) return 1;
+
+  // Find range of block coordinates
+  const int bs = RGBD_FUSION_BLOCK_SIZE;
+  int bmin[3], bmax[3];
+  BlockIndices(0, bmin[0], bmin[1], bmin[2]);
+  BlockIndices(0, bmax[0], bmax[1], bmax[2]);
+  for (int b = 1; b < nblocks; b++) {
+    int bxyz[3];
+    BlockIndices(b, bxyz[0], bxyz[1], bxyz[2]);
+    for (int dim = 0; dim < 3; dim++) {
+      if (bxyz[dim] < bmin[dim]) bmin[dim] = bxyz[dim];
+      if (bxyz[dim] > bmax[dim]) bmax[dim] = bxyz[dim];
+    }
+  }
+
+  // Create sparse grid of signed distances with the same blocks
+  // (voxels that have not been observed are left unknown)
+  int resolution[3];
+  for (int dim = 0; dim < 3; dim++) resolution[dim] = (bmax[dim] - bmin[dim] + 1) * bs;
+  R3Box grid_bbox(VoxelWorldPosition(bmin[0]*bs, bmin[1]*bs, bmin[2]*bs),
+    VoxelWorldPosition(bmin[0]*bs + resolution[0] - 1, bmin[1]*bs + resolution[1] - 1, bmin[2]*bs + resolution[2] - 1));
+  R3SparseGrid grid(resolution[0], resolution[1], resolution[2], grid_bbox, R2_GRID_UNKNOWN_VALUE);
+  for (int b = 0; b < nblocks; b++) {
+    int bx, by, bz;
+    BlockIndices(b, bx, by, bz);
+    int grid_block_index = grid.AllocateBlock(bx - bmin[0], by - bmin[1], bz - bmin[2]);
+    RNScalar *values = grid.BlockValues(grid_block_index);
+    const RGBDFusionVoxel *voxels = block_voxels[b];
+    for (int i = 0; i < RGBD_FUSION_BLOCK_VOXELS; i++) {
+      if ((voxels[i].weight <= 0) || (voxels[i].weight < min_weight)) continue;
+      values[i] = voxels[i].distance * truncation_distance;
+    }
+  }
+
+  // Extract zero crossings of signed distances
+  int first_vertex_index = mesh->NVertices();
+  if (!grid.GenerateIsoSurface(0, mesh)) return 0;
+
+  // Assign vertex colors by interpolating colors of observed voxels
+#pragma omp parallel for schedule(dynamic, 256)
+  for (int v = first_vertex_index; v < mesh->NVertices(); v++) {
+    R3MeshVertex *vertex = mesh->Vertex(v);
+    const R3Point& position = mesh->VertexPosition(vertex);
+    RNScalar x = position.X() / voxel_spacing;
+    RNScalar y = position.Y() / voxel_spacing;
+    RNScalar z = position.Z() / voxel_spacing;
+    int i0 = (int) floor(x), j0 = (int) floor(y), k0 = (int) floor(z);
+    RNScalar tx = x - i0, ty = y - j0, tz = z - k0;
+    RNScalar rgb[3] = { 0, 0, 0 };
+    RNScalar total_weight = 0;
+    for (int dk = 0; dk <= 1; dk++) {
+      for (int dj = 0; dj <= 1; dj++) {
+        for (int di = 0; di <= 1; di++) {
+          const RGBDFusionVoxel *voxel = Voxel(i0 + di, j0 + dj, k0 + dk);
+          if (!voxel || (voxel->weight <= 0) || (voxel->weight < min_weight)) continue;
+          RNScalar w = ((di) ? tx : 1 - tx) * ((dj) ? ty : 1 - ty) * ((dk) ? tz : 1 - tz);
+          for (int c = 0; c < 3; c++) rgb[c] += w * voxel->color[c];
+          total_weight += w;
+        }
+      }
+    }
+    if (total_weight > 0) {
+      RNScalar scale = 1.0 / (255.0 * total_weight);
+      mesh->SetVertexColor(vertex, RNRgb(scale * rgb[0], scale * rgb[1], scale * rgb[2]));
+    }
+  }
+
+  // Return success
+  return 1;
+}
+
+
+
@@ -0,0 +1,223 @@
+////////////////////////////////////////////////////////////////////////
+// Include file for RGBDFusion class
+////////////////////////////////////////////////////////////////////////
+
+
+
+////////////////////////////////////////////////////////////////////////
+// NOTE:
+// Truncated signed distances (positive in front of surfaces), weights,
+// and colors are stored in 8x8x8 blocks of voxels.  Blocks are allocated
+// only within the truncation distance of observed depths and are found
+// through a hash table, so memory grows with the area of observed
+// surfaces rather than with the volume of their bounding box.
+////////////////////////////////////////////////////////////////////////
+
+
+
+////////////////////////////////////////////////////////////////////////
+// Voxel definition
+////////////////////////////////////////////////////////////////////////
+
+struct RGBDFusionVoxel {
+  RNScalar32 distance;
+  RNScalar32 weight;
+  RNUChar8 color[4];
+};
+
+
+
+////////////////////////////////////////////////////////////////////////
+// Class definition
+////////////////////////////////////////////////////////////////////////
+
+class RGBDFusion {
+public:
+  // Constructors/destructors
+  RGBDFusion(RNLength voxel_spacing = 0.01, RNLength truncation_distance = 0.04);
+  ~RGBDFusion(void);
+
+  // Property functions
+  RNLength VoxelSpacing(void) const;
+  RNLength TruncationDistance(void) const;
+  RNLength MaxDepth(void) const;
+  RNScalar MaxWeight(void) const;
+  int NIntegratedImages(void) const;
+  R3Box WorldBBox(void) const;
+
+  // Block property functions
+  int NBlocks(void) const;
+  unsigned long long NBytes(void) const;
+
+  // Voxel access functions
+  const RGBDFusionVoxel *Voxel(int i, int j, int k) const;
+  R3Point VoxelWorldPosition(int i, int j, int k) const;
+  RNScalar WorldDistance(const R3Point& world_position) const;
+
+  // Manipulation functions
+  void SetMaxDepth(RNLength max_depth);
+  void SetMaxWeight(RNScalar max_weight);
+  void Empty(void);
+
+  // Integration functions
+  int IntegrateImage(RGBDImage *image);
+  int IntegrateImage(const R2Grid& depth_image,
+    const R3Matrix& intrinsics, const R3Affine& camera_to_world,
+    const R2Grid *red_image = NULL, const R2Grid *green_image = NULL, const R2Grid *blue_image = NULL);
+  int IntegrateConfiguration(RGBDConfiguration *configuration);
+
+  // Surface extraction functions
+  int ExtractMesh(R3Mesh *mesh, RNScalar min_weight = 0) const;
+
+public:
+  // Block access functions (for use by algorithms that traverse blocks)
+  RGBDFusionVoxel *BlockVoxels(int block_index) const;
+  void BlockIndices(int block_index, int& bx, int& by, int& bz) const;
+  int FindBlock(int bx, int by, int bz) const;
+  int AllocateBlock(int bx, int by, int bz);
+
+private:
+  void RehashBlocks(int hash_size);
+
+private:
+  RNLength voxel_spacing;
+  RNLength truncation_distance;
+  RNLength max_depth;
+  RNScalar max_weight;
+  int nintegrated_images;
+  RGBDFusionVoxel **block_voxels;
+  RNInt64 *block_keys;
+  int nblocks;
+  int nallocated_blocks;
+  int *hash_table;
+  int hash_size;
+};
+
+
+
+////////////////////////////////////////////////////////////////////////
+// Useful constants
+////////////////////////////////////////////////////////////////////////
+
+const int RGBD_FUSION_BLOCK_SIZE = 8;
+const int RGBD_FUSION_BLOCK_VOXELS = 512;
+
+
+
+////////////////////////////////////////////////////////////////////////
+// Inline functions
+////////////////////////////////////////////////////////////////////////
+
+inline RNLength RGBDFusion::
+VoxelSpacing(void) const
+{
+  // Return distance between voxel centers
+  return voxel_spacing;
+}
+
+
+
+inline RNLength RGBDFusion::
+TruncationDistance(void) const
+{
+  // Return distance beyond which signed distances are truncated
+  return truncation_distance;
+}
+
+
+
+inline RNLength RGBDFusion::
+MaxDepth(void) const
+{
+  // Return maximum depth integrated (0 means no limit)
+  return max_depth;
+}
+
+
+
+inline RNScalar RGBDFusion::
+MaxWeight(void) const
+{
+  // Return maximum weight of a voxel (older observations fade once it is reached)
+  return max_weight;
+}
+
+
+
+inline int RGBDFusion::
+NIntegratedImages(void) const
+{
+  // Return number of images integrated so far
+  return nintegrated_images;
+}
+
+
+
+inline int RGBDFusion::
+NBlocks(void) const
+{
+  // Return number of allocated blocks
+  return nblocks;
+}
+
+
+
+inline unsigned long long RGBDFusion::
+NBytes(void) const
+{
+  // Return (approximate) number of bytes used for blocks
+  return (unsigned long long) nblocks * RGBD_FUSION_BLOCK_VOXELS * sizeof(RGBDFusionVoxel)
+    + (unsigned long long) nallocated_blocks * (sizeof(RGBDFusionVoxel *) + sizeof(RNInt64))
+    + (unsigned long long) hash_size * sizeof(int);
+}
+
+
+
+inline RGBDFusionVoxel *RGBDFusion::
+BlockVoxels(int block_index) const
+{
+  // Return voxels of allocated block (indexed by (k*8 + j)*8 + i)
+  assert((0 <= block_index) && (block_index < nblocks));
+  return block_voxels[block_index];
+}
+
+
+
+inline void RGBDFusion::
+BlockIndices(int block_index, int& bx, int& by, int& bz) const
+{
+  // Return block coordinates of allocated block (21 bits per coordinate, offset to be positive)
+  assert((0 <= block_index) && (block_index < nblocks));
+  RNInt64 key = block_keys[block_index];
+  bx = (int) (key & 0x1FFFFF) - 0x100000;
+  by = (int) ((key >> 21) & 0x1FFFFF) - 0x100000;
+  bz = (int) ((key >> 42) & 0x1FFFFF) - 0x100000;
+}
+
+
+
+inline int RGBDFusion::
+FindBlock(int bx, int by, int bz) const
+{
+  // Return index of allocated block (or -1 if not allocated)
+  if (nblocks == 0) return -1;
+  RNInt64 key = ((RNInt64) (bz + 0x100000) << 42) | ((RNInt64) (by + 0x100000) << 21) | (RNInt64) (bx + 0x100000);
+  RNUInt64 h = ((RNUInt64) key * 0x9E3779B97F4A7C15ULL) >> 32;
+  int mask = hash_size - 1;
+  for (int slot = (int) (h & mask); hash_table[slot] >= 0; slot = (slot + 1) & mask) {
+    if (block_keys[hash_table[slot]] == key) return hash_table[slot];
+  }
+  return -1;
+}
+
+
+
+inline R3Point RGBDFusion::
+VoxelWorldPosition(int i, int j, int k) const
+{
+  // Return world position of voxel center
+  return R3Point(i * voxel_spacing, j * voxel_spacing, k * voxel_spacing);
+}
+
+
+
@@ -9,6 +9,10 @@
 ////////////////////////////////////////////////////////////////////////
 
 #include "RGBD.h"
+#include <sys/stat.h>
+#if (RN_OS != RN_WINDOWS)
+#  include <dirent.h>
+#endif
 
 
 
@@ -29,7 +33,9 @@ RGBDImage(void)
     color_filename(NULL),
     depth_filename(NULL),
     color_resident_count(0),
-    depth_resident_count(0)
+    depth_resident_count(0),
+    color_cache_entry(NULL),
+    depth_cache_entry(NULL)
 {
 }
 
@@ -49,7 +55,9 @@ RGBDImage(const char *color_filename, const char *depth_filename,
     color_filename((color_filename) ? strdup(color_filename) : NULL),
     depth_filename((depth_filename) ? strdup(depth_filename) : NULL),
     color_resident_count(0),
-    depth_resident_count(0)
+    depth_resident_count(0),
+    color_cache_entry(NULL),
+    depth_cache_entry(NULL)
 {
 }
 
@@ -947,6 +955,419 @@ FillMissingDepthValues(R2Grid& depth_image,
 
 
 
+////////////////////////////////////////////////////////////////////////
+// File cache functions
+////////////////////////////////////////////////////////////////////////
+
+// Types of file cache entries
+#define RGBD_FILE_CACHE_COLOR  1
+#define RGBD_FILE_CACHE_DEPTH  2
+
+
+
+// Header of file cache entry (followed by source filename and raw little-endian pixels)
+struct RGBDFileCacheHeader {
+  char magic[16];
+  int type;
+  int width, height;
+  int ncomponents;
+  int nbytes_per_row;
+  int source_filename_length;
+  unsigned long long source_size;
+  long long source_mtime;
+};
+
+
+
+// File cache entry on disk (for enforcing maximum size)
+struct RGBDFileCacheEntry {
+  char *filename;
+  unsigned long long size;
+  long long mtime;
+};
+
+
+
+// File cache variables
+static char *file_cache_directory = NULL;
+static unsigned long long file_cache_size = 0;
+static unsigned long long file_cache_max_size = 0;
+static RNArray<RGBDFileCacheEntry *> file_cache_entries;
+
+
+
+static int
+RGBDCompareFileCacheEntries(const void *data1, const void *data2)
+{
+  // Sort entries from oldest to newest
+  RGBDFileCacheEntry *entry1 = *((RGBDFileCacheEntry **) data1);
+  RGBDFileCacheEntry *entry2 = *((RGBDFileCacheEntry **) data2);
+  if (entry1->mtime < entry2->mtime) return -1;
+  if (entry1->mtime > entry2->mtime) return 1;
+  return 0;
+}
+
+
+
+static void
+TrimFileCacheEntries(void)
+{
+  // Delete oldest entries until under maximum size (the newest is always kept)
+  if (file_cache_max_size == 0) return;
+  int ndeleted = 0;
+  while ((file_cache_size > file_cache_max_size) && (ndeleted < file_cache_entries.NEntries() - 1)) {
+    RGBDFileCacheEntry *oldest = file_cache_entries.Kth(ndeleted++);
+    remove(oldest->filename);
+    file_cache_size -= oldest->size;
+    free(oldest->filename);
+    delete oldest;
+  }
+
+  // Remove deleted entries from array
+  if (ndeleted > 0) {
+    RNArray<RGBDFileCacheEntry *> remaining;
+    for (int i = ndeleted; i < file_cache_entries.NEntries(); i++) remaining.Insert(file_cache_entries.Kth(i));
+    file_cache_entries = remaining;
+  }
+}
+
+
+
+static void
+InsertFileCacheEntry(const char *filename, unsigned long long size, long long mtime)
+{
+  // Remember entry (caller must be in critical section)
+  RGBDFileCacheEntry *entry = new RGBDFileCacheEntry();
+  entry->filename = strdup(filename);
+  entry->size = size;
+  entry->mtime = mtime;
+  file_cache_entries.Insert(entry);
+  file_cache_size += size;
+
+  // Enforce maximum size
+  TrimFileCacheEntries();
+}
+
+
+
+static void
+EmptyFileCacheEntries(void)
+{
+  // Forget entries (does not delete files)
+  for (int i = 0; i < file_cache_entries.NEntries(); i++) {
+    RGBDFileCacheEntry *entry = file_cache_entries.Kth(i);
+    free(entry->filename);
+    delete entry;
+  }
+  file_cache_entries.Empty();
+  file_cache_size = 0;
+}
+
+
+
+static void
+ScanFileCacheEntries(void)
+{
+#if (RN_OS != RN_WINDOWS)
+  // Open directory
+  DIR *dir = opendir(file_cache_directory);
+  if (!dir) return;
+
+  // Find entries already in directory
+  struct dirent *dirent;
+  while ((dirent = readdir(dir)) != NULL) {
+    const char *suffix = strrchr(dirent->d_name, '.');
+    if (!suffix || strcmp(suffix, ".rgbdc")) continue;
+    char filename[4096];
+    sprintf(filename, "%s/%s", file_cache_directory, dirent->d_name);
+    struct stat st;
+    if (stat(filename, &st) != 0) continue;
+    RGBDFileCacheEntry *entry = new RGBDFileCacheEntry();
+    entry->filename = strdup(filename);
+    entry->size = st.st_size;
+    entry->mtime = st.st_mtime;
+    file_cache_entries.Insert(entry);
+    file_cache_size += st.st_size;
+  }
+
+  // Close directory
+  closedir(dir);
+
+  // Sort entries from oldest to newest
+  file_cache_entries.Sort(RGBDCompareFileCacheEntries);
+#endif
+}
+
+
+
+static int
+GetFileCacheFilename(const char *source_filename, char *cache_filename,
+  unsigned long long& source_size, long long& source_mtime)
+{
+  // Get source file size and modification time
+  struct stat st;
+  if (stat(source_filename, &st) != 0) return 0;
+  source_size = st.st_size;
+  source_mtime = st.st_mtime;
+
+  // Get cache filename (from hash of source filename, size, and modification time)
+  int status = 0;
+#pragma omp critical(RGBDFileCache)
+  {
+    if (file_cache_directory) {
+      unsigned long long hash = 14695981039346656037ULL;
+      for (const char *c = source_filename; *c; c++) hash = (hash ^ (unsigned char) *c) * 1099511628211ULL;
+      for (int i = 0; i < 8; i++) hash = (hash ^ ((source_size >> (8*i)) & 0xFF)) * 1099511628211ULL;
+      for (int i = 0; i < 8; i++) hash = (hash ^ ((source_mtime >> (8*i)) & 0xFF)) * 1099511628211ULL;
+      sprintf(cache_filename, "%s/%016llx.rgbdc", file_cache_directory, hash);
+      status = 1;
+    }
+  }
+
+  // Return whether file cache is enabled
+  return status;
+}
+
+
+
+static FILE *
+OpenFileCacheEntry(const char *source_filename, int type, RGBDFileCacheHeader& header)
+{
+  // Get cache filename
+  char cache_filename[4096];
+  unsigned long long source_size;
+  long long source_mtime;
+  if (!file_cache_directory) return NULL;
+  if (!GetFileCacheFilename(source_filename, cache_filename, source_size, source_mtime)) return NULL;
+
+  // Open cache file
+  FILE *fp = fopen(cache_filename, "rb");
+  if (!fp) return NULL;
+
+  // Read header
+  if (fread(&header, sizeof(RGBDFileCacheHeader), 1, fp) != 1) { fclose(fp); return NULL; }
+
+  // Check header (entries are never updated in place, so any mismatch is a hash collision or a stale entry)
+  int length = strlen(source_filename);
+  if (strncmp(header.magic, "RGBDFileCache", 16) || (header.type != type) ||
+      (header.source_size != source_size) || (header.source_mtime != source_mtime) ||
+      (header.source_filename_length != length) || (header.width <= 0) || (header.height <= 0)) {
+    fclose(fp);
+    return NULL;
+  }
+
+  // Check source filename
+  char filename[4096];
+  if ((length >= 4096) || (fread(filename, 1, length, fp) != (size_t) length) ||
+      strncmp(filename, source_filename, length)) {
+    fclose(fp);
+    return NULL;
+  }
+
+  // Return file positioned at pixels
+  return fp;
+}
+
+
+
+static int
+WriteFileCacheEntry(const char *source_filename, int type,
+  int width, int height, int ncomponents, int nbytes_per_row, const void *pixels)
+{
+  // Get cache filename
+  char cache_filename[4096];
+  unsigned long long source_size;
+  long long source_mtime;
+  if (!file_cache_directory) return 0;
+  if (!GetFileCacheFilename(source_filename, cache_filename, source_size, source_mtime)) return 0;
+
+  // Fill header
+  RGBDFileCacheHeader header;
+  memset(&header, 0, sizeof(RGBDFileCacheHeader));
+  strncpy(header.magic, "RGBDFileCache", 16);
+  header.type = type;
+  header.width = width;
+  header.height = height;
+  header.ncomponents = ncomponents;
+  header.nbytes_per_row = nbytes_per_row;
+  header.source_filename_length = strlen(source_filename);
+  header.source_size = source_size;
+  header.source_mtime = source_mtime;
+
+  // Write to temporary file (so that other readers never see partial entries)
+  char tmp_filename[8192];
+  sprintf(tmp_filename, "%s.tmp", cache_filename);
+  FILE *fp = fopen(tmp_filename, "wb");
+  if (!fp) return 0;
+  size_t nbytes = (size_t) height * nbytes_per_row;
+  int status = 1;
+  if (fwrite(&header, sizeof(RGBDFileCacheHeader), 1, fp) != 1) status = 0;
+  else if (fwrite(source_filename, 1, header.source_filename_length, fp) != (size_t) header.source_filename_length) status = 0;
+  else if (fwrite(pixels, 1, nbytes, fp) != nbytes) status = 0;
+  fclose(fp);
+
+  // Move temporary file into place
+  if (status) {
+    remove(cache_filename);
+    if (rename(tmp_filename, cache_filename) != 0) status = 0;
+  }
+  if (!status) {
+    remove(tmp_filename);
+    return 0;
+  }
+
+  // Remember entry and enforce maximum size
+  unsigned long long entry_size = sizeof(RGBDFileCacheHeader) + header.source_filename_length + nbytes;
+#pragma omp critical(RGBDFileCache)
+  {
+    InsertFileCacheEntry(cache_filename, entry_size, (long long) time(NULL));
+  }
+
+  // Return success
+  return 1;
+}
+
+
+
+static int
+ReadFileCacheColorImage(const char *source_filename, R2Image& color_image)
+{
+  // Open cache entry
+  RGBDFileCacheHeader header;
+  FILE *fp = OpenFileCacheEntry(source_filename, RGBD_FILE_CACHE_COLOR, header);
+  if (!fp) return 0;
+
+  // Check pixel layout
+  R2Image image(header.width, header.height, header.ncomponents);
+  if (image.RowSize() != header.nbytes_per_row) { fclose(fp); return 0; }
+
+  // Read pixels directly into image
+  size_t nbytes = (size_t) header.height * header.nbytes_per_row;
+  if (fread((unsigned char *) image.Pixels(), 1, nbytes, fp) != nbytes) { fclose(fp); return 0; }
+  fclose(fp);
+
+  // Return success
+  color_image = image;
+  return 1;
+}
+
+
+
+static int
+ReadFileCacheDepthImage(const char *source_filename, R2Grid& depth_image)
+{
+  // Open cache entry
+  RGBDFileCacheHeader header;
+  FILE *fp = OpenFileCacheEntry(source_filename, RGBD_FILE_CACHE_DEPTH, header);
+  if (!fp) return 0;
+
+  // Check pixel layout
+  if ((header.ncomponents != 1) || (header.nbytes_per_row != header.width * (int) sizeof(RNScalar32))) {
+    fclose(fp);
+    return 0;
+  }
+
+  // Read values (directly into grid, if possible)
+  depth_image = R2Grid(header.width, header.height);
+  RNScalar *grid_values = (RNScalar *) depth_image.GridValues();
+  int nvalues = header.width * header.height;
+  if (sizeof(RNScalar) == sizeof(RNScalar32)) {
+    if (fread(grid_values, sizeof(RNScalar32), nvalues, fp) != (size_t) nvalues) { fclose(fp); return 0; }
+  }
+  else {
+    RNScalar32 *values = new RNScalar32 [ nvalues ];
+    int status = (fread(values, sizeof(RNScalar32), nvalues, fp) == (size_t) nvalues) ? 1 : 0;
+    for (int i = 0; i < nvalues; i++) grid_values[i] = values[i];
+    delete [] values;
+    if (!status) { fclose(fp); return 0; }
+  }
+
+  // Close file
+  fclose(fp);
+
+  // Return success
+  return 1;
+}
+
+
+
+static int
+WriteFileCacheColorImage(const char *source_filename, const R2Image& color_image)
+{
+  // Write pixels (including row padding)
+  return WriteFileCacheEntry(source_filename, RGBD_FILE_CACHE_COLOR,
+    color_image.Width(), color_image.Height(), color_image.NComponents(),
+    color_image.RowSize(), color_image.Pixels());
+}
+
+
+
+static int
+WriteFileCacheDepthImage(const char *source_filename, const R2Grid& depth_image)
+{
+  // Write values as 32-bit floats
+  int width = depth_image.XResolution();
+  int height = depth_image.YResolution();
+  int nvalues = width * height;
+  if (nvalues == 0) return 0;
+  if (sizeof(RNScalar) == sizeof(RNScalar32)) {
+    return WriteFileCacheEntry(source_filename, RGBD_FILE_CACHE_DEPTH,
+      width, height, 1, width * sizeof(RNScalar32), depth_image.GridValues());
+  }
+  else {
+    RNScalar32 *values = new RNScalar32 [ nvalues ];
+    const RNScalar *grid_values = depth_image.GridValues();
+    for (int i = 0; i < nvalues; i++) values[i] = grid_values[i];
+    int status = WriteFileCacheEntry(source_filename, RGBD_FILE_CACHE_DEPTH,
+      width, height, 1, width * sizeof(RNScalar32), values);
+    delete [] values;
+    return status;
+  }
+}
+
+
+
+void RGBDImage::
+SetFileCacheDirectory(const char *directory, unsigned long long max_bytes)
+{
+  // Set directory where decoded color/depth files are cached (NULL for none)
+#pragma omp critical(RGBDFileCache)
+  {
+    // Forget previous directory
+    if (file_cache_directory) free(file_cache_directory);
+    file_cache_directory = NULL;
+    EmptyFileCacheEntries();
+
+    // Remember new directory and find entries already in it
+    file_cache_max_size = max_bytes;
+    if (directory) {
+      file_cache_directory = strdup(directory);
+      ScanFileCacheEntries();
+      TrimFileCacheEntries();
+    }
+  }
+}
+
+
+
+const char *RGBDImage::
+FileCacheDirectory(void)
+{
+  // Return directory where decoded color/depth files are cached
+  return file_cache_directory;
+}
+
+
+
+unsigned long long RGBDImage::
+FileCacheSize(void)
+{
+  // Return number of bytes in file cache directory (as known to this process)
+  return file_cache_size;
+}
+
+
+
 ////////////////////////////////////////////////////////////////////////
 // Create/read/write/release functions
 ////////////////////////////////////////////////////////////////////////
@@ -1019,19 +1440,11 @@ ReadColorChannels(void)
     return 1;
   }
 
-  // Initialize image
+  // Read color image (from configuration's cache, if possible)
   R2Image color_image;
-
-  // Check filename
-  if (color_filename) {
-    // Get full filename
-    char full_filename[4096];
-    const char *dirname = (configuration) ? configuration->ColorDirectory() : NULL;
-    if (dirname) sprintf(full_filename, "%s/%s", dirname, color_filename);
-    else sprintf(full_filename, "%s", color_filename);
-
-    // Read color image
-    if (!color_image.Read(full_filename)) return 0;
+  if (!configuration || !configuration->ReadCachedColorImage(this, color_image)) {
+    if (!ReadColorImage(color_image)) return 0;
+    if (configuration) configuration->CacheColorImage(this, color_image);
   }
 
   // Create color channels
@@ -1049,9 +1462,48 @@ ReadDepthChannel(void)
     return 1;
   }
 
-  // Initialize image
+  // Read depth image (from configuration's cache, if possible)
   R2Grid depth_image;
+  if (!configuration || !configuration->ReadCachedDepthImage(this, depth_image)) {
+    if (!ReadDepthImage(depth_image)) return 0;
+    if (configuration) configuration->CacheDepthImage(this, depth_image);
+  }
+
+  // Convert file values to depths
+  if (!ProcessDepthImage(depth_image)) return 0;
+
+  // Create depth channel
+  return CreateDepthChannel(depth_image);
+}
+
+
+
+int RGBDImage::
+ReadColorImage(R2Image& color_image) const
+{
+  // Check filename
+  if (color_filename) {
+    // Get full filename
+    char full_filename[4096];
+    const char *dirname = (configuration) ? configuration->ColorDirectory() : NULL;
+    if (dirname) sprintf(full_filename, "%s/%s", dirname, color_filename);
+    else sprintf(full_filename, "%s", color_filename);
+
+    // Read color image (from file cache, if possible)
+    if (ReadFileCacheColorImage(full_filename, color_image)) return 1;
+    if (!color_image.Read(full_filename)) return 0;
+    if (file_cache_directory) WriteFileCacheColorImage(full_filename, color_image);
+  }
 
+  // Return success
+  return 1;
+}
+
+
+
+int RGBDImage::
+ReadDepthImage(R2Grid& depth_image) const
+{
   // Check filename
   if (depth_filename) {
     // Get full filename
@@ -1060,39 +1512,55 @@ ReadDepthChannel(void)
     if (dirname) sprintf(full_filename, "%s/%s", dirname, depth_filename);
     else sprintf(full_filename, "%s", depth_filename);
 
-    // Read depth image
+    // Read depth image (from file cache, if possible)
+    if (ReadFileCacheDepthImage(full_filename, depth_image)) return 1;
     if (!depth_image.ReadFile(full_filename)) return 0;
-    depth_image.Substitute(0, R2_GRID_UNKNOWN_VALUE);
-    if (strstr(depth_filename, ".png")) depth_image.Multiply(0.001);
-    // MaskBoundaries(depth_image);
-
-    // Perform dataset-dependent processing
-    if (configuration && configuration->DatasetFormat()) {
-      if (!strcmp(configuration->DatasetFormat(), "matterport")) {
-        depth_image.Multiply(0.25);
-      }
-      else if (!strcmp(configuration->DatasetFormat(), "tum")) {
-        depth_image.Multiply(0.2);
-      }
+    if (file_cache_directory) WriteFileCacheDepthImage(full_filename, depth_image);
+  }
+  
+  // Return success
+  return 1;
+}
+
+
+
+int RGBDImage::
+ProcessDepthImage(R2Grid& depth_image) const
+{
+  // Check filename
+  if (!depth_filename) return 1;
+
+  // Convert file values to depths
+  depth_image.Substitute(0, R2_GRID_UNKNOWN_VALUE);
+  if (strstr(depth_filename, ".png")) depth_image.Multiply(0.001);
+  // MaskBoundaries(depth_image);
+
+  // Perform dataset-dependent processing
+  if (configuration && configuration->DatasetFormat()) {
+    if (!strcmp(configuration->DatasetFormat(), "matterport")) {
+      depth_image.Multiply(0.25);
+    }
+    else if (!strcmp(configuration->DatasetFormat(), "tum")) {
+      depth_image.Multiply(0.2);
     }
+  }
 
-    // Smooth depth image
-    if (configuration && configuration->DatasetFormat()) {
-      if (!strcmp(configuration->DatasetFormat(), "sunrgbd") ||
-          !strcmp(configuration->DatasetFormat(), "sun3d") ||
-          !strcmp(configuration->DatasetFormat(), "nyu") ||
-          !strcmp(configuration->DatasetFormat(), "princeton")) {
-        RNScalar d_sigma = 0.05;
-        RNScalar xy_sigma = 3 * depth_image.XResolution() / 640.0;
-        // depth_image.Substitute(0, R2_GRID_UNKNOWN_VALUE);
-        depth_image.BilateralFilter(xy_sigma, d_sigma);
-        // depth_image.Substitute(R2_GRID_UNKNOWN_VALUE, 0);
-      }
+  // Smooth depth image
+  if (configuration && configuration->DatasetFormat()) {
+    if (!strcmp(configuration->DatasetFormat(), "sunrgbd") ||
+        !strcmp(configuration->DatasetFormat(), "sun3d") ||
+        !strcmp(configuration->DatasetFormat(), "nyu") ||
+        !strcmp(configuration->DatasetFormat(), "princeton")) {
+      RNScalar d_sigma = 0.05;
+      RNScalar xy_sigma = 3 * depth_image.XResolution() / 640.0;
+      // depth_image.Substitute(0, R2_GRID_UNKNOWN_VALUE);
+      depth_image.BilateralFilter(xy_sigma, d_sigma);
+      // depth_image.Substitute(R2_GRID_UNKNOWN_VALUE, 0);
     }
   }
-  
-  // Create depth channel
-  return CreateDepthChannel(depth_image);
+
+  // Return success
+  return 1;
 }
 
 
@@ -1221,6 +1689,9 @@ ReleaseDepthChannel(void)
 void RGBDImage::
 SetColorFilename(const char *filename)
 {
+  // Remove decoded channels from configuration's cache
+  if (configuration) configuration->UncacheImage(this);
+
   // Set filename
   if (color_filename) free(color_filename);
   if (filename && strcmp(filename, "-")) color_filename = strdup(filename);
@@ -1232,6 +1703,9 @@ SetColorFilename(const char *filename)
 void RGBDImage::
 SetDepthFilename(const char *filename)
 {
+  // Remove decoded channels from configuration's cache
+  if (configuration) configuration->UncacheImage(this);
+
   // Set filename
   if (depth_filename) free(depth_filename);
   if (filename && strcmp(filename, "-")) depth_filename = strdup(filename);
@@ -105,6 +105,19 @@ public:
   // Channel creation
   virtual int CreateColorChannels(const R2Image& color_image);
   virtual int CreateDepthChannel(const R2Grid& image);
+
+  // Channel decoding (reads files without making channels resident,
+  // ProcessDepthImage converts values read from a file into depths)
+  virtual int ReadColorImage(R2Image& color_image) const;
+  virtual int ReadDepthImage(R2Grid& depth_image) const;
+  virtual int ProcessDepthImage(R2Grid& depth_image) const;
+
+  // File cache functions (decoded color/depth files are dumped raw into the
+  // directory on first read, and read back from there by later runs;
+  // oldest entries are deleted beyond max_bytes, unless it is zero)
+  static void SetFileCacheDirectory(const char *directory, unsigned long long max_bytes = 0);
+  static const char *FileCacheDirectory(void);
+  static unsigned long long FileCacheSize(void);
   
   // Filename access functions
   const char *ColorFilename(void) const;
@@ -134,6 +147,8 @@ private:
   char *depth_filename;
   int color_resident_count;
   int depth_resident_count;
+  RGBDChannelCacheEntry *color_cache_entry;
+  RGBDChannelCacheEntry *depth_cache_entry;
 };
 
 
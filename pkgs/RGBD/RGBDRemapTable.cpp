@@ -0,0 +1,910 @@
+////////////////////////////////////////////////////////////////////////
+// Source file for RGBDRemapTable class
+////////////////////////////////////////////////////////////////////////
+
+
+
+////////////////////////////////////////////////////////////////////////
+// Include files
+////////////////////////////////////////////////////////////////////////
+
+#include "RGBD.h"
+
+
+
+////////////////////////////////////////////////////////////////////////
+// Shared table variables
+////////////////////////////////////////////////////////////////////////
+
+static RNArray<RGBDRemapTable *> shared_tables;
+static char *shared_table_directory = NULL;
+
+
+
+////////////////////////////////////////////////////////////////////////
+// Constructors/destructors
+////////////////////////////////////////////////////////////////////////
+
+RGBDRemapTable::
+RGBDRemapTable(void)
+  : type(RGBD_REMAP_NONE),
+    input_width(0),
+    input_height(0),
+    output_width(0),
+    output_height(0),
+    nkey(0),
+    bilinear_indices(NULL),
+    bilinear_weights(NULL),
+    footprint_offsets(NULL),
+    footprint_indices(NULL),
+    empty_value(R2_GRID_UNKNOWN_VALUE),
+    nsamples(0),
+    sample_indices(NULL),
+    sample_rays(NULL),
+    splat_extrinsics(R4identity_matrix)
+{
+  // Initialize splat intrinsics
+  for (int i = 0; i < 4; i++) splat_intrinsics[i] = 0;
+}
+
+
+
+RGBDRemapTable::
+~RGBDRemapTable(void)
+{
+  // Delete tables
+  Empty();
+}
+
+
+
+////////////////////////////////////////////////////////////////////////
+// Property functions
+////////////////////////////////////////////////////////////////////////
+
+unsigned long long RGBDRemapTable::
+NBytes(void) const
+{
+  // Return number of bytes used for tables
+  unsigned long long nbytes = 0;
+  int noutputs = output_width * output_height;
+  if (bilinear_indices) nbytes += (unsigned long long) noutputs * (sizeof(int) + 2 * sizeof(RNScalar32));
+  if (footprint_offsets) nbytes += (unsigned long long) (noutputs + 1) * sizeof(int);
+  if (footprint_indices) nbytes += (unsigned long long) footprint_offsets[noutputs] * sizeof(int);
+  if (sample_indices) nbytes += (unsigned long long) nsamples * (sizeof(int) + 2 * sizeof(RNScalar32));
+  return nbytes;
+}
+
+
+
+////////////////////////////////////////////////////////////////////////
+// Creation functions
+////////////////////////////////////////////////////////////////////////
+
+void RGBDRemapTable::
+Empty(void)
+{
+  // Delete tables
+  if (bilinear_indices) { delete [] bilinear_indices; bilinear_indices = NULL; }
+  if (bilinear_weights) { delete [] bilinear_weights; bilinear_weights = NULL; }
+  if (footprint_offsets) { delete [] footprint_offsets; footprint_offsets = NULL; }
+  if (footprint_indices) { delete [] footprint_indices; footprint_indices = NULL; }
+  if (sample_indices) { delete [] sample_indices; sample_indices = NULL; }
+  if (sample_rays) { delete [] sample_rays; sample_rays = NULL; }
+  nsamples = 0;
+
+  // Reset geometry
+  type = RGBD_REMAP_NONE;
+  input_width = input_height = 0;
+  output_width = output_height = 0;
+  nkey = 0;
+}
+
+
+
+static void
+AppendCameraKey(RNScalar *key, int& nkey, const RGBDCamera *camera)
+{
+  // Append all parameters of camera (or zeroes) to key
+  if (!camera) {
+    for (int i = 0; i < 40; i++) key[nkey++] = 0;
+    return;
+  }
+
+  // Append dimensions
+  key[nkey++] = camera->colorWidth;
+  key[nkey++] = camera->colorHeight;
+  key[nkey++] = camera->depthWidth;
+  key[nkey++] = camera->depthHeight;
+
+  // Append color intrinsics and distortion
+  key[nkey++] = camera->fx_color;
+  key[nkey++] = camera->fy_color;
+  key[nkey++] = camera->mx_color;
+  key[nkey++] = camera->my_color;
+  key[nkey++] = camera->k1_color;
+  key[nkey++] = camera->k2_color;
+  key[nkey++] = camera->k3_color;
+  key[nkey++] = camera->k4_color;
+  key[nkey++] = camera->p1_color;
+  key[nkey++] = camera->p2_color;
+
+  // Append depth intrinsics and distortion
+  key[nkey++] = camera->fx_depth;
+  key[nkey++] = camera->fy_depth;
+  key[nkey++] = camera->mx_depth;
+  key[nkey++] = camera->my_depth;
+  key[nkey++] = camera->k1_depth;
+  key[nkey++] = camera->k2_depth;
+  key[nkey++] = camera->k3_depth;
+  key[nkey++] = camera->k4_depth;
+  key[nkey++] = camera->p1_depth;
+  key[nkey++] = camera->p2_depth;
+
+  // Append extrinsics
+  for (int i = 0; i < 4; i++) {
+    for (int j = 0; j < 4; j++) {
+      key[nkey++] = camera->depthToColorExtrinsics[i][j];
+    }
+  }
+}
+
+
+
+void RGBDRemapTable::
+SetKey(int type, const RGBDCamera *distorted_camera, const RGBDCamera *undistorted_camera,
+  int input_width, int input_height, int output_width, int output_height)
+{
+  // Set key with all parameters that determine the table
+  nkey = 0;
+  key[nkey++] = type;
+  key[nkey++] = input_width;
+  key[nkey++] = input_height;
+  key[nkey++] = output_width;
+  key[nkey++] = output_height;
+  AppendCameraKey(key, nkey, distorted_camera);
+  AppendCameraKey(key, nkey, undistorted_camera);
+  assert(nkey <= 96);
+}
+
+
+
+RNBoolean RGBDRemapTable::
+HasSameKey(const RGBDRemapTable& table) const
+{
+  // Check if tables were created with the same parameters
+  if (nkey != table.nkey) return FALSE;
+  for (int i = 0; i < nkey; i++) {
+    if (key[i] != table.key[i]) return FALSE;
+  }
+  return TRUE;
+}
+
+
+
+int RGBDRemapTable::
+CreateColorUndistortion(const RGBDCamera& distorted_camera, const RGBDCamera& undistorted_camera,
+  int input_width, int input_height)
+{
+  // Empty previous tables
+  Empty();
+
+  // Check cameras
+  if ((input_width < 2) || (input_height < 2)) return 0;
+  if ((distorted_camera.colorWidth == 0) || (distorted_camera.colorHeight == 0)) return 0;
+  if ((undistorted_camera.colorWidth == 0) || (undistorted_camera.colorHeight == 0)) return 0;
+  double sx = (double) distorted_camera.colorWidth / (double) undistorted_camera.colorWidth;
+  double sy = (double) distorted_camera.colorHeight / (double) undistorted_camera.colorHeight;
+
+  // Set geometry
+  this->type = RGBD_REMAP_BILINEAR;
+  this->input_width = input_width;
+  this->input_height = input_height;
+  this->output_width = undistorted_camera.colorWidth;
+  this->output_height = undistorted_camera.colorHeight;
+  SetKey(type, &distorted_camera, &undistorted_camera, input_width, input_height, output_width, output_height);
+
+  // Allocate tables
+  bilinear_indices = new int [ output_width * output_height ];
+  bilinear_weights = new RNScalar32 [ 2 * output_width * output_height ];
+
+  // Compute source position of every output pixel via reverse mapping
+#pragma omp parallel for schedule(dynamic, 8)
+  for (int output_iy = 0; output_iy < output_height; output_iy++) {
+    for (int output_ix = 0; output_ix < output_width; output_ix++) {
+      int output_index = output_iy*output_width + output_ix;
+      bilinear_indices[output_index] = -1;
+      bilinear_weights[2*output_index+0] = 0;
+      bilinear_weights[2*output_index+1] = 0;
+
+      // Compute coordinates in undistorted input image
+      // Note that this ignores p1 and p2
+      RNScalar x = sx * (output_ix + 0.5 - undistorted_camera.mx_color) + distorted_camera.mx_color;
+      RNScalar y = sy * (output_iy + 0.5 - undistorted_camera.my_color) + distorted_camera.my_color;
+
+      // Compute coordinates in distorted input image
+      if ((distorted_camera.k1_color != 0.0) || (distorted_camera.k2_color != 0.0) ||
+          (distorted_camera.k3_color != 0.0) || (distorted_camera.k4_color != 0.0) ||
+          (distorted_camera.p1_color != 0.0) || (distorted_camera.k2_color != 0.0)) {
+        double nx = (x - distorted_camera.mx_color) / distorted_camera.fx_color;
+        double ny = (y - distorted_camera.my_color) / distorted_camera.fy_color;
+        double rr = nx*nx + ny*ny; double rrrr = rr*rr;
+        double s = 1.0 + rr*distorted_camera.k1_depth + rrrr*distorted_camera.k2_depth + rrrr*rr*distorted_camera.k3_depth + rrrr*rrrr*distorted_camera.k4_depth;
+        nx = s*nx + distorted_camera.p2_color*(rr + 2*nx*nx) + 2*distorted_camera.p1_color*nx*ny;
+        ny = s*ny + distorted_camera.p1_color*(rr + 2*ny*ny) + 2*distorted_camera.p2_color*nx*ny;
+        x = nx*distorted_camera.fx_color + distorted_camera.mx_color;
+        y = ny*distorted_camera.fy_color + distorted_camera.my_color;
+      }
+
+      // Check if outside input image
+      if ((x < 0) || (x > input_width-1)) continue;
+      if ((y < 0) || (y > input_height-1)) continue;
+
+      // Remember top-left source pixel and bilinear weights
+      // (last row/column is interpolated with full weight from the previous one)
+      int ix = (int) x;
+      int iy = (int) y;
+      RNScalar dx = x - ix;
+      RNScalar dy = y - iy;
+      if (ix >= input_width-1) { ix = input_width-2; dx = 1; }
+      if (iy >= input_height-1) { iy = input_height-2; dy = 1; }
+      bilinear_indices[output_index] = iy*input_width + ix;
+      bilinear_weights[2*output_index+0] = dx;
+      bilinear_weights[2*output_index+1] = dy;
+    }
+  }
+
+  // Return success
+  return 1;
+}
+
+
+
+static int
+DepthUndistortionSample(const RGBDCamera& distorted_camera, const RGBDCamera& undistorted_camera,
+  int input_width, int input_height, int output_width, int output_height,
+  double undistorted_input_x, double undistorted_input_y, int& output_index)
+{
+  // Compute coordinates in distorted input image
+  // Note that this ignores p1 and p2
+  double distorted_input_x = undistorted_input_x;
+  double distorted_input_y = undistorted_input_y;
+  if ((distorted_camera.k1_depth != 0.0) || (distorted_camera.k2_depth != 0.0) ||
+      (distorted_camera.k3_depth != 0.0) || (distorted_camera.k3_depth != 0.0) ||
+      (distorted_camera.p1_depth != 0.0) || (distorted_camera.p2_depth != 0.0)) {
+    double nx = (undistorted_input_x - distorted_camera.mx_depth) / distorted_camera.fx_depth;
+    double ny = (undistorted_input_y - distorted_camera.my_depth) / distorted_camera.fy_depth;
+    double rr = nx*nx + ny*ny; double rrrr = rr*rr;
+    double s = 1.0 + rr*distorted_camera.k1_depth + rrrr*distorted_camera.k2_depth + rrrr*rr*distorted_camera.k3_depth + rrrr*rrrr*distorted_camera.k4_depth;
+    nx = s*nx + distorted_camera.p2_depth*(rr + 2*nx*nx) + 2*distorted_camera.p1_depth*nx*ny;
+    ny = s*ny + distorted_camera.p1_depth*(rr + 2*ny*ny) + 2*distorted_camera.p2_depth*nx*ny;
+    distorted_input_x = nx*distorted_camera.fx_depth + distorted_camera.mx_depth;
+    distorted_input_y = ny*distorted_camera.fy_depth + distorted_camera.my_depth;
+  }
+
+  // Get closest distorted input pixel
+  int distorted_input_ix = (int) (distorted_input_x + 0.5);
+  int distorted_input_iy = (int) (distorted_input_y + 0.5);
+  if (distorted_input_ix < 0) return -1;
+  if (distorted_input_ix >= input_width) return -1;
+  if (distorted_input_iy < 0) return -1;
+  if (distorted_input_iy >= input_height) return -1;
+
+  // Project into output pixel coordinates (independent of depth for identity extrinsics)
+  output_index = -1;
+  if (distorted_camera.depthToColorExtrinsics.IsIdentity()) {
+    double x = (undistorted_input_x - distorted_camera.mx_depth) / distorted_camera.fx_depth;
+    double y = (undistorted_input_y - distorted_camera.my_depth) / distorted_camera.fy_depth;
+    int undistorted_output_ix = (int) (undistorted_camera.mx_depth + x * undistorted_camera.fx_depth + 0.5);
+    int undistorted_output_iy = (int) (undistorted_camera.my_depth + y * undistorted_camera.fy_depth + 0.5);
+    if ((undistorted_output_ix >= 0) && (undistorted_output_ix < output_width) &&
+        (undistorted_output_iy >= 0) && (undistorted_output_iy < output_height)) {
+      output_index = undistorted_output_iy*output_width + undistorted_output_ix;
+    }
+  }
+
+  // Return index of input pixel
+  return distorted_input_iy*input_width + distorted_input_ix;
+}
+
+
+
+int RGBDRemapTable::
+CreateDepthUndistortion(const RGBDCamera& distorted_camera, const RGBDCamera& undistorted_camera,
+  int input_width, int input_height)
+{
+  // Empty previous tables
+  Empty();
+
+  // Check cameras
+  if ((input_width == 0) || (input_height == 0)) return 0;
+  if ((distorted_camera.depthWidth == 0) || (distorted_camera.depthHeight == 0)) return 0;
+  if ((undistorted_camera.depthWidth == 0) || (undistorted_camera.depthHeight == 0)) return 0;
+  RNBoolean splat = !distorted_camera.depthToColorExtrinsics.IsIdentity();
+
+  // Set geometry
+  this->type = (splat) ? RGBD_REMAP_SPLAT : RGBD_REMAP_FOOTPRINT;
+  this->input_width = input_width;
+  this->input_height = input_height;
+  this->output_width = undistorted_camera.depthWidth;
+  this->output_height = undistorted_camera.depthHeight;
+  this->empty_value = R2_GRID_UNKNOWN_VALUE;
+  SetKey(type, &distorted_camera, &undistorted_camera, input_width, input_height, output_width, output_height);
+  int noutputs = output_width * output_height;
+
+  // Sample input image more densely than output image (to avoid pin-holes in output image)
+  double step_factor = 0.5;
+  double x_step = step_factor * input_width / (double) output_width;
+  double y_step = step_factor * input_height / (double) output_height;
+
+  // Count samples (per output pixel if footprints)
+  if (!splat) {
+    footprint_offsets = new int [ noutputs + 1 ];
+    for (int i = 0; i <= noutputs; i++) footprint_offsets[i] = 0;
+  }
+  for (double y = 0.5*y_step; y < input_height; y += y_step) {
+    for (double x = 0.5*x_step; x < input_width; x += x_step) {
+      int output_index = -1;
+      int input_index = DepthUndistortionSample(distorted_camera, undistorted_camera,
+        input_width, input_height, output_width, output_height, x, y, output_index);
+      if (input_index < 0) continue;
+      if (splat) nsamples++;
+      else if (output_index >= 0) footprint_offsets[output_index+1]++;
+    }
+  }
+
+  // Allocate tables
+  int *footprint_counts = NULL;
+  if (splat) {
+    sample_indices = new int [ nsamples ];
+    sample_rays = new RNScalar32 [ 2 * nsamples ];
+    nsamples = 0;
+  }
+  else {
+    for (int i = 0; i < noutputs; i++) footprint_offsets[i+1] += footprint_offsets[i];
+    footprint_indices = new int [ footprint_offsets[noutputs] ];
+    footprint_counts = new int [ noutputs ];
+    for (int i = 0; i < noutputs; i++) footprint_counts[i] = 0;
+  }
+
+  // Fill tables
+  for (double y = 0.5*y_step; y < input_height; y += y_step) {
+    for (double x = 0.5*x_step; x < input_width; x += x_step) {
+      int output_index = -1;
+      int input_index = DepthUndistortionSample(distorted_camera, undistorted_camera,
+        input_width, input_height, output_width, output_height, x, y, output_index);
+      if (input_index < 0) continue;
+      if (splat) {
+        // Remember source pixel and ray in depth camera coordinates
+        sample_indices[nsamples] = input_index;
+        sample_rays[2*nsamples+0] = (x - distorted_camera.mx_depth) / distorted_camera.fx_depth;
+        sample_rays[2*nsamples+1] = (y - distorted_camera.my_depth) / distorted_camera.fy_depth;
+        nsamples++;
+      }
+      else if (output_index >= 0) {
+        // Add source pixel to footprint of output pixel (if not already there)
+        int *footprint = &footprint_indices[footprint_offsets[output_index]];
+        int k = 0;
+        while ((k < footprint_counts[output_index]) && (footprint[k] != input_index)) k++;
+        if (k == footprint_counts[output_index]) footprint[footprint_counts[output_index]++] = input_index;
+      }
+    }
+  }
+
+  // Compact footprints (removing space left by duplicates)
+  if (!splat) {
+    int nindices = 0;
+    for (int i = 0; i < noutputs; i++) {
+      int start = footprint_offsets[i];
+      footprint_offsets[i] = nindices;
+      for (int k = 0; k < footprint_counts[i]; k++) {
+        footprint_indices[nindices++] = footprint_indices[start + k];
+      }
+    }
+    footprint_offsets[noutputs] = nindices;
+    delete [] footprint_counts;
+  }
+
+  // Remember transformation into output camera
+  if (splat) {
+    splat_extrinsics = distorted_camera.depthToColorExtrinsics;
+    splat_intrinsics[0] = undistorted_camera.fx_depth;
+    splat_intrinsics[1] = undistorted_camera.fy_depth;
+    splat_intrinsics[2] = undistorted_camera.mx_depth;
+    splat_intrinsics[3] = undistorted_camera.my_depth;
+  }
+
+  // Return success
+  return 1;
+}
+
+
+
+int RGBDRemapTable::
+CreateDepthResampling(int input_width, int input_height, int output_width, int output_height)
+{
+  // Empty previous tables
+  Empty();
+
+  // Check dimensions
+  if ((input_width == 0) || (input_height == 0)) return 0;
+  if ((output_width == 0) || (output_height == 0)) return 0;
+
+  // Set geometry
+  this->type = RGBD_REMAP_FOOTPRINT;
+  this->input_width = input_width;
+  this->input_height = input_height;
+  this->output_width = output_width;
+  this->output_height = output_height;
+  this->empty_value = 0;
+  SetKey(type, NULL, NULL, input_width, input_height, output_width, output_height);
+  int noutputs = output_width * output_height;
+
+  // Compute scale factors
+  double xscale = (double) input_width / (double) output_width;
+  double yscale = (double) input_height / (double) output_height;
+
+  // Compute footprint ranges of output columns and rows (max < min if empty)
+  int *column_ranges = new int [ 2 * output_width ];
+  int *row_ranges = new int [ 2 * output_height ];
+  for (int dim = 0; dim < 2; dim++) {
+    int noutput = (dim == 0) ? output_width : output_height;
+    int ninput = (dim == 0) ? input_width : input_height;
+    double scale = (dim == 0) ? xscale : yscale;
+    int *ranges = (dim == 0) ? column_ranges : row_ranges;
+    for (int i = 0; i < noutput; i++) {
+      double c = scale * i;
+      int min_i = c - 0.5*scale + 0.5;
+      int max_i = c + 0.5*scale + 0.5;
+      if ((min_i >= ninput) || (max_i < 0)) { ranges[2*i] = 0; ranges[2*i+1] = -1; continue; }
+      if (min_i < 0) min_i = 0;
+      if (max_i >= ninput) max_i = ninput-1;
+      if (max_i < min_i) max_i = min_i;
+      ranges[2*i] = min_i;
+      ranges[2*i+1] = max_i;
+    }
+  }
+
+  // Fill footprints
+  footprint_offsets = new int [ noutputs + 1 ];
+  footprint_offsets[0] = 0;
+  for (int iy = 0; iy < output_height; iy++) {
+    for (int ix = 0; ix < output_width; ix++) {
+      int nx = column_ranges[2*ix+1] - column_ranges[2*ix] + 1;
+      int ny = row_ranges[2*iy+1] - row_ranges[2*iy] + 1;
+      int n = ((nx > 0) && (ny > 0)) ? nx * ny : 0;
+      footprint_offsets[iy*output_width + ix + 1] = footprint_offsets[iy*output_width + ix] + n;
+    }
+  }
+  footprint_indices = new int [ footprint_offsets[noutputs] ];
+  for (int iy = 0; iy < output_height; iy++) {
+    for (int ix = 0; ix < output_width; ix++) {
+      int *footprint = &footprint_indices[footprint_offsets[iy*output_width + ix]];
+      if (column_ranges[2*ix+1] < column_ranges[2*ix]) continue;
+      for (int j = row_ranges[2*iy]; j <= row_ranges[2*iy+1]; j++) {
+        for (int i = column_ranges[2*ix]; i <= column_ranges[2*ix+1]; i++) {
+          *(footprint++) = j*input_width + i;
+        }
+      }
+    }
+  }
+
+  // Delete ranges
+  delete [] column_ranges;
+  delete [] row_ranges;
+
+  // Return success
+  return 1;
+}
+
+
+
+////////////////////////////////////////////////////////////////////////
+// Application functions
+////////////////////////////////////////////////////////////////////////
+
+int RGBDRemapTable::
+Apply(const R2Grid& input_image, R2Grid& output_image) const
+{
+  // Check table
+  if (type == RGBD_REMAP_NONE) return 0;
+
+  // Check input image
+  if ((input_image.XResolution() != input_width) || (input_image.YResolution() != input_height)) {
+    fprintf(stderr, "Remap table for %dx%d images applied to %dx%d image\n",
+      input_width, input_height, input_image.XResolution(), input_image.YResolution());
+    return 0;
+  }
+
+  // Save copy of input image (so can pass same image both in and out)
+  R2Grid source_image;
+  const R2Grid *source = &input_image;
+  if (source == &output_image) { source_image = input_image; source = &source_image; }
+
+  // Initialize the output image
+  output_image = R2Grid(output_width, output_height);
+  const RNScalar *input_values = source->GridValues();
+  RNScalar *output_values = &output_image(0);
+
+  // Gather output values
+  if (type == RGBD_REMAP_BILINEAR) return ApplyBilinear(input_values, output_values);
+  else if (type == RGBD_REMAP_FOOTPRINT) return ApplyFootprint(input_values, output_values);
+  else if (type == RGBD_REMAP_SPLAT) return ApplySplat(input_values, output_values);
+  else return 0;
+}
+
+
+
+int RGBDRemapTable::
+ApplyBilinear(const RNScalar *input_values, RNScalar *output_values) const
+{
+  // Interpolate input values, ignoring unknown values (as in R2Grid::GridValue)
+#pragma omp parallel for schedule(dynamic, 8)
+  for (int iy = 0; iy < output_height; iy++) {
+    for (int ix = 0; ix < output_width; ix++) {
+      int output_index = iy*output_width + ix;
+      int index = bilinear_indices[output_index];
+      if (index < 0) { output_values[output_index] = R2_GRID_UNKNOWN_VALUE; continue; }
+      RNScalar dx = bilinear_weights[2*output_index+0];
+      RNScalar dy = bilinear_weights[2*output_index+1];
+      RNScalar value11 = input_values[index];
+      RNScalar value21 = input_values[index + 1];
+      RNScalar value12 = input_values[index + input_width];
+      RNScalar value22 = input_values[index + input_width + 1];
+      RNScalar weight11 = (1.0-dx) * (1.0-dy);
+      RNScalar weight12 = (1.0-dx) * dy;
+      RNScalar weight21 = dx * (1.0-dy);
+      RNScalar weight22 = dx * dy;
+      RNScalar value = 0;
+      RNScalar weight = 0;
+      if (value11 != R2_GRID_UNKNOWN_VALUE) { value += weight11 * value11; weight += weight11; }
+      if (value12 != R2_GRID_UNKNOWN_VALUE) { value += weight12 * value12; weight += weight12; }
+      if (value21 != R2_GRID_UNKNOWN_VALUE) { value += weight21 * value21; weight += weight21; }
+      if (value22 != R2_GRID_UNKNOWN_VALUE) { value += weight22 * value22; weight += weight22; }
+      output_values[output_index] = (weight > 0) ? value / weight : R2_GRID_UNKNOWN_VALUE;
+    }
+  }
+
+  // Return success
+  return 1;
+}
+
+
+
+int RGBDRemapTable::
+ApplyFootprint(const RNScalar *input_values, RNScalar *output_values) const
+{
+  // Find minimum valid input value in footprint of every output pixel
+#pragma omp parallel for schedule(dynamic, 8)
+  for (int iy = 0; iy < output_height; iy++) {
+    for (int ix = 0; ix < output_width; ix++) {
+      int output_index = iy*output_width + ix;
+      RNScalar min_value = FLT_MAX;
+      for (int k = footprint_offsets[output_index]; k < footprint_offsets[output_index+1]; k++) {
+        RNScalar value = input_values[footprint_indices[k]];
+        if ((value > 0) && (value < min_value)) min_value = value;
+      }
+      output_values[output_index] = (min_value < FLT_MAX) ? min_value : empty_value;
+    }
+  }
+
+  // Return success
+  return 1;
+}
+
+
+
+int RGBDRemapTable::
+ApplySplat(const RNScalar *input_values, RNScalar *output_values) const
+{
+  // Initialize output values
+  int noutputs = output_width * output_height;
+  for (int i = 0; i < noutputs; i++) output_values[i] = R2_GRID_UNKNOWN_VALUE;
+
+  // Splat samples, keeping closest depth at every output pixel
+  for (int i = 0; i < nsamples; i++) {
+    // Get/check depth
+    RNScalar depth = input_values[sample_indices[i]];
+    if (depth <= 0) continue;
+
+    // Find 3D position in output (color) camera coordinates
+    R3Point position(sample_rays[2*i+0] * depth, sample_rays[2*i+1] * depth, -depth);
+    position = splat_extrinsics * position;
+
+    // Snap to closest pixel in output image
+    int ix = (int) (splat_intrinsics[2] + position[0] * splat_intrinsics[0] / -position[2] + 0.5);
+    if ((ix < 0) || (ix >= output_width)) continue;
+    int iy = (int) (splat_intrinsics[3] + position[1] * splat_intrinsics[1] / -position[2] + 0.5);
+    if ((iy < 0) || (iy >= output_height)) continue;
+
+    // Store only closest depth
+    RNScalar new_depth = -position[2];
+    RNScalar& old_depth = output_values[iy*output_width + ix];
+    if ((old_depth == 0.0) || (old_depth == R2_GRID_UNKNOWN_VALUE) || (new_depth < old_depth)) {
+      old_depth = new_depth;
+    }
+  }
+
+  // Return success
+  return 1;
+}
+
+
+
+////////////////////////////////////////////////////////////////////////
+// Input/output functions
+////////////////////////////////////////////////////////////////////////
+
+int RGBDRemapTable::
+ReadFile(const char *filename)
+{
+  // Empty previous tables
+  Empty();
+
+  // Open file
+  FILE *fp = fopen(filename, "rb");
+  if (!fp) {
+    fprintf(stderr, "Unable to open remap table file %s\n", filename);
+    return 0;
+  }
+
+  // Read header
+  char magic[16];
+  int header[7];
+  if ((fread(magic, sizeof(char), 16, fp) != 16) || strncmp(magic, "RGBDRemapTable", 14) ||
+      (fread(header, sizeof(int), 7, fp) != 7) || (header[6] < 0) || (header[6] > 96) ||
+      (fread(key, sizeof(RNScalar), header[6], fp) != (size_t) header[6])) {
+    fprintf(stderr, "Unable to read header of remap table file %s\n", filename);
+    fclose(fp);
+    return 0;
+  }
+
+  // Set geometry
+  type = header[0];
+  input_width = header[1];
+  input_height = header[2];
+  output_width = header[3];
+  output_height = header[4];
+  nsamples = header[5];
+  nkey = header[6];
+  int noutputs = output_width * output_height;
+
+  // Read tables
+  int status = 1;
+  if (type == RGBD_REMAP_BILINEAR) {
+    bilinear_indices = new int [ noutputs ];
+    bilinear_weights = new RNScalar32 [ 2 * noutputs ];
+    if (fread(bilinear_indices, sizeof(int), noutputs, fp) != (size_t) noutputs) status = 0;
+    else if (fread(bilinear_weights, sizeof(RNScalar32), 2 * noutputs, fp) != (size_t) (2 * noutputs)) status = 0;
+  }
+  else if (type == RGBD_REMAP_FOOTPRINT) {
+    footprint_offsets = new int [ noutputs + 1 ];
+    if (fread(&empty_value, sizeof(RNScalar), 1, fp) != 1) status = 0;
+    else if (fread(footprint_offsets, sizeof(int), noutputs + 1, fp) != (size_t) (noutputs + 1)) status = 0;
+    else {
+      int nindices = footprint_offsets[noutputs];
+      footprint_indices = new int [ nindices ];
+      if (fread(footprint_indices, sizeof(int), nindices, fp) != (size_t) nindices) status = 0;
+    }
+  }
+  else if (type == RGBD_REMAP_SPLAT) {
+    sample_indices = new int [ nsamples ];
+    sample_rays = new RNScalar32 [ 2 * nsamples ];
+    RNScalar m[16];
+    if (fread(m, sizeof(RNScalar), 16, fp) != 16) status = 0;
+    else if (fread(splat_intrinsics, sizeof(RNScalar), 4, fp) != 4) status = 0;
+    else if (fread(sample_indices, sizeof(int), nsamples, fp) != (size_t) nsamples) status = 0;
+    else if (fread(sample_rays, sizeof(RNScalar32), 2 * nsamples, fp) != (size_t) (2 * nsamples)) status = 0;
+    else splat_extrinsics = R4Matrix(m);
+  }
+  else {
+    status = 0;
+  }
+
+  // Close file
+  fclose(fp);
+
+  // Check status
+  if (!status) {
+    fprintf(stderr, "Unable to read remap table file %s\n", filename);
+    Empty();
+    return 0;
+  }
+
+  // Return success
+  return 1;
+}
+
+
+
+int RGBDRemapTable::
+WriteFile(const char *filename) const
+{
+  // Check table
+  if (type == RGBD_REMAP_NONE) return 0;
+
+  // Open file
+  FILE *fp = fopen(filename, "wb");
+  if (!fp) {
+    fprintf(stderr, "Unable to open remap table file %s\n", filename);
+    return 0;
+  }
+
+  // Write header
+  char magic[16] = { 0 };
+  strncpy(magic, "RGBDRemapTable", 16);
+  int header[7] = { type, input_width, input_height, output_width, output_height, nsamples, nkey };
+  int status = 1;
+  if (fwrite(magic, sizeof(char), 16, fp) != 16) status = 0;
+  else if (fwrite(header, sizeof(int), 7, fp) != 7) status = 0;
+  else if (fwrite(key, sizeof(RNScalar), nkey, fp) != (size_t) nkey) status = 0;
+
+  // Write tables
+  int noutputs = output_width * output_height;
+  if (!status) {
+    // Already failed
+  }
+  else if (type == RGBD_REMAP_BILINEAR) {
+    if (fwrite(bilinear_indices, sizeof(int), noutputs, fp) != (size_t) noutputs) status = 0;
+    else if (fwrite(bilinear_weights, sizeof(RNScalar32), 2 * noutputs, fp) != (size_t) (2 * noutputs)) status = 0;
+  }
+  else if (type == RGBD_REMAP_FOOTPRINT) {
+    int nindices = footprint_offsets[noutputs];
+    if (fwrite(&empty_value, sizeof(RNScalar), 1, fp) != 1) status = 0;
+    else if (fwrite(footprint_offsets, sizeof(int), noutputs + 1, fp) != (size_t) (noutputs + 1)) status = 0;
+    else if (fwrite(footprint_indices, sizeof(int), nindices, fp) != (size_t) nindices) status = 0;
+  }
+  else if (type == RGBD_REMAP_SPLAT) {
+    RNScalar m[16];
+    for (int i = 0; i < 4; i++) for (int j = 0; j < 4; j++) m[4*i+j] = splat_extrinsics[i][j];
+    if (fwrite(m, sizeof(RNScalar), 16, fp) != 16) status = 0;
+    else if (fwrite(splat_intrinsics, sizeof(RNScalar), 4, fp) != 4) status = 0;
+    else if (fwrite(sample_indices, sizeof(int), nsamples, fp) != (size_t) nsamples) status = 0;
+    else if (fwrite(sample_rays, sizeof(RNScalar32), 2 * nsamples, fp) != (size_t) (2 * nsamples)) status = 0;
+  }
+
+  // Close file
+  fclose(fp);
+
+  // Check status
+  if (!status) {
+    fprintf(stderr, "Unable to write remap table file %s\n", filename);
+    return 0;
+  }
+
+  // Return success
+  return 1;
+}
+
+
+
+////////////////////////////////////////////////////////////////////////
+// Shared table functions
+////////////////////////////////////////////////////////////////////////
+
+const RGBDRemapTable *RGBDRemapTable::
+ColorUndistortionTable(const RGBDCamera& distorted_camera,
+  const RGBDCamera& undistorted_camera, int input_width, int input_height)
+{
+  // Return shared table for undistorting color images
+  return SharedTable(RGBD_REMAP_BILINEAR, &distorted_camera, &undistorted_camera,
+    input_width, input_height, undistorted_camera.colorWidth, undistorted_camera.colorHeight);
+}
+
+
+
+const RGBDRemapTable *RGBDRemapTable::
+DepthUndistortionTable(const RGBDCamera& distorted_camera,
+  const RGBDCamera& undistorted_camera, int input_width, int input_height)
+{
+  // Return shared table for undistorting depth images
+  int type = (distorted_camera.depthToColorExtrinsics.IsIdentity()) ? RGBD_REMAP_FOOTPRINT : RGBD_REMAP_SPLAT;
+  return SharedTable(type, &distorted_camera, &undistorted_camera,
+    input_width, input_height, undistorted_camera.depthWidth, undistorted_camera.depthHeight);
+}
+
+
+
+const RGBDRemapTable *RGBDRemapTable::
+DepthResamplingTable(int input_width, int input_height, int output_width, int output_height)
+{
+  // Return shared table for resampling depth images
+  return SharedTable(RGBD_REMAP_FOOTPRINT, NULL, NULL,
+    input_width, input_height, output_width, output_height);
+}
+
+
+
+const RGBDRemapTable *RGBDRemapTable::
+SharedTable(int type, const RGBDCamera *distorted_camera, const RGBDCamera *undistorted_camera,
+  int input_width, int input_height, int output_width, int output_height)
+{
+  // Create key
+  RGBDRemapTable query;
+  query.SetKey(type, distorted_camera, undistorted_camera,
+    input_width, input_height, output_width, output_height);
+
+  // Find or create table (tables are never deleted while in use, except by EmptyCache)
+  RGBDRemapTable *result = NULL;
+#pragma omp critical(RGBDRemapTable)
+  {
+    // Search tables already in memory
+    for (int i = 0; i < shared_tables.NEntries(); i++) {
+      RGBDRemapTable *table = shared_tables.Kth(i);
+      if (table->HasSameKey(query)) { result = table; break; }
+    }
+
+    if (!result) {
+      // Get cache filename (from hash of key)
+      char filename[4096];
+      filename[0] = '\0';
+      if (shared_table_directory) {
+        unsigned long long hash = 14695981039346656037ULL;
+        const unsigned char *bytes = (const unsigned char *) query.key;
+        for (size_t i = 0; i < query.nkey * sizeof(RNScalar); i++) {
+          hash = (hash ^ bytes[i]) * 1099511628211ULL;
+        }
+        sprintf(filename, "%s/remap_%016llx.bin", shared_table_directory, hash);
+      }
+
+      // Read table from cache directory
+      RGBDRemapTable *table = new RGBDRemapTable();
+      if (filename[0] && RNFileExists(filename) && table->ReadFile(filename) && table->HasSameKey(query)) {
+        result = table;
+      }
+      else {
+        // Create table
+        int status = 0;
+        if (distorted_camera && undistorted_camera) {
+          if (type == RGBD_REMAP_BILINEAR) status = table->CreateColorUndistortion(*distorted_camera, *undistorted_camera, input_width, input_height);
+          else status = table->CreateDepthUndistortion(*distorted_camera, *undistorted_camera, input_width, input_height);
+        }
+        else {
+          status = table->CreateDepthResampling(input_width, input_height, output_width, output_height);
+        }
+
+        // Write table to cache directory
+        if (status) {
+          if (filename[0]) table->WriteFile(filename);
+          result = table;
+        }
+      }
+
+      // Remember table
+      if (result) shared_tables.Insert(result);
+      else delete table;
+    }
+  }
+
+  // Return table
+  return result;
+}
+
+
+
+void RGBDRemapTable::
+SetCacheDirectory(const char *directory)
+{
+  // Set directory where shared tables are read/written (NULL for none)
+#pragma omp critical(RGBDRemapTable)
+  {
+    if (shared_table_directory) free(shared_table_directory);
+    shared_table_directory = (directory) ? strdup(directory) : NULL;
+  }
+}
+
+
+
+void RGBDRemapTable::
+EmptyCache(void)
+{
+  // Delete shared tables (none may be in use)
+#pragma omp critical(RGBDRemapTable)
+  {
+    for (int i = 0; i < shared_tables.NEntries(); i++) delete shared_tables.Kth(i);
+    shared_tables.Empty();
+  }
+}
+
+
+
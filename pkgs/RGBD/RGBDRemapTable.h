@@ -0,0 +1,162 @@
+////////////////////////////////////////////////////////////////////////
+// Include file for RGBDRemapTable class
+////////////////////////////////////////////////////////////////////////
+
+
+
+////////////////////////////////////////////////////////////////////////
+// NOTE:
+// A remap table stores, for one pair of input/output image geometries,
+// where every output pixel gathers its value from in the input image.
+// Tables are built once per camera (the distortion model is evaluated
+// only then) and applied to every frame with a tight parallel loop.
+// Color tables store source pixels and bilinear weights, depth tables
+// store footprints of source pixels whose minimum valid depth is kept.
+// Depth-to-color extrinsics that are not the identity make the mapping
+// depend on depth, so those tables store rays and splat depths instead.
+////////////////////////////////////////////////////////////////////////
+
+
+
+////////////////////////////////////////////////////////////////////////
+// Class definition
+////////////////////////////////////////////////////////////////////////
+
+class RGBDRemapTable {
+public:
+  // Constructors/destructors
+  RGBDRemapTable(void);
+  ~RGBDRemapTable(void);
+
+  // Property functions
+  int Type(void) const;
+  int InputWidth(void) const;
+  int InputHeight(void) const;
+  int OutputWidth(void) const;
+  int OutputHeight(void) const;
+  unsigned long long NBytes(void) const;
+
+  // Creation functions
+  int CreateColorUndistortion(const RGBDCamera& distorted_camera, const RGBDCamera& undistorted_camera,
+    int input_width, int input_height);
+  int CreateDepthUndistortion(const RGBDCamera& distorted_camera, const RGBDCamera& undistorted_camera,
+    int input_width, int input_height);
+  int CreateDepthResampling(int input_width, int input_height, int output_width, int output_height);
+  void Empty(void);
+
+  // Application functions
+  int Apply(const R2Grid& input_image, R2Grid& output_image) const;
+
+  // Input/output functions
+  int ReadFile(const char *filename);
+  int WriteFile(const char *filename) const;
+
+  // Shared table functions (tables are created once and then
+  // reused, and also read from/written to the cache directory if set)
+  static const RGBDRemapTable *ColorUndistortionTable(const RGBDCamera& distorted_camera,
+    const RGBDCamera& undistorted_camera, int input_width, int input_height);
+  static const RGBDRemapTable *DepthUndistortionTable(const RGBDCamera& distorted_camera,
+    const RGBDCamera& undistorted_camera, int input_width, int input_height);
+  static const RGBDRemapTable *DepthResamplingTable(int input_width, int input_height,
+    int output_width, int output_height);
+  static void SetCacheDirectory(const char *directory);
+  static void EmptyCache(void);
+
+private:
+  static const RGBDRemapTable *SharedTable(int type,
+    const RGBDCamera *distorted_camera, const RGBDCamera *undistorted_camera,
+    int input_width, int input_height, int output_width, int output_height);
+  RNBoolean HasSameKey(const RGBDRemapTable& table) const;
+  void SetKey(int type, const RGBDCamera *distorted_camera, const RGBDCamera *undistorted_camera,
+    int input_width, int input_height, int output_width, int output_height);
+  int ApplyBilinear(const RNScalar *input_values, RNScalar *output_values) const;
+  int ApplyFootprint(const RNScalar *input_values, RNScalar *output_values) const;
+  int ApplySplat(const RNScalar *input_values, RNScalar *output_values) const;
+
+private:
+  // Geometry
+  int type;
+  int input_width, input_height;
+  int output_width, output_height;
+  RNScalar key[96];
+  int nkey;
+
+  // Bilinear tables (one entry per output pixel, -1 if outside)
+  int *bilinear_indices;
+  RNScalar32 *bilinear_weights;
+
+  // Footprint tables (compressed rows, one per output pixel)
+  int *footprint_offsets;
+  int *footprint_indices;
+  RNScalar empty_value;
+
+  // Splat tables (one entry per sample)
+  int nsamples;
+  int *sample_indices;
+  RNScalar32 *sample_rays;
+  R4Matrix splat_extrinsics;
+  RNScalar splat_intrinsics[4];
+};
+
+
+
+////////////////////////////////////////////////////////////////////////
+// Type definitions
+////////////////////////////////////////////////////////////////////////
+
+#define RGBD_REMAP_NONE       0
+#define RGBD_REMAP_BILINEAR   1
+#define RGBD_REMAP_FOOTPRINT  2
+#define RGBD_REMAP_SPLAT      3
+
+
+
+////////////////////////////////////////////////////////////////////////
+// Inline functions
+////////////////////////////////////////////////////////////////////////
+
+inline int RGBDRemapTable::
+Type(void) const
+{
+  // Return type of table (RGBD_REMAP_NONE if not created)
+  return type;
+}
+
+
+
+inline int RGBDRemapTable::
+InputWidth(void) const
+{
+  // Return width of images to which table can be applied
+  return input_width;
+}
+
+
+
+inline int RGBDRemapTable::
+InputHeight(void) const
+{
+  // Return height of images to which table can be applied
+  return input_height;
+}
+
+
+
+inline int RGBDRemapTable::
+OutputWidth(void) const
+{
+  // Return width of images created by table
+  return output_width;
+}
+
+
+
+inline int RGBDRemapTable::
+OutputHeight(void) const
+{
+  // Return height of images created by table
+  return output_height;
+}
+
+
+
@@ -30,7 +30,7 @@ RGBDPoint(void)
     normal(0,0,0),
     radius(0),
     boundary(0),
-    neighbors(),
+    nneighbors(0),
     segment(NULL),
     segment_affinity(0),
     segment_index(-1),
@@ -378,20 +378,16 @@ RGBDSegment(RGBDSegmentation *segmentation, RGBDPoint *seed_point, int primitive
     points(),
     parent(NULL),
     children(),
-    pairs(),
     primitive(primitive_type),
+    version(0),
     possible_affinity(0),
     total_affinity(0)
 {
   // Update primitive
   if (seed_point) primitive.Update(seed_point);
 
-  // Insert into segmentation
-  if (segmentation) {
-    this->segmentation_index = segmentation->segments.NEntries();
-    this->segmentation = segmentation;
-    segmentation->segments.Insert(this);
-  }
+  // Remember segmentation (caller inserts segment into segmentation)
+  this->segmentation = segmentation;
 }
 
 
@@ -404,17 +400,13 @@ RGBDSegment(RGBDSegmentation *segmentation, RGBDPoint *seed_point, const RGBDPri
     points(),
     parent(NULL),
     children(),
-    pairs(),
     primitive(primitive),
+    version(0),
     possible_affinity(0),
     total_affinity(0)
 {
-  // Insert into segmentation
-  if (segmentation) {
-    this->segmentation_index = segmentation->segments.NEntries();
-    this->segmentation = segmentation;
-    segmentation->segments.Insert(this);
-  }
+  // Remember segmentation (caller inserts segment into segmentation)
+  this->segmentation = segmentation;
 }
 
 
@@ -427,8 +419,8 @@ RGBDSegment(RGBDSegmentation *segmentation, RGBDSegment *child1, RGBDSegment *ch
     points(),
     parent(NULL),
     children(),
-    pairs(),
     primitive(),
+    version(0),
     possible_affinity(0),
     total_affinity(0)
 {
@@ -466,12 +458,8 @@ RGBDSegment(RGBDSegmentation *segmentation, RGBDSegment *child1, RGBDSegment *ch
   children.Insert(child1);
   children.Insert(child2);
 
-  // Insert into segmentation
-  if (segmentation) {
-    this->segmentation_index = segmentation->segments.NEntries();
-    this->segmentation = segmentation;
-    segmentation->segments.Insert(this);
-  }
+  // Remember segmentation (caller inserts segment into segmentation)
+  this->segmentation = segmentation;
 }
 
 
@@ -601,6 +589,9 @@ InsertChild(RGBDSegment *child)
   // Update hierarchy
   child->parent = this;
   children.Insert(child);
+
+  // Update version (pairs computed before the merge are now stale)
+  version++;
 }
 
 
@@ -635,8 +626,8 @@ UpdatePoints(const R3Kdtree<RGBDPoint *> *kdtree)
       RGBDPoint *point = stack.Tail();
       stack.RemoveTail();
       points1.Insert(point);
-      for (int i = 0; i < point->neighbors.NEntries(); i++) {
-        RGBDPoint *neighbor = point->neighbors.Kth(i);
+      for (int i = 0; i < point->nneighbors; i++) {
+        RGBDPoint *neighbor = point->neighbors[i];
         if (neighbor->mark == mark) continue;
         neighbor->mark = mark;
         RNLength d = primitive.Distance(neighbor->position);
@@ -646,8 +637,9 @@ UpdatePoints(const R3Kdtree<RGBDPoint *> *kdtree)
       }
     }
   }
-  else if (kdtree) {
+  else if (kdtree || segmentation) {
     // Find all points near primitive
+    if (!kdtree) kdtree = segmentation->Kdtree();
     RNLength max_segment_primitive_distance = (segmentation) ? segmentation->max_segment_primitive_distance : 0;
     if (primitive.primitive_type == RGBD_POINT_PRIMITIVE_TYPE) kdtree->FindAll(primitive.centroid, 0, max_segment_primitive_distance, points1);
     else if (primitive.primitive_type == RGBD_LINE_PRIMITIVE_TYPE) kdtree->FindAll(primitive.line, 0, max_segment_primitive_distance, points1);
@@ -890,86 +882,88 @@ RGBDCompareSegments(const void *data1, const void *data2)
 
 RGBDSegmentPair::
 RGBDSegmentPair(RGBDSegment *segment1, RGBDSegment *segment2, RNScalar affinity)
-  : affinity(affinity),
-    heapentry(NULL)
+  : affinity(affinity)
 {
-  // Insert pair into segments
-  if (segment1 && segment2) {
-    // Remember segments
-    segments[0] = segment1;
-    segments[1] = segment2;
-
-    // Remember position of pair in segments
-    segment_index[0] = segment1->pairs.NEntries();
-    segment_index[1] = segment2->pairs.NEntries();
-
-    // Update segments
-    segment1->pairs.Insert(this);
-    segment2->pairs.Insert(this);
-  }
-  else {
-    // Initialize segments
-    segments[0] = NULL;
-    segments[1] = NULL;
-
-    // Initialize segment index
-    segment_index[0] = -1;
-    segment_index[1] = -1;
-  }
+  // Remember segments and their versions (so can detect stale pairs)
+  segments[0] = segment1;
+  segments[1] = segment2;
+  segment_version[0] = (segment1) ? segment1->version : -1;
+  segment_version[1] = (segment2) ? segment2->version : -1;
 }
 
 
 
-RGBDSegmentPair::
-~RGBDSegmentPair(void)
-{
-  // Remove this pair from first segment
-  if (segments[0]) {
-    assert(segment_index[0] >= 0);
-    RNArrayEntry *entry = segments[0]->pairs.KthEntry(segment_index[0]);
-    RGBDSegmentPair *tail = segments[0]->pairs.Tail();
-    if (tail->segments[0] == segments[0]) tail->segment_index[0] = segment_index[0];
-    else if (tail->segments[1] == segments[0]) tail->segment_index[1] = segment_index[0];
-    segments[0]->pairs.EntryContents(entry) = tail;
-    segments[0]->pairs.RemoveTail();
-  }
+////////////////////////////////////////////////////////////////////////
+// Pair heap (flat array of pairs, highest affinity first)
+////////////////////////////////////////////////////////////////////////
 
-  // Remove this pair from second segment
-  if (segments[1]) {
-    assert(segment_index[1] >= 0);
-    RNArrayEntry *entry = segments[1]->pairs.KthEntry(segment_index[1]);
-    RGBDSegmentPair *tail = segments[1]->pairs.Tail();
-    if (tail->segments[0] == segments[1]) tail->segment_index[0] = segment_index[1];
-    else if (tail->segments[1] == segments[1]) tail->segment_index[1] = segment_index[1];
-    segments[1]->pairs.EntryContents(entry) = tail;
-    segments[1]->pairs.RemoveTail();
-  }
-}
+class RGBDSegmentPairHeap {
+public:
+  RGBDSegmentPairHeap(void) : entries(NULL), nentries(0), nallocated(0) {};
+  ~RGBDSegmentPairHeap(void) { if (entries) delete [] entries; };
+  int IsEmpty(void) const { return (nentries == 0); };
+  int NEntries(void) const { return nentries; };
+  void Push(const RGBDSegmentPair& pair);
+  RGBDSegmentPair Pop(void);
+private:
+  RGBDSegmentPair *entries;
+  int nentries;
+  int nallocated;
+};
 
 
 
-static RGBDSegmentPair *
-FindPair(RGBDSegment *segment1, RGBDSegment *segment2) 
+void RGBDSegmentPairHeap::
+Push(const RGBDSegmentPair& pair)
 {
-  // Swap segments so that segment1 has fewer pairs
-  if (segment1->pairs.NEntries() > segment2->pairs.NEntries()) {
-    RGBDSegment *swap = segment1; 
-    segment1 = segment2; 
-    segment2 = swap;
-  }
+  // Allocate space for entry
+  if (nentries == nallocated) {
+    nallocated = (nallocated > 0) ? 2 * nallocated : 1024;
+    RGBDSegmentPair *tmp = new RGBDSegmentPair [ nallocated ];
+    for (int i = 0; i < nentries; i++) tmp[i] = entries[i];
+    if (entries) delete [] entries;
+    entries = tmp;
+  }
+
+  // Bubble up
+  int i = nentries++;
+  while (i > 0) {
+    int parent = (i - 1) / 2;
+    if (entries[parent].affinity >= pair.affinity) break;
+    entries[i] = entries[parent];
+    i = parent;
+  }
+  entries[i] = pair;
+}
+
 
-  // Search for pair
-  for (int i = 0; i < segment1->pairs.NEntries(); i++) {
-    RGBDSegmentPair *pair = segment1->pairs.Kth(i);
-    if (pair->segments[0] == segment2) return pair;
-    if (pair->segments[1] == segment2) return pair;
-  }
 
-  // RGBDSegmentPair not found
-  return NULL;
+RGBDSegmentPair RGBDSegmentPairHeap::
+Pop(void)
+{
+  // Remove top entry
+  assert(nentries > 0);
+  RGBDSegmentPair result = entries[0];
+  RGBDSegmentPair last = entries[--nentries];
+
+  // Bubble down
+  int i = 0;
+  while (TRUE) {
+    int child = 2*i + 1;
+    if (child >= nentries) break;
+    if ((child+1 < nentries) && (entries[child+1].affinity > entries[child].affinity)) child++;
+    if (last.affinity >= entries[child].affinity) break;
+    entries[i] = entries[child];
+    i = child;
+  }
+  if (nentries > 0) entries[i] = last;
+
+  // Return top entry
+  return result;
 }
 
 
+
 #if 0
 static int
 FindPairIndex(RNArray<RGBDSegmentPair *>& pairs, RGBDSegment *segment0, RGBDSegment *segment1)
@@ -997,7 +991,13 @@ RGBDSegmentation(void)
   : points(),
     kdtree(NULL),
     segments(),
-    point_buffer(NULL)
+    point_buffer(NULL),
+    point_creation_time(0),
+    segment_creation_time(0),
+    refinement_time(0),
+    ransac_time(0),
+    merge_time(0),
+    deletion_time(0)
 {
   // Set default parameters
   SetDefaultParameters();
@@ -1015,7 +1015,13 @@ RGBDSegmentation(const R2Grid& px_image, const R2Grid& py_image, const R2Grid& p
   : points(),
     kdtree(NULL),
     segments(),
-    point_buffer(NULL)
+    point_buffer(NULL),
+    point_creation_time(0),
+    segment_creation_time(0),
+    refinement_time(0),
+    ransac_time(0),
+    merge_time(0),
+    deletion_time(0)
 {
   // Set parameters 
   SetDefaultParameters();
@@ -1047,6 +1053,22 @@ RGBDSegmentation::
 
 
 
+const R3Kdtree<RGBDPoint *> *RGBDSegmentation::
+Kdtree(void)
+{
+  // Create kdtree of points (only segments without seed points need it)
+  if (!kdtree && !points.IsEmpty()) {
+    RGBDPoint tmp; int position_offset = (unsigned char *) &(tmp.position) - (unsigned char *) &tmp;
+    kdtree = new R3Kdtree<RGBDPoint *>(points, position_offset);
+    if (!kdtree) fprintf(stderr, "Unable to create kdtree\n");
+  }
+
+  // Return kdtree
+  return kdtree;
+}
+
+
+
 RNScalar RGBDSegmentation::
 Affinity(void) const
 {
@@ -1081,6 +1103,10 @@ CreatePoints(const R2Grid& px_image, const R2Grid& py_image, const R2Grid& pz_im
   const R2Grid& depth_image, const R2Grid& radius_image,
   const R2Grid& boundary_image, const R2Image& color_image)
 {
+  // Start timer
+  RNTime start_time;
+  start_time.Read();
+
   // Allocate points 
   point_buffer = new RGBDPoint [ depth_image.NEntries() ];
   if (!point_buffer) {
@@ -1130,15 +1156,7 @@ CreatePoints(const R2Grid& px_image, const R2Grid& py_image, const R2Grid& pz_im
     }
   }
 
-  // Create kdtree of points
-  RGBDPoint tmp; int position_offset = (unsigned char *) &(tmp.position) - (unsigned char *) &tmp;
-  kdtree = new R3Kdtree<RGBDPoint *>(points, position_offset);
-  if (!kdtree) {
-    fprintf(stderr, "Unable to create kdtree\n");
-    return 0;
-  }
-  
-  // Create arrays of neighbor points
+  // Create arrays of neighbor points (kdtree is created when first needed)
   for (int i = 0; i < points.NEntries(); i++) {
     RGBDPoint *point = points.Kth(i);
     int ix, iy, neighbor_index;
@@ -1152,11 +1170,14 @@ CreatePoints(const R2Grid& px_image, const R2Grid& py_image, const R2Grid& pz_im
         RGBDPoint *neighbor = &point_buffer[neighbor_index];
         if ((point->boundary & RGBD_SHADOW_BOUNDARY) && (neighbor->boundary & RGBD_SILHOUETTE_BOUNDARY)) continue;
         if ((point->boundary & RGBD_SILHOUETTE_BOUNDARY) && (neighbor->boundary & RGBD_SHADOW_BOUNDARY)) continue;
-        point->neighbors.Insert(neighbor);
+        point->neighbors[point->nneighbors++] = neighbor;
       }
     }
   }
 
+  // Update timer
+  point_creation_time += start_time.Elapsed();
+
   // Return success
   return 1;
 }
@@ -1267,28 +1288,37 @@ RefineSegments(void)
     // Will rebuild list of segments
     segments.Empty();
 
-    // Refine each segment
+    // Refit primitives of all segments in parallel (each reads only its own points)
+    RNBoolean *errors = new RNBoolean [ tmp.NEntries() ];
+#pragma omp parallel for schedule(dynamic, 16)
+    for (int i = 0; i < tmp.NEntries(); i++) {
+      errors[i] = (tmp.Kth(i)->UpdatePrimitive()) ? FALSE : TRUE;
+    }
+
+    // Reassign points to segments (serially, since segments steal points from each other)
     RNBoolean converged = TRUE;
     for (int i = 0; i < tmp.NEntries(); i++) {
       RGBDSegment *segment = tmp.Kth(i);
       int prev_npoints = segment->points.NEntries();
 
       // Refine segment
-      RNBoolean error = FALSE;
-      if (!error && !segment->UpdatePrimitive()) error = TRUE;
+      RNBoolean error = errors[i];
       if (!error && !segment->UpdatePoints(kdtree)) error = TRUE; 
 
-      // Insert segment
-      segment->segmentation_index = segments.NEntries();    
-      if (!error) segments.Insert(segment);
-      else delete segment;
-
       // Check for convergence
       if (error || (prev_npoints != segment->points.NEntries())) {
         converged = FALSE;
       }
+
+      // Insert segment
+      segment->segmentation_index = segments.NEntries();    
+      if (!error) segments.Insert(segment);
+      else delete segment;
     }
 
+    // Delete errors
+    delete [] errors;
+
     // Check if converged
     if (converged) break;
   }
@@ -1367,21 +1397,32 @@ MergeSegments(void)
 
   //////////
 
-  // Create pairs between segments with nearby points
-  RNArray<RGBDSegmentPair *> pairs;
+  // Make sure segment indices are consistent (used to avoid duplicate pairs)
+  for (int i = 0; i < segments.NEntries(); i++) segments[i]->segmentation_index = i;
+
+  // Create heap of pairs between segments with nearby points
+  RGBDSegmentPairHeap heap;
   for (int i = 0; i < segments.NEntries(); i++) {
     RGBDSegment *segment0 = segments.Kth(i);
     if (segment0->points.IsEmpty()) continue;
     RGBDPoint *point0 = segment0->points.Head();
 
     // Create pairs
-    for (int j = 0; j < point0->neighbors.NEntries(); j++) {
-      RGBDPoint *point1 = point0->neighbors.Kth(j);
+    for (int j = 0; j < point0->nneighbors; j++) {
+      RGBDPoint *point1 = point0->neighbors[j];
       if (point0 == point1) continue;
       RGBDSegment *segment1 = point1->segment;
       if (!segment1) continue;
       if (segment0 == segment1) continue;
 
+      // Check if already have pair (from an earlier neighbor, or from the other segment's head point)
+      RNBoolean found = FALSE;
+      for (int k = 0; k < j; k++) {
+        if (point0->neighbors[k]->segment == segment1) { found = TRUE; break; }
+      }
+      if (found) continue;
+      if ((point1 == segment1->points.Head()) && (segment1->segmentation_index < segment0->segmentation_index)) continue;
+
       // Check if within max neighbor distance
       if (max_neighbor_distance_factor > 0) {
         RNScalar radius = (point0->radius > point1->radius) ? point1->radius : point0->radius;
@@ -1390,63 +1431,47 @@ MergeSegments(void)
         if (dd > max_neighbor_distance * max_neighbor_distance) continue;
       }
 
-      // Check if already have pair
-      if (FindPair(segment0, segment1)) continue;
-
       // Compute affinity
       RNScalar affinity = segment0->Affinity(segment1);
       if (affinity < min_pair_affinity) continue;
 
-      // Create pair
-      RGBDSegmentPair *pair = new RGBDSegmentPair(segment0, segment1, affinity);
-      if (!pair) continue;
-
       // Insert pair
-      pairs.Insert(pair);
+      heap.Push(RGBDSegmentPair(segment0, segment1, affinity));
     }
   }
 
   // Check if there are any pairs
-  if (pairs.IsEmpty()) return 1;
+  if (heap.IsEmpty()) return 1;
 
   //////////
 
-  // Initialize heap
-  RGBDSegmentPair tmp;
-  RNHeap<RGBDSegmentPair *> heap(&tmp, &tmp.affinity, &tmp.heapentry, FALSE);
-  for (int i = 0; i < pairs.NEntries(); i++) {
-    RGBDSegmentPair *pair = pairs.Kth(i);
-    heap.Push(pair);
-  }
-
   // Merge segments hierarchically
   while (!heap.IsEmpty()) {
     // Get pair
-    RGBDSegmentPair *pair = heap.Pop();
+    RGBDSegmentPair pair = heap.Pop();
 
     // Check if we are done
-    if (pair->affinity < min_pair_affinity) break;
+    if (pair.affinity < min_pair_affinity) break;
 
     // Get segments
-    RGBDSegment *segment0 = pair->segments[0];
-    RGBDSegment *segment1 = pair->segments[1];
+    RGBDSegment *segment0 = pair.segments[0];
+    RGBDSegment *segment1 = pair.segments[1];
 
-    // Check if either segment has already been merged
-    if (segment0->parent || segment1->parent) {
+    // Check if either segment has changed since the pair was created
+    if (segment0->parent || segment1->parent ||
+        (segment0->version != pair.segment_version[0]) ||
+        (segment1->version != pair.segment_version[1])) {
       // Find ancestors
       RGBDSegment *ancestor0 = segment0;
       RGBDSegment *ancestor1 = segment1;
       while (ancestor0->parent) ancestor0 = ancestor0->parent;
       while (ancestor1->parent) ancestor1 = ancestor1->parent;
       if (ancestor0 != ancestor1) {
-        if (!FindPair(ancestor0, ancestor1)) {
-          RNScalar affinity = ancestor0->Affinity(ancestor1);
-          if (affinity > min_pair_affinity) {
-            // Create a pair between the ancestors
-            RGBDSegmentPair *pair = new RGBDSegmentPair(ancestor0, ancestor1, affinity);
-            heap.Push(pair);
-            push_count++;
-          }
+        RNScalar affinity = ancestor0->Affinity(ancestor1);
+        if (affinity > min_pair_affinity) {
+          // Create a pair between the ancestors (with up-to-date affinity)
+          heap.Push(RGBDSegmentPair(ancestor0, ancestor1, affinity));
+          push_count++;
         }
       }
     }
@@ -1454,40 +1479,35 @@ MergeSegments(void)
       if (0 && print_progress) {
         static unsigned long count = 0;
         if ((count++ % 1000) == 0) {
-          printf("        %15.12f : %9d %9d : %15d %15d %15d\n", pair->affinity, 
+          printf("        %15.12f : %9d %9d : %15d %15d %15d\n", pair.affinity, 
                  segment0->points.NEntries(), segment1->points.NEntries(), 
                  heap.NEntries(), merge_count, push_count);
         }
       }
 
-#if 0
-      // Create merged segment
-      RGBDSegment *segment = new RGBDSegment(this, segment0, segment1);
-      segments.Insert(segment);
-      merge_count++;
-#else
       // Merge smaller segment into bigger one
       RGBDSegment *parent = (segment0->points.NEntries() > segment1->points.NEntries()) ? segment0 : segment1;
       RGBDSegment *child = (segment0->points.NEntries() > segment1->points.NEntries()) ? segment1 : segment0;
       parent->InsertChild(child);
       merge_count++;
-#endif
     }
-
-    // Delete pair
-    delete pair;
   }
 
-  // Remove merged segments
+  // Remove merged segments (hierarchy is discarded, so no need to remove children one by one)
   RNArray<RGBDSegment *> merged_segments;
   RNArray<RGBDSegment *> all_segments = segments;
   segments.Empty();
   for (int i = 0; i < all_segments.NEntries(); i++) {
     RGBDSegment *segment = all_segments.Kth(i);
-    segment->segmentation_index = segments.NEntries();    
-    if (!segment->parent) { segments.Insert(segment); continue; }
-    segment->parent->RemoveChild(segment);
-    merged_segments.Insert(segment);
+    segment->children.Empty();
+    if (!segment->parent) { 
+      segment->segmentation_index = segments.NEntries();    
+      segments.Insert(segment); 
+    }
+    else {
+      segment->parent = NULL;
+      merged_segments.Insert(segment);
+    }
   }
 
   // Delete merged segments
@@ -1634,12 +1654,19 @@ CreateSegments(int primitive_type)
   }
 
   // Create segments
+  RNTime timer;
   if (initialize_hierarchically) {
+    timer.Read();
     if (!CreateSingletonSegments(primitive_type)) return 0;
+    segment_creation_time += timer.Elapsed();
+    timer.Read();
     if (!MergeSegments()) return 0;
+    merge_time += timer.Elapsed();
   }
   else {
+    timer.Read();
     if (!CreateRansacSegments(primitive_type)) return 0;
+    ransac_time += timer.Elapsed();
   }
 
   // Check segments
@@ -1654,7 +1681,9 @@ CreateSegments(int primitive_type)
   // Iteratively update segments
   for (int i = 0; i < max_refinement_iterations; i++) {
     // Refine segments
+    timer.Read();
     if (!RefineSegments()) return 0;
+    refinement_time += timer.Elapsed();
 
     // Print debug message
     if (print_progress) {
@@ -1663,7 +1692,9 @@ CreateSegments(int primitive_type)
     }
 
     // Create segments
+    timer.Read();
     if (!CreateRansacSegments(primitive_type)) return 0;
+    ransac_time += timer.Elapsed();
 
     // Print debug message
     if (print_progress) {
@@ -1672,7 +1703,9 @@ CreateSegments(int primitive_type)
     }
 
     // Merge segments
+    timer.Read();
     if (!MergeSegments()) return 0;
+    merge_time += timer.Elapsed();
 
     // Print debug message
     if (print_progress) {
@@ -1681,7 +1714,9 @@ CreateSegments(int primitive_type)
     }
 
     // Delete segments
+    timer.Read();
     if (!DeleteSegments()) return 0;
+    deletion_time += timer.Elapsed();
 
     // Print debug message
     if (print_progress) {
@@ -1700,12 +1735,15 @@ CreateSegments(int primitive_type)
   }
 
   // Delete segments
+  timer.Read();
   if (!DeleteSegments()) return 0;
+  deletion_time += timer.Elapsed();
 
   // Print debug message
   if (print_progress) {
     printf("      SH %.3f %d %d %g\n", step_time.Elapsed(), segments.NEntries(), NUnsegmentedPoints(), Affinity());
     step_time.Read();
+    PrintTimes(stdout);
   }
 
   // Sort segments
@@ -1748,6 +1786,7 @@ ReadSegmentImage(const char *filename)
   }
 
   // Update segment primitives
+#pragma omp parallel for schedule(dynamic, 16)
   for (int i = 0; i < segments.NEntries(); i++) {
     RGBDSegment *segment = segments.Kth(i);
     segment->UpdatePrimitive();
@@ -1785,6 +1824,23 @@ WriteSegmentImage(int xres, int yres, const char *filename) const
 
 
 
+void RGBDSegmentation::
+PrintTimes(FILE *fp) const
+{
+  // Print time spent in each step of segmentation (accumulated over all calls)
+  if (!fp) fp = stdout;
+  fprintf(fp, "      Points = %.3f\n", point_creation_time);
+  fprintf(fp, "      Singletons = %.3f\n", segment_creation_time);
+  fprintf(fp, "      Ransac = %.3f\n", ransac_time);
+  fprintf(fp, "      Refinement = %.3f\n", refinement_time);
+  fprintf(fp, "      Merging = %.3f\n", merge_time);
+  fprintf(fp, "      Deletion = %.3f\n", deletion_time);
+  fprintf(fp, "      Total = %.3f\n", point_creation_time + segment_creation_time +
+    ransac_time + refinement_time + merge_time + deletion_time);
+}
+
+
+
 void RGBDSegmentation::
 SetDefaultParameters(void)
 {
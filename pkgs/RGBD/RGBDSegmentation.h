@@ -34,7 +34,8 @@ public:
   RNScalar radius;
   RNRgb color;
   unsigned int boundary;
-  RNArray<RGBDPoint *> neighbors;
+  RGBDPoint *neighbors[8];
+  int nneighbors;
   struct RGBDSegment *segment;
   RNScalar segment_affinity;
   int segment_index;
@@ -83,8 +84,8 @@ public:
   RNArray<RGBDPoint *> points;
   RGBDSegment *parent;
   RNArray<RGBDSegment *> children;
-  RNArray<struct RGBDSegmentPair *> pairs;
   RGBDPrimitive primitive;
+  int version;
   RNScalar possible_affinity; 
   RNScalar total_affinity;
 };
@@ -92,12 +93,10 @@ public:
 struct RGBDSegmentPair {
 public:
   RGBDSegmentPair(RGBDSegment *segment1 = NULL, RGBDSegment *segment2 = NULL, RNScalar affinity = 0);
-  ~RGBDSegmentPair(void);
 public:
   RGBDSegment *segments[2];
-  int segment_index[2];
+  int segment_version[2];
   RNScalar affinity; 
-  RGBDSegmentPair **heapentry;
 };
 
 struct RGBDSegmentation {
@@ -124,6 +123,7 @@ public:
   int DeleteSegments(void);  
   int MergeSegments(void);  
   int SplitSegments(void);
+  const R3Kdtree<RGBDPoint *> *Kdtree(void);
 public:
   int ReadSegmentImage(const char *filename);
   int WriteSegmentImage(int xres, int yres, const char *filename) const;
@@ -151,6 +151,15 @@ public:
   int max_refinement_iterations;
   int max_ransac_iterations;
   int print_progress;
+
+  // Timing statistics (seconds spent in each step)
+  void PrintTimes(FILE *fp = stdout) const;
+  RNScalar point_creation_time;
+  RNScalar segment_creation_time;
+  RNScalar refinement_time;
+  RNScalar ransac_time;
+  RNScalar merge_time;
+  RNScalar deletion_time;
 };
 
 
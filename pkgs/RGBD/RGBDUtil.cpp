@@ -72,11 +72,15 @@ int RGBDCreatePositionChannels(
   output_py_image = output_px_image;
   output_pz_image = output_px_image;
 
-  // Fill position images
-  for (int i = 0; i < input_undistorted_depth_image.XResolution(); i++) {
-    for (int j = 0; j < input_undistorted_depth_image.YResolution(); j++) {
+  // Fill position images (rows in parallel)
+  const int width = input_undistorted_depth_image.XResolution();
+  const int height = input_undistorted_depth_image.YResolution();
+  const RNScalar *depths = input_undistorted_depth_image.GridValues();
+#pragma omp parallel for schedule(dynamic, 8)
+  for (int j = 0; j < height; j++) {
+    for (int i = 0; i < width; i++) {
       // Get depth
-      RNScalar depth = input_undistorted_depth_image.GridValue(i, j);
+      RNScalar depth = depths[j*width + i];
       if (RNIsNegativeOrZero(depth)) continue;
 
       // Get position in camera coordinate system 
@@ -138,80 +142,180 @@ int RGBDCreateBoundaryChannel(
   filled_input_depth_image.Substitute(0, R2_GRID_UNKNOWN_VALUE);
   filled_input_depth_image.FillHoles();
 
-  // Mark interior boundaries, silhouettes, and shadows
-  for (int i = 1; i < output_boundary_image.XResolution()-1; i++) {
-    for (int j = 1; j < output_boundary_image.YResolution()-1; j++) {
-      // Get original depth
-      RNScalar depth = input_depth_image.GridValue(i, j);
-
+  // Convenient variables
+  const int width = input_depth_image.XResolution();
+  const int height = input_depth_image.YResolution();
+  const RNScalar *depths = input_depth_image.GridValues();
+  const RNScalar *filled_depths = filled_input_depth_image.GridValues();
+
+  // Classify every interior pixel (rows in parallel).  The code for a
+  // pixel has two bits per side for each of the four neighbor directions
+  // (1 = first neighbor is a shadow, 2 = first neighbor is a silhouette),
+  // bit 16 for a border at the pixel, and bit 17 for a hole at the pixel.
+  int *codes = new int [ width * height ];
+  for (int i = 0; i < width * height; i++) codes[i] = 0;
+#pragma omp parallel for schedule(dynamic, 8)
+  for (int j = 1; j < height-1; j++) {
+    const RNScalar *row = &depths[j*width];
+    const RNScalar *filled_row = &filled_depths[j*width];
+    int *code_row = &codes[j*width];
+    for (int i = 1; i < width-1; i++) {
       // Check if in hole
-      if (RNIsNegativeOrZero(depth)) {
-        output_boundary_image.SetGridValue(i, j, RGBD_BORDER_BOUNDARY);
-        continue;
-      }
+      if (RNIsNegativeOrZero(row[i])) { code_row[i] = (1 << 17); continue; }
 
       // Get filled depth
-      depth = filled_input_depth_image.GridValue(i, j);
+      RNScalar depth = filled_row[i];
       if (RNIsNegativeOrZero(depth)) continue;
+      RNScalar threshold = depth * depth_threshold;
+      if (threshold < 0.1) threshold = 0.1;
 
-      // Check depth relative to horizontal neighbors
+      // Check depth relative to neighbors in four directions
+      int code = 0;
       for (int k = 0; k < 4; k++) {
-        int s = (k < 3) ? -1 : 0;
-        int t = (k < 3) ? k-1 : -1;
+        int offset = (k < 3) ? (1 - k)*width + 1 : width;
 
-        // Get depth on one side
-        RNScalar depthA = filled_input_depth_image.GridValue(i-s, j-t);
-        if (RNIsNegativeOrZero(depthA)) {
-          output_boundary_image.SetGridValue(i, j, RGBD_BORDER_BOUNDARY);
-          break;
-        }
-
-        // Get depth on other side
-        RNScalar depthB = filled_input_depth_image.GridValue(i+s, j+t);
-        if (RNIsNegativeOrZero(depthB)) {
-          output_boundary_image.SetGridValue(i, j, RGBD_BORDER_BOUNDARY);
+        // Get depths on both sides
+        RNScalar depthA = filled_row[i + offset];
+        RNScalar depthB = filled_row[i - offset];
+        if (RNIsNegativeOrZero(depthA) || RNIsNegativeOrZero(depthB)) {
+          code |= (1 << 16);
           break;
         }
 
         // Check differences of depth for shadow/silhouette
         RNScalar deltaA = depth - depthA;
         RNScalar deltaB = depthB - depth;
-        RNScalar threshold = depth * depth_threshold;
-        if (threshold < 0.1) threshold = 0.1;
-        if (deltaA < -threshold) {
-          if (deltaA < 4*deltaB) {
-            output_boundary_image.SetGridValue(i-s, j-t, RGBD_SHADOW_BOUNDARY);
-            output_boundary_image.SetGridValue(i, j, RGBD_SILHOUETTE_BOUNDARY);
-          }
+        if ((deltaA < -threshold) && (deltaA < 4*deltaB)) code |= (1 << (4*k));
+        else if ((deltaA > threshold) && (deltaA > 4*deltaB)) code |= (2 << (4*k));
+        if ((deltaB < -threshold) && (deltaB < 4*deltaA)) code |= (1 << (4*k+2));
+        else if ((deltaB > threshold) && (deltaB > 4*deltaA)) code |= (2 << (4*k+2));
+      }
+
+      // Remember code
+      code_row[i] = code;
+    }
+  }
+
+  // Mark interior boundaries, silhouettes, and shadows (in the original
+  // scan order, so that labels written by neighbors override in the same way)
+  for (int i = 1; i < width-1; i++) {
+    for (int j = 1; j < height-1; j++) {
+      int code = codes[j*width + i];
+      if (code == 0) continue;
+
+      // Check if in hole
+      if (code & (1 << 17)) {
+        output_boundary_image.SetGridValue(i, j, RGBD_BORDER_BOUNDARY);
+        continue;
+      }
+
+      // Mark shadows and silhouettes in each direction
+      for (int k = 0; k < 4; k++) {
+        int s = (k < 3) ? -1 : 0;
+        int t = (k < 3) ? k-1 : -1;
+        int a = (code >> (4*k)) & 3;
+        int b = (code >> (4*k+2)) & 3;
+        if (a == 1) {
+          output_boundary_image.SetGridValue(i-s, j-t, RGBD_SHADOW_BOUNDARY);
+          output_boundary_image.SetGridValue(i, j, RGBD_SILHOUETTE_BOUNDARY);
         }
-        else if (deltaA > threshold) {
-          if (deltaA > 4*deltaB) {
-            output_boundary_image.SetGridValue(i-s, j-t, RGBD_SILHOUETTE_BOUNDARY);
-            output_boundary_image.SetGridValue(i, j, RGBD_SHADOW_BOUNDARY);
-          }
+        else if (a == 2) {
+          output_boundary_image.SetGridValue(i-s, j-t, RGBD_SILHOUETTE_BOUNDARY);
+          output_boundary_image.SetGridValue(i, j, RGBD_SHADOW_BOUNDARY);
         }
-        if (deltaB < -threshold) {
-          if (deltaB < 4*deltaA) {
-            output_boundary_image.SetGridValue(i+s, j+t, RGBD_SILHOUETTE_BOUNDARY);
-            output_boundary_image.SetGridValue(i, j, RGBD_SHADOW_BOUNDARY);
-          }
+        if (b == 1) {
+          output_boundary_image.SetGridValue(i+s, j+t, RGBD_SILHOUETTE_BOUNDARY);
+          output_boundary_image.SetGridValue(i, j, RGBD_SHADOW_BOUNDARY);
         }
-        else if (deltaB > threshold) {
-          if (deltaB > 4*deltaA) {
-            output_boundary_image.SetGridValue(i+s, j+t, RGBD_SHADOW_BOUNDARY);
-            output_boundary_image.SetGridValue(i, j, RGBD_SILHOUETTE_BOUNDARY);
-          }
+        else if (b == 2) {
+          output_boundary_image.SetGridValue(i+s, j+t, RGBD_SHADOW_BOUNDARY);
+          output_boundary_image.SetGridValue(i, j, RGBD_SILHOUETTE_BOUNDARY);
         }
       }
+
+      // Mark border
+      if (code & (1 << 16)) {
+        output_boundary_image.SetGridValue(i, j, RGBD_BORDER_BOUNDARY);
+      }
     }
   }
 
+  // Delete codes
+  delete [] codes;
+
   // Return success 
   return 1;
 }
 
 
 
+static void
+AddMoments(RNScalar moments[10], RNScalar x, RNScalar y, RNScalar z)
+{
+  // Add point to moments (count, sums of x, y, z, and sums of xx, xy, xz, yy, yz, zz)
+  moments[0] += 1;
+  moments[1] += x;
+  moments[2] += y;
+  moments[3] += z;
+  moments[4] += x*x;
+  moments[5] += x*y;
+  moments[6] += x*z;
+  moments[7] += y*y;
+  moments[8] += y*z;
+  moments[9] += z*z;
+}
+
+
+
+static int
+ComputeNormal(const RNScalar moments[10], const R3Point& position, const R3Point& viewpoint,
+  R3Vector& normal, RNScalar& variance)
+{
+  // Check number of points
+  RNScalar n = moments[0];
+  if (n < 3) return 0;
+
+  // Compute covariance matrix (moments can be relative to any origin)
+  RNScalar cx = moments[1] / n;
+  RNScalar cy = moments[2] / n;
+  RNScalar cz = moments[3] / n;
+  RNScalar m[9];
+  m[0] = moments[4] / n - cx*cx;
+  m[1] = moments[5] / n - cx*cy;
+  m[2] = moments[6] / n - cx*cz;
+  m[4] = moments[7] / n - cy*cy;
+  m[5] = moments[8] / n - cy*cz;
+  m[8] = moments[9] / n - cz*cz;
+  m[3] = m[1];
+  m[6] = m[2];
+  m[7] = m[5];
+
+  // Calculate SVD of second order moments
+  RNScalar U[9];
+  RNScalar W[3];
+  RNScalar Vt[9];
+  RNSvdDecompose(3, 3, m, U, W, Vt);  // m == U . DiagonalMatrix(W) . Vt
+
+  // Normal is perpendicular to the two principle axes with largest variances
+  R3Vector axis0(Vt[0], Vt[1], Vt[2]);
+  R3Vector axis1(Vt[3], Vt[4], Vt[5]);
+  axis0.Normalize();
+  axis1.Normalize();
+  normal = axis0 % axis1;
+
+  // Flip normal to point towards camera
+  R3Plane plane(position, normal);
+  if (R3SignedDistance(plane, viewpoint) < 0) normal.Flip(); 
+
+  // Return largest variance
+  variance = W[0];
+
+  // Return success
+  return 1;
+}
+
+
+
 int RGBDCreateNormalChannels(const R2Grid& input_depth_image, 
   const R2Grid& input_px_image, const R2Grid& input_py_image, const R2Grid& input_pz_image, const R2Grid& boundary_image,
   R2Grid& output_nx_image, R2Grid& output_ny_image, R2Grid& output_nz_image, R2Grid& output_radius_image,
@@ -225,160 +329,225 @@ int RGBDCreateNormalChannels(const R2Grid& input_depth_image,
   output_nz_image = output_nx_image;
   output_radius_image = output_nx_image;
 
-  // Allocate array of neighborhood points
-  int pixel_radius = neighborhood_pixel_radius * input_depth_image.XResolution() / 640.0 + 0.5;
+  // Convenient variables
+  const int width = input_depth_image.XResolution();
+  const int height = input_depth_image.YResolution();
+  const int npixels = width * height;
+  const RNScalar *depths = input_depth_image.GridValues();
+  const RNScalar *pxs = input_px_image.GridValues();
+  const RNScalar *pys = input_py_image.GridValues();
+  const RNScalar *pzs = input_pz_image.GridValues();
+  const RNScalar *boundaries = boundary_image.GridValues();
+  int pixel_radius = neighborhood_pixel_radius * width / 640.0 + 0.5;
   if (pixel_radius == 0) pixel_radius = 1;
   int neighborhood_pixel_radius_squared = pixel_radius * pixel_radius;
   RNScalar neighborhood_world_radius_squared = neighborhood_world_radius * neighborhood_world_radius;
-  R3Point *neighborhood_points = new R3Point [ input_depth_image.NEntries() ];
 
-  // Allocate search grid
-  R2Grid search_grid(input_depth_image.XResolution(), input_depth_image.YResolution());
-  const RNScalar *search_valuesp = search_grid.GridValues();
-  search_grid.Clear(-1);
+  // Compute summed area tables of position moments (for square windows)
+  const int table_width = width + 1;
+  R3Point table_origin(0, 0, 0);
+  RNScalar *tables[10] = { NULL };
+  RNScalar *window_min[3] = { NULL };
+  RNScalar *window_max[3] = { NULL };
+  if (!neighborhood_search) {
+    // Use average position as origin (to keep sums small)
+    int norigin = 0;
+    for (int i = 0; i < npixels; i++) {
+      if (RNIsNegativeOrZero(depths[i])) continue;
+      table_origin += R3Point(pxs[i], pys[i], pzs[i]);
+      norigin++;
+    }
+    if (norigin > 0) table_origin /= norigin;
+
+    // Sum moments along rows, then along columns
+    for (int m = 0; m < 10; m++) tables[m] = new RNScalar [ table_width * (height + 1) ];
+#pragma omp parallel for schedule(dynamic, 8)
+    for (int j = 0; j <= height; j++) {
+      RNScalar moments[10] = { 0 };
+      for (int m = 0; m < 10; m++) tables[m][j*table_width] = 0;
+      for (int i = 0; i < width; i++) {
+        int index = (j-1)*width + i;
+        if ((j > 0) && !RNIsNegativeOrZero(depths[index])) {
+          AddMoments(moments, pxs[index] - table_origin.X(), pys[index] - table_origin.Y(), pzs[index] - table_origin.Z());
+        }
+        for (int m = 0; m < 10; m++) tables[m][j*table_width + i+1] = moments[m];
+      }
+    }
+#pragma omp parallel for schedule(dynamic, 8)
+    for (int i = 0; i <= width; i++) {
+      for (int j = 1; j <= height; j++) {
+        for (int m = 0; m < 10; m++) tables[m][j*table_width + i] += tables[m][(j-1)*table_width + i];
+      }
+    }
 
-  // Fill normal images
-  for (int i = 0; i < input_depth_image.XResolution(); i++) {
-    for (int j = 0; j < input_depth_image.YResolution(); j++) {
-      int neighborhood_npoints = 0;
+    // Compute bounding boxes of positions in (circles enclosing) windows,
+    // so that windows entirely within the world radius can use the tables
+    if (neighborhood_world_radius_squared > 0) {
+      const RNScalar *positions[3] = { pxs, pys, pzs };
+      int resolution[2] = { width, height };
+      RNLength window_radius = sqrt(2.0) * neighborhood_pixel_radius + 0.5;
+      for (int dim = 0; dim < 3; dim++) {
+        window_min[dim] = new RNScalar [ npixels ];
+        window_max[dim] = new RNScalar [ npixels ];
+        for (int i = 0; i < npixels; i++) {
+          RNScalar value = (RNIsNegativeOrZero(depths[i])) ? R2_GRID_UNKNOWN_VALUE : positions[dim][i];
+          window_min[dim][i] = window_max[dim][i] = value;
+        }
+        RNRankFilter(window_min[dim], 2, resolution, window_radius, 0, TRUE, R2_GRID_UNKNOWN_VALUE);
+        RNRankFilter(window_max[dim], 2, resolution, window_radius, 1, TRUE, R2_GRID_UNKNOWN_VALUE);
+      }
+    }
+  }
 
-      // Check depth
-      RNScalar depth = input_depth_image.GridValue(i, j);
-      if (RNIsNegativeOrZero(depth)) continue;
+  // Fill normal images (rows in parallel)
+#pragma omp parallel
+  {
+    // Allocate search marks and stack
+    int *search_marks = NULL;
+    int *search_stack = NULL;
+    if (neighborhood_search) {
+      search_marks = new int [ npixels ];
+      search_stack = new int [ npixels ];
+      for (int i = 0; i < npixels; i++) search_marks[i] = -1;
+    }
 
-      // Get image position
-      R2Point image_position(i, j);
-
-      // Get world position
-      RNScalar x = input_px_image.GridValue(i, j);
-      RNScalar y = input_py_image.GridValue(i, j);
-      RNScalar z = input_pz_image.GridValue(i, j);
-      R3Point world_position(x, y, z);
-
-      // Create array of neighborhood points
-      if (neighborhood_search) {
-        // Initialize stack
-        int seed_index;
-        RNArray<const RNScalar *> stack;
-        search_grid.IndicesToIndex(i, j, seed_index);
-        const RNScalar *seed_valuep = &search_valuesp[seed_index];
-        search_grid.SetGridValue(seed_index, seed_index);
-        stack.Insert(seed_valuep);
-
-        // Depth first search, not extending beyond boundaries
-        while (!stack.IsEmpty()) {
-          // Pop current point off stack
-          int ix, iy;
-          const RNScalar *current_valuep = stack.Tail(); stack.RemoveTail();
-          int current_index = current_valuep - search_valuesp;
-          search_grid.IndexToIndices(current_index, ix, iy);
-
-          // Get current info
-          RNScalar current_x = input_px_image.GridValue(ix, iy);
-          RNScalar current_y = input_py_image.GridValue(ix, iy);
-          RNScalar current_z = input_pz_image.GridValue(ix, iy);
-          R3Point current_position(current_x, current_y, current_z);
-          RNScalar current_boundary_value = boundary_image.GridValue(ix, iy);
-          int current_boundary = (int) (current_boundary_value + 0.5);
-        
-          // Add point to array
-          neighborhood_points[neighborhood_npoints++] = current_position;
-
-          // Add adjacent points to stack
-          for (int inx = ix-1; inx <= ix+1; inx++) {
-            if ((inx < 0) || (inx >= search_grid.XResolution())) continue;
-            for (int iny = iy-1; iny <= iy+1; iny++) {
-              if ((iny < 0) || (iny >= search_grid.YResolution())) continue;
-
-              // Check if neighbor has already been visited
-              RNScalar neighbor_value = search_grid.GridValue(inx, iny);
-              if (RNIsEqual(neighbor_value, seed_index)) continue;
-              search_grid.SetGridValue(inx, iny, seed_index);
-
-              // Check neighbor depth
-              RNScalar neighbor_depth = input_depth_image.GridValue(inx, iny);
-              if (RNIsNegativeOrZero(neighbor_depth)) continue;
-
-              // Check neighbor image distance
-              R2Point neighbor_image_position(inx, iny);
-              if (R2SquaredDistance(image_position, neighbor_image_position) > neighborhood_pixel_radius_squared) continue;
-            
-              // Check neighbor world distance
-              RNScalar neighbor_x = input_px_image.GridValue(inx, iny);
-              RNScalar neighbor_y = input_py_image.GridValue(inx, iny);
-              RNScalar neighbor_z = input_pz_image.GridValue(inx, iny);
-              R3Point neighbor_world_position(neighbor_x, neighbor_y, neighbor_z);
-              if (neighborhood_world_radius_squared > 0) {
-                if (R3SquaredDistance(world_position, neighbor_world_position) > neighborhood_world_radius_squared) continue;
+#pragma omp for schedule(dynamic, 4)
+    for (int j = 0; j < height; j++) {
+      for (int i = 0; i < width; i++) {
+        // Check depth
+        int seed_index = j*width + i;
+        RNScalar depth = depths[seed_index];
+        if (RNIsNegativeOrZero(depth)) continue;
+
+        // Get world position
+        R3Point world_position(pxs[seed_index], pys[seed_index], pzs[seed_index]);
+
+        // Accumulate moments of neighborhood points
+        RNScalar moments[10] = { 0 };
+        if (neighborhood_search) {
+          // Depth first search, not extending beyond boundaries
+          int nstack = 0;
+          search_marks[seed_index] = seed_index;
+          search_stack[nstack++] = seed_index;
+          while (nstack > 0) {
+            // Pop current point off stack
+            int current_index = search_stack[--nstack];
+            int ix = current_index % width;
+            int iy = current_index / width;
+
+            // Add point to moments
+            AddMoments(moments, pxs[current_index] - world_position.X(),
+              pys[current_index] - world_position.Y(), pzs[current_index] - world_position.Z());
+            int current_boundary = (int) (boundaries[current_index] + 0.5);
+
+            // Add adjacent points to stack
+            for (int inx = ix-1; inx <= ix+1; inx++) {
+              if ((inx < 0) || (inx >= width)) continue;
+              for (int iny = iy-1; iny <= iy+1; iny++) {
+                if ((iny < 0) || (iny >= height)) continue;
+
+                // Check if neighbor has already been visited
+                int neighbor_index = iny*width + inx;
+                if (search_marks[neighbor_index] == seed_index) continue;
+                search_marks[neighbor_index] = seed_index;
+
+                // Check neighbor depth
+                if (RNIsNegativeOrZero(depths[neighbor_index])) continue;
+
+                // Check neighbor image distance
+                int dx = inx - i, dy = iny - j;
+                if (dx*dx + dy*dy > neighborhood_pixel_radius_squared) continue;
+
+                // Check neighbor world distance
+                if (neighborhood_world_radius_squared > 0) {
+                  R3Point neighbor_world_position(pxs[neighbor_index], pys[neighbor_index], pzs[neighbor_index]);
+                  if (R3SquaredDistance(world_position, neighbor_world_position) > neighborhood_world_radius_squared) continue;
+                }
+
+                // Check if neighbor is across boundary
+                int neighbor_boundary = (int) (boundaries[neighbor_index] + 0.5);
+                if ((current_boundary == RGBD_SHADOW_BOUNDARY) && (neighbor_boundary == RGBD_SILHOUETTE_BOUNDARY)) continue;
+                if ((current_boundary == RGBD_SILHOUETTE_BOUNDARY) && (neighbor_boundary == RGBD_SHADOW_BOUNDARY)) continue;
+
+                // Add neighbor to search
+                search_stack[nstack++] = neighbor_index;
               }
-
-              // Check if neighbor is across boundary
-              int neighbor_boundary = (int) (boundary_image.GridValue(inx, iny) + 0.5);
-              if ((current_boundary == RGBD_SHADOW_BOUNDARY) && (neighbor_boundary == RGBD_SILHOUETTE_BOUNDARY)) continue;
-              if ((current_boundary == RGBD_SILHOUETTE_BOUNDARY) && (neighbor_boundary == RGBD_SHADOW_BOUNDARY)) continue;
-        
-              // Add neighbor to search
-              int neighbor_index;
-              search_grid.IndicesToIndex(inx, iny, neighbor_index);
-              const RNScalar *neighbor_valuep = &search_valuesp[neighbor_index];
-              stack.Insert(neighbor_valuep);
             }
           }
         }
-      }
-      else {
-        // Add neighbor points to array
-        for (int inx = i-neighborhood_pixel_radius; inx <= i+neighborhood_pixel_radius; inx++) {
-          if ((inx < 0) || (inx >= input_depth_image.XResolution())) continue;
-          for (int iny = j-neighborhood_pixel_radius; iny <= j+neighborhood_pixel_radius; iny++) {
-            if ((iny < 0) || (iny >= input_depth_image.YResolution())) continue;
-            
-            // Check neighbor depth
-            RNScalar neighbor_depth = input_depth_image.GridValue(inx, iny);
-            if (RNIsNegativeOrZero(neighbor_depth)) continue;
-
-            // Check neighbor world position
-            RNScalar neighbor_x = input_px_image.GridValue(inx, iny);
-            RNScalar neighbor_y = input_py_image.GridValue(inx, iny);
-            RNScalar neighbor_z = input_pz_image.GridValue(inx, iny);
-            R3Point neighbor_world_position(neighbor_x, neighbor_y, neighbor_z);
-            if (neighborhood_world_radius_squared > 0) {
-              if (R3SquaredDistance(world_position, neighbor_world_position) > neighborhood_world_radius_squared) continue;
+        else {
+          // Get window
+          int i0 = (i - neighborhood_pixel_radius < 0) ? 0 : i - neighborhood_pixel_radius;
+          int j0 = (j - neighborhood_pixel_radius < 0) ? 0 : j - neighborhood_pixel_radius;
+          int i1 = (i + neighborhood_pixel_radius >= width) ? width - 1 : i + neighborhood_pixel_radius;
+          int j1 = (j + neighborhood_pixel_radius >= height) ? height - 1 : j + neighborhood_pixel_radius;
+
+          // Check whether all points in window are within world radius
+          RNBoolean inside = TRUE;
+          if (neighborhood_world_radius_squared > 0) {
+            RNScalar d[3];
+            for (int dim = 0; dim < 3; dim++) {
+              RNScalar d1 = world_position[dim] - window_min[dim][seed_index];
+              RNScalar d2 = window_max[dim][seed_index] - world_position[dim];
+              d[dim] = (d1 > d2) ? d1 : d2;
             }
+            if (d[0]*d[0] + d[1]*d[1] + d[2]*d[2] > neighborhood_world_radius_squared) inside = FALSE;
+          }
 
-            // Add neighbor point to array
-            neighborhood_points[neighborhood_npoints++] = neighbor_world_position;
+          // Add neighbor points
+          if (inside) {
+            // Get moments from summed area tables
+            int index00 = j0*table_width + i0;
+            int index01 = j0*table_width + i1+1;
+            int index10 = (j1+1)*table_width + i0;
+            int index11 = (j1+1)*table_width + i1+1;
+            for (int m = 0; m < 10; m++) {
+              moments[m] = tables[m][index11] - tables[m][index01] - tables[m][index10] + tables[m][index00];
+            }
+          }
+          else {
+            // Add neighbor points within world radius one at a time
+            for (int iny = j0; iny <= j1; iny++) {
+              for (int inx = i0; inx <= i1; inx++) {
+                int neighbor_index = iny*width + inx;
+                if (RNIsNegativeOrZero(depths[neighbor_index])) continue;
+                R3Point neighbor_world_position(pxs[neighbor_index], pys[neighbor_index], pzs[neighbor_index]);
+                if (R3SquaredDistance(world_position, neighbor_world_position) > neighborhood_world_radius_squared) continue;
+                AddMoments(moments, neighbor_world_position.X() - world_position.X(),
+                  neighbor_world_position.Y() - world_position.Y(), neighbor_world_position.Z() - world_position.Z());
+              }
+            }
           }
         }
-      }
-
-      // Check number of neighbor points
-      if (neighborhood_npoints < 3) continue;
 
-      // Solve for normal
-      RNScalar variances[3];
-      R3Point centroid = R3Centroid(neighborhood_npoints, neighborhood_points);
-      R3Triad triad = R3PrincipleAxes(centroid, neighborhood_npoints, neighborhood_points, NULL, variances);
-      R3Vector normal = triad[2];
+        // Solve for normal
+        R3Vector normal;
+        RNScalar variance;
+        if (!ComputeNormal(moments, world_position, viewpoint, normal, variance)) continue;
 
-      // Flip normal to point towards camera
-      R3Plane plane(world_position, normal);
-      if (R3SignedDistance(plane, viewpoint) < 0) normal.Flip(); 
+        // Fill normal images
+        output_nx_image.SetGridValue(i, j, normal.X());
+        output_ny_image.SetGridValue(i, j, normal.Y());
+        output_nz_image.SetGridValue(i, j, normal.Z());
 
-      // Fill normal images
-      output_nx_image.SetGridValue(i, j, normal.X());
-      output_ny_image.SetGridValue(i, j, normal.Y());
-      output_nz_image.SetGridValue(i, j, normal.Z());
-
-      // Fill radius image
-      RNScalar r = sqrt(variances[0]);
-      if (neighborhood_pixel_radius > 1) r /= neighborhood_pixel_radius;
-      output_radius_image.SetGridValue(i, j, r);
+        // Fill radius image
+        RNScalar r = sqrt(variance);
+        if (neighborhood_pixel_radius > 1) r /= neighborhood_pixel_radius;
+        output_radius_image.SetGridValue(i, j, r);
+      }
     }
+
+    // Delete search marks and stack
+    if (search_marks) delete [] search_marks;
+    if (search_stack) delete [] search_stack;
   }
 
-  // Delete array of neighborhood points
-  delete [] neighborhood_points;
+  // Delete summed area tables and window bounds
+  for (int m = 0; m < 10; m++) if (tables[m]) delete [] tables[m];
+  for (int dim = 0; dim < 3; dim++) {
+    if (window_min[dim]) delete [] window_min[dim];
+    if (window_max[dim]) delete [] window_max[dim];
+  }
 
   // Return success 
   return 1;
@@ -416,63 +585,13 @@ int RGBDCreateUndistortedColorImage(
     return 1;
   }
 
-  // Save copy of input image (so can pass same image both in and out)
-  R2Grid source_color_image(input_distorted_color_image);
+  // Get table mapping output pixels to input image positions (created once per camera)
+  const RGBDRemapTable *table = RGBDRemapTable::ColorUndistortionTable(distorted_camera, undistorted_camera,
+    input_distorted_color_image.XResolution(), input_distorted_color_image.YResolution());
+  if (!table) return 0;
 
-  // Initialize the output image
-  output_undistorted_color_image = R2Grid(undistorted_camera.colorWidth, undistorted_camera.colorHeight);
-  output_undistorted_color_image.Clear(R2_GRID_UNKNOWN_VALUE);
-  
-  // Compute output image via reverse mapping
-  for (int output_iy = 0; output_iy < output_undistorted_color_image.YResolution(); output_iy++) {
-    for (int output_ix = 0; output_ix < output_undistorted_color_image.XResolution(); output_ix++) {
-      // Compute coordinates in undistorted output image
-      R2Point undistorted_output_position(output_ix + 0.5, output_iy + 0.5);
-
-      // Compute coordinates in undistorted input image
-      // Note that this ignores p1 and p2
-      R2Point undistorted_input_position(undistorted_output_position);
-      RNScalar x = sx * (undistorted_output_position.X() - undistorted_camera.mx_color) + distorted_camera.mx_color;
-      RNScalar y = sy * (undistorted_output_position.Y() - undistorted_camera.my_color) + distorted_camera.my_color;
-      undistorted_input_position.Reset(x, y);
-      
-      // Compute coordinates in distorted input image
-      R2Point distorted_input_position(undistorted_input_position);
-      if ((distorted_camera.k1_color != 0.0) || (distorted_camera.k2_color != 0.0) ||
-          (distorted_camera.k3_color != 0.0) || (distorted_camera.k4_color != 0.0) ||
-          (distorted_camera.p1_color != 0.0) || (distorted_camera.k2_color != 0.0)) {
-        double nx = (undistorted_input_position.X() - distorted_camera.mx_color) / distorted_camera.fx_color;
-        double ny = (undistorted_input_position.Y() - distorted_camera.my_color) / distorted_camera.fy_color;
-        double rr = nx*nx + ny*ny; double rrrr = rr*rr;
-        double s = 1.0 + rr*distorted_camera.k1_depth + rrrr*distorted_camera.k2_depth + rrrr*rr*distorted_camera.k3_depth + rrrr*rrrr*distorted_camera.k4_depth;
-        nx = s*nx + distorted_camera.p2_color*(rr + 2*nx*nx) + 2*distorted_camera.p1_color*nx*ny;
-        ny = s*ny + distorted_camera.p1_color*(rr + 2*ny*ny) + 2*distorted_camera.p2_color*nx*ny;
-        double x = nx*distorted_camera.fx_color + distorted_camera.mx_color;
-        double y = ny*distorted_camera.fy_color + distorted_camera.my_color;
-        distorted_input_position.Reset(x, y);
-      }
-
-      // Check if outside input image
-      if (distorted_input_position.X() < 0) continue;
-      if (distorted_input_position.X() > source_color_image.XResolution()-1) continue;
-      if (distorted_input_position.Y() < 0) continue;
-      if (distorted_input_position.Y() > source_color_image.YResolution()-1) continue;
-
-#if 0
-      // Check if center goes to center
-      if (RNIsEqual(undistorted_output_position.X(), distorted_camera.mx_color, 0.5) &&
-          RNIsEqual(undistorted_output_position.Y(), distorted_camera.my_color, 0.5) &&
-          !R2Contains(undistorted_output_position, distorted_input_position)) RNAbort("HERE");
-#endif
-      
-      // Copy value from input image to output image (bilinear interpolation)
-      RNScalar value = source_color_image.GridValue(distorted_input_position);
-      output_undistorted_color_image.SetGridValue(output_ix, output_iy, value);
-    }
-  }
-
-  // Return success
-  return 1;
+  // Compute output image via reverse mapping (bilinear interpolation)
+  return table->Apply(input_distorted_color_image, output_undistorted_color_image);
 }
 
 
@@ -505,120 +624,13 @@ int RGBDCreateUndistortedDepthImage(
     return 1;
   }
 
-  // Save copy of input image (so can pass same image both in and out)
-  R2Grid source_depth_image(input_distorted_depth_image);
+  // Get table mapping input pixels to output pixels (created once per camera)
+  const RGBDRemapTable *table = RGBDRemapTable::DepthUndistortionTable(distorted_camera, undistorted_camera,
+    input_distorted_depth_image.XResolution(), input_distorted_depth_image.YResolution());
+  if (!table) return 0;
 
-  // Initialize the output image
-  output_undistorted_depth_image = R2Grid(undistorted_camera.depthWidth, undistorted_camera.depthHeight);
-  output_undistorted_depth_image.Clear(R2_GRID_UNKNOWN_VALUE);
-
-#ifdef MASK_HOLES
-  // Create image with no holes 
-  source_depth_image.Substitute(0, R2_GRID_UNKNOWN_VALUE);
-  source_depth_image.FillHoles();
-#endif
-  
-  // Compute output image via a combination of reverse and forward mapping
-  double step_factor = 0.5; // make <1 to avoid pin-holes in output image (or use InterpolateDepthImage, which is faster but not as good)
-  double x_step = step_factor * source_depth_image.XResolution() / (double) output_undistorted_depth_image.XResolution();
-  double y_step = step_factor * source_depth_image.YResolution() / (double) output_undistorted_depth_image.YResolution();
-  for (double undistorted_input_y = 0.5*y_step; undistorted_input_y < source_depth_image.YResolution(); undistorted_input_y += y_step) {
-    for (double undistorted_input_x = 0.5*x_step; undistorted_input_x < source_depth_image.XResolution(); undistorted_input_x += x_step) {
-      // Compute coordinates in distorted input image
-      // Note that this ignores p1 and p2
-      R2Point distorted_input_position(undistorted_input_x, undistorted_input_y);
-      if ((distorted_camera.k1_depth != 0.0) || (distorted_camera.k2_depth != 0.0) ||
-          (distorted_camera.k3_depth != 0.0) || (distorted_camera.k3_depth != 0.0) ||
-          (distorted_camera.p1_depth != 0.0) || (distorted_camera.p2_depth != 0.0)) {
-        double nx = (undistorted_input_x - distorted_camera.mx_depth) / distorted_camera.fx_depth;
-        double ny = (undistorted_input_y - distorted_camera.my_depth) / distorted_camera.fy_depth;
-        double rr = nx*nx + ny*ny; double rrrr = rr*rr;
-        double s = 1.0 + rr*distorted_camera.k1_depth + rrrr*distorted_camera.k2_depth + rrrr*rr*distorted_camera.k3_depth + rrrr*rrrr*distorted_camera.k4_depth;
-        nx = s*nx + distorted_camera.p2_depth*(rr + 2*nx*nx) + 2*distorted_camera.p1_depth*nx*ny;
-        ny = s*ny + distorted_camera.p1_depth*(rr + 2*ny*ny) + 2*distorted_camera.p2_depth*nx*ny;
-        double x = nx*distorted_camera.fx_depth + distorted_camera.mx_depth;
-        double y = ny*distorted_camera.fy_depth + distorted_camera.my_depth;
-        distorted_input_position.Reset(x, y);
-      }
-
-      // Get closest distorted input pixel
-      int distorted_input_ix = (int) (distorted_input_position.X() + 0.5);
-      int distorted_input_iy = (int) (distorted_input_position.Y() + 0.5);
-      if (distorted_input_ix < 0) continue;
-      if (distorted_input_ix >= source_depth_image.XResolution()) continue;
-      if (distorted_input_iy < 0) continue;
-      if (distorted_input_iy >= source_depth_image.YResolution()) continue;
-
-#ifdef MASK_HOLES
-      // Get depth, even if there was a hole there originally
-      RNBoolean depth_was_missing = FALSE;
-      RNScalar depth = source_depth_image.GridValue(distorted_input_ix, distorted_input_iy);
-      if (depth <= 0) {
-        depth = interpolated_depth_image.GridValue(distorted_input_ix, distorted_input_iy);
-        if (depth <= 0) continue;
-        depth_was_missing = TRUE;
-      }
-#else
-      // Get/check depth
-      RNScalar depth = source_depth_image.GridValue(distorted_input_ix, distorted_input_iy);
-      if (depth <= 0) continue;
-#endif
-      
-      // Find 3D position in depth camera coordinates
-      R3Point world_position;
-      world_position[0] = (undistorted_input_x - distorted_camera.mx_depth) * depth / distorted_camera.fx_depth;
-      world_position[1] = (undistorted_input_y - distorted_camera.my_depth) * depth / distorted_camera.fy_depth;
-      world_position[2] = -depth;
-
-      // Transform into output (color) camera coordinates
-      world_position = distorted_camera.depthToColorExtrinsics * world_position;
-
-      // Project into output pixel coordinates
-      R3Point undistorted_output_position;
-      undistorted_output_position[0] = undistorted_camera.mx_depth + world_position[0] * undistorted_camera.fx_depth / -world_position[2];
-      undistorted_output_position[1] = undistorted_camera.my_depth + world_position[1] * undistorted_camera.fy_depth / -world_position[2];
-      undistorted_output_position[2] = world_position[2];
-
-      // Snap to closest pixel in output image
-      int undistorted_output_ix = (int) (undistorted_output_position[0] + 0.5);
-      if (undistorted_output_ix < 0) continue;
-      if (undistorted_output_ix >= output_undistorted_depth_image.XResolution()) continue;
-      int undistorted_output_iy = (int) (undistorted_output_position[1] + 0.5);
-      if (undistorted_output_iy < 0) continue;
-      if (undistorted_output_iy >= output_undistorted_depth_image.YResolution()) continue;
-
-#ifdef MASK_HOLES
-      // Assign depth of zero in pixels where a hole is mapped
-      if (depth_was_missing) undistorted_output_position[2] = 0.0;
-#endif
-      
-      // Store only closest grid value at every ix,iy in output image
-      RNScalar new_depth = -undistorted_output_position[2];
-      RNScalar old_depth = output_undistorted_depth_image.GridValue(undistorted_output_ix, undistorted_output_iy);
-      if ((old_depth == 0.0) || (old_depth == R2_GRID_UNKNOWN_VALUE) || (new_depth < old_depth)) {
-        output_undistorted_depth_image.SetGridValue(undistorted_output_ix, undistorted_output_iy, new_depth);
-      }
-
-#if 0
-      // Check if center goes to center
-      if (distorted_camera.depthToColorExtrinsics.IsIdentity() &&
-          undistorted_camera.depthToColorExtrinsics.IsIdentity() &&
-          RNIsEqual(undistorted_output_position.X(), undistorted_camera.mx_depth, 0.5) &&
-          RNIsEqual(undistorted_output_position.Y(), undistorted_camera.my_depth, 0.5)) {
-        if (RNIsNotEqual(distorted_input_position.X(), distorted_camera.mx_depth, 0.5) ||
-            RNIsNotEqual(distorted_input_position.Y(), distorted_camera.my_depth, 0.5)) {
-          printf("%g %g | %g %g\n",
-                 distorted_input_position.X(), distorted_input_position.Y(),
-                 undistorted_output_position.X(), undistorted_output_position.Y());
-                 
-        }
-      }
-#endif
-    }
-  }
-
-  // Return success
-  return 1;
+  // Compute output image, keeping closest depth mapped to every output pixel
+  return table->Apply(input_distorted_depth_image, output_undistorted_depth_image);
 }
 
 
@@ -637,47 +649,9 @@ int RGBDResampleDepthImage(R2Grid& image, R3Matrix& intrinsics_matrix, int xres,
   double xscale = (double) image.XResolution() / (double) xres;
   double yscale = (double) image.YResolution() / (double) yres;
 
-  // Copy original image and then initialize to zeroes
-  R2Grid copy_image(image);
-  image = R2Grid(xres, yres);
-
-  // Resample images
-  for (int iy = 0; iy < yres; iy++) {
-    double cy = yscale * iy;
-    int min_y = cy - 0.5*yscale + 0.5;
-    if (min_y >= copy_image.YResolution()) continue;
-    int max_y = cy + 0.5*yscale + 0.5;
-    if (max_y < 0) continue;
-    if (min_y < 0) min_y = 0;
-    if (max_y >= copy_image.YResolution()) max_y = copy_image.YResolution()-1;
-    if (max_y < min_y) max_y = min_y;
-    
-    for (int ix = 0; ix < xres; ix++) {
-      double cx = xscale * ix;
-      int min_x = cx - 0.5*xscale + 0.5;
-      if (min_x >= copy_image.XResolution()) continue;
-      int max_x = cx + 0.5*xscale + 0.5;
-      if (max_x < 0) continue;
-      if (min_x < 0) min_x = 0;
-      if (max_x >= copy_image.XResolution()) max_x = copy_image.XResolution()-1;
-      if (max_x < min_x) max_x = min_x;
-
-      // Find minimum depth in neighborhood
-      RNScalar min_depth = FLT_MAX;
-      for (int j = min_y; j <= max_y; j++) {
-        for (int i = min_x; i <= max_x; i++) {
-          RNScalar depth = copy_image.GridValue(i, j);
-          if ((depth <= 0) || (depth == R2_GRID_UNKNOWN_VALUE)) continue;
-          if (depth < min_depth) min_depth = depth;
-        }
-      }
-
-      // Set depth
-      if (min_depth < FLT_MAX) {
-        image.SetGridValue(ix, iy, min_depth);
-      }
-    }
-  }
+  // Resample image (minimum depth in footprint of every output pixel)
+  const RGBDRemapTable *table = RGBDRemapTable::DepthResamplingTable(image.XResolution(), image.YResolution(), xres, yres);
+  if (!table || !table->Apply(image, image)) return 0;
 
   // Update depth intrinsics matrix
   intrinsics_matrix[0][0] /= xscale;
@@ -762,3 +736,414 @@ int RGBDResampleColorImage(R2Image& image, R3Matrix& intrinsics_matrix, int xres
 
 
 
+////////////////////////////////////////////////////////////////////////
+// SURFACE TEXTURE CREATION FUNCTIONS
+////////////////////////////////////////////////////////////////////////
+
+struct RGBDTexelSamples {
+  // Texels that lie on the surface (with world positions and normals)
+  RGBDSurface *surface;
+  int width, height;
+  int nsamples;
+  int *texel_indices;
+  RNScalar32 *positions;
+  RNScalar32 *normals;
+  R3Box bbox;
+
+  // Color accumulators (red, green, blue, weight)
+  RNScalar32 *colors;
+};
+
+
+
+static int
+CreateTexelSamples(RGBDTexelSamples& samples, RGBDSurface *surface)
+{
+  // Initialize samples
+  samples.surface = surface;
+  samples.width = surface->NTexels(RN_X);
+  samples.height = surface->NTexels(RN_Y);
+  samples.nsamples = 0;
+  samples.texel_indices = NULL;
+  samples.positions = NULL;
+  samples.normals = NULL;
+  samples.colors = NULL;
+  samples.bbox = R3null_box;
+
+  // Create texel position map
+  R2Grid px_image, py_image, pz_image, nx_image, ny_image, nz_image;
+  if (!RGBDCreateTexelPositionChannels(surface, px_image, py_image, pz_image, nx_image, ny_image, nz_image)) return 0;
+
+  // Count texels on surface
+  int ntexels = px_image.NEntries();
+  const RNScalar *px_values = px_image.GridValues();
+  for (int i = 0; i < ntexels; i++) {
+    if (px_values[i] != R2_GRID_UNKNOWN_VALUE) samples.nsamples++;
+  }
+
+  // Allocate samples
+  samples.texel_indices = new int [ samples.nsamples ];
+  samples.positions = new RNScalar32 [ 3 * samples.nsamples ];
+  samples.normals = new RNScalar32 [ 3 * samples.nsamples ];
+  samples.colors = new RNScalar32 [ 4 * samples.nsamples ];
+
+  // Fill samples (in texel order, so that consecutive samples are nearby)
+  int k = 0;
+  for (int i = 0; i < ntexels; i++) {
+    if (px_values[i] == R2_GRID_UNKNOWN_VALUE) continue;
+    R3Point position(px_image.GridValue(i), py_image.GridValue(i), pz_image.GridValue(i));
+    samples.texel_indices[k] = i;
+    samples.positions[3*k+0] = position.X();
+    samples.positions[3*k+1] = position.Y();
+    samples.positions[3*k+2] = position.Z();
+    samples.normals[3*k+0] = nx_image.GridValue(i);
+    samples.normals[3*k+1] = ny_image.GridValue(i);
+    samples.normals[3*k+2] = nz_image.GridValue(i);
+    samples.colors[4*k+0] = 0;
+    samples.colors[4*k+1] = 0;
+    samples.colors[4*k+2] = 0;
+    samples.colors[4*k+3] = 0;
+    samples.bbox.Union(position);
+    k++;
+  }
+
+  // Return success
+  return 1;
+}
+
+
+
+static void
+DeleteTexelSamples(RGBDTexelSamples& samples)
+{
+  // Delete arrays
+  if (samples.texel_indices) delete [] samples.texel_indices;
+  if (samples.positions) delete [] samples.positions;
+  if (samples.normals) delete [] samples.normals;
+  if (samples.colors) delete [] samples.colors;
+  samples.texel_indices = NULL;
+  samples.positions = NULL;
+  samples.normals = NULL;
+  samples.colors = NULL;
+  samples.nsamples = 0;
+}
+
+
+
+static RNBoolean
+IsBoxInFrustum(const R3Box& box, RGBDImage *image)
+{
+  // Check box
+  if (box.IsEmpty()) return FALSE;
+
+  // Get camera parameters
+  const R3Matrix& intrinsics = image->Intrinsics();
+  RNScalar fx = intrinsics[0][0];
+  RNScalar fy = intrinsics[1][1];
+  RNScalar cx = intrinsics[0][2];
+  RNScalar cy = intrinsics[1][2];
+  if (RNIsZero(fx) || RNIsZero(fy)) return TRUE;
+  RNScalar xres = (image->NPixels(RN_X) > 0) ? image->NPixels(RN_X) : 2 * cx;
+  RNScalar yres = (image->NPixels(RN_Y) > 0) ? image->NPixels(RN_Y) : 2 * cy;
+  R4Matrix world_to_camera = image->CameraToWorld().Matrix().Inverse();
+
+  // Box is outside frustum if all corners are outside any one of its
+  // (convex) half-spaces: in front of camera, and inside image bounds
+  int outside[5] = { 0, 0, 0, 0, 0 };
+  for (int i = 0; i < 8; i++) {
+    R3Point p = world_to_camera * box.Corner((RNOctant) i);
+    RNScalar d = -p.Z();
+    if (d <= 0) outside[0]++;
+    if (fx * p.X() + cx * d < 0) outside[1]++;
+    if (fx * p.X() + cx * d > xres * d) outside[2]++;
+    if (fy * p.Y() + cy * d < 0) outside[3]++;
+    if (fy * p.Y() + cy * d > yres * d) outside[4]++;
+  }
+
+  // Check half-spaces
+  for (int i = 0; i < 5; i++) {
+    if (outside[i] == 8) return FALSE;
+  }
+
+  // Box is (at least partially) in frustum
+  return TRUE;
+}
+
+
+
+static int
+AccumulateTexelColors(RGBDTexelSamples& samples, RGBDImage *image,
+  RNScalar max_depth_error, RNAngle max_view_angle)
+{
+  // Get channels (assumes they have been read)
+  R2Grid *depth_channel = image->DepthChannel();
+  R2Grid *red_channel = image->RedChannel();
+  R2Grid *green_channel = image->GreenChannel();
+  R2Grid *blue_channel = image->BlueChannel();
+  if (!depth_channel || !red_channel || !green_channel || !blue_channel) return 0;
+
+  // Get camera parameters
+  const R3Matrix& intrinsics = image->Intrinsics();
+  RNScalar fx = intrinsics[0][0];
+  RNScalar fy = intrinsics[1][1];
+  RNScalar cx = intrinsics[0][2];
+  RNScalar cy = intrinsics[1][2];
+  if (RNIsZero(fx) || RNIsZero(fy)) return 0;
+  int xres = depth_channel->XResolution();
+  int yres = depth_channel->YResolution();
+  R4Matrix world_to_camera = image->CameraToWorld().Matrix().Inverse();
+  R3Point viewpoint = image->WorldViewpoint();
+  RNScalar min_cos = cos(max_view_angle);
+
+  // Accumulate colors of samples visible in image (consecutive tiles of samples in parallel)
+#pragma omp parallel for schedule(dynamic, 1024)
+  for (int k = 0; k < samples.nsamples; k++) {
+    // Transform sample position into camera coordinates
+    R3Point world_position(samples.positions[3*k+0], samples.positions[3*k+1], samples.positions[3*k+2]);
+    R3Point camera_position = world_to_camera * world_position;
+    RNScalar depth = -camera_position.Z();
+    if (depth <= 0) continue;
+
+    // Project into image
+    RNScalar x = cx + camera_position.X() * fx / depth;
+    RNScalar y = cy + camera_position.Y() * fy / depth;
+    int ix = (int) (x + 0.5);
+    int iy = (int) (y + 0.5);
+    if ((ix < 0) || (ix >= xres) || (iy < 0) || (iy >= yres)) continue;
+
+    // Check visibility (depth in image must match depth of sample)
+    RNScalar image_depth = depth_channel->GridValue(ix, iy);
+    if ((image_depth == R2_GRID_UNKNOWN_VALUE) || (image_depth <= 0)) continue;
+    if (fabs(image_depth - depth) > max_depth_error * depth) continue;
+
+    // Check view angle (texels without normals are accepted)
+    RNScalar weight = 1.0 / depth;
+    R3Vector normal(samples.normals[3*k+0], samples.normals[3*k+1], samples.normals[3*k+2]);
+    if (!normal.IsZero()) {
+      R3Vector view_vector = viewpoint - world_position;
+      view_vector.Normalize();
+      RNScalar cos_angle = fabs(normal.Dot(view_vector));
+      if (cos_angle < min_cos) continue;
+      weight *= cos_angle;
+    }
+
+    // Get color
+    RNScalar red = red_channel->GridValue(x, y);
+    if (red == R2_GRID_UNKNOWN_VALUE) continue;
+    RNScalar green = green_channel->GridValue(x, y);
+    if (green == R2_GRID_UNKNOWN_VALUE) continue;
+    RNScalar blue = blue_channel->GridValue(x, y);
+    if (blue == R2_GRID_UNKNOWN_VALUE) continue;
+
+    // Accumulate weighted color
+    samples.colors[4*k+0] += weight * red;
+    samples.colors[4*k+1] += weight * green;
+    samples.colors[4*k+2] += weight * blue;
+    samples.colors[4*k+3] += weight;
+  }
+
+  // Return success
+  return 1;
+}
+
+
+
+static int
+AccumulateTexelColors(RGBDTexelSamples *samples, int nsurfaces, RGBDImage *image,
+  RNScalar max_depth_error, RNAngle max_view_angle)
+{
+  // Find surfaces within frustum of image
+  RNArray<RGBDTexelSamples *> visible_samples;
+  for (int i = 0; i < nsurfaces; i++) {
+    if (samples[i].nsamples == 0) continue;
+    if (!IsBoxInFrustum(samples[i].bbox, image)) continue;
+    visible_samples.Insert(&samples[i]);
+  }
+
+  // Check if any surfaces are visible
+  if (visible_samples.IsEmpty()) return 1;
+
+  // Read channels
+  if (!image->ReadDepthChannel()) return 0;
+  if (!image->ReadColorChannels()) { image->ReleaseDepthChannel(); return 0; }
+
+  // Accumulate colors of surfaces that survived culling (with exact test now that channels are read)
+  int status = 1;
+  for (int i = 0; i < visible_samples.NEntries(); i++) {
+    RGBDTexelSamples *s = visible_samples.Kth(i);
+    if (!IsBoxInFrustum(s->bbox, image)) continue;
+    if (!AccumulateTexelColors(*s, image, max_depth_error, max_view_angle)) status = 0;
+  }
+
+  // Release channels
+  image->ReleaseColorChannels();
+  image->ReleaseDepthChannel();
+
+  // Return status
+  return status;
+}
+
+
+
+static void
+FillTexelColors(const RGBDTexelSamples& samples, R2Image& output_image)
+{
+  // Compute averaged colors (texels not seen by any image are black)
+  output_image = R2Image(samples.width, samples.height, 3);
+  for (int k = 0; k < samples.nsamples; k++) {
+    RNScalar weight = samples.colors[4*k+3];
+    if (weight <= 0) continue;
+    int ix = samples.texel_indices[k] % samples.width;
+    int iy = samples.texel_indices[k] / samples.width;
+    RNRgb color(samples.colors[4*k+0] / weight, samples.colors[4*k+1] / weight, samples.colors[4*k+2] / weight);
+    output_image.SetPixelRGB(ix, iy, color);
+  }
+}
+
+
+
+int RGBDCreateTexelPositionChannels(RGBDSurface *surface,
+  R2Grid& output_px_image, R2Grid& output_py_image, R2Grid& output_pz_image,
+  R2Grid& output_nx_image, R2Grid& output_ny_image, R2Grid& output_nz_image)
+{
+  // Check surface
+  int width = surface->NTexels(RN_X);
+  int height = surface->NTexels(RN_Y);
+  if ((width <= 0) || (height <= 0)) return 0;
+
+  // Initialize position and normal images
+  output_px_image = R2Grid(width, height);
+  output_px_image.Clear(R2_GRID_UNKNOWN_VALUE);
+  output_py_image = output_px_image;
+  output_pz_image = output_px_image;
+  output_nx_image = R2Grid(width, height);
+  output_ny_image = output_nx_image;
+  output_nz_image = output_nx_image;
+
+  // Update lazily computed mesh data (so that it can be read in parallel)
+  R3Mesh *mesh = surface->mesh;
+  if (mesh) {
+    if (!surface->mesh_face_index) surface->UpdateMeshFaceIndex();
+    if (!surface->mesh_face_index) return 0;
+    for (int i = 0; i < mesh->NFaces(); i++) mesh->FaceNormal(mesh->Face(i));
+  }
+
+  // Get writable values
+  RNScalar *px_values = &output_px_image(0);
+  RNScalar *py_values = &output_py_image(0);
+  RNScalar *pz_values = &output_pz_image(0);
+  RNScalar *nx_values = &output_nx_image(0);
+  RNScalar *ny_values = &output_ny_image(0);
+  RNScalar *nz_values = &output_nz_image(0);
+
+  // Fill position and normal images (rows in parallel)
+#pragma omp parallel for schedule(dynamic, 8)
+  for (int iy = 0; iy < height; iy++) {
+    for (int ix = 0; ix < width; ix++) {
+      int i = iy*width + ix;
+      R2Point texture_position(ix + 0.5, iy + 0.5);
+      R3Point world_position;
+      R3Vector world_normal(0, 0, 0);
+      if (surface->rectangle) {
+        if (!RGBDTransformTextureToWorld(texture_position, world_position, surface)) continue;
+        world_normal = surface->rectangle->Normal();
+      }
+      else if (mesh) {
+        double barycentrics[3];
+        R3MeshFace *face = surface->SearchMeshFaceIndex(texture_position, barycentrics);
+        if (!face) continue;
+        world_position = mesh->FacePoint(face, barycentrics);
+        world_normal = mesh->FaceNormal(face);
+      }
+      else {
+        continue;
+      }
+      px_values[i] = world_position.X();
+      py_values[i] = world_position.Y();
+      pz_values[i] = world_position.Z();
+      nx_values[i] = world_normal.X();
+      ny_values[i] = world_normal.Y();
+      nz_values[i] = world_normal.Z();
+    }
+  }
+
+  // Return success
+  return 1;
+}
+
+
+
+int RGBDCreateSurfaceColorChannels(RGBDSurface *surface, const RNArray<RGBDImage *>& images,
+  R2Image& output_color_image, RNScalar max_depth_error, RNAngle max_view_angle)
+{
+  // Create texel samples
+  RGBDTexelSamples samples;
+  if (!CreateTexelSamples(samples, surface)) return 0;
+
+  // Accumulate colors from all images
+  int status = 1;
+  for (int i = 0; i < images.NEntries(); i++) {
+    RGBDImage *image = images.Kth(i);
+    if (!AccumulateTexelColors(&samples, 1, image, max_depth_error, max_view_angle)) status = 0;
+  }
+
+  // Compute colors
+  FillTexelColors(samples, output_color_image);
+
+  // Delete texel samples
+  DeleteTexelSamples(samples);
+
+  // Return status
+  return status;
+}
+
+
+
+int RGBDCreateSurfaceTextures(RGBDConfiguration *configuration,
+  RNScalar max_depth_error, RNAngle max_view_angle, RNBoolean write_textures)
+{
+  // Check surfaces
+  int nsurfaces = configuration->NSurfaces();
+  if (nsurfaces == 0) return 1;
+
+  // Create texel samples for all surfaces (computed once, then reused for every image)
+  RGBDTexelSamples *samples = new RGBDTexelSamples [ nsurfaces ];
+  for (int i = 0; i < nsurfaces; i++) {
+    RGBDSurface *surface = configuration->Surface(i);
+    if (!CreateTexelSamples(samples[i], surface)) DeleteTexelSamples(samples[i]);
+  }
+
+  // Accumulate colors from every image (each image is read once for all surfaces)
+  int status = 1;
+  for (int i = 0; i < configuration->NImages(); i++) {
+    RGBDImage *image = configuration->Image(i);
+    if (!AccumulateTexelColors(samples, nsurfaces, image, max_depth_error, max_view_angle)) status = 0;
+  }
+
+  // Update surface color channels
+  for (int i = 0; i < nsurfaces; i++) {
+    RGBDSurface *surface = configuration->Surface(i);
+    if (samples[i].nsamples == 0) continue;
+
+    // Compute colors
+    R2Image color_image;
+    FillTexelColors(samples[i], color_image);
+
+    // Set color channels (created if not resident)
+    if (!surface->CreateColorChannels(color_image)) { status = 0; continue; }
+    surface->SetColorChannels(color_image);
+
+    // Write color channels (and release them, otherwise they stay resident)
+    if (write_textures) {
+      if (!surface->WriteColorChannels()) status = 0;
+      surface->ReleaseColorChannels();
+    }
+  }
+
+  // Delete texel samples
+  for (int i = 0; i < nsurfaces; i++) DeleteTexelSamples(samples[i]);
+  delete [] samples;
+
+  // Return status
+  return status;
+}
@@ -23,6 +23,24 @@ int RGBDCreateBoundaryChannel(RGBDImage *image,
 
 
 
+////////////////////////////////////////////////////////////////////////
+// High-level Surface Texture Creation Functions
+////////////////////////////////////////////////////////////////////////
+
+int RGBDCreateSurfaceTextures(RGBDConfiguration *configuration,
+  RNScalar max_depth_error = 0.1, RNAngle max_view_angle = RN_PI_OVER_TWO,
+  RNBoolean write_textures = TRUE);
+
+int RGBDCreateSurfaceColorChannels(RGBDSurface *surface, const RNArray<RGBDImage *>& images,
+  R2Image& output_color_image,
+  RNScalar max_depth_error = 0.1, RNAngle max_view_angle = RN_PI_OVER_TWO);
+
+int RGBDCreateTexelPositionChannels(RGBDSurface *surface,
+  R2Grid& output_px_image, R2Grid& output_py_image, R2Grid& output_pz_image,
+  R2Grid& output_nx_image, R2Grid& output_ny_image, R2Grid& output_nz_image);
+
+
+
 ////////////////////////////////////////////////////////////////////////
 // Mid-level Image Channel Creation Functions
 ////////////////////////////////////////////////////////////////////////
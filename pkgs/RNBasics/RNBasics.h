@@ -88,6 +88,13 @@
 
 
 
+/* Filter stuff */
+
+#include "RNBasics/RNRankFilter.h"
+#include "RNBasics/RNBilateralFilter.h"
+
+
+
 /* JSON stuff */
 
 #include "RNBasics/json.h"
@@ -0,0 +1,438 @@
+// Source file for bilateral filter functions
+
+
+
+////////////////////////////////////////////////////////////////////////
+// NOTE:
+// Two implementations are provided, and the cheaper one is chosen based
+// on the sigmas and the grid resolution.  For large spatial sigmas, values
+// are splatted into a coarse "bilateral grid" spanning space and value,
+// blurred with separable Gaussians, and sliced with multilinear
+// interpolation (Paris and Durand, "A Fast Approximation of the Bilateral
+// Filter using a Signal Processing Approach").  For small spatial sigmas,
+// the filter is computed directly on tiles in parallel, using precomputed
+// spatial weights and a lookup table for the range kernel.
+////////////////////////////////////////////////////////////////////////
+
+
+
+// Include files
+
+#include "RNBasics/RNBasics.h"
+
+
+
+// Useful constants
+
+static const RNScalar RN_BILATERAL_GRID_SAMPLING = 0.5;
+static const RNScalar RN_BILATERAL_GRID_MAX_CELLS = (1 << 25);
+static const int RN_BILATERAL_TILE_SIZE = 64;
+static const int RN_BILATERAL_LUT_BINS_PER_SIGMA = 1024;
+static const int RN_BILATERAL_LUT_MAX_SIGMAS = 8;
+
+
+
+////////////////////////////////////////////////////////////////////////
+// Direct (tiled) implementation
+////////////////////////////////////////////////////////////////////////
+
+static void
+DirectBilateralFilter(const RNScalar *input, RNScalar *output, const int resolution[3],
+  RNLength grid_sigma, RNScalar value_sigma,
+  RNBoolean skip_unknown_values, RNScalar unknown_value)
+{
+  // Get convenient variables
+  int xres = resolution[0];
+  int yres = resolution[1];
+  int zres = resolution[2];
+  int nrows = yres * zres;
+  int r = (int) (3 * grid_sigma + 1);
+  int rz = (zres > 1) ? r : 0;
+  int r_squared = r * r;
+
+  // Compute rows of window and spatial weights of their entries
+  int max_rows = (2*r+1) * (2*rz+1);
+  int *window_dy = new int [ max_rows ];
+  int *window_dz = new int [ max_rows ];
+  int *window_half_widths = new int [ max_rows ];
+  int *window_weight_offsets = new int [ max_rows ];
+  RNScalar *window_weights = new RNScalar [ max_rows * (2*r+1) ];
+  double grid_denom = 2.0 * grid_sigma * grid_sigma;
+  int nwindow_rows = 0, nwindow_weights = 0;
+  for (int dz = -rz; dz <= rz; dz++) {
+    for (int dy = -r; dy <= r; dy++) {
+      int remainder = r_squared - dy*dy - dz*dz;
+      if (remainder < 0) continue;
+      int w = (int) sqrt((double) remainder);
+      while ((w+1)*(w+1) <= remainder) w++;
+      while (w*w > remainder) w--;
+      window_dy[nwindow_rows] = dy;
+      window_dz[nwindow_rows] = dz;
+      window_half_widths[nwindow_rows] = w;
+      window_weight_offsets[nwindow_rows] = nwindow_weights;
+      for (int dx = -w; dx <= w; dx++) {
+        int grid_distance_squared = dx*dx + dy*dy + dz*dz;
+        window_weights[nwindow_weights++] = exp(-grid_distance_squared / grid_denom);
+      }
+      nwindow_rows++;
+    }
+  }
+
+  // Compute lookup table for range kernel (indexed by value difference / value_sigma)
+  int nlut = RN_BILATERAL_LUT_MAX_SIGMAS * RN_BILATERAL_LUT_BINS_PER_SIGMA + 2;
+  RNScalar *lut = new RNScalar [ nlut ];
+  for (int i = 0; i < nlut; i++) {
+    RNScalar u = (RNScalar) i / RN_BILATERAL_LUT_BINS_PER_SIGMA;
+    lut[i] = exp(-0.5 * u * u);
+  }
+  RNScalar lut_scale = RN_BILATERAL_LUT_BINS_PER_SIGMA / value_sigma;
+  RNScalar lut_max = nlut - 2;
+
+  // Filter tiles of rows in parallel
+  int ntiles_per_row = (xres + RN_BILATERAL_TILE_SIZE - 1) / RN_BILATERAL_TILE_SIZE;
+  int ntiles = nrows * ntiles_per_row;
+#pragma omp parallel
+  {
+    // Allocate per-thread buffers
+    const RNScalar **rows = new const RNScalar * [ nwindow_rows ];
+    int *half_widths = new int [ nwindow_rows ];
+    const RNScalar **weights = new const RNScalar * [ nwindow_rows ];
+
+#pragma omp for schedule(dynamic)
+    for (int tile = 0; tile < ntiles; tile++) {
+      int row = tile / ntiles_per_row;
+      int y = row % yres;
+      int z = row / yres;
+      int x0 = (tile % ntiles_per_row) * RN_BILATERAL_TILE_SIZE;
+      int x1 = (x0 + RN_BILATERAL_TILE_SIZE < xres) ? x0 + RN_BILATERAL_TILE_SIZE : xres;
+
+      // Find rows of window inside grid
+      int n = 0;
+      for (int i = 0; i < nwindow_rows; i++) {
+        int iy = y + window_dy[i];
+        int iz = z + window_dz[i];
+        if ((iy < 0) || (iy >= yres)) continue;
+        if ((iz < 0) || (iz >= zres)) continue;
+        rows[n] = &input[(iz*yres + iy) * xres];
+        half_widths[n] = window_half_widths[i];
+        weights[n] = &window_weights[window_weight_offsets[i] + window_half_widths[i]];
+        n++;
+      }
+
+      // Filter entries of tile
+      const RNScalar *center = &input[row * xres];
+      RNScalar *dst = &output[row * xres];
+      for (int cx = x0; cx < x1; cx++) {
+        // Check if current value is unknown - if so, don't update
+        RNScalar value = center[cx];
+        if (skip_unknown_values && (value == unknown_value)) { dst[cx] = value; continue; }
+
+        // Sum weighted samples
+        RNScalar sum = 0;
+        RNScalar weight = 0;
+        for (int i = 0; i < n; i++) {
+          const RNScalar *src = rows[i];
+          const RNScalar *spatial_weights = weights[i];
+          int xmin = cx - half_widths[i];
+          int xmax = cx + half_widths[i];
+          if (xmin < 0) xmin = 0;
+          if (xmax >= xres) xmax = xres - 1;
+          for (int x = xmin; x <= xmax; x++) {
+            RNScalar sample = src[x];
+            if (skip_unknown_values && (sample == unknown_value)) continue;
+            RNScalar u = fabs(value - sample) * lut_scale;
+            if (u >= lut_max) continue;
+            int k = (int) u;
+            RNScalar t = u - k;
+            RNScalar range_weight = (1.0 - t) * lut[k] + t * lut[k+1];
+            RNScalar w = spatial_weights[x - cx] * range_weight;
+            sum += w * sample;
+            weight += w;
+          }
+        }
+
+        // Set value
+        if (weight > 0) dst[cx] = sum / weight;
+        else dst[cx] = (skip_unknown_values) ? unknown_value : value;
+      }
+    }
+
+    // Delete per-thread buffers
+    delete [] rows;
+    delete [] half_widths;
+    delete [] weights;
+  }
+
+  // Delete temporary memory
+  delete [] window_dy;
+  delete [] window_dz;
+  delete [] window_half_widths;
+  delete [] window_weight_offsets;
+  delete [] window_weights;
+  delete [] lut;
+}
+
+
+
+////////////////////////////////////////////////////////////////////////
+// Bilateral grid implementation
+////////////////////////////////////////////////////////////////////////
+
+static void
+BlurBilateralGrid(RNScalar *cells, const int gres[4], int axis, const RNScalar *kernel, int kr)
+{
+  // Get line structure along axis (each cell has weighted sum and weight)
+  int n = gres[axis];
+  if (n < 2) return;
+  int stride = 1;
+  for (int a = 0; a < axis; a++) stride *= gres[a];
+  int ncells = gres[0] * gres[1] * gres[2] * gres[3];
+  int nlines = ncells / n;
+
+#pragma omp parallel
+  {
+    // Allocate per-thread buffer
+    RNScalar *buffer = new RNScalar [ 2*n ];
+
+#pragma omp for schedule(static)
+    for (int line = 0; line < nlines; line++) {
+      // Gather line
+      int base = (line / stride) * stride * n + (line % stride);
+      for (int q = 0; q < n; q++) {
+        buffer[2*q+0] = cells[2*(base + q*stride) + 0];
+        buffer[2*q+1] = cells[2*(base + q*stride) + 1];
+      }
+
+      // Convolve line with kernel (zero outside)
+      for (int q = 0; q < n; q++) {
+        RNScalar sum = 0, weight = 0;
+        int kmin = (q - kr < 0) ? -q : -kr;
+        int kmax = (q + kr >= n) ? n - 1 - q : kr;
+        for (int k = kmin; k <= kmax; k++) {
+          sum += kernel[k + kr] * buffer[2*(q+k)+0];
+          weight += kernel[k + kr] * buffer[2*(q+k)+1];
+        }
+        cells[2*(base + q*stride) + 0] = sum;
+        cells[2*(base + q*stride) + 1] = weight;
+      }
+    }
+
+    // Delete per-thread buffer
+    delete [] buffer;
+  }
+}
+
+
+
+static void
+GridBilateralFilter(const RNScalar *input, RNScalar *output, const int resolution[3], int ndimensions,
+  RNLength grid_sigma, RNScalar value_sigma, RNScalar min_value, const int gres[4],
+  RNBoolean skip_unknown_values, RNScalar unknown_value)
+{
+  // Get convenient variables
+  int xres = resolution[0];
+  int yres = resolution[1];
+  int zres = resolution[2];
+  RNScalar cell_size = RN_BILATERAL_GRID_SAMPLING * grid_sigma;
+  RNScalar cell_value = RN_BILATERAL_GRID_SAMPLING * value_sigma;
+  int ncells = gres[0] * gres[1] * gres[2] * gres[3];
+  int cell_stride[4] = { 1, gres[0], gres[0]*gres[1], gres[0]*gres[1]*gres[2] };
+
+  // Allocate cells (weighted sum and weight)
+  RNScalar *cells = new RNScalar [ 2 * ncells ];
+  for (int i = 0; i < 2*ncells; i++) cells[i] = 0;
+
+  // Splat values into cells, one slab of cells along the last spatial axis
+  // at a time, so that threads never write the same cells
+  int slab_axis = ndimensions - 1;
+  int nslab_samples = resolution[slab_axis];
+  int nmiddle = (ndimensions == 3) ? yres : 1;
+#pragma omp parallel for schedule(dynamic)
+  for (int s = 0; s < gres[slab_axis]; s++) {
+    int pmin = (int) ((s - 1) * cell_size) - 1;
+    int pmax = (int) ((s + 1) * cell_size) + 1;
+    if (pmin < 0) pmin = 0;
+    if (pmax > nslab_samples - 1) pmax = nslab_samples - 1;
+    for (int p = pmin; p <= pmax; p++) {
+      // Compute weight of sample slab for this cell slab
+      RNScalar fp = p / cell_size;
+      int p0 = (int) fp;
+      RNScalar slab_weight;
+      if (p0 == s) slab_weight = 1.0 - (fp - p0);
+      else if (p0 + 1 == s) slab_weight = fp - p0;
+      else continue;
+
+      // Splat samples in slab
+      for (int m = 0; m < nmiddle; m++) {
+        int y = (ndimensions == 3) ? m : p;
+        int z = (ndimensions == 3) ? p : 0;
+        const RNScalar *src = &input[(z*yres + y) * xres];
+
+        // Compute cell coordinates along middle axis
+        int y0 = s, ny = 1;
+        RNScalar wy[2] = { slab_weight, 0 };
+        if (ndimensions == 3) {
+          RNScalar fy = y / cell_size;
+          y0 = (int) fy;
+          wy[0] = (1.0 - (fy - y0)) * slab_weight;
+          wy[1] = (fy - y0) * slab_weight;
+          ny = 2;
+        }
+
+        for (int x = 0; x < xres; x++) {
+          RNScalar value = src[x];
+          if (skip_unknown_values && (value == unknown_value)) continue;
+          RNScalar fx = x / cell_size;
+          RNScalar fv = (value - min_value) / cell_value;
+          int x0 = (int) fx;
+          int v0 = (int) fv;
+          RNScalar tx = fx - x0;
+          RNScalar tv = fv - v0;
+          for (int iv = 0; iv < 2; iv++) {
+            RNScalar w_v = (iv) ? tv : 1.0 - tv;
+            for (int iy = 0; iy < ny; iy++) {
+              RNScalar w_vy = w_v * wy[iy];
+              int base = (v0 + iv) * cell_stride[3] + x0;
+              if (ndimensions == 3) base += s * cell_stride[2] + (y0 + iy) * cell_stride[1];
+              else base += s * cell_stride[1];
+              RNScalar w0 = w_vy * (1.0 - tx);
+              RNScalar w1 = w_vy * tx;
+              cells[2*base+0] += w0 * value;
+              cells[2*base+1] += w0;
+              cells[2*base+2] += w1 * value;
+              cells[2*base+3] += w1;
+            }
+          }
+        }
+      }
+    }
+  }
+
+  // Blur cells with separable Gaussian (narrowed to account for the
+  // variance added by linear splatting and slicing)
+  RNScalar blur_sigma = sqrt(1.0 / (RN_BILATERAL_GRID_SAMPLING * RN_BILATERAL_GRID_SAMPLING) - 1.0 / 3.0);
+  int kr = (int) ceil(3 * blur_sigma);
+  RNScalar *kernel = new RNScalar [ 2*kr + 1 ];
+  for (int k = -kr; k <= kr; k++) kernel[k + kr] = exp(-0.5 * k * k / (blur_sigma * blur_sigma));
+  for (int axis = 0; axis < 4; axis++) {
+    BlurBilateralGrid(cells, gres, axis, kernel, kr);
+  }
+
+  // Slice cells at every sample
+  int nrows = yres * zres;
+#pragma omp parallel for schedule(static)
+  for (int row = 0; row < nrows; row++) {
+    int y = row % yres;
+    int z = row / yres;
+    RNScalar fy = y / cell_size;
+    RNScalar fz = z / cell_size;
+    int y0 = (int) fy;
+    int z0 = (int) fz;
+    RNScalar wy[2] = { 1.0 - (fy - y0), fy - y0 };
+    RNScalar wz[2] = { 1.0 - (fz - z0), fz - z0 };
+    int nz = (ndimensions == 3) ? 2 : 1;
+    const RNScalar *src = &input[row * xres];
+    RNScalar *dst = &output[row * xres];
+    for (int x = 0; x < xres; x++) {
+      RNScalar value = src[x];
+      if (skip_unknown_values && (value == unknown_value)) { dst[x] = value; continue; }
+      RNScalar fx = x / cell_size;
+      RNScalar fv = (value - min_value) / cell_value;
+      int x0 = (int) fx;
+      int v0 = (int) fv;
+      RNScalar tx = fx - x0;
+      RNScalar tv = fv - v0;
+      RNScalar sum = 0, weight = 0;
+      for (int iv = 0; iv < 2; iv++) {
+        RNScalar w_v = (iv) ? tv : 1.0 - tv;
+        for (int iz = 0; iz < nz; iz++) {
+          for (int iy = 0; iy < 2; iy++) {
+            RNScalar w_vzy = w_v * wz[iz] * wy[iy];
+            int base = (v0 + iv) * cell_stride[3] + (z0 + iz) * cell_stride[2] + (y0 + iy) * cell_stride[1] + x0;
+            RNScalar w0 = w_vzy * (1.0 - tx);
+            RNScalar w1 = w_vzy * tx;
+            sum += w0 * cells[2*base+0] + w1 * cells[2*base+2];
+            weight += w0 * cells[2*base+1] + w1 * cells[2*base+3];
+          }
+        }
+      }
+      dst[x] = (weight > 0) ? sum / weight : value;
+    }
+  }
+
+  // Delete temporary memory
+  delete [] kernel;
+  delete [] cells;
+}
+
+
+
+////////////////////////////////////////////////////////////////////////
+// Public function
+////////////////////////////////////////////////////////////////////////
+
+void
+RNBilateralFilter(RNScalar *values, int ndimensions, const int *resolution,
+  RNLength grid_sigma, RNScalar value_sigma,
+  RNBoolean skip_unknown_values, RNScalar unknown_value)
+{
+  // Get convenient variables
+  assert((ndimensions == 2) || (ndimensions == 3));
+  int res[3] = { resolution[0], resolution[1], (ndimensions == 3) ? resolution[2] : 1 };
+  int nvalues = res[0] * res[1] * res[2];
+  if (nvalues == 0) return;
+
+  // Check sigmas (nothing to do if either kernel is a delta function)
+  if ((grid_sigma <= 0) || (value_sigma <= 0)) return;
+
+  // Find range of known values
+  RNScalar min_value = FLT_MAX;
+  RNScalar max_value = -FLT_MAX;
+  int nknown = 0;
+  for (int i = 0; i < nvalues; i++) {
+    RNScalar value = values[i];
+    if (skip_unknown_values && (value == unknown_value)) continue;
+    if (value < min_value) min_value = value;
+    if (value > max_value) max_value = value;
+    nknown++;
+  }
+  if (nknown == 0) return;
+
+  // Estimate cost of direct implementation
+  int r = (int) (3 * grid_sigma + 1);
+  RNScalar window_size = (ndimensions == 3) ? 4.19 * r * r * r : 3.14 * r * r;
+  RNScalar direct_cost = nknown * window_size;
+
+  // Estimate cost of bilateral grid implementation
+  RNScalar cell_size = RN_BILATERAL_GRID_SAMPLING * grid_sigma;
+  RNScalar cell_value = RN_BILATERAL_GRID_SAMPLING * value_sigma;
+  RNScalar ncells = 1;
+  int gres[4] = { 1, 1, 1, 1 };
+  for (int dim = 0; dim < ndimensions; dim++) {
+    RNScalar n = floor((res[dim] - 1) / cell_size) + 2;
+    ncells *= n;
+    if (ncells <= RN_BILATERAL_GRID_MAX_CELLS) gres[dim] = (int) n;
+  }
+  RNScalar nvalue_cells = floor((max_value - min_value) / cell_value) + 2;
+  ncells *= nvalue_cells;
+  if (ncells <= RN_BILATERAL_GRID_MAX_CELLS) gres[3] = (int) nvalue_cells;
+  RNScalar kernel_size = 2 * ceil(3 / RN_BILATERAL_GRID_SAMPLING) + 1;
+  RNScalar grid_cost = 2.0 * nknown * (1 << (ndimensions + 1)) + ncells * (ndimensions + 1) * kernel_size;
+
+  // Copy input values
+  RNScalar *input = new RNScalar [ nvalues ];
+  for (int i = 0; i < nvalues; i++) input[i] = values[i];
+
+  // Filter values with cheaper implementation
+  if ((ncells <= RN_BILATERAL_GRID_MAX_CELLS) && (grid_cost < direct_cost)) {
+    GridBilateralFilter(input, values, res, ndimensions, grid_sigma, value_sigma, min_value, gres, skip_unknown_values, unknown_value);
+  }
+  else {
+    DirectBilateralFilter(input, values, res, grid_sigma, value_sigma, skip_unknown_values, unknown_value);
+  }
+
+  // Delete temporary memory
+  delete [] input;
+}
+
+
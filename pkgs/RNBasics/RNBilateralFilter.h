@@ -0,0 +1,16 @@
+// Include file for bilateral filter functions
+
+
+
+// Function to replace every value of a regular 2D or 3D grid by the
+// average of values within 3*grid_sigma of it, weighted by a Gaussian
+// of grid distance (grid_sigma) times a Gaussian of value difference
+// (value_sigma).  Values are stored with x varying fastest.  If
+// skip_unknown_values is set, entries equal to unknown_value are neither
+// used as samples nor updated.
+
+extern void RNBilateralFilter(RNScalar *values, int ndimensions, const int *resolution,
+  RNLength grid_sigma, RNScalar value_sigma,
+  RNBoolean skip_unknown_values = FALSE, RNScalar unknown_value = 0);
+
+
@@ -0,0 +1,498 @@
+// Source file for rank filter functions
+
+
+
+////////////////////////////////////////////////////////////////////////
+// NOTE:
+// The (circular or spherical) window is decomposed into a set of rows,
+// each with its own half-width along x, and output rows are computed
+// independently in parallel.  Min and max use the van Herk / Gil-Werman
+// algorithm, which takes constant time per entry for every window row.
+// Other percentiles quantize values to their ranks among the distinct
+// values and slide a two-level (coarse/fine) histogram along each output
+// row, as in Huang and Perreault-Hebert.  If there are too many distinct
+// values for histograms to pay off, samples are sorted as before.
+////////////////////////////////////////////////////////////////////////
+
+
+
+// Include files
+
+#include "RNBasics/RNBasics.h"
+
+
+
+// Useful constants
+
+static const int RN_RANK_FILTER_MAX_HISTOGRAM_LEVELS = (1 << 20);
+static const RNScalar RN_RANK_FILTER_INFINITY = DBL_MAX;
+
+
+
+////////////////////////////////////////////////////////////////////////
+// Window functions
+////////////////////////////////////////////////////////////////////////
+
+struct RNRankFilterWindow {
+  // Rows of window relative to center (dy, dz) and half-width of each row
+  int nrows;
+  int *dy;
+  int *dz;
+  int *half_widths;
+  int max_samples;
+};
+
+
+
+static void
+CreateWindow(RNRankFilterWindow *window, int ndimensions, RNLength grid_radius)
+{
+  // Allocate rows
+  int r = (int) grid_radius;
+  int rz = (ndimensions == 3) ? r : 0;
+  int max_rows = (2*r+1) * (2*rz+1);
+  window->dy = new int [ max_rows ];
+  window->dz = new int [ max_rows ];
+  window->half_widths = new int [ max_rows ];
+  window->nrows = 0;
+  window->max_samples = 0;
+
+  // Find half-width of each row (entries with dx*dx + dy*dy + dz*dz <= radius^2)
+  RNScalar grid_radius_squared = grid_radius * grid_radius;
+  for (int dz = -rz; dz <= rz; dz++) {
+    for (int dy = -r; dy <= r; dy++) {
+      RNScalar remainder = grid_radius_squared - dy*dy - dz*dz;
+      if (remainder < 0) continue;
+      int w = (int) sqrt(remainder);
+      while ((w < r) && ((w+1)*(w+1) <= remainder)) w++;
+      while ((w > 0) && (w*w > remainder)) w--;
+      window->dy[window->nrows] = dy;
+      window->dz[window->nrows] = dz;
+      window->half_widths[window->nrows] = w;
+      window->max_samples += 2*w + 1;
+      window->nrows++;
+    }
+  }
+}
+
+
+
+static void
+DeleteWindow(RNRankFilterWindow *window)
+{
+  // Delete rows
+  delete [] window->dy;
+  delete [] window->dz;
+  delete [] window->half_widths;
+}
+
+
+
+static int
+FindInputRows(const RNRankFilterWindow *window, int y, int z, int yres, int zres,
+  int *input_rows, int *half_widths)
+{
+  // Find rows of window that are inside the grid for output row (y, z)
+  int n = 0;
+  for (int i = 0; i < window->nrows; i++) {
+    int iy = y + window->dy[i];
+    int iz = z + window->dz[i];
+    if ((iy < 0) || (iy >= yres)) continue;
+    if ((iz < 0) || (iz >= zres)) continue;
+    input_rows[n] = iz * yres + iy;
+    half_widths[n] = window->half_widths[i];
+    n++;
+  }
+  return n;
+}
+
+
+
+////////////////////////////////////////////////////////////////////////
+// Min/max filter (van Herk / Gil-Werman)
+////////////////////////////////////////////////////////////////////////
+
+static void
+MinMaxFilter(const RNScalar *input, RNScalar *output, int xres, int yres, int zres,
+  const RNRankFilterWindow *window, RNBoolean max,
+  RNBoolean skip_unknown_values, RNScalar unknown_value)
+{
+  // Get convenient variables
+  int nrows = yres * zres;
+  int max_half_width = 0;
+  for (int i = 0; i < window->nrows; i++) {
+    if (window->half_widths[i] > max_half_width) max_half_width = window->half_widths[i];
+  }
+
+  // Compute sign so that max can be computed as min
+  RNScalar sign = (max) ? -1 : 1;
+
+#pragma omp parallel
+  {
+    // Allocate per-thread buffers
+    int max_length = xres + 2*max_half_width;
+    RNScalar *a = new RNScalar [ max_length ];
+    RNScalar *g = new RNScalar [ max_length ];
+    RNScalar *h = new RNScalar [ max_length ];
+    RNScalar *result = new RNScalar [ xres ];
+    int *input_rows = new int [ window->nrows ];
+    int *half_widths = new int [ window->nrows ];
+
+#pragma omp for schedule(dynamic)
+    for (int row = 0; row < nrows; row++) {
+      // Initialize result
+      for (int x = 0; x < xres; x++) result[x] = RN_RANK_FILTER_INFINITY;
+
+      // Combine min of every window row
+      int ninput_rows = FindInputRows(window, row % yres, row / yres, yres, zres, input_rows, half_widths);
+      for (int i = 0; i < ninput_rows; i++) {
+        const RNScalar *src = &input[input_rows[i] * xres];
+        int w = half_widths[i];
+        int k = 2*w + 1;
+        int length = xres + 2*w;
+
+        // Fill padded row (unknown and outside values do not contribute)
+        for (int j = 0; j < w; j++) a[j] = a[length - 1 - j] = RN_RANK_FILTER_INFINITY;
+        for (int x = 0; x < xres; x++) {
+          RNScalar value = src[x];
+          if (skip_unknown_values && (value == unknown_value)) a[w + x] = RN_RANK_FILTER_INFINITY;
+          else a[w + x] = sign * value;
+        }
+
+        // Check for trivial window
+        if (w == 0) {
+          for (int x = 0; x < xres; x++) if (a[x] < result[x]) result[x] = a[x];
+          continue;
+        }
+
+        // Compute prefix and suffix minima within blocks of k entries
+        for (int start = 0; start < length; start += k) {
+          int end = (start + k < length) ? start + k : length;
+          g[start] = a[start];
+          for (int j = start + 1; j < end; j++) g[j] = (a[j] < g[j-1]) ? a[j] : g[j-1];
+          h[end-1] = a[end-1];
+          for (int j = end - 2; j >= start; j--) h[j] = (a[j] < h[j+1]) ? a[j] : h[j+1];
+        }
+
+        // Window [x, x+k-1] in padded row spans at most two blocks
+        for (int x = 0; x < xres; x++) {
+          RNScalar value = (h[x] < g[x + k - 1]) ? h[x] : g[x + k - 1];
+          if (value < result[x]) result[x] = value;
+        }
+      }
+
+      // Write output row
+      const RNScalar *src = &input[row * xres];
+      RNScalar *dst = &output[row * xres];
+      for (int x = 0; x < xres; x++) {
+        if (skip_unknown_values && (src[x] == unknown_value)) dst[x] = src[x];
+        else if (result[x] == RN_RANK_FILTER_INFINITY) dst[x] = unknown_value;
+        else dst[x] = sign * result[x];
+      }
+    }
+
+    // Delete per-thread buffers
+    delete [] a;
+    delete [] g;
+    delete [] h;
+    delete [] result;
+    delete [] input_rows;
+    delete [] half_widths;
+  }
+}
+
+
+
+////////////////////////////////////////////////////////////////////////
+// Percentile filter with sliding histograms
+////////////////////////////////////////////////////////////////////////
+
+static RNScalar *
+CreateLevels(const RNScalar *input, int nvalues,
+  RNBoolean skip_unknown_values, RNScalar unknown_value, int *nlevels)
+{
+  // Copy values
+  RNScalar *levels = new RNScalar [ nvalues ];
+  int count = 0;
+  for (int i = 0; i < nvalues; i++) {
+    if (skip_unknown_values && (input[i] == unknown_value)) continue;
+    levels[count++] = input[i];
+  }
+
+  // Sort values and remove duplicates
+  qsort(levels, count, sizeof(RNScalar), RNCompareScalars);
+  int n = 0;
+  for (int i = 0; i < count; i++) {
+    if ((n > 0) && (levels[n-1] == levels[i])) continue;
+    levels[n++] = levels[i];
+  }
+
+  // Return sorted distinct values
+  *nlevels = n;
+  return levels;
+}
+
+
+
+static void
+HistogramFilter(const RNScalar *input, RNScalar *output, int xres, int yres, int zres,
+  const RNRankFilterWindow *window, RNScalar percentile,
+  const RNScalar *levels, int nlevels,
+  RNBoolean skip_unknown_values, RNScalar unknown_value)
+{
+  // Get convenient variables
+  int nrows = yres * zres;
+  int nvalues = xres * nrows;
+
+  // Quantize values to their indices in sorted list of levels (-1 for unknown)
+  int *quantized = new int [ nvalues ];
+#pragma omp parallel for schedule(static)
+  for (int i = 0; i < nvalues; i++) {
+    RNScalar value = input[i];
+    if (skip_unknown_values && (value == unknown_value)) { quantized[i] = -1; continue; }
+    int lo = 0, hi = nlevels - 1;
+    while (lo < hi) {
+      int mid = (lo + hi) / 2;
+      if (levels[mid] < value) lo = mid + 1;
+      else hi = mid;
+    }
+    quantized[i] = lo;
+  }
+
+  // Choose coarse histogram bins so that both levels have about sqrt(nlevels) bins
+  int shift = 0;
+  while ((1 << (2*shift)) < nlevels) shift++;
+  int ncoarse = (nlevels >> shift) + 1;
+
+#pragma omp parallel
+  {
+    // Allocate per-thread histograms (cleared incrementally after each row)
+    int *fine = new int [ nlevels ];
+    int *coarse = new int [ ncoarse ];
+    for (int i = 0; i < nlevels; i++) fine[i] = 0;
+    for (int i = 0; i < ncoarse; i++) coarse[i] = 0;
+    int *input_rows = new int [ window->nrows ];
+    int *half_widths = new int [ window->nrows ];
+
+#pragma omp for schedule(dynamic)
+    for (int row = 0; row < nrows; row++) {
+      // Find window rows
+      int ninput_rows = FindInputRows(window, row % yres, row / yres, yres, zres, input_rows, half_widths);
+
+      // Fill histogram for window at x = 0
+      int count = 0;
+      for (int i = 0; i < ninput_rows; i++) {
+        const int *src = &quantized[input_rows[i] * xres];
+        int xmax = (half_widths[i] < xres) ? half_widths[i] : xres - 1;
+        for (int x = 0; x <= xmax; x++) {
+          int level = src[x];
+          if (level < 0) continue;
+          fine[level]++;
+          coarse[level >> shift]++;
+          count++;
+        }
+      }
+
+      // Slide window along row
+      const RNScalar *center = &input[row * xres];
+      RNScalar *dst = &output[row * xres];
+      for (int x = 0; x < xres; x++) {
+        // Compute output value
+        if (skip_unknown_values && (center[x] == unknown_value)) {
+          dst[x] = center[x];
+        }
+        else if (count == 0) {
+          dst[x] = unknown_value;
+        }
+        else {
+          // Find level with given rank
+          int target = (int) (percentile * count);
+          if (target < 0) target = 0;
+          else if (target >= count) target = count - 1;
+          int c = 0, sum = 0;
+          while (sum + coarse[c] <= target) sum += coarse[c++];
+          int level = c << shift;
+          while (sum + fine[level] <= target) sum += fine[level++];
+          dst[x] = levels[level];
+        }
+
+        // Check if last entry
+        if (x == xres - 1) break;
+
+        // Update histogram for window at x + 1
+        for (int i = 0; i < ninput_rows; i++) {
+          const int *src = &quantized[input_rows[i] * xres];
+          int xout = x - half_widths[i];
+          if ((xout >= 0) && (src[xout] >= 0)) {
+            fine[src[xout]]--;
+            coarse[src[xout] >> shift]--;
+            count--;
+          }
+          int xin = x + 1 + half_widths[i];
+          if ((xin < xres) && (src[xin] >= 0)) {
+            fine[src[xin]]++;
+            coarse[src[xin] >> shift]++;
+            count++;
+          }
+        }
+      }
+
+      // Clear histogram for window at x = xres - 1
+      for (int i = 0; i < ninput_rows; i++) {
+        const int *src = &quantized[input_rows[i] * xres];
+        int xmin = xres - 1 - half_widths[i];
+        if (xmin < 0) xmin = 0;
+        for (int x = xmin; x < xres; x++) {
+          int level = src[x];
+          if (level < 0) continue;
+          fine[level]--;
+          coarse[level >> shift]--;
+        }
+      }
+    }
+
+    // Delete per-thread buffers
+    delete [] fine;
+    delete [] coarse;
+    delete [] input_rows;
+    delete [] half_widths;
+  }
+
+  // Delete quantized values
+  delete [] quantized;
+}
+
+
+
+////////////////////////////////////////////////////////////////////////
+// Percentile filter with sorting
+////////////////////////////////////////////////////////////////////////
+
+static void
+SortFilter(const RNScalar *input, RNScalar *output, int xres, int yres, int zres,
+  const RNRankFilterWindow *window, RNScalar percentile,
+  RNBoolean skip_unknown_values, RNScalar unknown_value)
+{
+  // Get convenient variables
+  int nrows = yres * zres;
+
+#pragma omp parallel
+  {
+    // Allocate per-thread buffers
+    RNScalar *samples = new RNScalar [ window->max_samples ];
+    int *input_rows = new int [ window->nrows ];
+    int *half_widths = new int [ window->nrows ];
+
+#pragma omp for schedule(dynamic)
+    for (int row = 0; row < nrows; row++) {
+      int ninput_rows = FindInputRows(window, row % yres, row / yres, yres, zres, input_rows, half_widths);
+      const RNScalar *center = &input[row * xres];
+      RNScalar *dst = &output[row * xres];
+      for (int cx = 0; cx < xres; cx++) {
+        // Check if current value is unknown - if so, don't update
+        if (skip_unknown_values && (center[cx] == unknown_value)) {
+          dst[cx] = center[cx];
+          continue;
+        }
+
+        // Build list of grid values in neighborhood
+        int nsamples = 0;
+        for (int i = 0; i < ninput_rows; i++) {
+          const RNScalar *src = &input[input_rows[i] * xres];
+          int xmin = cx - half_widths[i];
+          int xmax = cx + half_widths[i];
+          if (xmin < 0) xmin = 0;
+          if (xmax >= xres) xmax = xres - 1;
+          for (int x = xmin; x <= xmax; x++) {
+            RNScalar sample = src[x];
+            if (skip_unknown_values && (sample == unknown_value)) continue;
+            samples[nsamples++] = sample;
+          }
+        }
+
+        // Check number of grid values in neighborhood
+        if (nsamples == 0) {
+          dst[cx] = unknown_value;
+        }
+        else {
+          // Sort samples found in neighborhood
+          qsort(samples, nsamples, sizeof(RNScalar), RNCompareScalars);
+
+          // Set grid value to percentile of neighborhood
+          int index = (int) (percentile * nsamples);
+          if (index < 0) index = 0;
+          else if (index >= nsamples) index = nsamples-1;
+          dst[cx] = samples[index];
+        }
+      }
+    }
+
+    // Delete per-thread buffers
+    delete [] samples;
+    delete [] input_rows;
+    delete [] half_widths;
+  }
+}
+
+
+
+////////////////////////////////////////////////////////////////////////
+// Public function
+////////////////////////////////////////////////////////////////////////
+
+void
+RNRankFilter(RNScalar *values, int ndimensions, const int *resolution,
+  RNLength grid_radius, RNScalar percentile,
+  RNBoolean skip_unknown_values, RNScalar unknown_value)
+{
+  // Get convenient variables
+  assert((ndimensions == 2) || (ndimensions == 3));
+  assert(grid_radius >= 0);
+  int xres = resolution[0];
+  int yres = resolution[1];
+  int zres = (ndimensions == 3) ? resolution[2] : 1;
+  int nvalues = xres * yres * zres;
+  if (nvalues == 0) return;
+
+  // Create window
+  RNRankFilterWindow window;
+  CreateWindow(&window, ndimensions, grid_radius);
+
+  // Copy input values
+  RNScalar *input = new RNScalar [ nvalues ];
+  for (int i = 0; i < nvalues; i++) input[i] = values[i];
+
+  // Filter values
+  if (percentile <= 0) {
+    // Min filter
+    MinMaxFilter(input, values, xres, yres, zres, &window, FALSE, skip_unknown_values, unknown_value);
+  }
+  else if (percentile >= 1) {
+    // Max filter
+    MinMaxFilter(input, values, xres, yres, zres, &window, TRUE, skip_unknown_values, unknown_value);
+  }
+  else {
+    // Find distinct values
+    int nlevels = 0;
+    RNScalar *levels = CreateLevels(input, nvalues, skip_unknown_values, unknown_value, &nlevels);
+
+    // Use histograms if searching them (about 2*sqrt(nlevels) steps per entry)
+    // is cheaper than sorting the samples of a window
+    RNScalar n = window.max_samples;
+    if ((nlevels > 0) && (nlevels <= RN_RANK_FILTER_MAX_HISTOGRAM_LEVELS) && (nlevels <= 64 * n * n)) {
+      HistogramFilter(input, values, xres, yres, zres, &window, percentile, levels, nlevels, skip_unknown_values, unknown_value);
+    }
+    else {
+      SortFilter(input, values, xres, yres, zres, &window, percentile, skip_unknown_values, unknown_value);
+    }
+
+    // Delete levels
+    delete [] levels;
+  }
+
+  // Delete temporary memory
+  delete [] input;
+  DeleteWindow(&window);
+}
+
+
@@ -0,0 +1,16 @@
+// Include file for rank filter functions
+
+
+
+// Function to replace every value of a regular 2D or 3D grid by the given
+// percentile (0 = min, 0.5 = median, 1 = max) of the values within
+// grid_radius of it.  Values are stored with x varying fastest.  If
+// skip_unknown_values is set, entries equal to unknown_value are neither
+// used as samples nor updated, and entries without any samples are set
+// to unknown_value.
+
+extern void RNRankFilter(RNScalar *values, int ndimensions, const int *resolution,
+  RNLength grid_radius, RNScalar percentile,
+  RNBoolean skip_unknown_values = FALSE, RNScalar unknown_value = 0);
+
+